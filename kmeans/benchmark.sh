@@ -47,11 +47,15 @@ for k in 2 4 8 16 32 64 128; do
     ompTime=$(./omp_main -o -n $k -b -i Image_data/${input} | grep 'Computation' | awk '{print $4}')
     gprof ./omp_main > profiles/omp-profile-$k.txt
 
+    # same run with the single shared accumulator updated atomically
+    ompAtomicTime=$(./omp_main -o -a -n $k -b -i Image_data/${input} | grep 'Computation' | awk '{print $4}')
+    gprof ./omp_main > profiles/omp-atomic-profile-$k.txt
+
     cudaTime=$(./cuda_main -o -n $k -b -i Image_data/${input} | grep 'Computation' | awk '{print $4}')
     gprof ./cuda_main > profiles/cuda-profile-$k.txt
     diff -q Image_data/${input}-$k.cluster_centres Image_data/${input}.cluster_centres
     diff -q Image_data/${input}-$k.membership Image_data/${input}.membership
 
     speedup=$(echo "scale=1; ${seqTime} / ${cudaTime}" | bc)
-    echo "k = $(printf "%3d" $k)  seqTime = ${seqTime}s  ompTime = ${ompTime}s  cudaTime = ${cudaTime}s  speedup = ${speedup}x"
+    echo "k = $(printf "%3d" $k)  seqTime = ${seqTime}s  ompTime = ${ompTime}s  ompAtomicTime = ${ompAtomicTime}s  cudaTime = ${cudaTime}s  speedup = ${speedup}x"
 done
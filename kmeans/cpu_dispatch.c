@@ -0,0 +1,31 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+/*   File:         cpu_dispatch.c  (OpenMP version)                          */
+/*   Description:  run-time selection of the SIMD distance kernels           */
+/*                                                                           */
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "kmeans.h"
+
+/*----< select_dist_kernels() >----------------------------------------------*/
+/* pick the widest kernel set the host supports: __builtin_cpu_supports()
+   runs cpuid and also checks (xgetbv) that the OS saves the wider registers.
+   The result is cached; call it outside of parallel regions. */
+const dist_kernels* select_dist_kernels(void)
+{
+    static const dist_kernels *best = NULL;
+
+    if (best == NULL) {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f"))
+            best = &dist_kernels_avx512;
+        else if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") &&
+                 __builtin_cpu_supports("f16c"))    /* unpack_avx2() */
+            best = &dist_kernels_avx2;
+        else
+            best = &dist_kernels_sse3;
+    }
+    return best;
+}
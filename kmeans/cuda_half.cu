@@ -0,0 +1,4 @@
+// The -P names, built as C++ for the same reason as cuda_io.cu. The 16-bit
+// copies of the objects are made by cuda_kmeans.cu as it transposes them.
+
+#include "half.c"
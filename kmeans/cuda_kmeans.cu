@@ -42,6 +42,10 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>     // memcpy
+#include <float.h>
+#include <limits.h>     // INT_MAX
+#include <cuda_fp16.h>  // __half2float()
 
 #include "kmeans.h"
 
@@ -58,17 +62,39 @@ static inline int nextPowerOfTwo(int n) {
     return ++n;
 }
 
+//  The objects as stored on the devices (-P): FP32, or a 16-bit copy that
+//  the kernels widen to FP32 coordinate by coordinate as they load it. The
+//  distances and the sums of the new centers are FP32 either way.
+typedef struct { unsigned short bits; } fp16_object;
+typedef struct { unsigned short bits; } bf16_object;
+
+__device__ inline static float toFloat(float x) { return x; }
+__device__ inline static float toFloat(fp16_object x) {
+    return __half2float(__ushort_as_half(x.bits));
+}
+__device__ inline static float toFloat(bf16_object x) {
+    return __uint_as_float((unsigned int)x.bits << 16);
+}
+
+//  and on the host, to fill the page-locked buffers they are copied from
+inline static void storeObject(float *o, float x) { *o = x; }
+inline static void storeObject(fp16_object *o, float x) {
+    o->bits = kmeans_float_to_half(KMEANS_FP16, x);
+}
+inline static void storeObject(bf16_object *o, float x) {
+    o->bits = kmeans_float_to_half(KMEANS_BF16, x);
+}
 
-typedef unsigned short BlockAccInt;
 
 /*----< euclid_dist_2() >----------------------------------------------------*/
 /* square of Euclid distance between two multi-dimensional points            */
-__host__ __device__ inline static
+template <typename Object>
+__device__ inline static
 float euclid_dist_2(int    numCoords,
                     int    numObjs,
                     int    numClusters,
-                    float *objects,     // [numCoords][numObjs]
-                    float *clusters,    // [numCoords][numClusters]
+                    const Object *objects,  // [numCoords][numObjs]
+                    const float *clusters,  // [numCoords][numClusters]
                     int    objectId,
                     int    clusterId)
 {
@@ -76,8 +102,9 @@ float euclid_dist_2(int    numCoords,
     float ans=0.0;
 
     for (i = 0; i < numCoords; i++) {
-        ans += (objects[numObjs * i + objectId] - clusters[numClusters * i + clusterId]) *
-               (objects[numObjs * i + objectId] - clusters[numClusters * i + clusterId]);
+        float diff = toFloat(objects[numObjs * i + objectId]) -
+                     clusters[numClusters * i + clusterId];
+        ans += diff * diff;
     }
 
     return(ans);
@@ -86,12 +113,22 @@ float euclid_dist_2(int    numCoords,
 /*----< find_nearest_cluster() >---------------------------------------------*/
 /*
 * Basic idea: each thread is responsible for the membership of one object
+*
+* The centers are streamed through shared memory tileClusters at a time, so
+* K*D is not bounded by the shared memory size. When all of them fit,
+* tileClusters == numClusters and the loop runs once. When not even one
+* center fits, tileClusters is 0 and the centers are read from global
+* memory (through L2) instead. The objects may be a range of a shard, whose
+* coordinates are ldObjects apart.
 */
+template <typename Object>
 __global__ static
 void find_nearest_cluster(int numCoords,
                           int numObjs,
+                          int ldObjects,            //  >= numObjs
                           int numClusters,
-                          float *objects,           //  [numCoords][numObjs]
+                          int tileClusters,
+                          const Object *objects,    //  [numCoords][ldObjects]
                           float *deviceClusters,    //  [numCoords][numClusters]
                           int *membership,          //  [numObjs]
                           int *intermediates)
@@ -105,65 +142,295 @@ void find_nearest_cluster(int numCoords,
     // objects that have changed their membership
     // We perform a reduction on this
     unsigned int *membershipChanged = (unsigned int *)sharedMemory;
+    //  [numCoords][tileClusters] slice of deviceClusters
     float *clusters = (float *)(sharedMemory + blockDim.x*sizeof(unsigned int));
 
     membershipChanged[threadIdx.x] = 0;
 
-    //  BEWARE: We can overrun our shared memory here if there are too many
-    //  clusters or too many coordinates!
-    // No need to worry about this part since numThreadsPerClusterBlock is fixed,
-    // also, numClusters * numCoords is very small for all test dataset
-    for (int i = threadIdx.x; i < numClusters; i += blockDim.x) {
-        for (int j = 0; j < numCoords; j++) {
-            clusters[numClusters * j + i] = deviceClusters[numClusters * j + i];
-        }
-    }
-    __syncthreads();
-
     int objectId = blockDim.x * blockIdx.x + threadIdx.x;
+    //  Threads past numObjs still help loading the tiles and must reach
+    //  every __syncthreads().
+    bool  active   = objectId < numObjs;
+    int   index    = 0;
+    float min_dist = FLT_MAX;
+
+    if (tileClusters == 0) {
+        if (active) {
+            /* find the cluster id that has min distance to object */
+            for (int i = 0; i < numClusters; i++) {
+                float dist = euclid_dist_2(numCoords, ldObjects, numClusters,
+                                           objects, deviceClusters, objectId, i);
+                /* no need square root */
+                if (dist < min_dist) { /* find the min and its array index */
+                    min_dist = dist;
+                    index    = i;
+                }
+            }
+        }
+    } else {
+        for (int first = 0; first < numClusters; first += tileClusters) {
+            int tile = min(tileClusters, numClusters - first);
+
+            __syncthreads();    //  Previous tile is no longer in use
+            for (int i = threadIdx.x; i < tile * numCoords; i += blockDim.x) {
+                int j = i / tile, c = i % tile;
+                clusters[tile * j + c] = deviceClusters[numClusters * j + first + c];
+            }
+            __syncthreads();
 
-    if (objectId < numObjs) {
-        int   index, i;
-        float dist, min_dist;
-
-        /* find the cluster id that has min distance to object */
-        index    = 0;
-        min_dist = euclid_dist_2(numCoords, numObjs, numClusters,
-                                 objects, clusters, objectId, 0);
-
-        for (i=1; i<numClusters; i++) {
-            dist = euclid_dist_2(numCoords, numObjs, numClusters,
-                                 objects, clusters, objectId, i);
-            /* no need square root */
-            if (dist < min_dist) { /* find the min and its array index */
-                min_dist = dist;
-                index    = i;
+            if (active) {
+                //  Tiles are visited in order and the comparison is strict,
+                //  so ties still go to the lowest cluster id.
+                for (int i = 0; i < tile; i++) {
+                    float dist = euclid_dist_2(numCoords, ldObjects, tile,
+                                               objects, clusters, objectId, i);
+                    if (dist < min_dist) {
+                        min_dist = dist;
+                        index    = first + i;
+                    }
+                }
             }
         }
+    }
 
+    if (active) {
         if (membership[objectId] != index) {
             membershipChanged[threadIdx.x] = 1;
         }
 
         /* assign the membership to object objectId */
         membership[objectId] = index;
+    }
+
+    __syncthreads();    //  For membershipChanged[]
+
+    //  blockDim.x *must* be a power of two!
+    // blockDim.x = numThreadsPerClusterBlock
+    for (unsigned int s = blockDim.x / 2; s > 0; s >>= 1) {
+        if (threadIdx.x < s) {
+            membershipChanged[threadIdx.x] +=
+                membershipChanged[threadIdx.x + s];
+        }
+        __syncthreads();
+    }
+
+    if (threadIdx.x == 0) {
+        intermediates[blockIdx.x] = membershipChanged[0];
+    }
+}
 
-        __syncthreads();    //  For membershipChanged[]
+/*----< find_nearest_cluster_gemm() >----------------------------------------*/
+/*
+* Assignment by matrix product, for KMEANS_GEMM_MIN_KD and more (kmeans.h):
+* the tiling of gemm_kernel in ../matrix_mul/cuda, with the arg-min as its
+* epilogue instead of the store of C. Each block takes GEMM_BLOCK_TILE
+* objects and sweeps all centers GEMM_BLOCK_TILE at a time; both operands
+* are stored coordinate major, the transposed layout of gemm_kernel, so the
+* loads of both tiles are coalesced. Each thread keeps the nearest center
+* of its GEMM_THREAD_TILE rows among its own columns, and the runner-up;
+* these are then merged per object through shared memory.
+*/
+#define GEMM_TILE_WIDTH  16
+#define GEMM_BLOCK_TILE  64
+#define GEMM_THREAD_TILE 4
+#define GEMM_THREADS     (GEMM_BLOCK_TILE / GEMM_THREAD_TILE)
+#define GEMM_LOADS       (GEMM_BLOCK_TILE * GEMM_TILE_WIDTH / \
+                          (GEMM_THREADS * GEMM_THREADS))
+
+template <typename Object>
+__global__ static
+void find_nearest_cluster_gemm(int numCoords,
+                               int numObjs,
+                               int ldObjects,               //  >= numObjs
+                               int numClusters,
+                               const Object *objects,       //  [numCoords][ldObjects]
+                               const float *deviceClusters, //  [numCoords][numClusters]
+                               const float *norms,          //  [numClusters] |c - origin|^2
+                               const float *origin,         //  [numCoords], center_norms()
+                               const float *maxNorm,        //  the largest of norms[]
+                               int *membership,             //  [numObjs]
+                               int *intermediates)
+{
+    __shared__ float tileObjects[GEMM_TILE_WIDTH][GEMM_BLOCK_TILE];
+    __shared__ float tileClusters[GEMM_TILE_WIDTH][GEMM_BLOCK_TILE];
+    //  the candidates of each thread column, per object of the block
+    __shared__ float candidateDist[GEMM_THREADS][GEMM_BLOCK_TILE];
+    __shared__ float candidateSecond[GEMM_THREADS][GEMM_BLOCK_TILE];
+    __shared__ int   candidateIndex[GEMM_THREADS][GEMM_BLOCK_TILE];
+    __shared__ float objectNorms[GEMM_BLOCK_TILE];  //  |x - origin|^2
+    __shared__ unsigned int membershipChanged;
+
+    int tx = threadIdx.x;
+    int ty = threadIdx.y;
+    int tid = ty * GEMM_THREADS + tx;
+    int row_0 = blockIdx.x * GEMM_BLOCK_TILE;
+
+    float min_dist[GEMM_THREAD_TILE], second[GEMM_THREAD_TILE];
+    float norm[GEMM_THREAD_TILE];
+    int   index[GEMM_THREAD_TILE];
+    for (int i = 0; i < GEMM_THREAD_TILE; i++) {
+        min_dist[i] = FLT_MAX;
+        second[i]   = FLT_MAX;
+        norm[i]     = 0.0f;
+        index[i]    = 0;
+    }
+    if (tid == 0) membershipChanged = 0;
+
+    for (int col_0 = 0; col_0 < numClusters; col_0 += GEMM_BLOCK_TILE) {
+        float sum[GEMM_THREAD_TILE][GEMM_THREAD_TILE];
+        for (int i = 0; i < GEMM_THREAD_TILE; i++)
+            for (int j = 0; j < GEMM_THREAD_TILE; j++)
+                sum[i][j] = 0.0f;
+
+        for (int k_0 = 0; k_0 < numCoords; k_0 += GEMM_TILE_WIDTH) {
+            //  anything past the objects, centers or coordinates is 0;
+            //  both are taken relative to origin
+            for (int l = 0; l < GEMM_LOADS; l++) {
+                int e = tid + l * GEMM_THREADS * GEMM_THREADS;
+                int r = e % GEMM_BLOCK_TILE, k = k_0 + e / GEMM_BLOCK_TILE;
+
+                tileObjects[k - k_0][r] = (row_0 + r < numObjs && k < numCoords) ?
+                    toFloat(objects[(size_t)ldObjects * k + row_0 + r]) - origin[k] :
+                    0.0f;
+                tileClusters[k - k_0][r] = (col_0 + r < numClusters && k < numCoords) ?
+                    deviceClusters[numClusters * k + col_0 + r] - origin[k] : 0.0f;
+            }
+            __syncthreads();
 
-        //  blockDim.x *must* be a power of two!
-        // blockDim.x = numThreadsPerClusterBlock
-        for (unsigned int s = blockDim.x / 2; s > 0; s >>= 1) {
-            if (threadIdx.x < s) {
-                membershipChanged[threadIdx.x] +=
-                    membershipChanged[threadIdx.x + s];
+            for (int kk = 0; kk < GEMM_TILE_WIDTH; kk++) {
+                float a_reg[GEMM_THREAD_TILE], b_reg[GEMM_THREAD_TILE];
+                for (int i = 0; i < GEMM_THREAD_TILE; i++)
+                    a_reg[i] = tileObjects[kk][ty + i * GEMM_THREADS];
+                for (int j = 0; j < GEMM_THREAD_TILE; j++)
+                    b_reg[j] = tileClusters[kk][tx + j * GEMM_THREADS];
+                for (int i = 0; i < GEMM_THREAD_TILE; i++)
+                    for (int j = 0; j < GEMM_THREAD_TILE; j++)
+                        sum[i][j] += a_reg[i] * b_reg[j];
+                if (col_0 == 0) {
+                    for (int i = 0; i < GEMM_THREAD_TILE; i++)
+                        norm[i] += a_reg[i] * a_reg[i];
+                }
             }
             __syncthreads();
         }
 
-        if (threadIdx.x == 0) {
-            intermediates[blockIdx.x] = membershipChanged[0];
+        //  |x|^2 is the same for every center and left out. A thread's
+        //  columns come in increasing order and the comparison is strict,
+        //  so its ties go to the lowest cluster id.
+        for (int j = 0; j < GEMM_THREAD_TILE; j++) {
+            int col = col_0 + tx + j * GEMM_THREADS;
+            if (col < numClusters) {
+                for (int i = 0; i < GEMM_THREAD_TILE; i++) {
+                    float dist = norms[col] - 2.0f * sum[i][j];
+                    if (dist < min_dist[i]) {
+                        second[i]   = min_dist[i];
+                        min_dist[i] = dist;
+                        index[i]    = col;
+                    } else if (dist < second[i]) {
+                        second[i] = dist;
+                    }
+                }
+            }
         }
     }
+
+    for (int i = 0; i < GEMM_THREAD_TILE; i++) {
+        candidateDist[tx][ty + i * GEMM_THREADS]   = min_dist[i];
+        candidateSecond[tx][ty + i * GEMM_THREADS] = second[i];
+        candidateIndex[tx][ty + i * GEMM_THREADS]  = index[i];
+        if (tx == 0) objectNorms[ty + i * GEMM_THREADS] = norm[i];
+    }
+    __syncthreads();
+
+    //  one thread per object merges the candidates, the lowest id of equal
+    //  distances first as in find_nearest_cluster(), and keeps the runner-
+    //  up. Within the rounding error of the expansion (KMEANS_GEMM_ERROR)
+    //  of the nearest, the object is searched again as there.
+    int objectId = row_0 + tid;
+    if (tid < GEMM_BLOCK_TILE && objectId < numObjs) {
+        float best = candidateDist[0][tid];
+        float runnerUp = candidateSecond[0][tid];
+        int   nearest = candidateIndex[0][tid];
+
+        for (int t = 1; t < GEMM_THREADS; t++) {
+            float dist = candidateDist[t][tid];
+            int   id   = candidateIndex[t][tid];
+            if (dist < best || (dist == best && id < nearest)) {
+                runnerUp = fminf(best, candidateSecond[t][tid]);
+                best     = dist;
+                nearest  = id;
+            } else {
+                runnerUp = fminf(runnerUp, dist);
+            }
+        }
+        if (runnerUp - best <= KMEANS_GEMM_ERROR(numCoords) *
+                               (objectNorms[tid] + 2.0f * *maxNorm)) {
+            best = FLT_MAX;
+            for (int c = 0; c < numClusters; c++) {
+                float dist = euclid_dist_2(numCoords, ldObjects, numClusters,
+                                           objects, deviceClusters, objectId, c);
+                if (dist < best) {
+                    best    = dist;
+                    nearest = c;
+                }
+            }
+        }
+        if (membership[objectId] != nearest)
+            atomicAdd(&membershipChanged, 1u);
+        membership[objectId] = nearest;
+    }
+    __syncthreads();
+
+    if (tid == 0) {
+        intermediates[blockIdx.x] = membershipChanged;
+    }
+}
+
+/*----< center_norms() >-----------------------------------------------------*/
+//  For find_nearest_cluster_gemm(), by one block: the mean of the centers,
+//  which it takes as the origin (distances do not change under a
+//  translation, and far from 0 |c|^2 - 2 x.c would lose them), then
+//  |c - origin|^2 of every center and the largest of these.
+//  blockDim.x *must* be a power of two!
+__global__ static
+void center_norms(int numCoords,
+                  int numClusters,
+                  const float *deviceClusters,  //  [numCoords][numClusters]
+                  float *norms,                 //  [numClusters]
+                  float *origin,                //  [numCoords]
+                  float *maxNorm)               //  [1]
+{
+    extern __shared__ float largest[];          //  [blockDim.x]
+
+    for (int j = threadIdx.x; j < numCoords; j += blockDim.x) {
+        float sum = 0.0f;
+        for (int c = 0; c < numClusters; c++)
+            sum += deviceClusters[numClusters * j + c];
+        origin[j] = sum / numClusters;
+    }
+    __syncthreads();
+
+    largest[threadIdx.x] = 0.0f;
+    for (int c = threadIdx.x; c < numClusters; c += blockDim.x) {
+        float norm = 0.0f;
+        for (int j = 0; j < numCoords; j++) {
+            float x = deviceClusters[numClusters * j + c] - origin[j];
+            norm += x * x;
+        }
+        norms[c] = norm;
+        largest[threadIdx.x] = fmaxf(largest[threadIdx.x], norm);
+    }
+    __syncthreads();
+
+    for (unsigned int s = blockDim.x / 2; s > 0; s >>= 1) {
+        if (threadIdx.x < s) {
+            largest[threadIdx.x] = fmaxf(largest[threadIdx.x],
+                                         largest[threadIdx.x + s]);
+        }
+        __syncthreads();
+    }
+
+    if (threadIdx.x == 0) *maxNorm = largest[0];
 }
 
 __global__ static
@@ -176,9 +443,13 @@ void compute_delta(int *deviceIntermediates,
     //  of two!
     extern __shared__ unsigned int intermediates[];
 
-    //  Copy global intermediate values into shared memory.
-    intermediates[threadIdx.x] =
-        (threadIdx.x < numIntermediates) ? deviceIntermediates[threadIdx.x] : 0;
+    //  Copy global intermediate values into shared memory. There may be
+    //  more intermediates than threads (numObjs > 1024 * 1024), so each
+    //  thread first sums a strided slice.
+    unsigned int sum = 0;
+    for (int i = threadIdx.x; i < numIntermediates; i += blockDim.x)
+        sum += deviceIntermediates[i];
+    intermediates[threadIdx.x] = sum;
 
     __syncthreads();
 
@@ -197,186 +468,1040 @@ void compute_delta(int *deviceIntermediates,
 }
 
 
-__global__ void reduce_cluster_size_per_block(
-    const int *deviceMembership,
-    int numObjs,
-    int cluster_id,
-    int *clusterSizeIntermediates) {
-  extern __shared__ char sharedMemory[];
-  /* blockDim.x * sizeof(BlockAccInt) */
-  BlockAccInt *clusterSize = (BlockAccInt *)sharedMemory;
+/*----< reduce_clusters_per_block() >----------------------------------------*/
+/*
+* Each block sums the objects of a grid-strided slice into per-cluster
+* partial sums and sizes, and writes them to its own slot of blockSums /
+* blockSizes, so no atomics on global memory are shared between blocks.
+* When the accumulators fit, they live in shared memory and are copied out
+* at the end; otherwise the block accumulates straight into its slot. With
+* accumulate the slots already hold the sums of other objects, which are
+* added to rather than replaced.
+*/
+template <typename Object>
+__global__ static
+void reduce_clusters_per_block(int numCoords,
+                               int numObjs,
+                               int ldObjects,             //  >= numObjs
+                               int numClusters,
+                               const Object *objects,     //  [numCoords][ldObjects]
+                               const int *membership,     //  [numObjs]
+                               float *blockSums,          //  [gridDim.x][numCoords][numClusters]
+                               int *blockSizes,           //  [gridDim.x][numClusters]
+                               int useSharedMemory,
+                               int accumulate)
+{
+    extern __shared__ char sharedMemory[];
 
-  clusterSize[threadIdx.x] = 0;
-  int objectId = blockDim.x * blockIdx.x + threadIdx.x;
-  if (objectId < numObjs && deviceMembership[objectId] == cluster_id) {
-    clusterSize[threadIdx.x] = 1;
-  }
-  __syncthreads();
+    const int numSums = numCoords * numClusters;
+    float *slotSums  = blockSums + (size_t)blockIdx.x * numSums;
+    int   *slotSizes = blockSizes + (size_t)blockIdx.x * numClusters;
+    float *sums;
+    int   *sizes;
+
+    if (useSharedMemory) {
+        sizes = (int *)sharedMemory;
+        sums  = (float *)(sharedMemory + numClusters * sizeof(int));
+    } else {
+        sizes = slotSizes;
+        sums  = slotSums;
+    }
 
-  for (unsigned int s = blockDim.x / 2; s > 0; s >>= 1) {
-    if (threadIdx.x < s) {
-      clusterSize[threadIdx.x] += clusterSize[threadIdx.x + s];
+    if (useSharedMemory || !accumulate) {
+        for (int i = threadIdx.x; i < numSums; i += blockDim.x) sums[i] = 0.0f;
+        for (int i = threadIdx.x; i < numClusters; i += blockDim.x) sizes[i] = 0;
     }
     __syncthreads();
-  }
-  if (threadIdx.x == 0) {
-    clusterSizeIntermediates[blockIdx.x] = clusterSize[0];
-  }
+
+    for (int objectId = blockDim.x * blockIdx.x + threadIdx.x;
+         objectId < numObjs;
+         objectId += blockDim.x * gridDim.x) {
+        int index = membership[objectId];
+
+        atomicAdd(&sizes[index], 1);
+        for (int j = 0; j < numCoords; j++)
+            atomicAdd(&sums[numClusters * j + index],
+                      toFloat(objects[ldObjects * j + objectId]));
+    }
+
+    if (useSharedMemory) {
+        __syncthreads();
+        if (accumulate) {
+            for (int i = threadIdx.x; i < numSums; i += blockDim.x) slotSums[i] += sums[i];
+            for (int i = threadIdx.x; i < numClusters; i += blockDim.x) slotSizes[i] += sizes[i];
+        } else {
+            for (int i = threadIdx.x; i < numSums; i += blockDim.x) slotSums[i] = sums[i];
+            for (int i = threadIdx.x; i < numClusters; i += blockDim.x) slotSizes[i] = sizes[i];
+        }
+    }
 }
 
+/*----< reduce_clusters() >--------------------------------------------------*/
+/*
+* One thread per (coordinate, cluster): add up the block partials and
+* replace the old center with the average. Empty clusters keep their
+* previous center, as in the sequential version.
+*/
+__global__ static
+void reduce_clusters(int numCoords,
+                     int numClusters,
+                     int numBlocks,
+                     const float *blockSums,      //  [numBlocks][numCoords][numClusters]
+                     const int *blockSizes,       //  [numBlocks][numClusters]
+                     float *deviceClusters)       //  [numCoords][numClusters]
+{
+    const int numSums = numCoords * numClusters;
+    int i = blockDim.x * blockIdx.x + threadIdx.x;
 
-__global__ void reduce_cluster_size() {
+    if (i < numSums) {
+        int   clusterId = i % numClusters;
+        int   size = 0;
+        float sum  = 0.0f;
+
+        for (int b = 0; b < numBlocks; b++) {
+            size += blockSizes[b * numClusters + clusterId];
+            sum  += blockSums[(size_t)b * numSums + i];
+        }
+        if (size > 0)
+            deviceClusters[i] = sum / size;
+    }
+}
+
+
+/*----< sum_cluster_blocks() >-----------------------------------------------*/
+/*
+* reduce_clusters() without the average, on each device of several: its
+* block partials folded into one, which reduce_clusters() on device 0 then
+* adds up over the devices.
+*/
+__global__ static
+void sum_cluster_blocks(int numCoords,
+                        int numClusters,
+                        int numBlocks,
+                        const float *blockSums,  //  [numBlocks][numCoords][numClusters]
+                        const int *blockSizes,   //  [numBlocks][numClusters]
+                        float *sums,             //  [numCoords][numClusters]
+                        int *sizes)              //  [numClusters]
+{
+    const int numSums = numCoords * numClusters;
+    int i = blockDim.x * blockIdx.x + threadIdx.x;
+
+    if (i < numSums) {
+        float sum = 0.0f;
+
+        for (int b = 0; b < numBlocks; b++)
+            sum += blockSums[(size_t)b * numSums + i];
+        sums[i] = sum;
+
+        if (i < numClusters) {
+            int size = 0;
+            for (int b = 0; b < numBlocks; b++)
+                size += blockSizes[b * numClusters + i];
+            sizes[i] = size;
+        }
+    }
 }
 
 
-template <class T>
-inline T getFirstDeviceValue(T *device_arr) {
-  T ans;
-  checkCuda(cudaMemcpy(&ans, device_arr, sizeof(T), cudaMemcpyDeviceToHost));
-  return ans;
+/*----< seed_update() >------------------------------------------------------*/
+//  Seeding (seed.c), one thread per object: fold the count new centers
+//  (ids firstId.., [count][numCoords], read by all threads alike) into the
+//  distance to and the id of the nearest center chosen so far.
+template <typename Object>
+__global__ static
+void seed_update(int numCoords,
+                 int numObjs,
+                 const Object *objects, //  [numCoords][numObjs]
+                 float *centers,        //  [count][numCoords]
+                 int count,
+                 int firstId,
+                 float *minDist,        //  [numObjs]
+                 int *nearest)          //  [numObjs]
+{
+    int objectId = blockDim.x * blockIdx.x + threadIdx.x;
+
+    if (objectId < numObjs) {
+        float best  = firstId == 0 ? FLT_MAX : minDist[objectId];
+        int   index = firstId == 0 ? 0 : nearest[objectId];
+
+        for (int c = 0; c < count; c++) {
+            float dist = 0.0f;
+            for (int j = 0; j < numCoords; j++) {
+                float diff = toFloat(objects[numObjs * j + objectId]) -
+                             centers[numCoords * c + j];
+                dist += diff * diff;
+            }
+            if (dist < best) {
+                best  = dist;
+                index = firstId + c;
+            }
+        }
+        minDist[objectId] = best;
+        nearest[objectId] = index;
+    }
+}
+
+//  One block per KMEANS_SEED_CHUNK objects; blockDim.x *must* be a power of
+//  two. The reduction tree is the same on every call, and so are the sums.
+__global__ static
+void seed_chunk_sums(int numObjs,
+                     float *minDist,    //  [numObjs]
+                     double *chunkSums) //  [numChunks]
+{
+    extern __shared__ char sharedMemory[];
+    double *sums = (double *)sharedMemory;
+    int first = blockIdx.x * KMEANS_SEED_CHUNK;
+    int last  = min(first + KMEANS_SEED_CHUNK, numObjs);
+
+    double sum = 0.0;
+    for (int i = first + threadIdx.x; i < last; i += blockDim.x) {
+        sum += minDist[i];
+    }
+    sums[threadIdx.x] = sum;
+    __syncthreads();
+
+    for (unsigned int s = blockDim.x / 2; s > 0; s >>= 1) {
+        if (threadIdx.x < s) {
+            sums[threadIdx.x] += sums[threadIdx.x + s];
+        }
+        __syncthreads();
+    }
+
+    if (threadIdx.x == 0) {
+        chunkSums[blockIdx.x] = sums[0];
+    }
+}
+
+__global__ static
+void seed_count(int numObjs,
+                int *nearest,           //  [numObjs]
+                int *counts)            //  [numCenters]
+{
+    int objectId = blockDim.x * blockIdx.x + threadIdx.x;
+
+    if (objectId < numObjs) {
+        atomicAdd(&counts[nearest[objectId]], 1);
+    }
 }
 
+//  Workspace slots, host
+#define WS_DIM_CLUSTERS     0   //  [numCoords][numClusters]
+#define WS_CLUSTERS         1   //  [numClusters][numCoords]
+#define WS_CLUSTER_ROWS     2   //  [numClusters]
+#define WS_SEED_CENTERS     3   //  [count][numCoords]
+//  page-locked host
+#define PIN_DIM_OBJECTS     0   //  [2][numCoords][loadChunk], the upload
+#define PIN_DELTAS          1   //  [numDevices]
+//  and device, on every device that holds a shard
+#define DEV_OBJECTS         0
+#define DEV_CLUSTERS        1
+#define DEV_MEMBERSHIP      2
+#define DEV_INTERMEDIATES   3
+#define DEV_BLOCK_SUMS      4
+#define DEV_BLOCK_SIZES     5
+#define DEV_SEED_MIN_DIST   6
+#define DEV_SEED_NEAREST    7
+#define DEV_SEED_CHUNK_SUMS 8
+#define DEV_SEED_CENTERS    9
+#define DEV_SEED_COUNTS     10
+#define DEV_PARTIALS        11  //  sums then sizes: one device's, on device
+                                //  0 those of all devices
+#define DEV_CENTER_NORMS    12  //  norms, origin and maxNorm of the shard
+
+//  workspace_get() for the memory of device, the current one
+static void* workspace_device(kmeans_workspace *ws, int device, int slot,
+                              size_t size)
+{
+    if (size > ws->deviceSize[device][slot]) {
+        if (ws->device[device][slot] != NULL) {
+            checkCuda(cudaFree(ws->device[device][slot]));
+        }
+        checkCuda(cudaMalloc(&ws->device[device][slot], size));
+        ws->deviceSize[device][slot] = size;
+    }
+    return ws->device[device][slot];
+}
+
+//  and for page-locked host memory, which the copies run from
+//  asynchronously
+static void* workspace_pinned(kmeans_workspace *ws, int slot, size_t size)
+{
+    if (size > ws->pinnedSize[slot]) {
+        if (ws->pinned[slot] != NULL) {
+            checkCuda(cudaFreeHost(ws->pinned[slot]));
+        }
+        checkCuda(cudaMallocHost(&ws->pinned[slot], size));
+        ws->pinnedSize[slot] = size;
+    }
+    return ws->pinned[slot];
+}
+
+void cuda_workspace_free(kmeans_workspace *ws)
+{
+    for (int d = 0; d < KMEANS_MAX_DEVICES; d++) {
+        for (int i = 0; i < KMEANS_WS_SLOTS; i++) {
+            if (ws->device[d][i] != NULL) {
+                checkCuda(cudaSetDevice(d));
+                checkCuda(cudaFree(ws->device[d][i]));
+            }
+            ws->device[d][i]     = NULL;
+            ws->deviceSize[d][i] = 0;
+        }
+    }
+    for (int i = 0; i < KMEANS_WS_SLOTS; i++) {
+        if (ws->pinned[i] != NULL) {
+            checkCuda(cudaFreeHost(ws->pinned[i]));
+        }
+        ws->pinned[i]     = NULL;
+        ws->pinnedSize[i] = 0;
+    }
+    ws->numDevices = 0;
+    workspace_free(ws);
+}
+
+//  seed_ops of the devices: the distances stay next to the objects of each
+//  shard, only the new centers go down and the chunk sums come back per
+//  update. The shards start at multiples of KMEANS_SEED_CHUNK, so the chunk
+//  sums are those of a single device.
+typedef struct {
+    kmeans_workspace *ws;
+    int     numCoords;
+    int     numDevices;
+    const int *shardStart;      //  [numDevices + 1]
+    void   *deviceObjects[KMEANS_MAX_DEVICES];   //  [numCoords][shard]
+    float  *deviceMinDist[KMEANS_MAX_DEVICES];   //  [shard]
+    int    *deviceNearest[KMEANS_MAX_DEVICES];   //  [shard]
+    double *deviceChunkSums[KMEANS_MAX_DEVICES]; //  [shard chunks]
+} device_seed;
+
+static const unsigned int numThreadsPerSeedBlock = 256;
+
+template <typename Object>
+static void device_seed_update(void *arg, float **centers, int count,
+                               int firstId, double *chunkSums)
+{
+    device_seed *s = (device_seed *)arg;
+    const size_t centersSize = (size_t)count * s->numCoords * sizeof(float);
+    float *hostCenters = (float *)workspace_get(s->ws, WS_SEED_CENTERS, centersSize);
+
+    for (int c = 0; c < count; c++) {
+        memcpy(hostCenters + c * s->numCoords, centers[c],
+               s->numCoords * sizeof(float));
+    }
+
+    //  the kernels of one device run while the centers go to the next
+    for (int d = 0; d < s->numDevices; d++) {
+        const int numObjs = s->shardStart[d + 1] - s->shardStart[d];
+        const unsigned int numChunks =
+            (numObjs + KMEANS_SEED_CHUNK - 1) / KMEANS_SEED_CHUNK;
+        const unsigned int numBlocks =
+            (numObjs + numThreadsPerSeedBlock - 1) / numThreadsPerSeedBlock;
+        float *deviceCenters;
+
+        checkCuda(cudaSetDevice(d));
+        deviceCenters = (float *)workspace_device(s->ws, d, DEV_SEED_CENTERS,
+                                                  centersSize);
+        checkCuda(cudaMemcpy(deviceCenters, hostCenters, centersSize,
+                  cudaMemcpyHostToDevice));
+
+        seed_update<Object> <<< numBlocks, numThreadsPerSeedBlock >>>
+            (s->numCoords, numObjs, (const Object *)s->deviceObjects[d],
+             deviceCenters, count, firstId, s->deviceMinDist[d],
+             s->deviceNearest[d]);
+        checkLastCudaError();
+
+        seed_chunk_sums <<< numChunks, numThreadsPerSeedBlock,
+                            numThreadsPerSeedBlock * sizeof(double) >>>
+            (numObjs, s->deviceMinDist[d], s->deviceChunkSums[d]);
+        checkLastCudaError();
+    }
+
+    for (int d = 0; d < s->numDevices; d++) {
+        const int numObjs = s->shardStart[d + 1] - s->shardStart[d];
+        const unsigned int numChunks =
+            (numObjs + KMEANS_SEED_CHUNK - 1) / KMEANS_SEED_CHUNK;
+
+        checkCuda(cudaSetDevice(d));
+        checkCuda(cudaMemcpy(chunkSums + s->shardStart[d] / KMEANS_SEED_CHUNK,
+                  s->deviceChunkSums[d], numChunks*sizeof(double),
+                  cudaMemcpyDeviceToHost));
+    }
+}
+
+static void device_seed_fetch(void *arg, int begin, int end, float *out)
+{
+    device_seed *s = (device_seed *)arg;
+
+    for (int d = 0; d < s->numDevices; d++) {
+        int first = max(begin, s->shardStart[d]);
+        int last  = min(end, s->shardStart[d + 1]);
+
+        if (first < last) {
+            checkCuda(cudaSetDevice(d));
+            checkCuda(cudaMemcpy(out + (first - begin),
+                      s->deviceMinDist[d] + (first - s->shardStart[d]),
+                      (last - first)*sizeof(float), cudaMemcpyDeviceToHost));
+        }
+    }
+}
+
+//  each device adds the objects of its shard to count[] in turn
+static void device_seed_count(void *arg, int numCenters, int *count)
+{
+    device_seed *s = (device_seed *)arg;
+
+    for (int d = 0; d < s->numDevices; d++) {
+        const int numObjs = s->shardStart[d + 1] - s->shardStart[d];
+        const unsigned int numBlocks =
+            (numObjs + numThreadsPerSeedBlock - 1) / numThreadsPerSeedBlock;
+        int *deviceCounts;
+
+        checkCuda(cudaSetDevice(d));
+        deviceCounts = (int *)workspace_device(s->ws, d, DEV_SEED_COUNTS,
+                                               numCenters*sizeof(int));
+        checkCuda(cudaMemcpy(deviceCounts, count, numCenters*sizeof(int),
+                  cudaMemcpyHostToDevice));
+        seed_count <<< numBlocks, numThreadsPerSeedBlock >>>
+            (numObjs, s->deviceNearest[d], deviceCounts);
+        checkLastCudaError();
+        checkCuda(cudaMemcpy(count, deviceCounts, numCenters*sizeof(int),
+                  cudaMemcpyDeviceToHost));
+    }
+}
+
+//  The k-means|| candidates are compared on the host
+static float seed_dist_2(int numCoords, float *coord1, float *coord2)
+{
+    float ans = 0.0f;
+    for (int i = 0; i < numCoords; i++)
+        ans += (coord1[i] - coord2[i]) * (coord1[i] - coord2[i]);
+    return ans;
+}
+
+//  One part of the objects and the buffers of the device that holds it
+typedef struct {
+    int     start;              //  first object of the shard
+    int     numObjs;            //  no. objects in the shard
+    unsigned int numClusterBlocks, numReductionThreads, numAccBlocks;
+    void   *objects;            //  [numCoords][numObjs], of the Object type
+    float  *clusters;           //  [numCoords][numClusters], a replica
+    int    *membership;         //  [numObjs]
+    int    *intermediates;      //  [max(numReductionThreads, numClusterBlocks)]
+    float  *norms;              //  [numClusters], with useGemm
+    float  *origin;             //  [numCoords], center_norms()
+    float  *maxNorm;            //  [1]
+    float  *blockSums;          //  [numAccBlocks][numCoords][numClusters]
+    int    *blockSizes;         //  [numAccBlocks][numClusters]
+    float  *partialSums;        //  [numCoords][numClusters], the blocks'
+    int    *partialSizes;       //  [numClusters]
+    cudaStream_t stream;
+    cudaStream_t upload;        //  the copies of the objects to the device
+    cudaEvent_t  ready;         //  partials sent (device 0: new centers)
+    cudaEvent_t  staged[2];     //  a chunk of the upload sent from buffer i
+} device_shard;
+
+//  What the launches of the assignment and of the block sums depend on
+//  besides the shard, the same on every device
+typedef struct {
+    int          numCoords;
+    int          numClusters;
+    int          useGemm;       //  find_nearest_cluster_gemm()
+    int          tileClusters;  //  else find_nearest_cluster()
+    unsigned int numThreadsPerClusterBlock, clusterBlockSharedDataSize;
+    unsigned int objectsPerClusterBlock;
+    unsigned int numThreadsPerAccBlock, accBlockSharedDataSize;
+    int          useSharedAccumulators;
+} launch_config;
+
+/*----< assign_range() >-----------------------------------------------------*/
+/* nearest centers of objects [first, first + count) of shard s on its
+   stream, the membership changes into the intermediates of their blocks;
+   first is a multiple of objectsPerClusterBlock                             */
+template <typename Object>
+static void assign_range(const launch_config *c,
+                         device_shard *s,
+                         int     first,
+                         int     count)
+{
+    const unsigned int numBlocks =
+        (count + c->objectsPerClusterBlock - 1) / c->objectsPerClusterBlock;
+    const Object *objects = (const Object *)s->objects + first;
+    int *intermediates = s->intermediates + first / c->objectsPerClusterBlock;
+
+    if (c->useGemm) {
+        find_nearest_cluster_gemm<Object>
+            <<< numBlocks, dim3(GEMM_THREADS, GEMM_THREADS), 0, s->stream >>>
+            (c->numCoords, count, s->numObjs, c->numClusters, objects,
+             s->clusters, s->norms, s->origin, s->maxNorm,
+             s->membership + first, intermediates);
+    } else {
+        find_nearest_cluster<Object>
+            <<< numBlocks, c->numThreadsPerClusterBlock,
+                c->clusterBlockSharedDataSize, s->stream >>>
+            (c->numCoords, count, s->numObjs, c->numClusters, c->tileClusters,
+             objects, s->clusters, s->membership + first, intermediates);
+    }
+    checkLastCudaError();
+}
+
+/*----< sum_range() >--------------------------------------------------------*/
+/* block sums of objects [first, first + count) of shard s on its stream, by
+   numBlocks of its numAccBlocks slots, replacing or adding to their sums    */
+template <typename Object>
+static void sum_range(const launch_config *c,
+                      device_shard *s,
+                      int     first,
+                      int     count,
+                      unsigned int numBlocks,
+                      int     accumulate)
+{
+    reduce_clusters_per_block<Object>
+        <<< numBlocks, c->numThreadsPerAccBlock,
+            c->useSharedAccumulators ? c->accBlockSharedDataSize : 0,
+            s->stream >>>
+        (c->numCoords, count, s->numObjs, c->numClusters,
+         (const Object *)s->objects + first, s->membership + first,
+         s->blockSums, s->blockSizes, c->useSharedAccumulators, accumulate);
+    checkLastCudaError();
+}
+
+/*----< send_centers() >-----------------------------------------------------*/
+/* clusters[numClusters][numCoords] to the replica of every device, through
+   dimClusters[numCoords][numClusters]                                       */
+static void send_centers(int     numDevices,
+                         device_shard *shards,
+                         int     numCoords,
+                         int     numClusters,
+                         float **clusters,
+                         float  *dimClusters)
+{
+    for (int i = 0; i < numCoords; i++) {
+        for (int j = 0; j < numClusters; j++) {
+            dimClusters[i * numClusters + j] = clusters[j][i];
+        }
+    }
+    for (int d = 0; d < numDevices; d++) {
+        checkCuda(cudaSetDevice(d));
+        checkCuda(cudaMemcpyAsync(shards[d].clusters, dimClusters,
+                  numClusters*numCoords*sizeof(float), cudaMemcpyHostToDevice,
+                  shards[d].stream));
+    }
+}
+
+/*----< cuda_seed() >--------------------------------------------------------*/
+/* initial centers in clusters[numClusters][numCoords], the distances to the
+   objects on the devices                                                    */
+template <typename Object>
+static void cuda_seed(kmeans_workspace *ws,
+                      int     init,
+                      float  *objects,        /* [numObjs][stride] */
+                      int     stride,
+                      int     numDevices,
+                      const int    *shardStart,  /* [numDevices + 1] */
+                      device_shard *shards,      /* [numDevices] */
+                      int     numCoords,
+                      int     numObjs,
+                      int     numClusters,
+                      float **clusters)
+{
+    device_seed s;
+    seed_ops    ops;
+
+    s.ws         = ws;
+    s.numCoords  = numCoords;
+    s.numDevices = numDevices;
+    s.shardStart = shardStart;
+    for (int d = 0; d < numDevices; d++) {
+        s.deviceObjects[d] = shards[d].objects;
+        if (init == KMEANS_SEED_PLUSPLUS || init == KMEANS_SEED_PARALLEL) {
+            const int n = shards[d].numObjs;
+
+            checkCuda(cudaSetDevice(d));
+            s.deviceMinDist[d] = (float *)workspace_device(ws, d,
+                DEV_SEED_MIN_DIST, n*sizeof(float));
+            s.deviceNearest[d] = (int *)workspace_device(ws, d,
+                DEV_SEED_NEAREST, n*sizeof(int));
+            s.deviceChunkSums[d] = (double *)workspace_device(ws, d,
+                DEV_SEED_CHUNK_SUMS,
+                (n + KMEANS_SEED_CHUNK - 1) / KMEANS_SEED_CHUNK * sizeof(double));
+        }
+    }
+
+    ops.arg    = &s;
+    ops.update = device_seed_update<Object>;
+    ops.fetch  = device_seed_fetch;
+    ops.count  = device_seed_count;
+
+    kmeans_seed(init, &ops, seed_dist_2, objects, stride, numObjs, numCoords,
+                numClusters, clusters);
+}
+
+
 /*----< cuda_kmeans() >-------------------------------------------------------*/
 //
 //  ----------------------------------------
 //  DATA LAYOUT
 //
-//  objects         [numObjs][numCoords]
+//  objects         [numObjs][stride], stride >= numCoords
 //  clusters        [numClusters][numCoords]
-//  dimObjects      [numCoords][numObjs]
+//  dimObjects      [2][numCoords][loadChunk] Objects, page-locked
 //  dimClusters     [numCoords][numClusters]
-//  newClusters     [numCoords][numClusters]
-//  deviceObjects   [numCoords][numObjs]
-//  deviceClusters  [numCoords][numClusters]
+//  deviceObjects   [numCoords][shard objects] Objects, on each device
+//  deviceClusters  [numCoords][numClusters], on each device
 //  ----------------------------------------
 //
-/* return an array of cluster centers of size [numClusters][numCoords]       */
-float** cuda_kmeans(float **objects,      /* in: [numObjs][numCoords] */
+//  The objects are split over the visible devices (CUDA_VISIBLE_DEVICES
+//  selects them) in contiguous shards of whole KMEANS_SEED_CHUNKs. Every
+//  device assigns its shard against its own replica of the centers and sums
+//  the new centers of the shard; device 0 gathers these partials (peer to
+//  peer where the devices allow it, else staged through the host by the
+//  driver), averages them and sends the new centers back to the others. Per
+//  iteration only numDevices x numClusters x (numCoords + 1) values cross
+//  between devices, and one membership change count per device to the host.
+//
+/* cuda_kmeans_ws() for objects stored as Object                           */
+template <typename Object>
+static float** cuda_kmeans_run(kmeans_workspace *ws,
+                   float  *objects,      /* in: [numObjs][stride] */
+                   int     stride,       /* no. floats between objects */
                    int     numCoords,    /* no. features */
                    int     numObjs,      /* no. objects */
                    int     numClusters,  /* no. clusters */
+                   int     init,         /* KMEANS_SEED_* */
+                   float  *centers,      /* in: [numClusters][numCoords], for
+                                            KMEANS_SEED_GIVEN, else unused */
                    float   threshold,    /* % objects change membership */
-                   int    *membership,   /* out: [numObjs] */
+                   int    *membership,   /* in/out: [numObjs], see
+                                            KMEANS_SEED_GIVEN */
                    int    *loop_iterations)
 {
-    int      i, j, index, loop=0;
-    int     *newClusterSize; /* [numClusters]: no. objects assigned in each
-                                new cluster */
+    int      i, j, d, loop=0;
     float    delta;          /* % of objects change their clusters */
-    float  **dimObjects;
+    Object  *dimObjects;
     float  **clusters;       /* out: [numClusters][numCoords] */
-    float  **dimClusters;
-    float  **newClusters;    /* [numCoords][numClusters] */
-
-    float *deviceObjects;
-    float *deviceClusters;
-    int *deviceMembership;
-    int *deviceIntermediates; // Record cluster changes for each block.
-
-    //  Copy objects given in [numObjs][numCoords] layout to new
-    //  [numCoords][numObjs] layout
-    // Note: why transform the layout?
-    malloc2D(dimObjects, numCoords, numObjs, float);
-    for (i = 0; i < numCoords; i++) {
-        for (j = 0; j < numObjs; j++) {
-            dimObjects[i][j] = objects[j][i];
-        }
+    float   *dimClusters;
+    int     *deltas;         /* [numDevices]: membership changes */
+    int      callerDevice, numDevices;
+    int      shardStart[KMEANS_MAX_DEVICES + 1];
+    device_shard shards[KMEANS_MAX_DEVICES];
+    float   *gatherSums;     /* on device 0: [numDevices][numCoords][numClusters] */
+    int     *gatherSizes;    /* on device 0: [numDevices][numClusters] */
+
+    checkCuda(cudaGetDevice(&callerDevice));
+
+    dimClusters = (float *)workspace_get(ws, WS_DIM_CLUSTERS,
+                                         numCoords*numClusters*sizeof(float));
+    /* a 2D space for returning variable clusters[] (coordinates of cluster
+       centers), which first holds the initial centers */
+    clusters    = (float **)workspace_get(ws, WS_CLUSTER_ROWS,
+                                          numClusters*sizeof(float *));
+    clusters[0] = (float *)workspace_get(ws, WS_CLUSTERS,
+                                         numClusters*numCoords*sizeof(float));
+    for (i = 1; i < numClusters; i++)
+        clusters[i] = clusters[i-1] + numCoords;
+
+    /* initialize membership[] */
+    kmeans_start(init, centers, numObjs, numCoords, numClusters, clusters,
+                 membership);
+
+    //  One shard per device, each of whole chunks but the last
+    const int numChunks = (numObjs + KMEANS_SEED_CHUNK - 1) / KMEANS_SEED_CHUNK;
+    checkCuda(cudaGetDeviceCount(&numDevices));
+    numDevices = min(numDevices, min(numChunks, KMEANS_MAX_DEVICES));
+    for (d = 0; d <= numDevices; d++) {
+        shardStart[d] = min(numObjs,
+            (int)((long)numChunks * d / numDevices) * KMEANS_SEED_CHUNK);
     }
 
-    /* pick first numClusters elements of objects[] as initial cluster centers*/
-    malloc2D(dimClusters, numCoords, numClusters, float);
-    for (i = 0; i < numCoords; i++) {
-        for (j = 0; j < numClusters; j++) {
-            dimClusters[i][j] = dimObjects[i][j];
+    if (ws->numDevices != numDevices) {
+        ws->sharedMemPerBlock   = (size_t)-1;
+        ws->multiProcessorCount = INT_MAX;
+        for (d = 0; d < numDevices; d++) {
+            cudaDeviceProp deviceProp;
+            checkCuda(cudaGetDeviceProperties(&deviceProp, d));
+            ws->sharedMemPerBlock   = min(ws->sharedMemPerBlock,
+                                          deviceProp.sharedMemPerBlock);
+            ws->multiProcessorCount = min(ws->multiProcessorCount,
+                                          deviceProp.multiProcessorCount);
         }
+        //  direct copies between device 0 and the others where possible;
+        //  an error here (already enabled, or no peer access) only means
+        //  cudaMemcpyPeerAsync() goes through the host
+        for (d = 1; d < numDevices; d++) {
+            int canAccess;
+            checkCuda(cudaDeviceCanAccessPeer(&canAccess, 0, d));
+            if (canAccess) {
+                checkCuda(cudaSetDevice(0));
+                cudaDeviceEnablePeerAccess(d, 0);
+                checkCuda(cudaSetDevice(d));
+                cudaDeviceEnablePeerAccess(0, 0);
+            }
+        }
+        cudaGetLastError();
+        ws->numDevices = numDevices;
     }
 
-    /* initialize membership[] */
-    for (i=0; i<numObjs; i++) membership[i] = -1;
-
-    /* need to initialize newClusterSize and newClusters[0] to all 0 */
-    newClusterSize = (int*) calloc(numClusters, sizeof(int));
-    assert(newClusterSize != NULL);
-
-    malloc2D(newClusters, numCoords, numClusters, float);
-    memset(newClusters[0], 0, numCoords * numClusters * sizeof(float));
-
-
-    //  To support reduction, numThreadsPerClusterBlock *must* be a power of
-    //  two, and it *must* be no larger than the number of bits that will
-    //  fit into an unsigned char, the type used to keep track of membership
-    //  changes in the kernel.
+    //  The tree reduction of membershipChanged[] in find_nearest_cluster
+    //  needs numThreadsPerClusterBlock to be a power of two; 1024 is the
+    //  most threads a block may have. Each counter is an unsigned int, so
+    //  it cannot overflow at any block size.
     const unsigned int numThreadsPerClusterBlock = 1024;
-    const unsigned int numClusterBlocks =
-        (numObjs + numThreadsPerClusterBlock - 1) / numThreadsPerClusterBlock; // ceil(numObjs / numThreadsPerBlock)
-    // Shared Data : membershipChanged and clusters
+
+    // Shared Data : membershipChanged and a tile of clusters
     // size of membershipChanged in shared memory is numThreadsPerClusterBlock * sizeof(uint)
-    // while size of clusters in shared mem is numClusters * numCoords * sizeof(float)
+    // while a tile of clusters takes tileClusters * numCoords * sizeof(float).
+    // Use the largest tile that fits, all numClusters if possible; 0 means
+    // not even one center fits and the kernel reads them from global memory.
+    const size_t membershipChangedSize =
+        numThreadsPerClusterBlock * sizeof(unsigned int);
+    const size_t centerSize = numCoords * sizeof(float);
+    int tileClusters = 0;
+    if (membershipChangedSize + centerSize <= ws->sharedMemPerBlock) {
+        tileClusters = (ws->sharedMemPerBlock - membershipChangedSize) / centerSize;
+        if (tileClusters > numClusters) tileClusters = numClusters;
+    }
     const unsigned int clusterBlockSharedDataSize =
-        numThreadsPerClusterBlock * sizeof(unsigned int) +
-        numClusters * numCoords * sizeof(float);
+        membershipChangedSize + tileClusters * centerSize;
+
+    // Many wide centers are assigned by matrix product instead, by blocks
+    // of GEMM_BLOCK_TILE objects (find_nearest_cluster_gemm)
+    const int useGemm = numCoords >= KMEANS_GEMM_MIN_COORDS &&
+                        (long)numClusters * numCoords >= KMEANS_GEMM_MIN_KD;
+    const unsigned int objectsPerClusterBlock =
+        useGemm ? GEMM_BLOCK_TILE : numThreadsPerClusterBlock;
+
+    // The new centers are accumulated by a fixed number of blocks (a couple
+    // per SM), each owning one slot of partial sums; reduce_clusters then
+    // folds the slots, one thread per (coordinate, cluster).
+    const unsigned int numThreadsPerAccBlock = 256;
+    const unsigned int accBlockSharedDataSize =
+        numClusters * sizeof(int) + numClusters * numCoords * sizeof(float);
+    const int useSharedAccumulators =
+        accBlockSharedDataSize <= ws->sharedMemPerBlock;
+    const unsigned int numUpdateThreads = 256;
+    const unsigned int numUpdateBlocks =
+        (numClusters * numCoords + numUpdateThreads - 1) / numUpdateThreads;
+    const size_t clustersSize = numClusters*numCoords*sizeof(float);
+    launch_config launch;
+
+    launch.numCoords                  = numCoords;
+    launch.numClusters                = numClusters;
+    launch.useGemm                    = useGemm;
+    launch.tileClusters               = tileClusters;
+    launch.numThreadsPerClusterBlock  = numThreadsPerClusterBlock;
+    launch.clusterBlockSharedDataSize = clusterBlockSharedDataSize;
+    launch.objectsPerClusterBlock     = objectsPerClusterBlock;
+    launch.numThreadsPerAccBlock      = numThreadsPerAccBlock;
+    launch.accBlockSharedDataSize     = accBlockSharedDataSize;
+    launch.useSharedAccumulators      = useSharedAccumulators;
+
+    for (d = 0; d < numDevices; d++) {
+        device_shard *s = &shards[d];
+
+        s->start   = shardStart[d];
+        s->numObjs = shardStart[d + 1] - shardStart[d];
+        s->numClusterBlocks =
+            (s->numObjs + objectsPerClusterBlock - 1) / objectsPerClusterBlock; // ceil(numObjs / objectsPerBlock)
+        // The size of deviceIntermediates should be at least numClusterBlocks
+        // since we are assigning intermediates for each block. compute_delta
+        // runs as a single block, so it folds the excess in a strided loop.
+        s->numReductionThreads =
+            min((unsigned int)nextPowerOfTwo(s->numClusterBlocks), 1024u);
+        // With large K*D the slots would outgrow the objects themselves, so
+        // a slot is only added for every numClusters objects.
+        s->numAccBlocks =
+            min(s->numClusterBlocks, 2u * ws->multiProcessorCount);
+        s->numAccBlocks = max(1u, min(s->numAccBlocks,
+                                      (unsigned int)(s->numObjs / numClusters)));
+
+        checkCuda(cudaSetDevice(d));
+        checkCuda(cudaStreamCreate(&s->stream));
+        checkCuda(cudaStreamCreate(&s->upload));
+        checkCuda(cudaEventCreateWithFlags(&s->ready, cudaEventDisableTiming));
+        for (i = 0; i < 2; i++)
+            checkCuda(cudaEventCreateWithFlags(&s->staged[i],
+                                               cudaEventDisableTiming));
+
+        s->objects = (float *)workspace_device(ws, d, DEV_OBJECTS,
+            (size_t)s->numObjs*numCoords*sizeof(Object));
+        s->clusters = (float *)workspace_device(ws, d, DEV_CLUSTERS,
+            clustersSize);
+        s->membership = (int *)workspace_device(ws, d, DEV_MEMBERSHIP,
+            s->numObjs*sizeof(int));
+        s->intermediates = (int *)workspace_device(ws, d, DEV_INTERMEDIATES,
+            max(s->numReductionThreads, s->numClusterBlocks)*sizeof(int));
+        s->blockSums = (float *)workspace_device(ws, d, DEV_BLOCK_SUMS,
+            (size_t)s->numAccBlocks*numClusters*numCoords*sizeof(float));
+        s->blockSizes = (int *)workspace_device(ws, d, DEV_BLOCK_SIZES,
+            s->numAccBlocks*numClusters*sizeof(int));
+        if (useGemm) {
+            s->norms = (float *)workspace_device(ws, d, DEV_CENTER_NORMS,
+                (numClusters + numCoords + 1)*sizeof(float));
+            s->origin  = s->norms + numClusters;
+            s->maxNorm = s->origin + numCoords;
+        }
 
-    // The size of deviceIntermediates should be at least numClusterBlocks
-    // since we are assigning intermediates for each block.
-    const unsigned int numReductionThreads =
-        nextPowerOfTwo(numClusterBlocks);
-    const unsigned int reductionBlockSharedDataSize =
-        numReductionThreads * sizeof(unsigned int);
+        //  device 0 keeps the partials of all devices, its own first
+        if (numDevices > 1) {
+            const int numPartials = d == 0 ? numDevices : 1;
+            s->partialSums = (float *)workspace_device(ws, d, DEV_PARTIALS,
+                numPartials * (clustersSize + numClusters*sizeof(int)));
+            s->partialSizes = (int *)(s->partialSums +
+                                      numPartials * numClusters * numCoords);
+        }
+    }
+    gatherSums  = shards[0].partialSums;
+    gatherSizes = shards[0].partialSizes;
+
+    //  The phases of the trace (-T) are timed on device 0's stream: its
+    //  assignment, its block sums, and the new centers
+    cudaEvent_t traceEvents[4];
+    double      uploadStart = 0.0;
+    if (kmeans_tracing) {
+        checkCuda(cudaSetDevice(0));
+        for (i = 0; i < 4; i++)
+            checkCuda(cudaEventCreate(&traceEvents[i]));
+        uploadStart = kmeans_trace_clock();
+    }
 
-    checkCuda(cudaMalloc(&deviceObjects, numObjs*numCoords*sizeof(float)));
-    checkCuda(cudaMalloc(&deviceClusters, numClusters*numCoords*sizeof(float)));
-    checkCuda(cudaMalloc(&deviceMembership, numObjs*sizeof(int)));
-    checkCuda(cudaMalloc(&deviceIntermediates, numReductionThreads*sizeof(int)));
+    //  Only k-means++ and k-means|| need the device distances of all the
+    //  objects. The first objects (-s first) and the caller's centers (-c,
+    //  -M) are on the host before the upload, so they are sent ahead of it
+    //  and the first iteration runs behind it instead: the assignment and
+    //  block sums of each chunk start on s->stream as soon as its copy on
+    //  s->upload is done, while the next chunks are transposed and copied.
+    const int overlapFirst = init != KMEANS_SEED_PLUSPLUS &&
+                             init != KMEANS_SEED_PARALLEL;
+
+    if (overlapFirst) {
+        cuda_seed<Object>(ws, init, objects, stride, numDevices, shardStart,
+                  shards, numCoords, numObjs, numClusters, clusters);
+        send_centers(numDevices, shards, numCoords, numClusters, clusters,
+                     dimClusters);
+        for (d = 0; d < numDevices; d++) {
+            device_shard *s = &shards[d];
+
+            checkCuda(cudaSetDevice(d));
+            if (kmeans_tracing && d == 0)
+                checkCuda(cudaEventRecord(traceEvents[0], s->stream));
+            if (useGemm) {
+                center_norms
+                    <<< 1, numThreadsPerSeedBlock,
+                        numThreadsPerSeedBlock * sizeof(float), s->stream >>>
+                    (numCoords, numClusters, s->clusters, s->norms, s->origin,
+                     s->maxNorm);
+                checkLastCudaError();
+            }
+        }
+    }
+
+    //  Copy objects given in [numObjs][stride] layout to the
+    //  [numCoords][numObjs] layout of each shard, which coalesces the reads
+    //  of the kernels, converted to Object on the way. This goes loadChunk
+    //  objects at a time through two page-locked buffers: a chunk is
+    //  transposed into one while the copy of the previous chunk runs from
+    //  the other, and the objects are read once, front to back, so a
+    //  mapped binary input (file_load()) comes in from disk during the
+    //  upload, behind the read-ahead, instead of before it. The staging
+    //  memory is that of two chunks, whatever numObjs. A chunk is whole
+    //  blocks of the assignment, so each has its own intermediates.
+    const size_t loadChunkBytes = 4 << 20;
+    int loadChunk = max(1, (int)(loadChunkBytes / (numCoords * sizeof(Object))));
+    loadChunk = min(numObjs, (int)((loadChunk + objectsPerClusterBlock - 1) /
+                        objectsPerClusterBlock * objectsPerClusterBlock));
+    int stagedBy[2] = {-1, -1};     //  the shard whose copy reads buffer i
+    int buffer = 0;
+
+    dimObjects = (Object *)workspace_pinned(ws, PIN_DIM_OBJECTS,
+                                            2 * (size_t)numCoords*loadChunk*sizeof(Object));
+    for (d = 0; d < numDevices; d++) {
+        device_shard *s = &shards[d];
+
+        checkCuda(cudaSetDevice(d));
+        checkCuda(cudaMemcpyAsync(s->membership, membership + s->start,
+                  s->numObjs*sizeof(int), cudaMemcpyHostToDevice, s->upload));
+
+        for (int first = 0; first < s->numObjs; first += loadChunk) {
+            const int count = min(loadChunk, s->numObjs - first);
+            Object *dimChunk = dimObjects + (size_t)buffer * numCoords * loadChunk;
+
+            if (stagedBy[buffer] >= 0) {
+                checkCuda(cudaEventSynchronize(
+                    shards[stagedBy[buffer]].staged[buffer]));
+            }
+            for (j = 0; j < count; j++) {
+                const float *object = objects + (size_t)(s->start + first + j) * stride;
+                for (i = 0; i < numCoords; i++)
+                    storeObject(&dimChunk[(size_t)i * count + j], object[i]);
+            }
+            checkCuda(cudaMemcpy2DAsync((Object *)s->objects + first,
+                      s->numObjs*sizeof(Object), dimChunk, count*sizeof(Object),
+                      count*sizeof(Object), numCoords,
+                      cudaMemcpyHostToDevice, s->upload));
+            checkCuda(cudaEventRecord(s->staged[buffer], s->upload));
+            stagedBy[buffer] = d;
+
+            //  The wait is on this record of the event, not on those that
+            //  reuse it for later chunks. The first chunk sets all the
+            //  slots of the block sums, the others add to as many of them
+            //  as they have numClusters objects.
+            if (overlapFirst) {
+                checkCuda(cudaStreamWaitEvent(s->stream, s->staged[buffer], 0));
+                assign_range<Object>(&launch, s, first, count);
+                sum_range<Object>(&launch, s, first, count,
+                    first == 0 ? s->numAccBlocks :
+                        max(1u, min(s->numAccBlocks,
+                                    (unsigned int)(count / numClusters))),
+                    first > 0);
+            }
+            buffer ^= 1;
+        }
+    }
+    deltas = (int *)workspace_pinned(ws, PIN_DELTAS, numDevices*sizeof(int));
+
+    if (!overlapFirst) {
+        //  the seeding kernels run on the default stream, after all the
+        //  copies
+        for (d = 0; d < numDevices; d++) {
+            checkCuda(cudaSetDevice(d));
+            checkCuda(cudaStreamSynchronize(shards[d].upload));
+        }
+        cuda_seed<Object>(ws, init, objects, stride, numDevices, shardStart,
+                  shards, numCoords, numObjs, numClusters, clusters);
+        send_centers(numDevices, shards, numCoords, numClusters, clusters,
+                     dimClusters);
+    }
 
-    //printf("%u %u %u\n", numClusterBlocks, numThreadsPerClusterBlock, clusterBlockSharedDataSize);
-    //printf("%u %u\n",numReductionThreads, reductionBlockSharedDataSize);
+    //  The centers stay on the devices between iterations; the only value
+    //  that crosses the bus to the host per iteration is the membership
+    //  change count of each device.
+    do {
+        kmeans_trace_record trace;
+
+        //  the first iteration of overlapFirst was launched with the upload,
+        //  which its trace includes, and its block sums with its assignment
+        const int launched = overlapFirst && loop == 0;
+
+        if (kmeans_tracing)
+            trace.start = launched ? uploadStart : kmeans_trace_clock();
+        for (d = 0; d < numDevices; d++) {
+            device_shard *s = &shards[d];
+
+            checkCuda(cudaSetDevice(d));
+            if (!launched) {
+                if (kmeans_tracing && d == 0)
+                    checkCuda(cudaEventRecord(traceEvents[0], s->stream));
+                if (useGemm) {
+                    center_norms
+                        <<< 1, numThreadsPerSeedBlock,
+                            numThreadsPerSeedBlock * sizeof(float), s->stream >>>
+                        (numCoords, numClusters, s->clusters, s->norms,
+                         s->origin, s->maxNorm);
+                    checkLastCudaError();
+                }
+                assign_range<Object>(&launch, s, 0, s->numObjs);
+            }
 
+            compute_delta
+                <<< 1, s->numReductionThreads,
+                    s->numReductionThreads * sizeof(unsigned int), s->stream >>>
+                (s->intermediates, s->numClusterBlocks, s->numReductionThreads);
+            checkLastCudaError();
+            if (kmeans_tracing && d == 0)
+                checkCuda(cudaEventRecord(traceEvents[1], s->stream));
+
+            if (!launched)
+                sum_range<Object>(&launch, s, 0, s->numObjs, s->numAccBlocks, 0);
+            if (kmeans_tracing && d == 0)
+                checkCuda(cudaEventRecord(traceEvents[2], s->stream));
+
+            if (numDevices == 1) {
+                reduce_clusters
+                    <<< numUpdateBlocks, numUpdateThreads, 0, s->stream >>>
+                    (numCoords, numClusters, s->numAccBlocks,
+                     s->blockSums, s->blockSizes, s->clusters);
+                checkLastCudaError();
+                if (kmeans_tracing)
+                    checkCuda(cudaEventRecord(traceEvents[3], s->stream));
+            } else {
+                sum_cluster_blocks
+                    <<< numUpdateBlocks, numUpdateThreads, 0, s->stream >>>
+                    (numCoords, numClusters, s->numAccBlocks,
+                     s->blockSums, s->blockSizes,
+                     s->partialSums, s->partialSizes);
+                checkLastCudaError();
+
+                if (d > 0) {
+                    checkCuda(cudaMemcpyPeerAsync(
+                        gatherSums + (size_t)d * numClusters * numCoords, 0,
+                        s->partialSums, d, clustersSize, s->stream));
+                    checkCuda(cudaMemcpyPeerAsync(
+                        gatherSizes + d * numClusters, 0,
+                        s->partialSizes, d, numClusters*sizeof(int),
+                        s->stream));
+                    checkCuda(cudaEventRecord(s->ready, s->stream));
+                }
+            }
 
-    checkCuda(cudaMemcpy(deviceObjects, dimObjects[0],
-              numObjs*numCoords*sizeof(float), cudaMemcpyHostToDevice));
-    checkCuda(cudaMemcpy(deviceMembership, membership,
-              numObjs*sizeof(int), cudaMemcpyHostToDevice));
+            checkCuda(cudaMemcpyAsync(&deltas[d], s->intermediates,
+                      sizeof(int), cudaMemcpyDeviceToHost, s->stream));
+        }
 
-    do {
-        checkCuda(cudaMemcpy(deviceClusters, dimClusters[0],
-                  numClusters*numCoords*sizeof(float), cudaMemcpyHostToDevice));
-
-        find_nearest_cluster
-            <<< numClusterBlocks, numThreadsPerClusterBlock, clusterBlockSharedDataSize >>>
-            (numCoords, numObjs, numClusters,
-             deviceObjects, deviceClusters, deviceMembership, deviceIntermediates);
-            
-        cudaThreadSynchronize(); checkLastCudaError();
-
-        compute_delta <<< 1, numReductionThreads, reductionBlockSharedDataSize >>>
-            (deviceIntermediates, numClusterBlocks, numReductionThreads);
-
-        cudaThreadSynchronize(); checkLastCudaError();
-        delta = (float)getFirstDeviceValue(deviceIntermediates);
-
-        checkCuda(cudaMemcpy(membership, deviceMembership,
-                    numObjs*sizeof(int), cudaMemcpyDeviceToHost));
-
-        for (int i=0; i<numObjs; i++) {
-            /* find the array index of nestest cluster center */
-            index = membership[i];
-
-            /* update new cluster centers : sum of objects located within */
-            newClusterSize[index]++;
-            for (int j=0; j<numCoords; j++)
-                newClusters[j][index] += objects[i][j];
-        }
-
-        //  TODO: Flip the nesting order
-        //  TODO: Change layout of newClusters to [numClusters][numCoords]
-        /* average the sum and replace old cluster centers with newClusters */
-        for (int i=0; i<numClusters; i++) {
-            for (int j=0; j<numCoords; j++) {
-                if (newClusterSize[i] > 0)
-                    dimClusters[j][i] = newClusters[j][i] / newClusterSize[i];
-                newClusters[j][i] = 0.0;   /* set back to 0 */
+        if (numDevices > 1) {
+            //  average on device 0 once all partials are in, then replace
+            //  the replicas
+            checkCuda(cudaSetDevice(0));
+            for (d = 1; d < numDevices; d++) {
+                checkCuda(cudaStreamWaitEvent(shards[0].stream,
+                                              shards[d].ready, 0));
             }
-            newClusterSize[i] = 0;   /* set back to 0 */
+            reduce_clusters
+                <<< numUpdateBlocks, numUpdateThreads, 0, shards[0].stream >>>
+                (numCoords, numClusters, numDevices,
+                 gatherSums, gatherSizes, shards[0].clusters);
+            checkLastCudaError();
+            checkCuda(cudaEventRecord(shards[0].ready, shards[0].stream));
+            if (kmeans_tracing)
+                checkCuda(cudaEventRecord(traceEvents[3], shards[0].stream));
+
+            for (d = 1; d < numDevices; d++) {
+                checkCuda(cudaSetDevice(d));
+                checkCuda(cudaStreamWaitEvent(shards[d].stream,
+                                              shards[0].ready, 0));
+                checkCuda(cudaMemcpyPeerAsync(shards[d].clusters, d,
+                          shards[0].clusters, 0, clustersSize,
+                          shards[d].stream));
+            }
+        }
+
+        delta = 0.0;
+        for (d = 0; d < numDevices; d++) {
+            checkCuda(cudaSetDevice(d));
+            checkCuda(cudaStreamSynchronize(shards[d].stream));
+            delta += deltas[d];
+        }
+
+        if (kmeans_tracing) {
+            float ms[3];
+
+            checkCuda(cudaSetDevice(0));
+            for (i = 0; i < 3; i++)
+                checkCuda(cudaEventElapsedTime(&ms[i], traceEvents[i],
+                                               traceEvents[i+1]));
+            //  the objects are read by the assignment and the block sums;
+            //  each device sends its delta, and with several the partial
+            //  sums go to device 0 and the centers back
+            trace.iteration = loop;
+            trace.assign    = ms[0] * 1e-3;
+            trace.reduce    = ms[1] * 1e-3;
+            trace.update    = ms[2] * 1e-3;
+            trace.delta     = (long)delta;
+            trace.distances = (long)numObjs * numClusters;
+            trace.bytes     = 2.0 * numObjs * numCoords * sizeof(Object);
+            trace.h2d       = 0.0;
+            trace.d2h       = numDevices * sizeof(int) + (numDevices - 1) *
+                              (2.0 * clustersSize + numClusters * sizeof(int));
+            kmeans_trace_iteration(&trace);
         }
 
         delta /= numObjs;
@@ -384,28 +1509,100 @@ float** cuda_kmeans(float **objects,      /* in: [numObjs][numCoords] */
 
     *loop_iterations = loop + 1;
 
-    /* allocate a 2D space for returning variable clusters[] (coordinates
-       of cluster centers) */
-    malloc2D(clusters, numClusters, numCoords, float);
+    if (kmeans_tracing) {
+        checkCuda(cudaSetDevice(0));
+        for (i = 0; i < 4; i++)
+            checkCuda(cudaEventDestroy(traceEvents[i]));
+    }
+
+    for (d = 0; d < numDevices; d++) {
+        checkCuda(cudaSetDevice(d));
+        checkCuda(cudaMemcpy(membership + shards[d].start, shards[d].membership,
+                  shards[d].numObjs*sizeof(int), cudaMemcpyDeviceToHost));
+        checkCuda(cudaEventDestroy(shards[d].ready));
+        for (i = 0; i < 2; i++)
+            checkCuda(cudaEventDestroy(shards[d].staged[i]));
+        checkCuda(cudaStreamDestroy(shards[d].stream));
+        checkCuda(cudaStreamDestroy(shards[d].upload));
+    }
+    checkCuda(cudaSetDevice(0));
+    checkCuda(cudaMemcpy(dimClusters, shards[0].clusters, clustersSize,
+                         cudaMemcpyDeviceToHost));
+    checkCuda(cudaSetDevice(callerDevice));
+
     for (i = 0; i < numClusters; i++) {
         for (j = 0; j < numCoords; j++) {
-            clusters[i][j] = dimClusters[j][i];
+            clusters[i][j] = dimClusters[j * numClusters + i];
         }
     }
 
-    checkCuda(cudaFree(deviceObjects));
-    checkCuda(cudaFree(deviceClusters));
-    checkCuda(cudaFree(deviceMembership));
-    checkCuda(cudaFree(deviceIntermediates));
+    return clusters;
+}
+
+/*----< cuda_kmeans_ws() >----------------------------------------------------*/
+/* return an array of cluster centers of size [numClusters][numCoords],
+   which belongs to ws. All buffers, on the host and on the devices, come
+   from ws.                                                                  */
+float** cuda_kmeans_ws(kmeans_workspace *ws, /* in/out: buffers */
+                   float  *objects,      /* in: [numObjs][stride] */
+                   int     stride,       /* no. floats between objects */
+                   int     numCoords,    /* no. features */
+                   int     numObjs,      /* no. objects */
+                   int     numClusters,  /* no. clusters */
+                   int     init,         /* KMEANS_SEED_* */
+                   float  *centers,      /* in: [numClusters][numCoords], for
+                                            KMEANS_SEED_GIVEN, else unused */
+                   int     precision,    /* KMEANS_FP*: objects as stored on
+                                            the devices */
+                   float   threshold,    /* % objects change membership */
+                   int    *membership,   /* in/out: [numObjs], see
+                                            KMEANS_SEED_GIVEN */
+                   int    *loop_iterations)
+{
+    switch (precision) {
+        case KMEANS_FP16:
+            return cuda_kmeans_run<fp16_object>(ws, objects, stride,
+                       numCoords, numObjs, numClusters, init, centers,
+                       threshold, membership, loop_iterations);
+        case KMEANS_BF16:
+            return cuda_kmeans_run<bf16_object>(ws, objects, stride,
+                       numCoords, numObjs, numClusters, init, centers,
+                       threshold, membership, loop_iterations);
+        default:
+            return cuda_kmeans_run<float>(ws, objects, stride,
+                       numCoords, numObjs, numClusters, init, centers,
+                       threshold, membership, loop_iterations);
+    }
+}
+
+/*----< cuda_kmeans() >-------------------------------------------------------*/
+/* cuda_kmeans_ws() on a workspace of its own, returns a malloc'd array of
+   cluster centers of size [numClusters][numCoords]                          */
+float** cuda_kmeans(float  *objects,      /* in: [numObjs][stride] */
+                   int     stride,       /* no. floats between objects */
+                   int     numCoords,    /* no. features */
+                   int     numObjs,      /* no. objects */
+                   int     numClusters,  /* no. clusters */
+                   int     init,         /* KMEANS_SEED_* */
+                   float  *centers,      /* in: [numClusters][numCoords], for
+                                            KMEANS_SEED_GIVEN, else unused */
+                   int     precision,    /* KMEANS_FP* */
+                   float   threshold,    /* % objects change membership */
+                   int    *membership,   /* in/out: [numObjs], see
+                                            KMEANS_SEED_GIVEN */
+                   int    *loop_iterations)
+{
+    kmeans_workspace ws;
+    float **clusters, **result;
+
+    memset(&ws, 0, sizeof(ws));
+    result = cuda_kmeans_ws(&ws, objects, stride, numCoords, numObjs,
+                            numClusters, init, centers, precision, threshold,
+                            membership, loop_iterations);
 
-    free(dimObjects[0]);
-    free(dimObjects);
-    free(dimClusters[0]);
-    free(dimClusters);
-    free(newClusters[0]);
-    free(newClusters);
-    free(newClusterSize);
+    malloc2D(clusters, numClusters, numCoords, float);
+    memcpy(clusters[0], result[0], numClusters * numCoords * sizeof(float));
+    cuda_workspace_free(&ws);
 
     return clusters;
 }
-
@@ -0,0 +1,33 @@
+// C entry points of the CUDA version, for libkmeans.c (built with gcc) in
+// libkmeans_cuda.a. The routines themselves keep the C++ linkage of the
+// rest of the CUDA build.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "kmeans.h"
+
+extern "C"
+float** libkmeans_cuda_run(kmeans_workspace *ws,
+                           float  *objects,      /* in: [numObjs][stride] */
+                           int     stride,
+                           int     numCoords,
+                           int     numObjs,
+                           int     numClusters,
+                           int     init,
+                           float  *centers,      /* in: KMEANS_SEED_GIVEN */
+                           int     precision,
+                           float   threshold,
+                           int    *membership,   /* in/out: [numObjs] */
+                           int    *loop_iterations)
+{
+    return cuda_kmeans_ws(ws, objects, stride, numCoords, numObjs,
+                          numClusters, init, centers, precision, threshold,
+                          membership, loop_iterations);
+}
+
+extern "C"
+void libkmeans_cuda_release(kmeans_workspace *ws)
+{
+    cuda_workspace_free(ws);
+}
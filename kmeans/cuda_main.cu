@@ -58,7 +58,20 @@ static void usage(char *argv0, float threshold) {
         "       -b             : input file is in binary format (default no)\n"
         "       -n num_clusters: number of clusters (K must > 1)\n"
         "       -t threshold   : threshold value (default %.4f)\n"
+        "       -s seeding     : initial centers: first (default), plusplus\n"
+        "                        (k-means++) or parallel (k-means||)\n"
+        "       -c centres_file: warm start from the centers of an earlier run\n"
+        "       -M member_file : and its memberships (objects past its end\n"
+        "                        are new); both in the format of -B\n"
+        "       -P precision   : objects stored as fp32 (default), fp16 or\n"
+        "                        bf16 on the GPU; with -o also compared to\n"
+        "                        an fp32 run\n"
+        "       -B             : write binary output files (default no)\n"
         "       -o             : output timing results (default no)\n"
+        "       -T trace_file  : per-iteration trace as JSON lines, or as a\n"
+        "                        Chrome trace if the name ends in .json\n"
+        "       -C             : add the hardware counters (of the host\n"
+        "                        thread) to the trace\n"
         "       -d             : enable debug mode\n";
     fprintf(stderr, help, argv0, threshold);
     exit(-1);
@@ -69,35 +82,70 @@ int main(int argc, char **argv) {
            int     opt;
     extern char   *optarg;
     extern int     optind;
-           int     isBinaryFile, is_output_timing;
+           int     i, numDevices;
+           int     isBinaryFile, isBinaryOutput, is_output_timing;
 
            int     numClusters, numCoords, numObjs;
            int    *membership;    /* [numObjs] */
+           int    *refMembership; /* [numObjs], the fp32 run's (-P, -o) */
+           int     numDiffer;     /* objects not where the fp32 run puts them */
            char   *filename;
-           float **objects;       /* [numObjs][numCoords] data objects */
+           char   *centresFile, *membershipFile;  /* -c, -M */
+           char   *traceFile;     /* -T */
+           int     traceCounters; /* -C */
+           float  *centers;       /* [numClusters][numCoords], from -c */
+           kmeans_data data;      /* [numObjs][numCoords] data objects */
            float **clusters;      /* [numClusters][numCoords] cluster center */
            float   threshold;
-           double  timing, io_timing, clustering_timing;
+           double  timing, io_timing, read_timing, write_timing;
+           double  clustering_timing, ref_timing;
            int     loop_iterations;
+           int     init;          /* KMEANS_SEED_* */
+           int     precision;     /* KMEANS_FP* */
 
     /* some default values */
     _debug           = 0;
     threshold        = 0.001;
     numClusters      = 0;
     isBinaryFile     = 0;
+    isBinaryOutput   = 0;
     is_output_timing = 0;
     filename         = NULL;
+    centresFile      = NULL;
+    membershipFile   = NULL;
+    traceFile        = NULL;
+    traceCounters    = 0;
+    centers          = NULL;
+    refMembership    = NULL;
+    init             = KMEANS_SEED_FIRST;
+    precision        = KMEANS_FP32;
 
-    while ( (opt=getopt(argc,argv,"p:i:n:t:abdo"))!= EOF) {
+    while ( (opt=getopt(argc,argv,"p:i:n:s:t:c:M:P:T:abBCdo"))!= EOF) {
         switch (opt) {
             case 'i': filename=optarg;
                       break;
             case 'b': isBinaryFile = 1;
                       break;
+            case 'B': isBinaryOutput = 1;
+                      break;
             case 't': threshold=atof(optarg);
                       break;
             case 'n': numClusters = atoi(optarg);
                       break;
+            case 's': init = kmeans_seed_method(optarg);
+                      if (init < 0) usage(argv[0], threshold);
+                      break;
+            case 'c': centresFile = optarg;
+                      break;
+            case 'M': membershipFile = optarg;
+                      break;
+            case 'P': precision = kmeans_precision_method(optarg);
+                      if (precision < 0) usage(argv[0], threshold);
+                      break;
+            case 'T': traceFile = optarg;
+                      break;
+            case 'C': traceCounters = 1;
+                      break;
             case 'o': is_output_timing = 1;
                       break;
             case 'd': _debug = 1;
@@ -110,38 +158,89 @@ int main(int argc, char **argv) {
     }
 
     if (filename == 0 || numClusters <= 1) usage(argv[0], threshold);
+    if (membershipFile != NULL && centresFile == NULL)
+        usage(argv[0], threshold);
+    if (centresFile != NULL) init = KMEANS_SEED_GIVEN;
+
+    if (traceFile != NULL &&
+        !kmeans_trace_open(traceFile, "cuda", traceCounters))
+        exit(1);
 
     if (is_output_timing) io_timing = wtime();
 
     /* read data points from file ------------------------------------------*/
-    objects = file_read(isBinaryFile, filename, &numObjs, &numCoords);
-    if (objects == NULL) exit(1);
+    if (!file_load(isBinaryFile, filename, &data)) exit(1);
+    numObjs   = data.numObjs;
+    numCoords = data.numCoords;
+
+    /* membership: the cluster id for each data object */
+    membership = (int*) malloc(numObjs * sizeof(int));
+    assert(membership != NULL);
+
+    /* the outputs of an earlier run to start from -------------------------*/
+    if (centresFile != NULL) {
+        centers = (float*) malloc(numClusters * numCoords * sizeof(float));
+        assert(centers != NULL);
+        if (!file_load_centres(isBinaryOutput, centresFile, numClusters,
+                               numCoords, centers))
+            exit(1);
+        if (membershipFile == NULL)
+            for (i=0; i<numObjs; i++) membership[i] = -1;
+        else if (!file_load_membership(isBinaryOutput, membershipFile,
+                                       numObjs, membership))
+            exit(1);
+    }
+
+    /* the fp32 run to compare with starts from the same memberships */
+    if (is_output_timing && precision != KMEANS_FP32) {
+        refMembership = (int*) malloc(numObjs * sizeof(int));
+        assert(refMembership != NULL);
+        memcpy(refMembership, membership, numObjs * sizeof(int));
+    }
 
     if (is_output_timing) {
         timing            = wtime();
         io_timing         = timing - io_timing;
+        read_timing       = io_timing;
         clustering_timing = timing;
     }
 
     /* start the timer for the core computation -----------------------------*/
-    /* membership: the cluster id for each data object */
-    membership = (int*) malloc(numObjs * sizeof(int));
-    assert(membership != NULL);
-
-    clusters = cuda_kmeans(objects, numCoords, numObjs, numClusters, threshold,
-                          membership, &loop_iterations);
-
-    free(objects[0]);
-    free(objects);
+    clusters = cuda_kmeans(data.objects, data.stride, numCoords, numObjs,
+                           numClusters, init, centers, precision, threshold,
+                           membership, &loop_iterations);
+    kmeans_trace_close();   /* the fp32 run below is not traced */
 
     if (is_output_timing) {
         timing            = wtime();
         clustering_timing = timing - clustering_timing;
     }
 
+    if (refMembership != NULL) {
+        float **refClusters;
+        int     refLoops;
+
+        refClusters = cuda_kmeans(data.objects, data.stride, numCoords,
+                                  numObjs, numClusters, init, centers,
+                                  KMEANS_FP32, threshold, refMembership,
+                                  &refLoops);
+        numDiffer = 0;
+        for (i=0; i<numObjs; i++)
+            if (refMembership[i] != membership[i]) numDiffer++;
+        free(refClusters[0]);
+        free(refClusters);
+        free(refMembership);
+
+        ref_timing = wtime() - timing;
+        timing    += ref_timing;    /* not part of the output write */
+    }
+
+    file_unload(&data);
+    free(centers);
+
     /* output: the coordinates of the cluster centres ----------------------*/
     file_write(filename, numClusters, numObjs, numCoords, clusters,
-               membership);
+               membership, isBinaryOutput);
 
     free(membership);
     free(clusters[0]);
@@ -149,19 +248,41 @@ int main(int argc, char **argv) {
 
     /*---- output performance numbers ---------------------------------------*/
     if (is_output_timing) {
-        io_timing += wtime() - timing;
+        write_timing = wtime() - timing;
+        io_timing   += write_timing;
         printf("\nPerforming **** Regular Kmeans (CUDA version) ****\n");
 
+        if (cudaGetDeviceCount(&numDevices) != cudaSuccess) numDevices = 0;
+        printf("Number of GPUs     = %d visible\n", numDevices);
+
         printf("Input file:     %s\n", filename);
         printf("numObjs       = %d\n", numObjs);
         printf("numCoords     = %d\n", numCoords);
         printf("numClusters   = %d\n", numClusters);
         printf("threshold     = %.4f\n", threshold);
 
+        printf("Seeding            = %s\n", kmeans_seed_name(init));
         printf("Loop iterations    = %d\n", loop_iterations);
 
         printf("I/O time           = %10.4f sec\n", io_timing);
+        if (isBinaryFile)
+            printf("Input read         = %10.4f sec (mapped)\n", read_timing);
+        else
+            printf("Input read         = %10.4f sec (%.1f MB/s parsed)\n",
+                   read_timing, data.fileSize / 1048576.0 / read_timing);
+        printf("Output write       = %10.4f sec%s\n", write_timing,
+               isBinaryOutput ? " (binary)" : "");
         printf("Computation timing = %10.4f sec\n", clustering_timing);
+
+        if (precision != KMEANS_FP32) {
+            printf("Object storage     = %s (%.1f MB on the GPUs, fp32 %.1f MB)\n",
+                   kmeans_precision_name(precision),
+                   (double)numObjs * numCoords * sizeof(kmeans_half) / 1048576.0,
+                   (double)numObjs * numCoords * sizeof(float) / 1048576.0);
+            printf("Membership vs fp32 = %d of %d objects differ (%.4f%%), fp32 run %.4f sec\n",
+                   numDiffer, numObjs, 100.0 * numDiffer / numObjs,
+                   ref_timing);
+        }
     }
 
     return(0);
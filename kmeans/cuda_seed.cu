@@ -0,0 +1,5 @@
+// Host side of the seeding (k-means++ and k-means||), built as C++ for the
+// same reason as cuda_io.cu. The distances to the objects are computed on
+// the device by the seed_ops of cuda_kmeans.cu.
+
+#include "seed.c"
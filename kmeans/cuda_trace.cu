@@ -0,0 +1,5 @@
+// The CUDA version is built with nvcc only, which compiles everything as
+// C++; kmeans.h declares the trace routines extern "C", so this copy of
+// trace.c links like the OpenMP one in libkmeans_cuda.a.
+
+#include "trace.c"
@@ -0,0 +1,146 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+/*   File:         dist_avx2.c  (OpenMP version)                             */
+/*   Description:  AVX2/FMA point-to-centroid distance kernels               */
+/*                                                                           */
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <immintrin.h>
+
+#include "kmeans.h"
+
+/*----< euclid_dist_2_avx2() >-----------------------------------------------*/
+/* square of Euclid distance between two multi-dimensional points            */
+__inline static
+float euclid_dist_2_avx2(int    numdims,  /* no. dimensions */
+                         float *coord1,   /* [numdims] */
+                         float *coord2)   /* [numdims] */
+{
+    int     i;
+    __m256  d8, sum8 = _mm256_setzero_ps();
+    __m256i tail;
+    __m128  sum;
+
+    for (i=0; i+8<=numdims; i+=8) {
+        d8   = _mm256_sub_ps(_mm256_loadu_ps(coord1+i), _mm256_loadu_ps(coord2+i));
+        sum8 = _mm256_fmadd_ps(d8, d8, sum8);
+    }
+    if (i < numdims) {
+        /* lanes without the sign bit set are neither read nor faulted on,
+           and load as 0 */
+        tail = _mm256_cmpgt_epi32(_mm256_set1_epi32(numdims - i),
+                                  _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+        d8   = _mm256_sub_ps(_mm256_maskload_ps(coord1+i, tail),
+                             _mm256_maskload_ps(coord2+i, tail));
+        sum8 = _mm256_fmadd_ps(d8, d8, sum8);
+    }
+    sum = _mm_add_ps(_mm256_castps256_ps128(sum8), _mm256_extractf128_ps(sum8, 1));
+    sum = _mm_hadd_ps(sum, sum);
+    sum = _mm_hadd_ps(sum, sum);
+    return _mm_cvtss_f32(sum);
+}
+
+/*----< find_nearest_cluster_avx2() >----------------------------------------*/
+static
+int find_nearest_cluster_avx2(int     numClusters, /* no. clusters */
+                              int     numCoords,   /* no. coordinates */
+                              float  *object,      /* [numCoords] */
+                              float **clusters)    /* [numClusters][numCoords] */
+{
+    int   index, i;
+    float dist, min_dist;
+
+    /* find the cluster id that has min distance to object */
+    index    = 0;
+    min_dist = euclid_dist_2_avx2(numCoords, object, clusters[0]);
+
+    for (i=1; i<numClusters; i++) {
+        dist = euclid_dist_2_avx2(numCoords, object, clusters[i]);
+        /* no need square root */
+        if (dist < min_dist) { /* find the min and its array index */
+            min_dist = dist;
+            index    = i;
+        }
+    }
+    return(index);
+}
+
+/*----< unpack_avx2() >------------------------------------------------------*/
+/* the 16-bit coordinates in[numCoords] of one object as FP32, 8 at a time:
+   FP16 with F16C (on every CPU with AVX2), BF16 by a shift into the upper
+   half */
+static
+void unpack_avx2(int                precision, /* KMEANS_FP16 or _BF16 */
+                 int                numCoords, /* no. coordinates */
+                 const kmeans_half *in,        /* [numCoords] */
+                 float             *out)       /* [numCoords] */
+{
+    int     i;
+    __m128i h8;
+
+    if (precision == KMEANS_BF16) {
+        for (i=0; i+8<=numCoords; i+=8) {
+            h8 = _mm_loadu_si128((const __m128i*)(in+i));
+            _mm256_storeu_ps(out+i, _mm256_castsi256_ps(
+                _mm256_slli_epi32(_mm256_cvtepu16_epi32(h8), 16)));
+        }
+        for (; i<numCoords; i++)
+            out[i] = kmeans_half_to_float(KMEANS_BF16, in[i]);
+    } else {
+        for (i=0; i+8<=numCoords; i+=8) {
+            h8 = _mm_loadu_si128((const __m128i*)(in+i));
+            _mm256_storeu_ps(out+i, _mm256_cvtph_ps(h8));
+        }
+        for (; i<numCoords; i++)
+            out[i] = kmeans_half_to_float(KMEANS_FP16, in[i]);
+    }
+}
+
+/*----< find_nearest_block_avx2() >------------------------------------------*/
+/* the nearest cluster of each of the KMEANS_BLOCK objects of one block, in
+   two registers of 8 (two independent chains of FMAs per center) */
+static
+void find_nearest_block_avx2(int     numClusters, /* no. clusters */
+                             int     numCoords,   /* no. coordinates */
+                             const float *block,  /* [numCoords][KMEANS_BLOCK] */
+                             float **clusters,    /* [numClusters][numCoords] */
+                             int    *index)       /* out: [KMEANS_BLOCK] */
+{
+    int    i, j;
+    __m256 c, d0, d1, dist0, dist1, closer0, closer1, id;
+    __m256 min0 = _mm256_setzero_ps(), min1 = _mm256_setzero_ps();
+    __m256 nearest0 = _mm256_setzero_ps(), nearest1 = _mm256_setzero_ps();
+
+    for (i=0; i<numClusters; i++) {
+        dist0 = dist1 = _mm256_setzero_ps();
+        for (j=0; j<numCoords; j++) {
+            c     = _mm256_broadcast_ss(&clusters[i][j]);
+            d0    = _mm256_sub_ps(_mm256_load_ps(block + j * KMEANS_BLOCK), c);
+            d1    = _mm256_sub_ps(_mm256_load_ps(block + j * KMEANS_BLOCK + 8), c);
+            dist0 = _mm256_fmadd_ps(d0, d0, dist0);
+            dist1 = _mm256_fmadd_ps(d1, d1, dist1);
+        }
+        /* the first center is the nearest so far, then the strictly
+           nearer ones, as in find_nearest_cluster(); the ids are blended
+           as floats, bit for bit */
+        if (i == 0) {
+            closer0 = closer1 = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        } else {
+            closer0 = _mm256_cmp_ps(dist0, min0, _CMP_LT_OQ);
+            closer1 = _mm256_cmp_ps(dist1, min1, _CMP_LT_OQ);
+        }
+        id       = _mm256_castsi256_ps(_mm256_set1_epi32(i));
+        min0     = _mm256_blendv_ps(min0, dist0, closer0);
+        min1     = _mm256_blendv_ps(min1, dist1, closer1);
+        nearest0 = _mm256_blendv_ps(nearest0, id, closer0);
+        nearest1 = _mm256_blendv_ps(nearest1, id, closer1);
+    }
+    _mm256_storeu_si256((__m256i*)index,     _mm256_castps_si256(nearest0));
+    _mm256_storeu_si256((__m256i*)(index+8), _mm256_castps_si256(nearest1));
+}
+
+const dist_kernels dist_kernels_avx2 = {
+    "avx2", euclid_dist_2_avx2, find_nearest_cluster_avx2,
+    find_nearest_block_avx2, unpack_avx2
+};
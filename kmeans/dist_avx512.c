@@ -0,0 +1,132 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+/*   File:         dist_avx512.c  (OpenMP version)                           */
+/*   Description:  AVX-512 point-to-centroid distance kernels                */
+/*                                                                           */
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <immintrin.h>
+
+#include "kmeans.h"
+
+/*----< euclid_dist_2_avx512() >---------------------------------------------*/
+/* square of Euclid distance between two multi-dimensional points            */
+__inline static
+float euclid_dist_2_avx512(int    numdims,  /* no. dimensions */
+                           float *coord1,   /* [numdims] */
+                           float *coord2)   /* [numdims] */
+{
+    int       i;
+    __m512    d, sum = _mm512_setzero_ps();
+    __mmask16 tail;
+
+    for (i=0; i+16<=numdims; i+=16) {
+        d   = _mm512_sub_ps(_mm512_loadu_ps(coord1+i), _mm512_loadu_ps(coord2+i));
+        sum = _mm512_fmadd_ps(d, d, sum);
+    }
+    if (i < numdims) {
+        /* masked lanes load as 0 and add nothing */
+        tail = (__mmask16)((1u << (numdims - i)) - 1);
+        d    = _mm512_sub_ps(_mm512_maskz_loadu_ps(tail, coord1+i),
+                             _mm512_maskz_loadu_ps(tail, coord2+i));
+        sum  = _mm512_fmadd_ps(d, d, sum);
+    }
+    return _mm512_reduce_add_ps(sum);
+}
+
+/*----< find_nearest_cluster_avx512() >--------------------------------------*/
+static
+int find_nearest_cluster_avx512(int     numClusters, /* no. clusters */
+                                int     numCoords,   /* no. coordinates */
+                                float  *object,      /* [numCoords] */
+                                float **clusters)    /* [numClusters][numCoords] */
+{
+    int   index, i;
+    float dist, min_dist;
+
+    /* find the cluster id that has min distance to object */
+    index    = 0;
+    min_dist = euclid_dist_2_avx512(numCoords, object, clusters[0]);
+
+    for (i=1; i<numClusters; i++) {
+        dist = euclid_dist_2_avx512(numCoords, object, clusters[i]);
+        /* no need square root */
+        if (dist < min_dist) { /* find the min and its array index */
+            min_dist = dist;
+            index    = i;
+        }
+    }
+    return(index);
+}
+
+/*----< unpack_avx512() >----------------------------------------------------*/
+__inline static
+__m512 widen_avx512(int precision, __m256i h16)
+{
+    if (precision == KMEANS_BF16)
+        return _mm512_castsi512_ps(
+            _mm512_slli_epi32(_mm512_cvtepu16_epi32(h16), 16));
+    return _mm512_cvtph_ps(h16);
+}
+
+/* the 16-bit coordinates in[numCoords] of one object as FP32, 16 at a time;
+   the last ones go through a zeroed copy (masked 16-bit loads would need
+   AVX-512BW) and a masked store */
+static
+void unpack_avx512(int                precision, /* KMEANS_FP16 or _BF16 */
+                   int                numCoords, /* no. coordinates */
+                   const kmeans_half *in,        /* [numCoords] */
+                   float             *out)       /* [numCoords] */
+{
+    int i;
+
+    for (i=0; i+16<=numCoords; i+=16)
+        _mm512_storeu_ps(out+i, widen_avx512(precision,
+                         _mm256_loadu_si256((const __m256i*)(in+i))));
+    if (i < numCoords) {
+        kmeans_half rest[16] = { 0 };
+        __mmask16   tail = (__mmask16)((1u << (numCoords - i)) - 1);
+
+        memcpy(rest, in+i, (numCoords - i) * sizeof(kmeans_half));
+        _mm512_mask_storeu_ps(out+i, tail, widen_avx512(precision,
+                              _mm256_loadu_si256((const __m256i*)rest)));
+    }
+}
+
+/*----< find_nearest_block_avx512() >----------------------------------------*/
+/* the nearest cluster of each of the KMEANS_BLOCK objects of one block: a
+   single register holds the distances of all of them to one center */
+static
+void find_nearest_block_avx512(int     numClusters, /* no. clusters */
+                               int     numCoords,   /* no. coordinates */
+                               const float *block,  /* [numCoords][KMEANS_BLOCK] */
+                               float **clusters,    /* [numClusters][numCoords] */
+                               int    *index)       /* out: [KMEANS_BLOCK] */
+{
+    int       i, j;
+    __m512    d, dist, min_dist = _mm512_setzero_ps();
+    __m512i   nearest = _mm512_setzero_si512();
+    __mmask16 closer;
+
+    for (i=0; i<numClusters; i++) {
+        dist = _mm512_setzero_ps();
+        for (j=0; j<numCoords; j++) {
+            d    = _mm512_sub_ps(_mm512_load_ps(block + j * KMEANS_BLOCK),
+                                 _mm512_set1_ps(clusters[i][j]));
+            dist = _mm512_fmadd_ps(d, d, dist);
+        }
+        /* the first center is the nearest so far, then the strictly
+           nearer ones, as in find_nearest_cluster() */
+        closer   = i == 0 ? (__mmask16)0xffff
+                          : _mm512_cmp_ps_mask(dist, min_dist, _CMP_LT_OQ);
+        min_dist = _mm512_mask_mov_ps(min_dist, closer, dist);
+        nearest  = _mm512_mask_mov_epi32(nearest, closer, _mm512_set1_epi32(i));
+    }
+    _mm512_storeu_si512(index, nearest);
+}
+
+const dist_kernels dist_kernels_avx512 = {
+    "avx512", euclid_dist_2_avx512, find_nearest_cluster_avx512,
+    find_nearest_block_avx512, unpack_avx512
+};
@@ -0,0 +1,128 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+/*   File:         dist_sse3.c  (OpenMP version)                             */
+/*   Description:  SSE3 point-to-centroid distance kernels                   */
+/*                                                                           */
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pmmintrin.h>
+
+#include "kmeans.h"
+
+/*----< euclid_dist_2_sse3() >-----------------------------------------------*/
+/* square of Euclid distance between two multi-dimensional points            */
+__inline static
+float euclid_dist_2_sse3(int    numdims,  /* no. dimensions */
+                         float *coord1,   /* [numdims] */
+                         float *coord2)   /* [numdims] */
+{
+    int    i;
+    float  ans, diff;
+    __m128 d, sum = _mm_setzero_ps();
+
+    for (i=0; i+4<=numdims; i+=4) {
+        d   = _mm_sub_ps(_mm_loadu_ps(coord1+i), _mm_loadu_ps(coord2+i));
+        sum = _mm_add_ps(sum, _mm_mul_ps(d, d));
+    }
+    sum = _mm_hadd_ps(sum, sum);
+    sum = _mm_hadd_ps(sum, sum);
+    ans = _mm_cvtss_f32(sum);
+
+    /* SSE has no masked load: finish the last numdims % 4 in scalar */
+    for (; i<numdims; i++) {
+        diff = coord1[i] - coord2[i];
+        ans += diff * diff;
+    }
+    return ans;
+}
+
+/*----< find_nearest_cluster_sse3() >----------------------------------------*/
+static
+int find_nearest_cluster_sse3(int     numClusters, /* no. clusters */
+                              int     numCoords,   /* no. coordinates */
+                              float  *object,      /* [numCoords] */
+                              float **clusters)    /* [numClusters][numCoords] */
+{
+    int   index, i;
+    float dist, min_dist;
+
+    /* find the cluster id that has min distance to object */
+    index    = 0;
+    min_dist = euclid_dist_2_sse3(numCoords, object, clusters[0]);
+
+    for (i=1; i<numClusters; i++) {
+        dist = euclid_dist_2_sse3(numCoords, object, clusters[i]);
+        /* no need square root */
+        if (dist < min_dist) { /* find the min and its array index */
+            min_dist = dist;
+            index    = i;
+        }
+    }
+    return(index);
+}
+
+/*----< unpack_sse3() >------------------------------------------------------*/
+/* the 16-bit coordinates in[numCoords] of one object as FP32 */
+static
+void unpack_sse3(int                precision, /* KMEANS_FP16 or _BF16 */
+                 int                numCoords, /* no. coordinates */
+                 const kmeans_half *in,        /* [numCoords] */
+                 float             *out)       /* [numCoords] */
+{
+    int i;
+
+    if (precision == KMEANS_BF16) {
+        for (i=0; i<numCoords; i++)
+            out[i] = kmeans_half_to_float(KMEANS_BF16, in[i]);
+    } else {
+        for (i=0; i<numCoords; i++)
+            out[i] = kmeans_half_to_float(KMEANS_FP16, in[i]);
+    }
+}
+
+/*----< find_nearest_block_sse3() >------------------------------------------*/
+/* the nearest cluster of each of the KMEANS_BLOCK objects of one block, 4
+   per register; SSE3 has no blendv, so the selects are and/andnot/or */
+static
+void find_nearest_block_sse3(int     numClusters, /* no. clusters */
+                             int     numCoords,   /* no. coordinates */
+                             const float *block,  /* [numCoords][KMEANS_BLOCK] */
+                             float **clusters,    /* [numClusters][numCoords] */
+                             int    *index)       /* out: [KMEANS_BLOCK] */
+{
+    int    i, j, k;
+    __m128 c, d, dist[4], min_dist[4], nearest[4], closer, id;
+
+    for (k=0; k<4; k++)
+        min_dist[k] = nearest[k] = _mm_setzero_ps();
+
+    for (i=0; i<numClusters; i++) {
+        for (k=0; k<4; k++) dist[k] = _mm_setzero_ps();
+        for (j=0; j<numCoords; j++) {
+            c = _mm_set1_ps(clusters[i][j]);
+            for (k=0; k<4; k++) {
+                d       = _mm_sub_ps(_mm_load_ps(block + j*KMEANS_BLOCK + 4*k), c);
+                dist[k] = _mm_add_ps(dist[k], _mm_mul_ps(d, d));
+            }
+        }
+        /* the first center is the nearest so far, then the strictly
+           nearer ones, as in find_nearest_cluster() */
+        id = _mm_castsi128_ps(_mm_set1_epi32(i));
+        for (k=0; k<4; k++) {
+            closer = i == 0 ? _mm_castsi128_ps(_mm_set1_epi32(-1))
+                            : _mm_cmplt_ps(dist[k], min_dist[k]);
+            min_dist[k] = _mm_or_ps(_mm_and_ps(closer, dist[k]),
+                                    _mm_andnot_ps(closer, min_dist[k]));
+            nearest[k]  = _mm_or_ps(_mm_and_ps(closer, id),
+                                    _mm_andnot_ps(closer, nearest[k]));
+        }
+    }
+    for (k=0; k<4; k++)
+        _mm_storeu_si128((__m128i*)(index + 4*k), _mm_castps_si128(nearest[k]));
+}
+
+const dist_kernels dist_kernels_sse3 = {
+    "sse3", euclid_dist_2_sse3, find_nearest_cluster_sse3,
+    find_nearest_block_sse3, unpack_sse3
+};
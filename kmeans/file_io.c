@@ -17,132 +17,590 @@
 
 #include <stdio.h>
 #include <stdlib.h>
-#include <string.h>     /* strtok() */
+#include <string.h>     /* memchr() */
 #include <sys/types.h>  /* open() */
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <unistd.h>     /* read(), close() */
+#include <sys/mman.h>   /* mmap(), madvise() */
 
 #include "kmeans.h"
 
-#define MAX_CHAR_PER_LINE 128
+/* text files are parsed in chunks of about this many bytes, one chunk at a
+   time per thread */
+#define PARSE_CHUNK (4 << 20)
 
+/*---< map_file() >----------------------------------------------------------*/
+/* map the whole file read-only; the pages are shared with other processes
+   reading the same file */
+static int map_file(char *filename, void **map, size_t *len)
+{
+    int         infile;
+    struct stat st;
+
+    if ((infile = open(filename, O_RDONLY)) == -1) {
+        fprintf(stderr, "Error: no such file (%s)\n", filename);
+        return 0;
+    }
+    if (fstat(infile, &st) == -1 || st.st_size == 0) {
+        fprintf(stderr, "Error: %s is empty\n", filename);
+        close(infile);
+        return 0;
+    }
+
+    *len = st.st_size;
+    *map = mmap(NULL, *len, PROT_READ, MAP_PRIVATE, infile, 0);
+    close(infile);
+    if (*map == MAP_FAILED) {
+        fprintf(stderr, "Error: cannot map %s\n", filename);
+        return 0;
+    }
+
+    /* the file is swept front to back; start the readahead now rather
+       than on the first page faults */
+    madvise(*map, *len, MADV_SEQUENTIAL);
+    madvise(*map, *len, MADV_WILLNEED);
+#ifdef MADV_HUGEPAGE
+    madvise(*map, *len, MADV_HUGEPAGE); /* if the file system supports it */
+#endif
+
+    return 1;
+}
 
-/*---< file_read() >---------------------------------------------------------*/
-float** file_read(int   isBinaryFile,  /* flag: 0 or 1 */
-                  char *filename,      /* input file name */
-                  int  *numObjs,       /* no. data objects (local) */
-                  int  *numCoords)     /* no. coordinates */
+/*---< map_binary() >--------------------------------------------------------*/
+/* objects point straight into the mapping: no copy */
+static int map_binary(char *filename, kmeans_data *data)
 {
-    float **objects;
-    int     i, j, len;
-    ssize_t numBytesRead;
+    int    *header;
+    size_t  len;
+
+    if (!map_file(filename, &data->map, &data->mapLength)) return 0;
+    data->fileSize = data->mapLength;
+
+    header          = (int*) data->map;
+    data->numObjs   = data->mapLength < 2 * sizeof(int) ? 0 : header[0];
+    data->numCoords = data->mapLength < 2 * sizeof(int) ? 0 : header[1];
+    data->stride    = data->numCoords;
+    data->objects   = (float*) (header + 2);
+    if (_debug) {
+        printf("File %s numObjs   = %d\n",filename,data->numObjs);
+        printf("File %s numCoords = %d\n",filename,data->numCoords);
+    }
 
-    if (isBinaryFile) {  /* input file is in raw binary format -------------*/
-        int infile;
-        if ((infile = open(filename, O_RDONLY, "0600")) == -1) {
-            fprintf(stderr, "Error: no such file (%s)\n", filename);
-            return NULL;
+    len = 2 * sizeof(int) +
+          (size_t)data->numObjs * data->numCoords * sizeof(float);
+    if (data->numObjs <= 0 || data->numCoords <= 0 || len > data->mapLength) {
+        fprintf(stderr, "Error: %s is not a binary k-means file\n", filename);
+        munmap(data->map, data->mapLength);
+        data->map = NULL;
+        return 0;
+    }
+
+    return 1;
+}
+
+/* separators between the values of a line */
+#define IS_SEP(c) ((c) == ' ' || (c) == '\t' || (c) == ',' || (c) == '\r')
+
+/*---< parse_float() >-------------------------------------------------------*/
+/* parse the number at p (p < end, not a separator) into *value, exactly as
+   (float)atof() would, and return the first character after it. A decimal
+   mantissa below 2^53 scaled by an exact power of ten (<= 1e22) takes a
+   single rounding in double, so it is done inline (Clinger's fast path).
+   Anything else (long mantissas, large exponents, inf, nan, hex) goes to
+   atof() through a nul-terminated copy, as the mapping is not terminated. */
+static const char* parse_float(const char *p, const char *end, float *value)
+{
+    static const double exact[] = {
+        1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10,
+        1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21,
+        1e22 };
+    const char         *s = p;
+    unsigned long long  mantissa = 0;
+    int                 negative = 0, sawDigit = 0, numDigits = 0, exp10 = 0;
+    char                token[64];
+    size_t              len;
+
+    if (*s == '-' || *s == '+') negative = (*s++ == '-');
+
+    for (; s < end && *s >= '0' && *s <= '9'; s++, sawDigit = 1) {
+        mantissa = mantissa * 10 + (*s - '0');
+        if (mantissa) numDigits++;
+    }
+    if (s < end && *s == '.') {
+        for (s++; s < end && *s >= '0' && *s <= '9'; s++, sawDigit = 1) {
+            mantissa = mantissa * 10 + (*s - '0');
+            if (mantissa) numDigits++;
+            exp10--;
         }
-        numBytesRead = read(infile, numObjs,    sizeof(int));
-        assert(numBytesRead == sizeof(int));
-        numBytesRead = read(infile, numCoords, sizeof(int));
-        assert(numBytesRead == sizeof(int));
-        if (_debug) {
-            printf("File %s numObjs   = %d\n",filename,*numObjs);
-            printf("File %s numCoords = %d\n",filename,*numCoords);
+    }
+    if (sawDigit && s < end && (*s == 'e' || *s == 'E')) {
+        const char *x = s + 1;
+        int         e = 0, eneg = 0;
+
+        if (x < end && (*x == '-' || *x == '+')) eneg = (*x++ == '-');
+        if (x < end && *x >= '0' && *x <= '9') {
+            for (; x < end && *x >= '0' && *x <= '9'; x++)
+                if (e < 10000) e = e * 10 + (*x - '0');
+            exp10 += eneg ? -e : e;
+            s = x;
         }
+    }
 
-        /* allocate space for objects[][] and read all objects */
-        len = (*numObjs) * (*numCoords);
-        objects    = (float**)malloc((*numObjs) * sizeof(float*));
-        assert(objects != NULL);
-        objects[0] = (float*) malloc(len * sizeof(float));
-        assert(objects[0] != NULL);
-        for (i=1; i<(*numObjs); i++)
-            objects[i] = objects[i-1] + (*numCoords);
+    /* numDigits guards against mantissa having wrapped around */
+    if (sawDigit && numDigits <= 19 && mantissa < (1ULL << 53) &&
+        exp10 >= -22 && exp10 <= 22 &&
+        (s == end || IS_SEP(*s) || *s == '\n')) {
+        double d = (double)mantissa;
+        d = exp10 < 0 ? d / exact[-exp10] : d * exact[exp10];
+        *value = (float)(negative ? -d : d);
+        return s;
+    }
 
-        numBytesRead = read(infile, objects[0], len*sizeof(float));
-        assert(numBytesRead == len*sizeof(float));
+    /* slow path */
+    for (s = p; s < end && !IS_SEP(*s) && *s != '\n'; s++) ;
+    len = (size_t)(s - p);
+    if (len > sizeof(token) - 1) len = sizeof(token) - 1;
+    memcpy(token, p, len);
+    token[len] = '\0';
+    *value = (float)atof(token);
+    return s;
+}
 
-        close(infile);
+/*---< count_objects() >-----------------------------------------------------*/
+/* no. non-blank lines in [p, end) */
+static int count_objects(const char *p, const char *end)
+{
+    int n = 0, blank = 1;
+
+    for (; p < end; p++) {
+        if (*p == '\n') {
+            n += !blank;
+            blank = 1;
+        }
+        else if (!IS_SEP(*p))
+            blank = 0;
     }
-    else {  /* input file is in ASCII format -------------------------------*/
-        FILE *infile;
-        char *line, *ret;
-        int   lineLen;
+    return n + !blank;
+}
 
-        if ((infile = fopen(filename, "r")) == NULL) {
-            fprintf(stderr, "Error: no such file (%s)\n", filename);
-            return NULL;
+/*---< parse_objects() >-----------------------------------------------------*/
+/* parse the non-blank lines of [p, end) into objects[][stride]: the first
+   value of a line is its id and is skipped, the next numCoords are the
+   coordinates, any further ones are ignored. Returns the no. lines with
+   fewer than numCoords coordinates. */
+static int parse_objects(const char *p, const char *end, int numCoords,
+                         int stride, float *objects)
+{
+    int j, numBad = 0;
+
+    while (p < end) {
+        while (p < end && (IS_SEP(*p) || *p == '\n')) p++;
+        if (p == end) break;
+
+        /* skip the id */
+        while (p < end && !IS_SEP(*p) && *p != '\n') p++;
+
+        for (j=0; j<numCoords; j++) {
+            while (p < end && IS_SEP(*p)) p++;
+            if (p == end || *p == '\n') break;
+            p = parse_float(p, end, &objects[j]);
+        }
+        if (j < numCoords) {
+            numBad++;
+            for (; j<numCoords; j++) objects[j] = 0.0;
         }
 
-        /* first find the number of objects */
-        lineLen = MAX_CHAR_PER_LINE;
-        line = (char*) malloc(lineLen);
-        assert(line != NULL);
-
-        (*numObjs) = 0;
-        while (fgets(line, lineLen, infile) != NULL) {
-            /* check each line to find the max line length */
-            while (strlen(line) == lineLen-1) {
-                /* this line read is not complete */
-                len = strlen(line);
-                fseek(infile, -len, SEEK_CUR);
-
-                /* increase lineLen */
-                lineLen += MAX_CHAR_PER_LINE;
-                line = (char*) realloc(line, lineLen);
-                assert(line != NULL);
-
-                ret = fgets(line, lineLen, infile);
-                assert(ret != NULL);
-            }
+        while (p < end && *p != '\n') p++;
+        objects += stride;
+    }
+    return numBad;
+}
+
+/*---< parse_text() >--------------------------------------------------------*/
+/* The mapped file is split into chunks that end at a newline. The threads
+   count the objects of their chunks, a prefix sum gives each chunk its
+   first object, and every chunk is then parsed straight into place. */
+static int parse_text(char *filename, kmeans_data *data)
+{
+    void       *map;
+    size_t      len;
+    const char *text, *end, *p;
+    long       *first;         /* [numChunks+1] first object of each chunk */
+    const char **bound;        /* [numChunks+1] first byte of each chunk */
+    int         i, numChunks, numBad = 0;
 
-            if (strtok(line, " \t\n") != 0)
-                (*numObjs)++;
+    if (!map_file(filename, &map, &len)) return 0;
+    data->fileSize = len;
+    text = (const char*) map;
+    end  = text + len;
+
+    numChunks = (int)((len + PARSE_CHUNK - 1) / PARSE_CHUNK);
+    bound = (const char**) malloc((numChunks + 1) * sizeof(const char*));
+    assert(bound != NULL);
+    first = (long*) malloc((numChunks + 1) * sizeof(long));
+    assert(first != NULL);
+
+    /* chunk i starts after the first newline at or past i * PARSE_CHUNK */
+    bound[0] = text;
+    for (i=1; i<numChunks; i++) {
+        p = (const char*) memchr(text + (size_t)i * PARSE_CHUNK, '\n',
+                                 end - (text + (size_t)i * PARSE_CHUNK));
+        bound[i] = (p == NULL) ? end : p + 1;
+        if (bound[i] < bound[i-1]) bound[i] = bound[i-1];
+    }
+    bound[numChunks] = end;
+
+    #pragma omp parallel for schedule(dynamic)
+    for (i=0; i<numChunks; i++)
+        first[i+1] = count_objects(bound[i], bound[i+1]);
+
+    first[0] = 0;
+    for (i=0; i<numChunks; i++) first[i+1] += first[i];
+    if (first[numChunks] == 0 || first[numChunks] > 0x7fffffff) {
+        fprintf(stderr, "Error: %s has %ld objects\n", filename,
+                first[numChunks]);
+        free(bound);
+        free(first);
+        munmap(map, len);
+        return 0;
+    }
+    data->numObjs = (int)first[numChunks];
+
+    /* find the no. coordinates of each object from the first one; the
+       first value (the id) is not a coordinate */
+    data->numCoords = -1;
+    for (p = text; p < end && data->numCoords < 0; p++) {
+        while (p < end && *p != '\n') {
+            while (p < end && IS_SEP(*p)) p++;
+            if (p == end || *p == '\n') break;
+            data->numCoords++;
+            while (p < end && !IS_SEP(*p) && *p != '\n') p++;
         }
-        rewind(infile);
-        if (_debug) printf("lineLen = %d\n",lineLen);
-
-        /* find the no. objects of each object */
-        (*numCoords) = 0;
-        while (fgets(line, lineLen, infile) != NULL) {
-            if (strtok(line, " \t\n") != 0) {
-                /* ignore the id (first coordiinate): numCoords = 1; */
-                while (strtok(NULL, " ,\t\n") != NULL) (*numCoords)++;
-                break; /* this makes read from 1st object */
-            }
+    }
+    if (data->numCoords <= 0)  {
+        fprintf(stderr, "Error: %s has no coordinates\n", filename);
+        free(bound);
+        free(first);
+        munmap(map, len);
+        return 0;
+    }
+    if (_debug) {
+        printf("File %s numObjs   = %d\n",filename,data->numObjs);
+        printf("File %s numCoords = %d\n",filename,data->numCoords);
+    }
+
+    /* allocate space for objects[][] and read all objects */
+    data->stride  = data->numCoords;
+    data->objects = (float*) malloc((size_t)data->numObjs * data->stride *
+                                    sizeof(float));
+    assert(data->objects != NULL);
+
+    #pragma omp parallel for schedule(dynamic) reduction(+:numBad)
+    for (i=0; i<numChunks; i++)
+        numBad += parse_objects(bound[i], bound[i+1], data->numCoords,
+                                data->stride,
+                                data->objects + first[i] * data->stride);
+
+    if (numBad > 0)
+        fprintf(stderr, "Warning: %d objects of %s have fewer than %d "
+                "coordinates, padded with 0\n", numBad, filename,
+                data->numCoords);
+
+    free(bound);
+    free(first);
+    munmap(map, len);
+
+    return 1;
+}
+
+/*---< file_load() >---------------------------------------------------------*/
+/* objects[i*stride .. i*stride+numCoords-1] are the coordinates of object i.
+   Binary files are mapped (see map_binary()), text files are parsed into a
+   malloc'd array (see parse_text()). Release with file_unload(). Returns 0
+   on error. */
+int file_load(int          isBinaryFile,  /* flag: 0 or 1 */
+              char        *filename,      /* input file name */
+              kmeans_data *data)          /* out */
+{
+    data->objects   = NULL;
+    data->map       = NULL;
+    data->mapLength = 0;
+    data->fileSize  = 0;
+
+    if (isBinaryFile)  /* input file is in raw binary format --------------*/
+        return map_binary(filename, data);
+    else               /* input file is in ASCII format -------------------*/
+        return parse_text(filename, data);
+}
+
+/*---< file_unload() >-------------------------------------------------------*/
+void file_unload(kmeans_data *data)
+{
+    if (data->map != NULL)
+        munmap(data->map, data->mapLength);
+    else
+        free(data->objects);
+    data->objects = NULL;
+    data->map     = NULL;
+}
+
+/* The outputs of an earlier run, read back to warm-start the next one
+   (KMEANS_SEED_GIVEN). They are in the formats file_write() writes, which
+   load like an input file: numClusters objects of numCoords coordinates,
+   or one object per membership whose single coordinate is its cluster id
+   (an int, not a float, in a binary file). */
+
+/*---< file_load_centres() >-------------------------------------------------*/
+/* Returns 0 on error, or if the file does not hold numClusters centers of
+   numCoords coordinates. */
+int file_load_centres(int     isBinaryFile,  /* flag: 0 or 1 */
+                      char   *filename,      /* .cluster_centres file */
+                      int     numClusters,
+                      int     numCoords,
+                      float  *centers)       /* out: [numClusters][numCoords] */
+{
+    kmeans_data data;
+    int         i;
+
+    if (!file_load(isBinaryFile, filename, &data)) return 0;
+    if (data.numObjs != numClusters || data.numCoords != numCoords) {
+        fprintf(stderr, "Error: %s has %d centers of %d coordinates, not %d of %d\n",
+                filename, data.numObjs, data.numCoords, numClusters,
+                numCoords);
+        file_unload(&data);
+        return 0;
+    }
+    for (i=0; i<numClusters; i++)
+        memcpy(centers + (size_t)i * numCoords,
+               data.objects + (size_t)i * data.stride,
+               numCoords * sizeof(float));
+    file_unload(&data);
+    return 1;
+}
+
+/*---< file_load_membership() >----------------------------------------------*/
+/* The file may list fewer objects than numObjs, when objects were appended
+   to the input since: those get -1, unassigned. Returns 0 on error. */
+int file_load_membership(int   isBinaryFile,  /* flag: 0 or 1 */
+                         char *filename,      /* .membership file */
+                         int   numObjs,
+                         int  *membership)    /* out: [numObjs] */
+{
+    kmeans_data data;
+    int         i, numRead;
+
+    if (!file_load(isBinaryFile, filename, &data)) return 0;
+    if (data.numCoords != 1) {
+        fprintf(stderr, "Error: %s is not a membership file\n", filename);
+        file_unload(&data);
+        return 0;
+    }
+    numRead = data.numObjs < numObjs ? data.numObjs : numObjs;
+    if (isBinaryFile)
+        memcpy(membership, data.objects, numRead * sizeof(int));
+    else
+        for (i=0; i<numRead; i++)
+            membership[i] = (int) data.objects[(size_t)i * data.stride];
+    for (i=numRead; i<numObjs; i++)
+        membership[i] = -1;
+    file_unload(&data);
+    return 1;
+}
+
+/* The outputs are formatted in parallel into large buffers, chunk by chunk,
+   and each buffer goes out with a single write(). With isBinaryOutput the
+   files are raw instead: the 2-integer header of the binary input format
+   ([numObjs, 1] resp. [numClusters, numCoords]) followed by int32
+   memberships resp. float32 centres, so they can be read back with -b. */
+
+/* objects per membership chunk; at most 24 bytes each in text */
+#define WRITE_CHUNK      65536
+/* chunks formatted at a time, one buffer each */
+#define WRITE_CHUNKS     16
+#define MAX_MEMBER_LINE  24
+
+/*---< write_fully() >-------------------------------------------------------*/
+static int write_fully(int fd, const void *buf, size_t len)
+{
+    const char *p = (const char*) buf;
+    ssize_t     n;
+
+    while (len > 0) {
+        if ((n = write(fd, p, len)) <= 0) return 0;
+        p   += n;
+        len -= n;
+    }
+    return 1;
+}
+
+/*---< format_int() >--------------------------------------------------------*/
+/* "%ld" into p, returns the end */
+static char* format_int(char *p, long v)
+{
+    char          digits[24];
+    int           n = 0;
+    unsigned long u = v < 0 ? 0UL - (unsigned long)v : (unsigned long)v;
+
+    if (v < 0) *p++ = '-';
+    do {
+        digits[n++] = '0' + u % 10;
+        u /= 10;
+    } while (u);
+    while (n) *p++ = digits[--n];
+    return p;
+}
+
+/*---< open_output() >-------------------------------------------------------*/
+static int open_output(char *filename, const char *suffix, char *outFileName)
+{
+    int fd;
+
+    sprintf(outFileName, "%s.%s", filename, suffix);
+    if ((fd = open(outFileName, O_WRONLY | O_CREAT | O_TRUNC, 0644)) == -1)
+        fprintf(stderr, "Error: cannot create %s\n", outFileName);
+    return fd;
+}
+
+/*---< file_write_centres() >-------------------------------------------------*/
+int file_write_centres(char      *filename,     /* input file name */
+                       int        numClusters,  /* no. clusters */
+                       int        numCoords,    /* no. coordinates (local) */
+                       float    **clusters,     /* [numClusters][numCoords] */
+                       int        isBinaryOutput)
+{
+    int     fd, i, ok;
+    char    outFileName[1024];
+
+    /* output: the coordinates of the cluster centres ----------------------*/
+    if ((fd = open_output(filename, "cluster_centres", outFileName)) == -1)
+        return 0;
+    printf("Writing coordinates of K=%d cluster centers to file \"%s\"\n",
+           numClusters, outFileName);
+
+    if (isBinaryOutput) {
+        int header[2] = { numClusters, numCoords };
+        ok = write_fully(fd, header, sizeof(header)) &&
+             write_fully(fd, clusters[0],
+                         (size_t)numClusters * numCoords * sizeof(float));
+    }
+    else {
+        /* "%d " then "%f " per coordinate: every row has its slot of at
+           most rowLen bytes, rows are formatted in parallel and packed */
+        size_t  rowLen = 16 + (size_t)numCoords * 64, len = 0;
+        char   *buf    = (char*) malloc(numClusters * rowLen);
+        size_t *used   = (size_t*) malloc(numClusters * sizeof(size_t));
+        assert(buf != NULL && used != NULL);
+
+        #pragma omp parallel for schedule(static)
+        for (i=0; i<numClusters; i++) {
+            char  *row = buf + i * rowLen, *p = row;
+            int    j;
+
+            p  = format_int(p, i);
+            *p++ = ' ';
+            for (j=0; j<numCoords; j++)
+                p += snprintf(p, row + rowLen - p, "%f ", clusters[i][j]);
+            *p++ = '\n';
+            used[i] = p - row;
         }
-        rewind(infile);
-        if (_debug) {
-            printf("File %s numObjs   = %d\n",filename,*numObjs);
-            printf("File %s numCoords = %d\n",filename,*numCoords);
+        for (i=0; i<numClusters; i++) {
+            memmove(buf + len, buf + i * rowLen, used[i]);
+            len += used[i];
         }
+        ok = write_fully(fd, buf, len);
+
+        free(used);
+        free(buf);
+    }
+
+    close(fd);
+    if (!ok) fprintf(stderr, "Error: cannot write %s\n", outFileName);
+    return ok;
+}
+
+/*---< membership_open() >---------------------------------------------------*/
+/* start a .membership file for numObjs objects, appended to in order with
+   membership_append() */
+int membership_open(membership_file *f,
+                    char            *filename,       /* input file name */
+                    long             numObjs,
+                    int              isBinaryOutput)
+{
+    char outFileName[1024];
+
+    f->isBinary   = isBinaryOutput;
+    f->numWritten = 0;
+    f->buf        = NULL;
+    if ((f->fd = open_output(filename, "membership", outFileName)) == -1)
+        return 0;
+    printf("Writing membership of N=%ld data objects to file \"%s\"\n",
+           numObjs, outFileName);
+
+    if (isBinaryOutput) {
+        int header[2] = { (int)numObjs, 1 };
+        return write_fully(f->fd, header, sizeof(header));
+    }
+
+    f->buf = (char*) malloc((size_t)WRITE_CHUNKS * WRITE_CHUNK *
+                            MAX_MEMBER_LINE);
+    assert(f->buf != NULL);
+    return 1;
+}
 
-        /* allocate space for objects[][] and read all objects */
-        len = (*numObjs) * (*numCoords);
-        objects    = (float**)malloc((*numObjs) * sizeof(float*));
-        assert(objects != NULL);
-        objects[0] = (float*) malloc(len * sizeof(float));
-        assert(objects[0] != NULL);
-        for (i=1; i<(*numObjs); i++)
-            objects[i] = objects[i-1] + (*numCoords);
-
-        i = 0;
-        /* read all objects */
-        while (fgets(line, lineLen, infile) != NULL) {
-            if (strtok(line, " \t\n") == NULL) continue;
-            for (j=0; j<(*numCoords); j++)
-                objects[i][j] = atof(strtok(NULL, " ,\t\n"));
-            i++;
+/*---< membership_append() >-------------------------------------------------*/
+/* write the memberships of the next count objects: "%d %d\n" per object,
+   WRITE_CHUNKS chunks formatted in parallel, then written in order */
+int membership_append(membership_file *f,
+                      int              count,
+                      const int       *membership)   /* [count] */
+{
+    size_t used[WRITE_CHUNKS];
+    int    first, c, numChunks;
+
+    if (f->isBinary) {
+        f->numWritten += count;
+        return write_fully(f->fd, membership, (size_t)count * sizeof(int));
+    }
+
+    for (first=0; first<count; first+=WRITE_CHUNKS*WRITE_CHUNK) {
+        int rest = count - first;
+
+        numChunks = (rest + WRITE_CHUNK - 1) / WRITE_CHUNK;
+        if (numChunks > WRITE_CHUNKS) numChunks = WRITE_CHUNKS;
+
+        #pragma omp parallel for schedule(static)
+        for (c=0; c<numChunks; c++) {
+            char *start = f->buf + (size_t)c * WRITE_CHUNK * MAX_MEMBER_LINE;
+            char *p     = start;
+            int   i     = first + c * WRITE_CHUNK;
+            int   last  = i + WRITE_CHUNK < count ? i + WRITE_CHUNK : count;
+
+            for (; i<last; i++) {
+                p    = format_int(p, f->numWritten + i);
+                *p++ = ' ';
+                p    = format_int(p, membership[i]);
+                *p++ = '\n';
+            }
+            used[c] = p - start;
         }
 
-        fclose(infile);
-        free(line);
+        for (c=0; c<numChunks; c++)
+            if (!write_fully(f->fd, f->buf +
+                             (size_t)c * WRITE_CHUNK * MAX_MEMBER_LINE,
+                             used[c]))
+                return 0;
     }
+    f->numWritten += count;
+    return 1;
+}
 
-    return objects;
+/*---< membership_close() >--------------------------------------------------*/
+int membership_close(membership_file *f)
+{
+    free(f->buf);
+    f->buf = NULL;
+    return close(f->fd) == 0;
 }
 
 /*---< file_write() >---------------------------------------------------------*/
@@ -151,33 +609,21 @@ int file_write(char      *filename,     /* input file name */
                int        numObjs,      /* no. data objects */
                int        numCoords,    /* no. coordinates (local) */
                float    **clusters,     /* [numClusters][numCoords] centers */
-               int       *membership)   /* [numObjs] */
+               int       *membership,   /* [numObjs] */
+               int        isBinaryOutput)
 {
-    FILE *fptr;
-    int   i, j;
-    char  outFileName[1024];
+    membership_file f;
+    int             ok;
 
-    /* output: the coordinates of the cluster centres ----------------------*/
-    sprintf(outFileName, "%s.cluster_centres", filename);
-    printf("Writing coordinates of K=%d cluster centers to file \"%s\"\n",
-           numClusters, outFileName);
-    fptr = fopen(outFileName, "w");
-    for (i=0; i<numClusters; i++) {
-        fprintf(fptr, "%d ", i);
-        for (j=0; j<numCoords; j++)
-            fprintf(fptr, "%f ", clusters[i][j]);
-        fprintf(fptr, "\n");
-    }
-    fclose(fptr);
+    if (!file_write_centres(filename, numClusters, numCoords, clusters,
+                            isBinaryOutput))
+        return 0;
 
     /* output: the closest cluster centre to each of the data points --------*/
-    sprintf(outFileName, "%s.membership", filename);
-    printf("Writing membership of N=%d data objects to file \"%s\"\n",
-           numObjs, outFileName);
-    fptr = fopen(outFileName, "w");
-    for (i=0; i<numObjs; i++)
-        fprintf(fptr, "%d %d\n", i, membership[i]);
-    fclose(fptr);
+    if (!membership_open(&f, filename, numObjs, isBinaryOutput)) return 0;
+    ok = membership_append(&f, numObjs, membership);
+    ok = membership_close(&f) && ok;
+    if (!ok) fprintf(stderr, "Error: cannot write %s.membership\n", filename);
 
-    return 1;
+    return ok;
 }
@@ -0,0 +1,220 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+/*   File:         gemm_assign.cpp  (OpenMP version)                         */
+/*   Description:  the assignment step as a matrix product, for many and     */
+/*                 wide centers: |x - c|^2 = |x|^2 + |c|^2 - 2 x.c, the      */
+/*                 cross terms of a tile of objects with all centers from    */
+/*                 the packed GEMM of ../matrix_mul/omp, the arg-min taken   */
+/*                 in its epilogue, strip by strip. |x|^2 is the same for    */
+/*                 every center and left out. Objects and centers are        */
+/*                 taken relative to the mean of the centers, and an object  */
+/*                 whose two nearest are closer than the rounding error of   */
+/*                 the expansion is searched again with exact distances.     */
+/*                                                                           */
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <float.h>          /* FLT_MAX */
+
+#include "matrix_mul.h"     /* omp::gemm(), omp::PackedB */
+#include "kmeans.h"
+
+struct gemm_centers {
+    int           numClusters;
+    int           numCoords;
+    float       (*dist)(int, float*, float*);  /* for the exact search */
+    float       **clusters; /* [numClusters][numCoords], of the iteration */
+    float        *origin;   /* [numCoords] the mean of the centers */
+    float        *shifted;  /* [numClusters][numCoords] c - origin */
+    omp::PackedB *packed;   /* shifted as the k x n operand, transposed */
+    float        *norms;    /* [numClusters] |c - origin|^2 */
+    float         maxNorm;  /* the largest of norms[] */
+};
+
+/*----< gemm_centers_new() >-------------------------------------------------*/
+gemm_centers* gemm_centers_new(int    numClusters,
+                               int    numCoords,
+                               float  (*dist)(int, float*, float*))
+{
+    gemm_centers *g = (gemm_centers*) malloc(sizeof(gemm_centers));
+    assert(g != NULL);
+
+    g->numClusters = numClusters;
+    g->numCoords   = numCoords;
+    g->dist        = dist;
+    g->clusters    = NULL;
+    g->packed      = NULL;
+    g->origin      = (float*) malloc(numCoords * sizeof(float));
+    g->shifted     = (float*) malloc((size_t)numClusters * numCoords *
+                                     sizeof(float));
+    g->norms       = (float*) malloc(numClusters * sizeof(float));
+    assert(g->origin != NULL && g->shifted != NULL && g->norms != NULL);
+    return g;
+}
+
+/*----< gemm_centers_update() >----------------------------------------------*/
+/* Pack the centers of this iteration, with the threads of the caller; call
+   it outside of parallel regions. Distances do not change under a
+   translation, so the product is of objects and centers relative to the
+   mean of the centers: far from the origin |x|^2 and 2 x.c would be much
+   larger than |x - c|^2, which their difference then loses. */
+void gemm_centers_update(gemm_centers *g,
+                         float       **clusters)  /* [numClusters][numCoords] */
+{
+    int i, j;
+
+    g->clusters = clusters;
+    for (j=0; j<g->numCoords; j++) {
+        double sum = 0.0;
+        for (i=0; i<g->numClusters; i++)
+            sum += clusters[i][j];
+        g->origin[j] = (float)(sum / g->numClusters);
+    }
+
+    g->maxNorm = 0.0f;
+    for (i=0; i<g->numClusters; i++) {
+        float *c    = g->shifted + (size_t)i * g->numCoords;
+        float  norm = 0.0f;
+        for (j=0; j<g->numCoords; j++) {
+            c[j]  = clusters[i][j] - g->origin[j];
+            norm += c[j] * c[j];
+        }
+        g->norms[i] = norm;
+        if (norm > g->maxNorm) g->maxNorm = norm;
+    }
+
+    delete g->packed;
+    g->packed = new omp::PackedB(true, g->numCoords, g->numClusters,
+                                 g->shifted, g->numCoords);
+}
+
+/*----< gemm_buffer_size() >-------------------------------------------------*/
+/* floats of the buffer of one thread in gemm_assign(): the shifted tile,
+   then that of gemm_fused(). Both are multiples of 16 so that the buffers
+   of all threads can follow each other 64-byte aligned; valid once
+   gemm_centers_update() has run */
+static size_t tile_size(const gemm_centers *g)
+{
+    return ((size_t)KMEANS_GEMM_TILE * g->numCoords + 15) / 16 * 16;
+}
+
+size_t gemm_buffer_size(const gemm_centers *g)
+{
+    return tile_size(g) +
+           (omp::kernel::fused_buffer_size(*g->packed) + 15) / 16 * 16;
+}
+
+/* the two nearest centers so far of each object of the tile */
+struct nearest_tile {
+    const gemm_centers *g;
+    float               min_dist[KMEANS_GEMM_TILE];
+    float               second[KMEANS_GEMM_TILE];  /* the runner-up's */
+    int                *nearest;
+};
+
+/*----< nearest_strip() >----------------------------------------------------*/
+/* epilogue of the GEMM: -2 x.c of objects i0.. against centers j0.. */
+static void nearest_strip(void *arg, unsigned int i0, unsigned int rows,
+                          unsigned int j0, unsigned int cols,
+                          const float *c, unsigned int ldc)
+{
+    nearest_tile *t     = (nearest_tile*) arg;
+    const float  *norms = t->g->norms + j0;
+    unsigned int  i, j;
+
+    for (i=0; i<rows; i++) {
+        const float *row      = c + (size_t)i * ldc;
+        float        min_dist = t->min_dist[i0 + i];
+        float        second   = t->second[i0 + i];
+        int          index    = t->nearest[i0 + i];
+
+        for (j=0; j<cols; j++) {
+            float dist = row[j] + norms[j];
+            if (dist < min_dist) {
+                second   = min_dist;
+                min_dist = dist;
+                index    = j0 + j;
+            } else if (dist < second) {
+                second = dist;
+            }
+        }
+        t->min_dist[i0 + i] = min_dist;
+        t->second[i0 + i]   = second;
+        t->nearest[i0 + i]  = index;
+    }
+}
+
+/*----< gemm_assign() >------------------------------------------------------*/
+/* The nearest centers of count (at most KMEANS_GEMM_TILE) objects, on the
+   calling thread alone (no parallel region, no allocation); returns how
+   many of them were searched again with exact distances. The strips of a
+   row come in increasing center ids and the comparisons are strict, so
+   ties go to the lowest cluster id as in find_nearest_cluster(). */
+int gemm_assign(const gemm_centers *g,
+                const float *objects,   /* [count][stride] */
+                int          stride,
+                int          count,
+                float       *buffer,    /* [gemm_buffer_size()], the thread's */
+                int         *nearest)   /* out: [count] */
+{
+    const int    numCoords = g->numCoords;
+    float       *tile      = buffer;    /* [count][numCoords] x - origin */
+    float        norms[KMEANS_GEMM_TILE];
+    nearest_tile t;
+    int          i, j, c, numExact = 0;
+
+    for (i=0; i<count; i++) {
+        const float *x    = objects + (size_t)i * stride;
+        float       *row  = tile + (size_t)i * numCoords;
+        float        norm = 0.0f;
+        for (j=0; j<numCoords; j++) {
+            row[j] = x[j] - g->origin[j];
+            norm  += row[j] * row[j];
+        }
+        norms[i] = norm;
+    }
+
+    t.g       = g;
+    t.nearest = nearest;
+    for (i=0; i<count; i++) {
+        t.min_dist[i] = FLT_MAX;
+        t.second[i]   = FLT_MAX;
+        nearest[i]    = 0;
+    }
+
+    omp::kernel::gemm_fused(false, count, -2.0f, tile, numCoords, *g->packed,
+                            buffer + tile_size(g), nearest_strip, &t);
+
+    /* a runner-up within the error may be the nearest: as the full search */
+    for (i=0; i<count; i++) {
+        float *object;
+        float  min_dist;
+
+        if (t.second[i] - t.min_dist[i] >
+            KMEANS_GEMM_ERROR(numCoords) * (norms[i] + 2.0f * g->maxNorm))
+            continue;
+
+        object   = (float*) objects + (size_t)i * stride;
+        min_dist = g->dist(numCoords, object, g->clusters[0]);
+        nearest[i] = 0;
+        for (c=1; c<g->numClusters; c++) {
+            float dist = g->dist(numCoords, object, g->clusters[c]);
+            if (dist < min_dist) {
+                min_dist   = dist;
+                nearest[i] = c;
+            }
+        }
+        numExact++;
+    }
+    return numExact;
+}
+
+/*----< gemm_centers_free() >------------------------------------------------*/
+void gemm_centers_free(gemm_centers *g)
+{
+    delete g->packed;
+    free(g->origin);
+    free(g->shifted);
+    free(g->norms);
+    free(g);
+}
@@ -0,0 +1,55 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+/*   File:         half.c  (OpenMP and CUDA version)                         */
+/*   Description:  the 16-bit copies of the objects, -P on omp_main and      */
+/*                 cuda_main: FP16 (IEEE binary16) or BF16 (the upper half   */
+/*                 of an FP32), see kmeans_float_to_half() in kmeans.h       */
+/*                                                                           */
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>     /* strcmp() */
+
+#include "kmeans.h"
+
+/*----< kmeans_precision_method() >------------------------------------------*/
+/* -P argument to KMEANS_FP*, -1 if unknown */
+int kmeans_precision_method(const char *name)
+{
+    if (strcmp(name, "fp32") == 0) return KMEANS_FP32;
+    if (strcmp(name, "fp16") == 0) return KMEANS_FP16;
+    if (strcmp(name, "bf16") == 0) return KMEANS_BF16;
+    return -1;
+}
+
+const char* kmeans_precision_name(int precision)
+{
+    switch (precision) {
+        case KMEANS_FP16: return "fp16";
+        case KMEANS_BF16: return "bf16";
+        default:          return "fp32";
+    }
+}
+
+/*----< kmeans_pack() >------------------------------------------------------*/
+/* the objects [numObjs][stride] as out[numObjs][numCoords], in parallel
+   when built with OpenMP */
+void kmeans_pack(int          precision,  /* KMEANS_FP16 or KMEANS_BF16 */
+                 const float *objects,    /* in: [numObjs][stride] */
+                 int          stride,
+                 int          numObjs,
+                 int          numCoords,
+                 kmeans_half *out)        /* out: [numObjs][numCoords] */
+{
+    int i;
+
+#pragma omp parallel for schedule(static)
+    for (i=0; i<numObjs; i++) {
+        const float *object = objects + (size_t)i * stride;
+        kmeans_half *packed = out + (size_t)i * numCoords;
+        int          j;
+
+        for (j=0; j<numCoords; j++)
+            packed[j] = kmeans_float_to_half(precision, object[j]);
+    }
+}
@@ -36,6 +36,8 @@
 #define _H_KMEANS
 
 #include <assert.h>
+#include <stdlib.h>     /* posix_memalign() */
+#include <string.h>     /* memcpy() */
 
 #define msg(format, ...) do { fprintf(stderr, format, ##__VA_ARGS__); } while (0)
 #define err(format, ...) do { fprintf(stderr, format, ##__VA_ARGS__); exit(1); } while (0)
@@ -61,13 +63,375 @@ inline void checkLastCudaError() {
 }
 #endif
 
-float** omp_kmeans(int, float**, int, int, int, float, int*);
-float** seq_kmeans(float**, int, int, int, float, int*, int*);
-float** cuda_kmeans(float**, int, int, int, float, int*, int*);
+/* Storage of the objects during the iterations (-P on omp_main and
+   cuda_main). KMEANS_FP16 and KMEANS_BF16 keep a 16-bit copy, rounded to
+   nearest even, so every pass over the objects reads half the bytes; each
+   coordinate is widened to FP32 as it is loaded and the distances and new
+   centers are still summed in FP32. FP16 keeps 11 significant bits over
+   +-65504, BF16 8 bits over the whole FP32 range. The seeds are drawn as
+   before (on the GPU, from the 16-bit copy). */
+#define KMEANS_FP32 0
+#define KMEANS_FP16 1
+#define KMEANS_BF16 2
 
-float** file_read(int, char*, int*, int*);
-int     file_write(char*, int, int, int, float**, int*);
+typedef unsigned short kmeans_half;
 
+int         kmeans_precision_method(const char*);
+const char* kmeans_precision_name(int);
+void        kmeans_pack(int, const float*, int, int, int, kmeans_half*);
+
+__inline static
+kmeans_half kmeans_float_to_half(int precision, float f)
+{
+    unsigned int u, sign;
+
+    memcpy(&u, &f, sizeof(u));
+    if (precision == KMEANS_BF16) {
+        if ((u & 0x7fffffff) > 0x7f800000)          /* NaN stays one */
+            return (kmeans_half)((u >> 16) | 0x40);
+        u += 0x7fff + ((u >> 16) & 1);
+        return (kmeans_half)(u >> 16);
+    }
+
+    sign = u & 0x80000000;
+    u   ^= sign;
+    if (u >= 0x47800000) {                  /* |f| >= 65536: Inf or NaN */
+        u = u > 0x7f800000 ? 0x7e00 : 0x7c00;
+    } else if (u < 0x38800000) {            /* subnormal half: the FPU */
+        float d, magic = 0.5f;              /* rounds at the 2^-24 bit */
+
+        memcpy(&d, &u, sizeof(d));
+        d += magic;
+        memcpy(&u, &d, sizeof(u));
+        u -= 0x3f000000;
+    } else {
+        u += 0xc8000fff + ((u >> 13) & 1);  /* rebias, round to even */
+        u >>= 13;
+    }
+    return (kmeans_half)(u | (sign >> 16));
+}
+
+__inline static
+float kmeans_half_to_float(int precision, kmeans_half h)
+{
+    unsigned int u;
+    float        f;
+
+    if (precision == KMEANS_BF16) {
+        u = (unsigned int)h << 16;
+    } else {
+        u = (unsigned int)(h & 0x7fff) << 13;
+        if ((u & 0x0f800000) == 0x0f800000) {       /* Inf, NaN */
+            u += 0x70000000;
+        } else if ((u & 0x0f800000) == 0) {         /* 0, subnormal: */
+            u += 0x38800000;                        /* 2^-14 + m 2^-24, */
+            memcpy(&f, &u, sizeof(f));              /* less 2^-14 */
+            f -= 6.103515625e-05f;
+            memcpy(&u, &f, sizeof(u));
+        } else {
+            u += 0x38000000;
+        }
+        u |= (unsigned int)(h & 0x8000) << 16;
+    }
+    memcpy(&f, &u, sizeof(f));
+    return f;
+}
+
+/* SIMD distance kernels of the OpenMP version (dist_*.c). Each set is built
+   with its own -m flags; select_dist_kernels() runs cpuid once and returns
+   the widest set the host supports. Any numCoords is handled in the kernels
+   (masked loads or a scalar remainder), so objects need no padding.
+   find_nearest_block assigns the KMEANS_BLOCK objects of one block of the
+   blocked layout (see omp_kmeans.c) at once, one object per SIMD lane, so
+   a low-dimensional object does not leave most lanes empty and needs no
+   horizontal sum; the block is 64-byte aligned.
+   unpack widens numCoords coordinates of a 16-bit copy (-P) to FP32, with
+   F16C or AVX-512 conversions where there are. */
+#define KMEANS_BLOCK 16         /* objects per block, one AVX-512 register */
+
+typedef struct {
+    const char *isa;
+    float (*euclid_dist_2)(int, float*, float*);
+    int   (*find_nearest_cluster)(int, int, float*, float**);
+    void  (*find_nearest_block)(int, int, const float*, float**, int*);
+    void  (*unpack)(int, int, const kmeans_half*, float*);
+} dist_kernels;
+
+extern const dist_kernels dist_kernels_sse3;
+extern const dist_kernels dist_kernels_avx2;
+extern const dist_kernels dist_kernels_avx512;
+
+const dist_kernels* select_dist_kernels(void);
+
+/* Triangle-inequality pruning of the assignment step (triangle.c), -e
+   (Elkan: numClusters lower bounds per object) or -H (Hamerly: one lower
+   bound per object) on seq_main and omp_main. A distance is only skipped
+   when the bounds prove the center strictly farther than the own one, with
+   slack for float rounding, so memberships match the full search. */
+#define KMEANS_FULL      0
+#define KMEANS_ELKAN     1
+#define KMEANS_HAMERLY   2
+
+#define KMEANS_MAX_LOOPS 501    /* while (... && loop++ < 500) */
+
+typedef struct {
+    int  method;                     /* in:  KMEANS_FULL/ELKAN/HAMERLY */
+    int  loops;                      /* out: no. iterations run */
+    long skipped[KMEANS_MAX_LOOPS]; /* out: distance evaluations skipped in
+                                        each iteration */
+} prune_stats;
+
+typedef struct triangle_bounds triangle_bounds;
+
+triangle_bounds* triangle_new(int, float (*)(int, float*, float*), float*,
+                              int, int, int, int);
+int     triangle_assign(triangle_bounds*, float**, int*, long*);
+void    triangle_free(triangle_bounds*);
+
+/* Assignment by matrix product (gemm_assign.cpp, omp_kmeans(); the CUDA
+   version has its own kernel): once numClusters x numCoords reaches
+   KMEANS_GEMM_MIN_KD, and the objects have KMEANS_GEMM_MIN_COORDS (below
+   that the blocked layout is faster), the distances of a tile of objects
+   to all centers come from one GEMM, |c|^2 - 2 x.c, on the calling
+   thread, and the nearest centers are picked in its epilogue from each
+   strip of the product as it is finished, so not even the tile x
+   numClusters matrix is stored. The expansion cancels when the objects
+   lie far from the origin compared with the distances between them, so
+   it is taken relative to the mean of the centers, and an object whose
+   runner-up is within its rounding error of the nearest is searched again
+   with euclid_dist_2(): the memberships are those of the full search. */
+#define KMEANS_GEMM_MIN_KD     4096
+#define KMEANS_GEMM_MIN_COORDS 32
+#define KMEANS_GEMM_TILE       128  /* objects per GEMM, one block of its A */
+/* Bound on the error of |c|^2 - 2 x.c over numCoords terms, relative to
+   |x|^2 + 2 max |c|^2 (both from the origin), with those of the shift and
+   of the float distances of the exact search: a runner-up this close to
+   the nearest may be the nearest. Needs <float.h>. */
+#define KMEANS_GEMM_ERROR(numCoords) (4.0f * ((numCoords) + 2) * FLT_EPSILON)
+
+typedef struct gemm_centers gemm_centers;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+gemm_centers* gemm_centers_new(int, int, float (*)(int, float*, float*));
+void    gemm_centers_update(gemm_centers*, float**);
+size_t  gemm_buffer_size(const gemm_centers*);
+int     gemm_assign(const gemm_centers*, const float*, int, int, float*, int*);
+void    gemm_centers_free(gemm_centers*);
+#ifdef __cplusplus
+}
+#endif
+
+/* Initial cluster centers (seed.c), -s on all drivers. KMEANS_SEED_FIRST
+   copies the first numClusters objects, KMEANS_SEED_PLUSPLUS is k-means++
+   and KMEANS_SEED_PARALLEL k-means||, which draws about 10*numClusters
+   candidates in 5 passes over the objects instead of numClusters passes and
+   reduces them with k-means++. The random draws are a function of the
+   object index, so the centers do not depend on the no. threads.
+   KMEANS_SEED_GIVEN warm-starts from the caller's centers and memberships,
+   those of an earlier run (-c, -M), and stops as soon as fewer than the
+   threshold of the objects move. */
+#define KMEANS_SEED_FIRST    0
+#define KMEANS_SEED_PLUSPLUS 1
+#define KMEANS_SEED_PARALLEL 2
+#define KMEANS_SEED_GIVEN    3
+
+#define KMEANS_SEED_CHUNK 4096  /* objects per partial sum of distances */
+
+/* Where the objects live: each backend keeps, for every object, the
+   squared distance to and the id of the nearest center chosen so far. */
+typedef struct {
+    void  *arg;
+    /* add the centers[0..count), ids firstId.., to the chosen ones
+       (firstId == 0 starts over) and store the sum of the distances of
+       every KMEANS_SEED_CHUNK objects in chunkSums[] */
+    void (*update)(void *arg, float **centers, int count, int firstId,
+                   double *chunkSums);
+    /* the distances of objects [begin, end) */
+    void (*fetch)(void *arg, int begin, int end, float *out);
+    /* add to count[] the no. objects nearest to each of numCenters */
+    void (*count)(void *arg, int numCenters, int *count);
+} seed_ops;
+
+int         kmeans_seed_method(const char*);
+const char* kmeans_seed_name(int);
+void        kmeans_seed(int, const seed_ops*, float (*)(int, float*, float*),
+                        float*, int, int, int, int, float**);
+void        kmeans_seed_host(int, float (*)(int, float*, float*), float*, int,
+                             int, int, int, float**);
+void        kmeans_start(int, const float*, int, int, int, float**, int*);
+
+/* Buffers of one clustering call. A kmeans_context (libkmeans.c) keeps its
+   workspace from one call to the next, so repeated calls of the same size
+   allocate nothing; omp_kmeans(), seq_kmeans() and cuda_kmeans() use one
+   that lives for the call. Each slot grows to the largest size asked for,
+   64-byte aligned, and is not initialized. */
+#define KMEANS_WS_SLOTS 13
+#define KMEANS_MAX_DEVICES 16   /* GPUs cuda_kmeans_ws() spreads over */
+
+typedef struct {
+    void   *host[KMEANS_WS_SLOTS];
+    size_t  hostSize[KMEANS_WS_SLOTS];
+    /* cuda_kmeans_ws() only: the slots of each GPU, and page-locked host
+       memory */
+    void   *device[KMEANS_MAX_DEVICES][KMEANS_WS_SLOTS];
+    size_t  deviceSize[KMEANS_MAX_DEVICES][KMEANS_WS_SLOTS];
+    void   *pinned[KMEANS_WS_SLOTS];
+    size_t  pinnedSize[KMEANS_WS_SLOTS];
+    int     numDevices;                 /* 0, or the GPUs the two below */
+    size_t  sharedMemPerBlock;          /* are the least over */
+    int     multiProcessorCount;
+} kmeans_workspace;
+
+__inline static
+void* workspace_get(kmeans_workspace *ws, int slot, size_t size)
+{
+    if (size > ws->hostSize[slot]) {
+        free(ws->host[slot]);
+        if (posix_memalign(&ws->host[slot], 64, size))
+            ws->host[slot] = NULL;
+        assert(ws->host[slot] != NULL);
+        ws->hostSize[slot] = size;
+    }
+    return ws->host[slot];
+}
+
+/* the host slots; cuda_workspace_free() also releases the device ones */
+__inline static
+void workspace_free(kmeans_workspace *ws)
+{
+    int i;
+    for (i=0; i<KMEANS_WS_SLOTS; i++) {
+        free(ws->host[i]);
+        ws->host[i]     = NULL;
+        ws->hostSize[i] = 0;
+    }
+}
+
+/* The *_ws versions return centers that belong to the workspace (valid
+   until its next use), the others a malloc'd copy. */
+float** omp_kmeans(int, float*, int, int, int, int, int, float*, int, float,
+                   int*, prune_stats*);
+float** omp_kmeans_ws(kmeans_workspace*, int, float*, int, int, int, int, int,
+                      float*, int, float, int*, prune_stats*);
+float** seq_kmeans(float*, int, int, int, int, int, float*, float, int*, int*,
+                   prune_stats*);
+float** seq_kmeans_ws(kmeans_workspace*, float*, int, int, int, int, int,
+                      float*, float, int*, int*, prune_stats*);
+
+/* mini-batch k-means streaming a binary input (omp_minibatch.c, -m) */
+float** omp_minibatch_kmeans(char*, int, int, int, float, int*, int*, int*,
+                             size_t*);
+int     omp_minibatch_write(char*, int, int, float**, int);
+float** cuda_kmeans(float*, int, int, int, int, int, float*, int, float,
+                    int*, int*);
+#ifdef __CUDACC__
+float** cuda_kmeans_ws(kmeans_workspace*, float*, int, int, int, int, int,
+                       float*, int, float, int*, int*);
+void    cuda_workspace_free(kmeans_workspace*);
+#endif
+
+/* the same for C callers, libkmeans built with the CUDA version
+   (cuda_libkmeans.cu) */
+#ifdef __cplusplus
+extern "C" {
+#endif
+float** libkmeans_cuda_run(kmeans_workspace*, float*, int, int, int, int, int,
+                           float*, int, float, int*, int*);
+void    libkmeans_cuda_release(kmeans_workspace*);
+#ifdef __cplusplus
+}
+#endif
+
+/* Input objects as one flat array: object i starts at objects + i*stride,
+   its numCoords coordinates are contiguous. file_load() maps binary files
+   read-only (no copy, the pages are shared with other jobs on the same
+   file) and parses text files into a malloc'd array, in parallel when
+   built with OpenMP. */
+typedef struct {
+    float  *objects;     /* [numObjs][stride] */
+    int     numObjs;
+    int     numCoords;
+    int     stride;      /* no. floats from one object to the next */
+    void   *map;         /* mmap'd file, NULL if objects is malloc'd */
+    size_t  mapLength;
+    size_t  fileSize;    /* bytes read, for the -o throughput */
+} kmeans_data;
+
+int     file_load(int, char*, kmeans_data*);
+void    file_unload(kmeans_data*);
+int     file_write(char*, int, int, int, float**, int*, int);
+int     file_write_centres(char*, int, int, float**, int);
+int     file_load_centres(int, char*, int, int, float*);
+int     file_load_membership(int, char*, int, int*);
+
+/* .membership written in pieces, for outputs that never are in memory */
+typedef struct {
+    int   fd;
+    int   isBinary;
+    long  numWritten;    /* no. objects so far */
+    char *buf;           /* text formatting buffers */
+} membership_file;
+
+int     membership_open(membership_file*, char*, long, int);
+int     membership_append(membership_file*, int, const int*);
+int     membership_close(membership_file*);
+
+
+/* NUMA placement of the objects (-N on omp_main, numa.c). KMEANS_NUMA_LOCAL
+   first-touches every object from the thread that assigns it in
+   omp_kmeans(); KMEANS_NUMA_INTERLEAVE spreads the pages over all nodes,
+   for runs whose threads do not stay put. Either copies the objects of
+   file_load() once, in parallel. */
+#define KMEANS_NUMA_OFF        0
+#define KMEANS_NUMA_LOCAL      1
+#define KMEANS_NUMA_INTERLEAVE 2
+
+/* binding of the OpenMP threads to cpus (-A): none, close (filling one
+   socket before the next) or spread (round-robin over the sockets) */
+#define KMEANS_BIND_NONE   0
+#define KMEANS_BIND_CLOSE  1
+#define KMEANS_BIND_SPREAD 2
+
+int         kmeans_numa_method(const char*);
+const char* kmeans_numa_name(int);
+int         kmeans_bind_method(const char*);
+const char* kmeans_bind_name(int);
+void*       kmeans_numa_malloc(int, int, size_t);
+int         kmeans_numa_place(int, kmeans_data*);
+int         kmeans_bind_threads(int);
+
+/* Per-iteration trace (-T on all drivers, trace.c). The kernels fill one
+   record per iteration while kmeans_tracing is set, so that untraced runs
+   pay for a single test per iteration. The phases are those of the
+   iteration: assign (the nearest centers, with the per-thread or per-block
+   sums), reduce (those sums, across threads, processes or devices) and
+   update (the new centers). */
+typedef struct {
+    int    iteration;
+    double start;        /* kmeans_trace_clock() */
+    double assign, reduce, update;  /* seconds */
+    long   delta;        /* objects that changed cluster, -1 if the
+                            iteration keeps no memberships (-m) */
+    long   distances;    /* distances evaluated */
+    double bytes;        /* object bytes read by the assignment */
+    double h2d, d2h;     /* bytes over the bus (CUDA), peer copies in d2h */
+} kmeans_trace_record;
+
+/* C linkage for nvcc too, so that libkmeans_cuda.a shares the OpenMP copy */
+#ifdef __cplusplus
+extern "C" {
+#endif
+extern int kmeans_tracing;
+
+int     kmeans_trace_open(const char*, const char*, int);
+double  kmeans_trace_clock(void);
+void    kmeans_trace_iteration(const kmeans_trace_record*);
+void    kmeans_trace_close(void);
+#ifdef __cplusplus
+}
+#endif
 
 double  wtime(void);
 
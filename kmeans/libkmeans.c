@@ -0,0 +1,171 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+/*   File:         libkmeans.c                                               */
+/*   Description:  contexts of libkmeans.h: the chosen backend and the       */
+/*                 workspace it runs on, kept between calls                  */
+/*                                                                           */
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>     /* memcpy() */
+#include <omp.h>
+
+#include "libkmeans.h"
+
+int _debug;             /* used by the backends */
+
+struct kmeans_context {
+    kmeans_params    params;
+    kmeans_workspace ws;        /* the backend's buffers */
+    float           *rows;      /* column-major input, transposed */
+    size_t           rowsSize;  /* bytes allocated to rows */
+    prune_stats     *prune;
+};
+
+/*----< kmeans_default_params() >--------------------------------------------*/
+void kmeans_default_params(kmeans_params *params)
+{
+    params->backend    = KMEANS_BACKEND_OMP;
+    params->numThreads = 0;
+    params->atomic     = 0;
+    params->prune      = KMEANS_FULL;
+    params->init       = KMEANS_SEED_FIRST;
+    params->precision  = KMEANS_FP32;
+    params->threshold  = 0.001;
+}
+
+/*----< kmeans_create() >----------------------------------------------------*/
+kmeans_context* kmeans_create(const kmeans_params *params)
+{
+    kmeans_context *ctx;
+
+    switch (params->backend) {
+        case KMEANS_BACKEND_SEQ:
+        case KMEANS_BACKEND_OMP:
+            break;
+#ifdef KMEANS_WITH_CUDA
+        case KMEANS_BACKEND_CUDA:
+            break;
+#endif
+        default:
+            return NULL;
+    }
+    if (params->threshold <= 0.0 ||
+        params->init < KMEANS_SEED_FIRST || params->init > KMEANS_SEED_GIVEN ||
+        params->prune < KMEANS_FULL || params->prune > KMEANS_HAMERLY ||
+        params->precision < KMEANS_FP32 || params->precision > KMEANS_BF16)
+        return NULL;
+    if (params->precision != KMEANS_FP32 &&
+        (params->backend == KMEANS_BACKEND_SEQ || params->prune != KMEANS_FULL))
+        return NULL;
+
+    ctx = (kmeans_context*) calloc(1, sizeof(kmeans_context));
+    assert(ctx != NULL);
+    ctx->params = *params;
+    ctx->prune  = (prune_stats*) malloc(sizeof(prune_stats));
+    assert(ctx->prune != NULL);
+
+    return ctx;
+}
+
+/*----< kmeans_run() >-------------------------------------------------------*/
+int kmeans_run(kmeans_context *ctx,
+               const float    *objects,     /* in: see layout */
+               int             layout,      /* KMEANS_ROW/COL_MAJOR */
+               int             ld,          /* leading dimension */
+               int             numObjs,
+               int             numCoords,
+               int             numClusters,
+               float          *centers,     /* out: [numClusters][numCoords] */
+               int            *membership,  /* out: [numObjs] */
+                                            /* both also in, to warm-start,
+                                               with KMEANS_SEED_GIVEN */
+               int            *loops)       /* out: no. iterations, or NULL */
+{
+    const kmeans_params *p = &ctx->params;
+    float  *rows = (float*) objects;
+    float **clusters = NULL;
+    int     stride = ld, loop_iterations = 0;
+
+    if (numObjs <= 0 || numCoords <= 0 || numClusters <= 1 ||
+        numClusters > numObjs)
+        return -1;
+    if (layout == KMEANS_ROW_MAJOR) {
+        if (ld < numCoords) return -1;
+    } else if (layout == KMEANS_COL_MAJOR) {
+        if (ld < numObjs) return -1;
+    } else {
+        return -1;
+    }
+
+    if (layout == KMEANS_COL_MAJOR) {
+        /* the backends read one object's coordinates at a time */
+        int    i;
+        size_t size = (size_t)numObjs * numCoords * sizeof(float);
+
+        if (size > ctx->rowsSize) {
+            free(ctx->rows);
+            ctx->rows = (float*) malloc(size);
+            assert(ctx->rows != NULL);
+            ctx->rowsSize = size;
+        }
+        rows   = ctx->rows;
+        stride = numCoords;
+#pragma omp parallel for schedule(static)
+        for (i=0; i<numObjs; i++) {
+            int j;
+            for (j=0; j<numCoords; j++)
+                rows[(size_t)i * numCoords + j] = objects[(size_t)j * ld + i];
+        }
+    }
+
+    ctx->prune->method = p->prune;
+    switch (p->backend) {
+        case KMEANS_BACKEND_SEQ:
+            clusters = seq_kmeans_ws(&ctx->ws, rows, stride, numCoords,
+                                     numObjs, numClusters, p->init, centers,
+                                     p->threshold, membership,
+                                     &loop_iterations, ctx->prune);
+            break;
+        case KMEANS_BACKEND_OMP: {
+            /* the caller's own default is put back afterwards */
+            int numThreads = omp_get_max_threads();
+
+            if (p->numThreads > 0) omp_set_num_threads(p->numThreads);
+            clusters = omp_kmeans_ws(&ctx->ws, p->atomic, rows, stride,
+                                     numCoords, numObjs, numClusters,
+                                     p->init, centers, p->precision,
+                                     p->threshold, membership, ctx->prune);
+            omp_set_num_threads(numThreads);
+            loop_iterations = ctx->prune->loops;
+            break;
+        }
+#ifdef KMEANS_WITH_CUDA
+        case KMEANS_BACKEND_CUDA:
+            clusters = libkmeans_cuda_run(&ctx->ws, rows, stride, numCoords,
+                                          numObjs, numClusters, p->init,
+                                          centers, p->precision, p->threshold,
+                                          membership, &loop_iterations);
+            break;
+#endif
+    }
+
+    memcpy(centers, clusters[0], (size_t)numClusters * numCoords *
+                                 sizeof(float));
+    if (loops != NULL) *loops = loop_iterations;
+    return 0;
+}
+
+/*----< kmeans_destroy() >---------------------------------------------------*/
+void kmeans_destroy(kmeans_context *ctx)
+{
+    if (ctx == NULL) return;
+#ifdef KMEANS_WITH_CUDA
+    if (ctx->params.backend == KMEANS_BACKEND_CUDA)
+        libkmeans_cuda_release(&ctx->ws);
+#endif
+    workspace_free(&ctx->ws);
+    free(ctx->rows);
+    free(ctx->prune);
+    free(ctx);
+}
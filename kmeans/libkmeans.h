@@ -0,0 +1,69 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+/*   File:         libkmeans.h                                               */
+/*   Description:  library interface to the k-means clustering (libkmeans.a, */
+/*                 libkmeans_cuda.a). A context owns every buffer of a call  */
+/*                 and keeps it for the next one, so a long-running program  */
+/*                 that clusters many inputs of similar size allocates only  */
+/*                 once.                                                     */
+/*                                                                           */
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef _H_LIBKMEANS
+#define _H_LIBKMEANS
+
+#include "kmeans.h"     /* KMEANS_FULL/ELKAN/HAMERLY, KMEANS_SEED_* */
+
+#define KMEANS_BACKEND_SEQ   0
+#define KMEANS_BACKEND_OMP   1
+#define KMEANS_BACKEND_CUDA  2  /* libkmeans_cuda.a only */
+
+/* layout of the objects given to kmeans_run(), ld >= the minor dimension */
+#define KMEANS_ROW_MAJOR     0  /* coordinate j of object i at [i*ld + j] */
+#define KMEANS_COL_MAJOR     1  /* at [j*ld + i] */
+
+typedef struct {
+    int    backend;      /* KMEANS_BACKEND_* */
+    int    numThreads;   /* omp: no. threads, 0 for the OpenMP default */
+    int    atomic;       /* omp: one shared accumulator (omp_main -a) */
+    int    prune;        /* seq, omp: KMEANS_FULL, _ELKAN or _HAMERLY */
+    int    init;         /* KMEANS_SEED_* */
+    int    precision;    /* omp, cuda: KMEANS_FP32, or _FP16 or _BF16
+                            copies of the objects (omp_main -P), not with
+                            prune */
+    float  threshold;    /* stop when fewer objects change membership */
+} kmeans_params;
+
+typedef struct kmeans_context kmeans_context;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* omp backend, no pruning, first objects as seeds, fp32, threshold 0.001 */
+void            kmeans_default_params(kmeans_params*);
+
+/* NULL if the backend is not built in or a parameter is out of range (or
+   precision is set with the seq backend or pruning). A context is used by
+   one thread at a time. */
+kmeans_context* kmeans_create(const kmeans_params*);
+
+/* cluster numObjs objects of numCoords coordinates into numClusters.
+   centers [numClusters][numCoords] and membership [numObjs] are outputs,
+   loops (may be NULL) gets the no. iterations. Returns 0, or -1 for bad
+   arguments.
+   With init KMEANS_SEED_GIVEN they are inputs too: the run starts from the
+   centers and memberships of an earlier one, so re-clustering after a few
+   objects were added (membership -1) or removed (dropped from objects and
+   membership alike) takes a few iterations instead of a full run. */
+int             kmeans_run(kmeans_context*, const float *objects, int layout,
+                           int ld, int numObjs, int numCoords,
+                           int numClusters, float *centers, int *membership,
+                           int *loops);
+
+void            kmeans_destroy(kmeans_context*);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,49 @@
+#!/bin/bash
+# vim:set ts=8 sw=4 sts=4 et:
+
+# Hybrid MPI + OpenMP scaling of mpi_main.
+#
+#   ./mpi_benchmark.sh [input.bin] [k] [cores]
+#
+# cores (default: this machine's) are split into processes x threads per
+# process, for 1, 2, 4, ... processes, each split running the same
+# clustering; the times
+# are compared with omp_main on all cores and with 1 x 1. To spread the
+# processes over several nodes set MPIRUN, e.g.
+#   MPIRUN="mpirun --hostfile nodes --map-by node" ./mpi_benchmark.sh
+# with cores the total over all nodes.
+
+set -e
+
+input=${1:-Image_data/color17695.bin}
+k=${2:-16}
+cores=${3:-$(nproc)}
+mpirun=${MPIRUN:-mpirun}
+
+make omp mpi
+
+echo "--------------------------------------------------------------------------------"
+uptime
+echo "input = ${input}  k = ${k}  cores = ${cores}"
+echo "--------------------------------------------------------------------------------"
+
+ompTime=$(./omp_main -o -p ${cores} -n $k -b -i ${input} | grep 'Computation' | awk '{print $4}')
+mv ${input}.cluster_centres ${input}-omp.cluster_centres
+mv ${input}.membership ${input}-omp.membership
+
+baseTime=$(OMP_NUM_THREADS=1 ${mpirun} -np 1 ./mpi_main -o -p 1 -n $k -b -i ${input} | grep 'Computation' | awk '{print $4}')
+
+for (( procs=1; procs<=cores; procs*=2 )); do
+    threads=$(( cores / procs ))
+    out=$(OMP_NUM_THREADS=${threads} ${mpirun} -np ${procs} ./mpi_main -o -p ${threads} -n $k -b -i ${input})
+    mpiTime=$(echo "${out}" | grep 'Computation' | awk '{print $4}')
+    reduceTime=$(echo "${out}" | grep 'Allreduce' | awk '{print $4}')
+    loops=$(echo "${out}" | grep 'Loop iterations' | awk '{print $4}')
+
+    # the last bits of the centers depend on the split (the sums are added
+    # up in another order), which on rare ties moves an object
+    diff -q ${input}-omp.membership ${input}.membership || true
+
+    speedup=$(echo "scale=1; ${baseTime} / ${mpiTime}" | bc)
+    echo "procs x threads = $(printf "%3d x %3d" ${procs} ${threads})  loops = ${loops}  mpiTime = ${mpiTime}s  allreduce = ${reduceTime}s  ompTime = ${ompTime}s  speedup = ${speedup}x"
+done
@@ -0,0 +1,195 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+/*   File:         mpi_io.c                                                  */
+/*   Description:  This program reads point data from a binary file, one     */
+/*                 slice of the objects per MPI process, and writes the      */
+/*                 cluster output of all processes to files                  */
+/*   Input file format:                                                      */
+/*                 binary file: first 4-byte integer is the number of data   */
+/*                 objects and 2nd integer is the no. of features (or        */
+/*                 coordinates) of each object                               */
+/*                                                                           */
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <mpi.h>
+
+#include "kmeans.h"
+#include "mpi_kmeans.h"
+
+/* no. memberships gathered at a time by the writing process */
+#define GATHER_CHUNK (1 << 20)
+
+/*---< mpi_slice_bounds() >-------------------------------------------------*/
+/* objects [*start, *start + *count) of numObjs belong to rank of nproc */
+void mpi_slice_bounds(int numObjs, int rank, int nproc, int *start,
+                      int *count)
+{
+    *start = (int)((long)numObjs * rank / nproc);
+    *count = (int)((long)numObjs * (rank + 1) / nproc) - *start;
+}
+
+/*---< mpi_read() >----------------------------------------------------------*/
+/* All processes of comm read the header, then each its own slice of the
+   objects with one collective read. Returns the malloc'd objects
+   [data->numObjs][numCoords] of this process, NULL on error (on all
+   processes). */
+float* mpi_read(char         *filename,  /* binary input file */
+                kmeans_slice *data,      /* out: this process's slice */
+                MPI_Comm      comm)
+{
+    MPI_File     fh;
+    MPI_Datatype objType;
+    MPI_Offset   offset;
+    int          rank, nproc, err, ok, header[2] = { 0, 0 };
+    float       *objects = NULL;
+
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &nproc);
+
+    err = MPI_File_open(comm, filename, MPI_MODE_RDONLY, MPI_INFO_NULL, &fh);
+    if (err != MPI_SUCCESS) {
+        if (rank == 0) fprintf(stderr, "Error: no such file (%s)\n", filename);
+        return NULL;
+    }
+
+    /* the header is read by all processes: a small read of the same block */
+    MPI_File_read_at_all(fh, 0, header, 2, MPI_INT, MPI_STATUS_IGNORE);
+    data->totalNumObjs = header[0];
+    data->numCoords    = header[1];
+    if (_debug && rank == 0) {
+        printf("File %s numObjs   = %d\n",filename,data->totalNumObjs);
+        printf("File %s numCoords = %d\n",filename,data->numCoords);
+    }
+
+    MPI_File_get_size(fh, &offset);
+    ok = data->totalNumObjs > 0 && data->numCoords > 0 &&
+         offset >= 2 * (MPI_Offset)sizeof(int) +
+                   (MPI_Offset)data->totalNumObjs * data->numCoords *
+                   sizeof(float);
+    if (!ok) {
+        if (rank == 0)
+            fprintf(stderr, "Error: %s is not a binary k-means file\n",
+                    filename);
+        MPI_File_close(&fh);
+        return NULL;
+    }
+    data->fileSize = offset;
+
+    mpi_slice_bounds(data->totalNumObjs, rank, nproc, &data->start,
+                     &data->numObjs);
+    objects = (float*) malloc(((size_t)data->numObjs * data->numCoords + 1) *
+                              sizeof(float));
+    assert(objects != NULL);
+
+    /* one element per object, so that the count stays an int */
+    MPI_Type_contiguous(data->numCoords, MPI_FLOAT, &objType);
+    MPI_Type_commit(&objType);
+    offset = 2 * sizeof(int) + (MPI_Offset)data->start * data->numCoords *
+                               sizeof(float);
+    err = MPI_File_read_at_all(fh, offset, objects, data->numObjs, objType,
+                               MPI_STATUS_IGNORE);
+    MPI_Type_free(&objType);
+    MPI_File_close(&fh);
+
+    ok = (err == MPI_SUCCESS);
+    MPI_Allreduce(MPI_IN_PLACE, &ok, 1, MPI_INT, MPI_LAND, comm);
+    if (!ok) {
+        if (rank == 0) fprintf(stderr, "Error: cannot read %s\n", filename);
+        free(objects);
+        return NULL;
+    }
+    return objects;
+}
+
+/*---< mpi_write_membership() >----------------------------------------------*/
+/* The .membership file of all processes, in the format of file_write():
+   process 0 writes its own memberships, then those of the others in rank
+   order, received GATHER_CHUNK at a time. Returns 0 on error. */
+int mpi_write_membership(char         *filename,    /* input file name */
+                         kmeans_slice *data,
+                         int          *membership,  /* [data->numObjs] */
+                         int           isBinaryOutput,
+                         MPI_Comm      comm)
+{
+    int rank, nproc, ok = 1;
+
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &nproc);
+
+    if (rank == 0) {
+        membership_file f;
+        int             p, *buf;
+
+        buf = (int*) malloc(GATHER_CHUNK * sizeof(int));
+        assert(buf != NULL);
+
+        ok = membership_open(&f, filename, data->totalNumObjs,
+                             isBinaryOutput);
+        if (ok) ok = membership_append(&f, data->numObjs, membership);
+        for (p=1; p<nproc; p++) {
+            int start, count, done;
+
+            mpi_slice_bounds(data->totalNumObjs, p, nproc, &start, &count);
+            for (done=0; done<count; done+=GATHER_CHUNK) {
+                int n = count - done < GATHER_CHUNK ? count - done
+                                                    : GATHER_CHUNK;
+                MPI_Recv(buf, n, MPI_INT, p, 0, comm, MPI_STATUS_IGNORE);
+                if (ok) ok = membership_append(&f, n, buf);
+            }
+        }
+        if (f.fd != -1) ok = membership_close(&f) && ok;
+        if (!ok)
+            fprintf(stderr, "Error: cannot write %s.membership\n", filename);
+        free(buf);
+    }
+    else {
+        int done;
+
+        for (done=0; done<data->numObjs; done+=GATHER_CHUNK) {
+            int n = data->numObjs - done < GATHER_CHUNK ? data->numObjs - done
+                                                        : GATHER_CHUNK;
+            MPI_Send(membership + done, n, MPI_INT, 0, 0, comm);
+        }
+    }
+
+    MPI_Bcast(&ok, 1, MPI_INT, 0, comm);
+    return ok;
+}
+
+/*---< mpi_read_membership() >-----------------------------------------------*/
+/* The memberships written by an earlier run (-M), read by process 0 with
+   file_load_membership() and scattered to the slices. Returns 0 on error
+   (on all processes). */
+int mpi_read_membership(char         *filename,    /* .membership file */
+                        kmeans_slice *data,
+                        int          *membership,  /* out: [data->numObjs] */
+                        int           isBinaryFile,
+                        MPI_Comm      comm)
+{
+    int  rank, nproc, p, ok = 1;
+    int *all = NULL, *counts = NULL, *starts = NULL;
+
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &nproc);
+
+    if (rank == 0) {
+        all    = (int*) malloc((size_t)data->totalNumObjs * sizeof(int));
+        counts = (int*) malloc(2 * nproc * sizeof(int));
+        assert(all != NULL && counts != NULL);
+        starts = counts + nproc;
+        for (p=0; p<nproc; p++)
+            mpi_slice_bounds(data->totalNumObjs, p, nproc, &starts[p],
+                             &counts[p]);
+        ok = file_load_membership(isBinaryFile, filename, data->totalNumObjs,
+                                  all);
+    }
+    MPI_Bcast(&ok, 1, MPI_INT, 0, comm);
+    if (ok)
+        MPI_Scatterv(all, counts, starts, MPI_INT, membership, data->numObjs,
+                     MPI_INT, 0, comm);
+
+    free(all);
+    free(counts);
+    return ok;
+}
@@ -0,0 +1,182 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+/*   File:         mpi_kmeans.c   (MPI + OpenMP version)                     */
+/*   Description:  Implementation of simple k-means clustering algorithm     */
+/*                 over the objects of all processes of an MPI communicator. */
+/*                 Each process assigns its own objects with the OpenMP      */
+/*                 loop of omp_kmeans.c; the sums and sizes of the new       */
+/*                 clusters and the no. changed memberships are then added   */
+/*                 up over all processes, so every process computes the same */
+/*                 new centers.                                              */
+/*                                                                           */
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <mpi.h>
+#include <omp.h>
+
+#include "kmeans.h"
+#include "mpi_kmeans.h"
+
+/* no two threads' accumulators share a line of this size */
+#define CACHE_LINE 64
+
+/*----< mpi_kmeans() >-------------------------------------------------------*/
+/* clusters[] hold the initial centers, the same on all processes, and
+   membership[] those of kmeans_start(). Returns the no. iterations; the
+   final centers are in clusters[] on every process. */
+int mpi_kmeans(float   *objects,       /* in: [numObjs][numCoords] */
+               int      numCoords,     /* no. coordinates */
+               int      numObjs,       /* no. objects of this process */
+               int      numClusters,   /* no. clusters */
+               float    threshold,     /* % objects change membership */
+               float  **clusters,      /* in/out: [numClusters][numCoords] */
+               int     *membership,    /* in/out: [numObjs] */
+               prune_stats *prune,     /* in/out: pruning, may be NULL */
+               double  *reduceTime,    /* out: seconds in MPI_Allreduce() */
+               MPI_Comm comm)
+{
+    int      i, loop=0, numLoops=0;
+    int      totalNumObjs;
+    int      delta;          /* no. objects that change their clusters */
+    int      magnitude = (int)(1.0 / threshold);
+    int      nthreads;
+    size_t   slotSize;       /* bytes per slot in local_slots */
+    char    *local_slots;    /* [nthreads][slotSize] */
+    float   *newClusters;    /* [numClusters*numCoords] sums, all processes */
+    int     *newClusterSize; /* [numClusters + 1]: sizes, then delta */
+    const dist_kernels *kernels = select_dist_kernels();
+    triangle_bounds *bounds = NULL;
+
+    MPI_Allreduce(&numObjs, &totalNumObjs, 1, MPI_INT, MPI_SUM, comm);
+    *reduceTime = 0.0;
+
+    /* one private accumulator per thread as in omp_kmeans_ws(): sums then
+       sizes, padded to whole cache lines */
+    nthreads = omp_get_max_threads();
+    slotSize = (size_t)numClusters * numCoords * sizeof(float) +
+               numClusters * sizeof(int);
+    slotSize = (slotSize + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+    local_slots = (char*) calloc(nthreads, slotSize);
+    newClusters    = (float*) malloc(numClusters * numCoords * sizeof(float));
+    newClusterSize = (int*)   malloc((numClusters + 1) * sizeof(int));
+    assert(local_slots != NULL && newClusters != NULL &&
+           newClusterSize != NULL);
+
+    if (prune != NULL) {
+        prune->loops = 0;
+        if (prune->method != KMEANS_FULL)
+            bounds = triangle_new(prune->method, kernels->euclid_dist_2,
+                                  objects, numCoords, numObjs, numCoords,
+                                  numClusters);
+    }
+
+    do {
+        double t;
+        kmeans_trace_record trace;
+
+        if (kmeans_tracing) trace.start = kmeans_trace_clock();
+        delta = 0;
+        if (bounds != NULL)
+            delta = triangle_assign(bounds, clusters, membership,
+                                    &prune->skipped[prune->loops]);
+        if (prune != NULL) prune->loops++;
+        numLoops++;
+
+#pragma omp parallel shared(objects,clusters,membership,local_slots)
+        {
+            int    j, index, tid = omp_get_thread_num();
+            int    numSlots = omp_get_num_threads();
+            float *sums  = (float*) (local_slots + tid * slotSize);
+            int   *sizes = (int*) (sums + numClusters * numCoords);
+
+#pragma omp for schedule(static) reduction(+:delta)
+            for (i=0; i<numObjs; i++) {
+                float *object = objects + (size_t)i * numCoords;
+
+                if (bounds != NULL) {
+                    /* already assigned by triangle_assign() */
+                    index = membership[i];
+                } else {
+                    index = kernels->find_nearest_cluster(numClusters,
+                                numCoords, object, clusters);
+                    if (membership[i] != index) delta += 1;
+                    membership[i] = index;
+                }
+
+                sizes[index]++;
+                for (j=0; j<numCoords; j++)
+                    sums[index * numCoords + j] += object[j];
+            }
+            /* implicit barrier: all slots are complete */
+#pragma omp master
+            if (kmeans_tracing)
+                trace.assign = kmeans_trace_clock() - trace.start;
+
+            /* the slots of this process, added in thread order */
+#pragma omp for schedule(static)
+            for (i=0; i<numClusters; i++) {
+                int size = 0;
+                for (j=0; j<numSlots; j++) {
+                    int *s = (int*) (local_slots + j * slotSize +
+                                     numClusters * numCoords * sizeof(float));
+                    size += s[i];
+                    s[i]  = 0;
+                }
+                newClusterSize[i] = size;
+            }
+#pragma omp for schedule(static)
+            for (i=0; i<numClusters*numCoords; i++) {
+                float sum = 0.0;
+                for (j=0; j<numSlots; j++) {
+                    float *s = (float*) (local_slots + j * slotSize);
+                    sum  += s[i];
+                    s[i]  = 0.0;
+                }
+                newClusters[i] = sum;
+            }
+        } /* end of #pragma omp parallel */
+
+        /* then over all processes: the sums, and the sizes with delta */
+        newClusterSize[numClusters] = delta;
+        t = MPI_Wtime();
+        MPI_Allreduce(MPI_IN_PLACE, newClusters, numClusters * numCoords,
+                      MPI_FLOAT, MPI_SUM, comm);
+        MPI_Allreduce(MPI_IN_PLACE, newClusterSize, numClusters + 1, MPI_INT,
+                      MPI_SUM, comm);
+        *reduceTime += MPI_Wtime() - t;
+        delta = newClusterSize[numClusters];
+        if (kmeans_tracing)
+            trace.reduce = kmeans_trace_clock() - trace.start - trace.assign;
+
+        /* average the sums into the new cluster centers */
+#pragma omp parallel for schedule(static)
+        for (i=0; i<numClusters*numCoords; i++) {
+            int cluster = i / numCoords;
+            if (newClusterSize[cluster] > 1)
+                clusters[cluster][i % numCoords] = newClusters[i] /
+                                                   newClusterSize[cluster];
+        }
+
+        if (kmeans_tracing) {
+            /* this process's objects; delta is over all of them */
+            trace.iteration = loop;
+            trace.update    = kmeans_trace_clock() - trace.start -
+                              trace.assign - trace.reduce;
+            trace.delta     = delta;
+            trace.distances = (long)numObjs * numClusters -
+                              (bounds != NULL ? prune->skipped[prune->loops-1] : 0);
+            trace.bytes     = (double)numObjs * numCoords * sizeof(float);
+            trace.h2d       = trace.d2h = 0.0;
+            kmeans_trace_iteration(&trace);
+        }
+
+    } while ((long)delta * magnitude > totalNumObjs && loop++ < 500);
+
+    if (bounds != NULL) triangle_free(bounds);
+    free(newClusterSize);
+    free(newClusters);
+    free(local_slots);
+
+    return numLoops;
+}
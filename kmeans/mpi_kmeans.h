@@ -0,0 +1,33 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+/*   File:         mpi_kmeans.h   (an MPI version)                           */
+/*   Description:  the MPI version (mpi_main): every process holds a slice   */
+/*                 of the objects and runs the OpenMP assignment on it; the  */
+/*                 new centers are summed over all processes each iteration  */
+/*                                                                           */
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef _H_MPI_KMEANS
+#define _H_MPI_KMEANS
+
+#include <mpi.h>
+
+#include "kmeans.h"
+
+/* the objects of one process: [start, start + numObjs) of the file */
+typedef struct {
+    int     totalNumObjs;  /* of all processes */
+    int     numCoords;
+    int     start;         /* index of the first object of this process */
+    int     numObjs;       /* no. objects of this process */
+    long    fileSize;      /* bytes of the input file */
+} kmeans_slice;
+
+void    mpi_slice_bounds(int, int, int, int*, int*);
+float*  mpi_read(char*, kmeans_slice*, MPI_Comm);
+int     mpi_read_membership(char*, kmeans_slice*, int*, int, MPI_Comm);
+int     mpi_write_membership(char*, kmeans_slice*, int*, int, MPI_Comm);
+
+int     mpi_kmeans(float*, int, int, int, float, float**, int*, prune_stats*,
+                   double*, MPI_Comm);
+
+#endif
@@ -0,0 +1,321 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+/*   File:         mpi_main.c   (an MPI + OpenMP version)                    */
+/*   Description:  This program shows an example on how to call a subroutine */
+/*                 that implements a simple k-means clustering algorithm     */
+/*                 based on Euclid distance, over several processes (nodes)  */
+/*                 each holding a slice of the data objects.                 */
+/*   Input file format:                                                      */
+/*                 binary file: first 4-byte integer is the number of data   */
+/*                 objects and 2nd integer is the no. of features (or        */
+/*                 coordinates) of each object                               */
+/*                                                                           */
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>     /* strtok() */
+#include <unistd.h>     /* getopt() */
+
+#include <mpi.h>
+#include <omp.h>
+int      _debug;
+#include "kmeans.h"
+#include "mpi_kmeans.h"
+
+/*---< usage() >------------------------------------------------------------*/
+static void usage(char *argv0, float threshold, int rank) {
+    char *help =
+        "Usage: %s [switches] -i filename -n num_clusters\n"
+        "       -i filename    : binary file containing data to be clustered,\n"
+        "                        each process reads its own slice\n"
+        "       -b             : input file is in binary format (the only one\n"
+        "                        supported)\n"
+        "       -n num_clusters: number of clusters (K must > 1)\n"
+        "       -t threshold   : threshold value (default %.4f)\n"
+        "       -p nproc       : number of threads per process (default\n"
+        "                        system allocated)\n"
+        "       -s seeding     : initial centers: first (default), plusplus\n"
+        "                        (k-means++) or parallel (k-means||), from the\n"
+        "                        objects of process 0\n"
+        "       -c centres_file: warm start from the centers of an earlier run\n"
+        "       -M member_file : and its memberships (objects past its end\n"
+        "                        are new); both in the format of -B\n"
+        "       -e             : Elkan triangle-inequality pruning\n"
+        "       -H             : Hamerly triangle-inequality pruning\n"
+        "       -B             : write binary output files (default no)\n"
+        "       -o             : output timing results (default no)\n"
+        "       -T trace_file  : per-iteration trace as JSON lines, or as a\n"
+        "                        Chrome trace if the name ends in .json\n"
+        "       -C             : add the hardware counters to the trace\n"
+        "       -d             : enable debug mode\n";
+    if (rank == 0) fprintf(stderr, help, argv0, threshold);
+    MPI_Finalize();
+    exit(-1);
+}
+
+/*---< main() >-------------------------------------------------------------*/
+int main(int argc, char **argv) {
+           int     opt;
+    extern char   *optarg;
+    extern int     optind;
+           int     i, nthreads, loop_iterations, ok;
+           int     rank, nproc, provided;
+           int     isBinaryFile, isBinaryOutput, is_output_timing;
+           int     init;          /* KMEANS_SEED_* */
+
+           int     numClusters, numCoords, numObjs;
+           int    *membership;    /* [numObjs] of this process */
+           char   *filename;
+           char   *centresFile, *membershipFile;  /* -c, -M */
+           char   *traceFile;     /* -T */
+           int     traceCounters; /* -C */
+           float  *centers;       /* [numClusters][numCoords], from -c */
+           float  *objects;       /* [numObjs][numCoords] of this process */
+           kmeans_slice data;
+           float **clusters;      /* [numClusters][numCoords] cluster center */
+           float   threshold;
+           double  timing, io_timing, read_timing, write_timing;
+           double  clustering_timing, reduce_timing;
+           prune_stats prune;
+
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &nproc);
+
+    /* some default values */
+    _debug            = 0;
+    nthreads          = 0;
+    threshold         = 0.001;
+    numClusters       = 0;
+    isBinaryFile      = 0;
+    isBinaryOutput    = 0;
+    is_output_timing  = 0;
+    filename          = NULL;
+    centresFile       = NULL;
+    membershipFile    = NULL;
+    traceFile         = NULL;
+    traceCounters     = 0;
+    centers           = NULL;
+    prune.method      = KMEANS_FULL;
+    init              = KMEANS_SEED_FIRST;
+
+    while ( (opt=getopt(argc,argv,"p:i:n:s:t:c:M:T:bBCdeHo"))!= EOF) {
+        switch (opt) {
+            case 'i': filename=optarg;
+                      break;
+            case 'b': isBinaryFile = 1;
+                      break;
+            case 'B': isBinaryOutput = 1;
+                      break;
+            case 't': threshold=atof(optarg);
+                      break;
+            case 'n': numClusters = atoi(optarg);
+                      break;
+            case 'p': nthreads = atoi(optarg);
+                      break;
+            case 's': init = kmeans_seed_method(optarg);
+                      if (init < 0) usage(argv[0], threshold, rank);
+                      break;
+            case 'c': centresFile = optarg;
+                      break;
+            case 'M': membershipFile = optarg;
+                      break;
+            case 'e': prune.method = KMEANS_ELKAN;
+                      break;
+            case 'H': prune.method = KMEANS_HAMERLY;
+                      break;
+            case 'T': traceFile = optarg;
+                      break;
+            case 'C': traceCounters = 1;
+                      break;
+            case 'o': is_output_timing = 1;
+                      break;
+            case 'd': _debug = 1;
+                      break;
+            case '?': usage(argv[0], threshold, rank);
+                      break;
+            default: usage(argv[0], threshold, rank);
+                      break;
+        }
+    }
+
+    if (filename == 0 || numClusters <= 1) usage(argv[0], threshold, rank);
+    if (!isBinaryFile) {
+        if (rank == 0)
+            fprintf(stderr, "Error: mpi_main needs a binary input file (-b)\n");
+        usage(argv[0], threshold, rank);
+    }
+    if (membershipFile != NULL && centresFile == NULL)
+        usage(argv[0], threshold, rank);
+    if (centresFile != NULL) init = KMEANS_SEED_GIVEN;
+
+    /* set the no. threads per process if specified in command line, else
+       use all threads allocated by run-time system */
+    if (nthreads > 0)
+        omp_set_num_threads(nthreads);
+
+    /* process 0 traces its own iterations (and the counters of its own
+       threads); the others run untraced */
+    ok = 1;
+    if (rank == 0 && traceFile != NULL)
+        ok = kmeans_trace_open(traceFile, "mpi", traceCounters);
+    MPI_Bcast(&ok, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    if (!ok) {
+        MPI_Finalize();
+        exit(1);
+    }
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    io_timing = MPI_Wtime();
+
+    /* read data points from file, each process its own slice --------------*/
+    objects = mpi_read(filename, &data, MPI_COMM_WORLD);
+    if (objects == NULL) {
+        MPI_Finalize();
+        exit(1);
+    }
+    numObjs   = data.numObjs;
+    numCoords = data.numCoords;
+
+    /* membership: the cluster id for each data object */
+    membership = (int*) malloc((numObjs + 1) * sizeof(int));
+    assert(membership != NULL);
+    malloc2D(clusters, numClusters, numCoords, float);
+
+    /* the initial centers, chosen by process 0 and sent to all ------------*/
+    ok = 1;
+    if (centresFile != NULL) {
+        centers = (float*) malloc(numClusters * numCoords * sizeof(float));
+        assert(centers != NULL);
+        if (rank == 0)
+            ok = file_load_centres(isBinaryOutput, centresFile, numClusters,
+                                   numCoords, centers);
+        MPI_Bcast(&ok, 1, MPI_INT, 0, MPI_COMM_WORLD);
+        if (ok)
+            MPI_Bcast(centers, numClusters * numCoords, MPI_FLOAT, 0,
+                      MPI_COMM_WORLD);
+        if (ok && membershipFile != NULL)
+            ok = mpi_read_membership(membershipFile, &data, membership,
+                                     isBinaryOutput, MPI_COMM_WORLD);
+        else if (ok)
+            for (i=0; i<numObjs; i++) membership[i] = -1;
+    }
+    else {
+        /* the first objects of the file, or k-means++/k-means|| on them */
+        if (rank == 0) {
+            ok = numObjs >= numClusters;
+            if (!ok)
+                fprintf(stderr, "Error: process 0 has %d objects, fewer than %d clusters\n",
+                        numObjs, numClusters);
+            else
+                kmeans_seed_host(init, select_dist_kernels()->euclid_dist_2,
+                                 objects, numCoords, numObjs, numCoords,
+                                 numClusters, clusters);
+        }
+        MPI_Bcast(&ok, 1, MPI_INT, 0, MPI_COMM_WORLD);
+        if (ok)
+            MPI_Bcast(clusters[0], numClusters * numCoords, MPI_FLOAT, 0,
+                      MPI_COMM_WORLD);
+    }
+    if (!ok) {
+        MPI_Finalize();
+        exit(1);
+    }
+    kmeans_start(init, centers, numObjs, numCoords, numClusters, clusters,
+                 membership);
+    free(centers);
+
+    timing            = MPI_Wtime();
+    io_timing         = timing - io_timing;
+    read_timing       = io_timing;
+    clustering_timing = timing;
+
+    /* start the core computation -------------------------------------------*/
+    loop_iterations = mpi_kmeans(objects, numCoords, numObjs, numClusters,
+                                 threshold, clusters, membership, &prune,
+                                 &reduce_timing, MPI_COMM_WORLD);
+    kmeans_trace_close();
+
+    free(objects);
+
+    timing            = MPI_Wtime();
+    clustering_timing = timing - clustering_timing;
+
+    /* output: the coordinates of the cluster centres ----------------------*/
+    ok = 1;
+    if (rank == 0)
+        ok = file_write_centres(filename, numClusters, numCoords, clusters,
+                                isBinaryOutput);
+    MPI_Bcast(&ok, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    if (ok)
+        mpi_write_membership(filename, &data, membership, isBinaryOutput,
+                             MPI_COMM_WORLD);
+
+    free(membership);
+    free(clusters[0]);
+    free(clusters);
+
+    write_timing = MPI_Wtime() - timing;
+    io_timing   += write_timing;
+
+    /*---- output performance numbers ---------------------------------------*/
+    if (is_output_timing) {
+        double max_reduce_timing;
+        long   total = 0;
+
+        /* the process that waited longest: communication plus the load
+           imbalance between the slices */
+        MPI_Reduce(&reduce_timing, &max_reduce_timing, 1, MPI_DOUBLE, MPI_MAX,
+                   0, MPI_COMM_WORLD);
+        if (prune.method != KMEANS_FULL)
+            MPI_Reduce(rank == 0 ? MPI_IN_PLACE : prune.skipped,
+                       prune.skipped, prune.loops, MPI_LONG, MPI_SUM, 0,
+                       MPI_COMM_WORLD);
+
+        if (rank == 0) {
+            numObjs = data.totalNumObjs;
+
+            printf("\nPerforming **** Regular Kmeans  (MPI + OpenMP) ----");
+            printf(" using array reduction ******\n");
+
+            printf("Number of processes = %d\n", nproc);
+            printf("Number of threads   = %d per process\n",
+                   omp_get_max_threads());
+            printf("SIMD kernels      = %s\n", select_dist_kernels()->isa);
+            printf("Input file:     %s\n", filename);
+            printf("numObjs       = %d\n", numObjs);
+            printf("numCoords     = %d\n", numCoords);
+            printf("numClusters   = %d\n", numClusters);
+            printf("threshold     = %.4f\n", threshold);
+
+            printf("Seeding            = %s\n", kmeans_seed_name(init));
+            printf("Loop iterations    = %d\n", loop_iterations);
+
+            printf("I/O time           = %10.4f sec\n", io_timing);
+            printf("Input read         = %10.4f sec (%.1f MB/s MPI-IO)\n",
+                   read_timing, data.fileSize / 1048576.0 / read_timing);
+            printf("Output write       = %10.4f sec%s\n", write_timing,
+                   isBinaryOutput ? " (binary)" : "");
+            printf("Computation timing = %10.4f sec\n", clustering_timing);
+            printf("Allreduce timing   = %10.4f sec (most of any process)\n",
+                   max_reduce_timing);
+
+            if (prune.method != KMEANS_FULL) {
+                printf("Pruning            = %s\n",
+                       prune.method == KMEANS_ELKAN ? "Elkan" : "Hamerly");
+                for (i=0; i<prune.loops; i++) {
+                    printf("  iteration %3d: skipped %12ld of %12ld distances (%5.1f%%)\n",
+                           i, prune.skipped[i], (long)numObjs * numClusters,
+                           100.0 * prune.skipped[i] / ((double)numObjs * numClusters));
+                    total += prune.skipped[i];
+                }
+                printf("Skipped distances  = %ld of %ld (%5.1f%%)\n", total,
+                       (long)numObjs * numClusters * prune.loops,
+                       100.0 * total / ((double)numObjs * numClusters * prune.loops));
+            }
+        }
+    }
+
+    MPI_Finalize();
+    return(0);
+}
@@ -0,0 +1,227 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+/*   File:         numa.c  (OpenMP version)                                  */
+/*   Description:  page placement of the objects on multi-socket hosts (-N   */
+/*                 on omp_main) and binding of the OpenMP threads to cpus    */
+/*                 (-A). Linux only: mbind() and sched_setaffinity() are     */
+/*                 called directly, so no libnuma is needed.                 */
+/*                                                                           */
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#define _GNU_SOURCE     /* CPU_SET(), sched_setaffinity() */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>     /* strcmp(), memcpy() */
+#include <sched.h>
+#include <unistd.h>     /* sysconf(), syscall() */
+#include <sys/syscall.h>
+#include <omp.h>
+
+#include "kmeans.h"
+
+#define MPOL_INTERLEAVE_ 3      /* <numaif.h> MPOL_INTERLEAVE */
+#define NUMA_MAX_NODES   1024   /* bits of the node mask */
+
+/*----< kmeans_numa_method() >-----------------------------------------------*/
+/* -N argument to KMEANS_NUMA_*, -1 if unknown */
+int kmeans_numa_method(const char *name)
+{
+    if (strcmp(name, "off")        == 0) return KMEANS_NUMA_OFF;
+    if (strcmp(name, "local")      == 0) return KMEANS_NUMA_LOCAL;
+    if (strcmp(name, "interleave") == 0) return KMEANS_NUMA_INTERLEAVE;
+    return -1;
+}
+
+const char* kmeans_numa_name(int placement)
+{
+    switch (placement) {
+        case KMEANS_NUMA_LOCAL:      return "local";
+        case KMEANS_NUMA_INTERLEAVE: return "interleave";
+        default:                     return "off";
+    }
+}
+
+/* -A argument to KMEANS_BIND_*, -1 if unknown */
+int kmeans_bind_method(const char *name)
+{
+    if (strcmp(name, "none")   == 0) return KMEANS_BIND_NONE;
+    if (strcmp(name, "close")  == 0) return KMEANS_BIND_CLOSE;
+    if (strcmp(name, "spread") == 0) return KMEANS_BIND_SPREAD;
+    return -1;
+}
+
+const char* kmeans_bind_name(int binding)
+{
+    switch (binding) {
+        case KMEANS_BIND_CLOSE:  return "close";
+        case KMEANS_BIND_SPREAD: return "spread";
+        default:                 return "none";
+    }
+}
+
+/*----< numa_alloc() >-------------------------------------------------------*/
+/* page aligned and untouched, so the first write places each page; with
+   KMEANS_NUMA_INTERLEAVE the pages go round-robin over the nodes instead */
+static void* numa_alloc(int placement, size_t bytes)
+{
+    static int    warned = 0;
+    size_t        page   = (size_t) sysconf(_SC_PAGESIZE);
+    void         *p;
+    unsigned long mask[NUMA_MAX_NODES / (8 * sizeof(unsigned long))];
+
+    bytes = (bytes + page - 1) / page * page;
+    if (bytes == 0) bytes = page;
+    if (posix_memalign(&p, page, bytes) != 0) return NULL;
+
+    if (placement == KMEANS_NUMA_INTERLEAVE) {
+        /* every node: the kernel keeps those the process may use */
+        memset(mask, 0xff, sizeof(mask));
+        if (syscall(SYS_mbind, p, bytes, MPOL_INTERLEAVE_, mask,
+                    (unsigned long)NUMA_MAX_NODES, 0) != 0 && !warned) {
+            perror("Warning: mbind(MPOL_INTERLEAVE), pages placed locally");
+            warned = 1;
+        }
+    }
+    return p;
+}
+
+/*----< kmeans_numa_malloc() >-----------------------------------------------*/
+/* numObjs elements of size bytes, zeroed in parallel with the same static
+   partitioning as the loop over the objects in omp_kmeans(), so that the
+   pages of a thread's objects are on its own node. Release with free(). */
+void* kmeans_numa_malloc(int placement, int numObjs, size_t size)
+{
+    char *p;
+    int   i;
+
+    if (placement == KMEANS_NUMA_OFF)
+        return calloc(numObjs, size);
+
+    p = (char*) numa_alloc(placement, (size_t)numObjs * size);
+    if (p == NULL) return NULL;
+
+#pragma omp parallel for schedule(static)
+    for (i=0; i<numObjs; i++)
+        memset(p + (size_t)i * size, 0, size);
+    return p;
+}
+
+/*----< kmeans_numa_place() >------------------------------------------------*/
+/* Copy the objects of a file_load() into pages placed as above: a thread
+   of the static schedule in omp_kmeans() copies, and so first touches,
+   the same objects it later assigns. The mapping or the parsed array is
+   released; file_unload() frees the copy. Binary inputs are otherwise
+   read from the page cache, wherever the file was read in. Returns 0 if
+   there is no memory (the objects are left as they were). */
+int kmeans_numa_place(int placement, kmeans_data *data)
+{
+    float *objects;
+    int    i;
+
+    if (placement == KMEANS_NUMA_OFF) return 1;
+
+    objects = (float*) numa_alloc(placement, (size_t)data->numObjs *
+                                  data->numCoords * sizeof(float));
+    if (objects == NULL) return 0;
+
+#pragma omp parallel for schedule(static)
+    for (i=0; i<data->numObjs; i++)
+        memcpy(objects + (size_t)i * data->numCoords,
+               data->objects + (size_t)i * data->stride,
+               data->numCoords * sizeof(float));
+
+    file_unload(data);
+    data->objects = objects;
+    data->stride  = data->numCoords;
+    return 1;
+}
+
+/*----< cpu_order() >--------------------------------------------------------*/
+/* the cpus this process may run on, grouped by socket (close) or taking
+   one of every socket in turn (spread); returns their number */
+static int cpu_order(int binding, int *order)
+{
+    cpu_set_t allowed;
+    int      *cpus, *package, *taken;
+    int       numCpus = 0, numPackages = 0, i, j, n;
+    char      path[128];
+    FILE     *f;
+
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) return 0;
+
+    cpus    = (int*) malloc(CPU_SETSIZE * sizeof(int));
+    package = (int*) malloc(CPU_SETSIZE * sizeof(int));
+    taken   = (int*) calloc(CPU_SETSIZE, sizeof(int));
+    assert(cpus != NULL && package != NULL && taken != NULL);
+
+    for (i=0; i<CPU_SETSIZE; i++) {
+        if (!CPU_ISSET(i, &allowed)) continue;
+        snprintf(path, sizeof(path),
+                 "/sys/devices/system/cpu/cpu%d/topology/physical_package_id",
+                 i);
+        package[numCpus] = 0;
+        if ((f = fopen(path, "r")) != NULL) {
+            if (fscanf(f, "%d", &package[numCpus]) != 1 ||
+                package[numCpus] < 0)
+                package[numCpus] = 0;
+            fclose(f);
+        }
+        if (package[numCpus] + 1 > numPackages)
+            numPackages = package[numCpus] + 1;
+        cpus[numCpus++] = i;
+    }
+
+    /* close: socket by socket; spread: round i takes the next cpu of
+       every socket that has one left */
+    n = 0;
+    if (binding == KMEANS_BIND_CLOSE) {
+        for (j=0; j<numPackages; j++)
+            for (i=0; i<numCpus; i++)
+                if (package[i] == j) order[n++] = cpus[i];
+    } else {
+        while (n < numCpus)
+            for (j=0; j<numPackages; j++)
+                for (i=0; i<numCpus; i++)
+                    if (package[i] == j && !taken[i]) {
+                        taken[i]   = 1;
+                        order[n++] = cpus[i];
+                        break;
+                    }
+    }
+
+    free(cpus);
+    free(package);
+    free(taken);
+    return n;
+}
+
+/*----< kmeans_bind_threads() >----------------------------------------------*/
+/* Pin thread t of a team of the current omp_get_max_threads() size to the
+   t-th cpu of the order above (wrapping round when there are more threads
+   than cpus). The OpenMP run-time keeps these threads for later parallel
+   regions of the same size, which is all omp_main runs, so call it after
+   omp_set_num_threads() and before the first parallel region that
+   matters. Returns the no. threads pinned, 0 on failure. */
+int kmeans_bind_threads(int binding)
+{
+    int *order, numCpus, numBound = 0;
+
+    if (binding == KMEANS_BIND_NONE) return 0;
+
+    order = (int*) malloc(CPU_SETSIZE * sizeof(int));
+    assert(order != NULL);
+    numCpus = cpu_order(binding, order);
+
+    if (numCpus > 0) {
+#pragma omp parallel reduction(+:numBound)
+        {
+            cpu_set_t cpu;
+
+            CPU_ZERO(&cpu);
+            CPU_SET(order[omp_get_thread_num() % numCpus], &cpu);
+            if (sched_setaffinity(0, sizeof(cpu), &cpu) == 0)
+                numBound++;
+        }
+    }
+    free(order);
+    return numBound;
+}
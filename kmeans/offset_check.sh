@@ -0,0 +1,63 @@
+#!/bin/bash
+# vim:set ts=8 sw=4 sts=4 et:
+
+# Regression run of the assignment by matrix product (gemm_assign.cpp and
+# find_nearest_cluster_gemm) on objects far from the origin, where
+# |c|^2 - 2 x.c would cancel: 64 coordinates and 64 or 128 clusters, so
+# K x D is past KMEANS_GEMM_MIN_KD. omp_main, and cuda_main if it is built,
+# must converge like seq_main and agree with it but for near ties, which
+# the float sums of the centers settle in any order (at most one object in
+# a hundred; the raw expansion lost over one in ten at offset 1000).
+#
+#   ./offset_check.sh [numObjs]
+
+set -e
+
+numObjs=${1:-20000}
+numCoords=64
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+
+make seq omp
+
+programs="omp_main"
+if [ -x ./cuda_main ]; then programs="$programs cuda_main"; fi
+
+status=0
+for offset in 0 1000 10000; do
+    input=$dir/offset$offset.txt
+
+    # 64 Gaussian clusters of deviation 3 around centers in [-10, 10)^64,
+    # all shifted by offset
+    awk -v n=$numObjs -v d=$numCoords -v off=$offset 'BEGIN {
+        srand(7)
+        for (k = 0; k < 64; k++)
+            for (j = 0; j < d; j++) c[k, j] = 20 * rand() - 10
+        for (i = 0; i < n; i++) {
+            k = int(64 * rand())
+            line = i
+            for (j = 0; j < d; j++) {
+                g = sqrt(-2 * log(1 - rand())) * cos(6.28318530718 * rand())
+                line = line sprintf(" %f", c[k, j] + 3 * g + off)
+            }
+            print line
+        }
+    }' > $input
+
+    for k in 64 128; do
+        seqLoops=$(./seq_main -o -n $k -i $input | grep 'Loop' | awk '{print $4}')
+        mv $input.membership $dir/seq.membership
+
+        for p in $programs; do
+            loops=$(./$p -o -n $k -i $input | grep 'Loop' | awk '{print $4}')
+            differ=$(paste $dir/seq.membership $input.membership | awk '$2 != $4' | wc -l)
+            result=ok
+            if [ $loops -gt 500 ] || [ $((differ * 100)) -gt $numObjs ]; then
+                result=FAILED
+                status=1
+            fi
+            echo "offset = $(printf "%5d" $offset)  k = $(printf "%3d" $k)  $p: loops = $loops (seq_main $seqLoops)  memberships differing = $differ  $result"
+        done
+    done
+done
+exit $status
@@ -24,221 +24,386 @@
 #include <inttypes.h>
 
 #include <omp.h>
-#include <pmmintrin.h>
 
 #include "kmeans.h"
 
-
-/*----< euclid_dist_2() >----------------------------------------------------*/
-/* square of Euclid distance between two multi-dimensional points            */
-  __inline static
-float euclid_dist_2(int    numdims,  /* no. dimensions */
-    float *coord1,   /* [numdims] */
-    float *coord2)   /* [numdims] */
-{
-  int i,j;
-  float c1 = 0, c2 = 0,c3 = 0 ,c4 = 0;
-  float ans = 0;
-
-  // loop unrolling
-  for (i = 0; i <numdims; i+=4) {
-    c1 += (coord1[i] - coord2[i]) * (coord1[i] - coord2[i]);
-    c2 += (coord1[i+1] - coord2[i+1]) * (coord1[i+1] - coord2[i+1]);
-    c3 += (coord1[i+2] - coord2[i+2]) * (coord1[i+2] - coord2[i+2]);
-    c4 += (coord1[i+3] - coord2[i+3]) * (coord1[i+3] - coord2[i+3]);
-  }
-  ans = c1 + c2 + c3 + c4;
-  return ans;
-}
-
-/*----< find_nearest_cluster() >---------------------------------------------*/
-  __inline static
-int find_nearest_cluster(int     numClusters, /* no. clusters */
-    int     numCoords,   /* no. coordinates */
-    float  *object,      /* [numCoords] */
-    float **clusters)    /* [numClusters][numCoords] */
+/* no two threads' accumulators share a line of this size */
+#define CACHE_LINE 64
+
+/* workspace slots */
+#define WS_CLUSTERS      0     /* [numClusters][numCoords] */
+#define WS_CLUSTER_ROWS  1     /* [numClusters] */
+#define WS_SIZES         2     /* [numClusters] */
+#define WS_LOCAL         3     /* [nslots][slotSize] */
+#define WS_LOCAL_ROWS    4     /* [2][nslots] */
+#define WS_PACKED        5     /* [numObjs][numCoords], 16-bit */
+#define WS_OBJECT_ROWS   6     /* [nthreads][rowSize] */
+#define WS_BLOCKED       7     /* [numBlocks][numCoords][KMEANS_BLOCK] */
+#define WS_GEMM_BUFFERS  8     /* [nthreads][gemm_buffer_size()] */
+
+/* the blocked layout pays off while an object fills few SIMD lanes; wider
+   objects keep the one-object kernels, which read them where they are */
+#define BLOCK_MAX_COORDS 64
+
+
+/*----< block_objects() >----------------------------------------------------*/
+/* Copy the objects into the blocked (AoSoA) layout: block b holds objects
+   b*KMEANS_BLOCK.. as numCoords rows of KMEANS_BLOCK floats, coordinate j
+   of all of them in row j, so that one aligned load fetches it for a whole
+   register of objects. The lanes past the last object are 0. The blocks
+   are written with the static schedule of the assignment loop, which so
+   first-touches its own. */
+static void block_objects(const float *objects,   /* [numObjs][stride] */
+                          int          stride,
+                          int          numCoords,
+                          int          numObjs,
+                          float       *blocked)   /* out */
 {
-  int   index, i;
-  float dist, min_dist;
-
-  /* find the cluster id that has min distance to object */
-  index    = 0;
-  min_dist = euclid_dist_2(numCoords, object, clusters[0]);
-
-  for (i=1; i<numClusters; i++) {
-    dist = euclid_dist_2(numCoords, object, clusters[i]);
-    /* no need square root */
-    if (dist < min_dist) { /* find the min and its array index */
-      min_dist = dist;
-      index    = i;
+  int b, numBlocks = (numObjs + KMEANS_BLOCK - 1) / KMEANS_BLOCK;
+
+#pragma omp parallel for schedule(static)
+  for (b=0; b<numBlocks; b++) {
+    float *block = blocked + (size_t)b * numCoords * KMEANS_BLOCK;
+    int    i, j, k;
+
+    for (k=0; k<KMEANS_BLOCK; k++) {
+      i = b * KMEANS_BLOCK + k;
+      for (j=0; j<numCoords; j++)
+        block[j * KMEANS_BLOCK + k] = i < numObjs ?
+                                      objects[(size_t)i * stride + j] : 0.0f;
     }
   }
-  return(index);
 }
 
-
 /*----< kmeans_clustering() >------------------------------------------------*/
-/* return an array of cluster centers of size [numClusters][numCoords]       */
-float** omp_kmeans(int     is_perform_atomic, /* in: */
-    float **objects,           /* in: [numObjs][numCoords] */
+/* return an array of cluster centers of size [numClusters][numCoords],
+   which belongs to ws                                                       */
+float** omp_kmeans_ws(kmeans_workspace *ws, /* in/out: buffers */
+    int     is_perform_atomic, /* in: */
+    float  *objects,           /* in: [numObjs][stride] */
+    int     stride,            /* no. floats between objects */
     int     numCoords,         /* no. coordinates */
     int     numObjs,           /* no. objects */
     int     numClusters,       /* no. clusters */
+    int     init,              /* KMEANS_SEED_* */
+    float  *centers,           /* in: [numClusters][numCoords], for
+                                  KMEANS_SEED_GIVEN, else unused */
+    int     precision,         /* KMEANS_FP*: objects as read by the
+                                  iterations, FP32 with pruning */
     float   threshold,         /* % objects change membership */
-    int    *membership)        /* out: [numObjs] */
+    int    *membership,        /* in/out: [numObjs], see KMEANS_SEED_GIVEN */
+    prune_stats *prune)        /* in/out: pruning, may be NULL */
 {
 
 
 
-  int      i, j, k, index, loop=0;
+  int      i, j, index, loop=0;
   int     *newClusterSize; /* [numClusters]: no. objects assigned in each
                               new cluster */
   int     delta;          /* % of objects change their clusters */
   int     magnitude = (int)(1.0 / threshold);
-  int     threshold_int = numObjs;
   float  **clusters;       /* out: [numClusters][numCoords] */
-  float  **newClusters;    /* [numClusters][numCoords] */
   double   timing;
 
   int      nthreads;             /* no. threads */
-  int    **local_newClusterSize; /* [nthreads][numClusters] */
-  float ***local_newClusters;    /* [nthreads][numClusters][numCoords] */
-  int isMultOf4 = 1;
-
-  int mask4 = 0x3;
-  // if numCoords is not multiple of 4, then re-arrange the arrage so that
-  // numCoords is multiple of 4. This makes sure that data is aligned.
-  // I find that in this case, loop unrolling can achieve the best performance.
-  if ((numCoords & mask4) > 0) {
-    isMultOf4 = 0;
-    int newNumCoords = numCoords + 4 - (numCoords & mask4);
-    float **newObjects = (float **)malloc(numObjs * sizeof(float*));
-    assert(newObjects != NULL);
-    newObjects[0] = (float *)calloc(numObjs * newNumCoords, sizeof(float));
-    assert(newObjects[0] != NULL);
-    memcpy(newObjects[0], objects[0], numCoords * sizeof(float));
-    for (i = 1; i < numObjs; i++) {
-      newObjects[i] = newObjects[i-1] + newNumCoords;
-      memcpy(newObjects[i], objects[i], numCoords * sizeof(float));
-    }
-
-    // override
-    numCoords = newNumCoords;
-    objects = newObjects;
-  }
-
+  int      nslots;               /* no. accumulators: nthreads, or 1 when
+                                    all threads update it atomically */
+  size_t   slotSize;             /* bytes per slot in local_slots */
+  char    *local_slots;          /* [nslots][slotSize] */
+  int    **local_newClusterSize; /* [nslots][numClusters] */
+  float  **local_newClusters;    /* [nslots][numClusters*numCoords] */
+  kmeans_half *packed = NULL;    /* [numObjs][numCoords], for precision */
+  float   *object_rows = NULL;   /* [nthreads][rowSize], unpacked objects */
+  size_t   rowSize = 0;          /* floats per row */
+  float   *blocked = NULL;       /* [numBlocks][numCoords][KMEANS_BLOCK] */
+  int      numBlocks = (numObjs + KMEANS_BLOCK - 1) / KMEANS_BLOCK;
+  gemm_centers *gemm = NULL;     /* the centers for gemm_assign() */
+  float   *gemm_buffers = NULL;  /* [nthreads][gemmBufferSize] */
+  size_t   gemmBufferSize = 0;
+  long     numExact;             /* objects gemm_assign() searched again */
+  int      numTiles = (numObjs + KMEANS_GEMM_TILE - 1) / KMEANS_GEMM_TILE;
+  const dist_kernels *kernels = select_dist_kernels();
+  triangle_bounds *bounds = NULL;
 
   nthreads = omp_get_max_threads();
 
-  /* allocate a 2D space for returning variable clusters[] (coordinates
-     of cluster centers) */
-  clusters    = (float**) malloc(numClusters *             sizeof(float*));
-  assert(clusters != NULL);
-  clusters[0] = (float*)  malloc(numClusters * numCoords * sizeof(float));
-  assert(clusters[0] != NULL);
+  /* a 2D space for returning variable clusters[] (coordinates of cluster
+     centers) */
+  clusters    = (float**) workspace_get(ws, WS_CLUSTER_ROWS,
+                                        numClusters * sizeof(float*));
+  clusters[0] = (float*)  workspace_get(ws, WS_CLUSTERS,
+                                        numClusters * numCoords * sizeof(float));
   for (i=1; i<numClusters; i++)
     clusters[i] = clusters[i-1] + numCoords;
 
-  /* pick first numClusters elements of objects[] as initial cluster centers*/
-  for (i=0; i<numClusters; i++)
-    for (j=0; j<numCoords; j++)
-      clusters[i][j] = objects[i][j];
+  kmeans_seed_host(init, kernels->euclid_dist_2, objects, stride, numObjs,
+      numCoords, numClusters, clusters);
 
   /* initialize membership[] */
-  for (i=0; i<numObjs; i++) membership[i] = -1;
+  kmeans_start(init, centers, numObjs, numCoords, numClusters, clusters,
+      membership);
+
+  newClusterSize = (int*) workspace_get(ws, WS_SIZES,
+                                        numClusters * sizeof(int));
+
+  /* each thread calculates new centers using a private space, its slot of
+     one contiguous array: numClusters*numCoords sums then numClusters
+     sizes, rounded up to whole cache lines so that no line is written by
+     two threads. All threads then reduce the slots together, each one
+     over a share of the clusters and coordinates.
+     With is_perform_atomic there is a single slot shared by all threads
+     and updated with atomic adds, so memory does not grow with the number
+     of threads (the order of the additions, hence the last bits of the
+     centers, then varies from run to run) */
+  nslots = is_perform_atomic ? 1 : nthreads;
+  slotSize = (size_t)numClusters * numCoords * sizeof(float) +
+             numClusters * sizeof(int);
+  slotSize = (slotSize + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+  local_slots = (char*) workspace_get(ws, WS_LOCAL, nslots * slotSize);
+  memset(local_slots, 0, nslots * slotSize);
+
+  local_newClusters    = (float**) workspace_get(ws, WS_LOCAL_ROWS,
+                                                 2 * nslots * sizeof(void*));
+  local_newClusterSize = (int**) (local_newClusters + nslots);
+  for (i=0; i<nslots; i++) {
+    local_newClusters[i]    = (float*) (local_slots + i * slotSize);
+    local_newClusterSize[i] = (int*) (local_newClusters[i] +
+                                      numClusters * numCoords);
+  }
 
-  /* need to initialize newClusterSize and newClusters[0] to all 0 */
-  newClusterSize = (int*) calloc(numClusters, sizeof(int));
-  assert(newClusterSize != NULL);
+  if (prune != NULL) {
+    prune->loops = 0;
+    if (prune->method != KMEANS_FULL)
+      bounds = triangle_new(prune->method, kernels->euclid_dist_2, objects,
+          stride, numObjs, numCoords, numClusters);
+  }
 
-  newClusters    = (float**) malloc(numClusters *            sizeof(float*));
-  assert(newClusters != NULL);
-  newClusters[0] = (float*)  calloc(numClusters * numCoords, sizeof(float));
-  assert(newClusters[0] != NULL);
-  for (i=1; i<numClusters; i++)
-    newClusters[i] = newClusters[i-1] + numCoords;
-
-  /* each thread calculates new centers using a private space,
-     then thread 0 does an array reduction on them. This approach
-     should be faster */
-  local_newClusterSize    = (int**) malloc(nthreads * sizeof(int*));
-  assert(local_newClusterSize != NULL);
-  local_newClusterSize[0] = (int*)  calloc(nthreads*numClusters,
-      sizeof(int));
-  assert(local_newClusterSize[0] != NULL);
-  for (i=1; i<nthreads; i++)
-    local_newClusterSize[i] = local_newClusterSize[i-1]+numClusters;
-
-  /* local_newClusters is a 3D array */
-  local_newClusters    =(float***)malloc(nthreads * sizeof(float**));
-  assert(local_newClusters != NULL);
-  local_newClusters[0] =(float**) malloc(nthreads * numClusters *
-      sizeof(float*));
-  assert(local_newClusters[0] != NULL);
-  for (i=1; i<nthreads; i++)
-    local_newClusters[i] = local_newClusters[i-1] + numClusters;
-  for (i=0; i<nthreads; i++) {
-    for (j=0; j<numClusters; j++) {
-      local_newClusters[i][j] = (float*)calloc(numCoords,
-          sizeof(float));
-      assert(local_newClusters[i][j] != NULL);
-    }
+  /* the iterations read the 16-bit copy, the seeds came from the objects */
+  if (precision != KMEANS_FP32) {
+    assert(bounds == NULL);
+    packed = (kmeans_half*) workspace_get(ws, WS_PACKED,
+        (size_t)numObjs * numCoords * sizeof(kmeans_half));
+    kmeans_pack(precision, objects, stride, numObjs, numCoords, packed);
+
+    rowSize = (numCoords * sizeof(float) + CACHE_LINE - 1) / CACHE_LINE *
+              CACHE_LINE / sizeof(float);
+    object_rows = (float*) workspace_get(ws, WS_OBJECT_ROWS,
+        nthreads * rowSize * sizeof(float));
+  }
+
+  /* FP32 objects against many wide centers are assigned by GEMM, low-
+     dimensional ones a block at a time */
+  if (precision == KMEANS_FP32 && bounds == NULL &&
+      numCoords >= KMEANS_GEMM_MIN_COORDS &&
+      (long)numClusters * numCoords >= KMEANS_GEMM_MIN_KD) {
+    gemm = gemm_centers_new(numClusters, numCoords, kernels->euclid_dist_2);
+  } else if (precision == KMEANS_FP32 && bounds == NULL &&
+             numCoords <= BLOCK_MAX_COORDS) {
+    blocked = (float*) workspace_get(ws, WS_BLOCKED,
+        (size_t)numBlocks * numCoords * KMEANS_BLOCK * sizeof(float));
+    block_objects(objects, stride, numCoords, numObjs, blocked);
   }
 
   if (_debug) timing = omp_get_wtime();
   do {
+    kmeans_trace_record trace;
+
+    if (kmeans_tracing) trace.start = kmeans_trace_clock();
     delta = 0;
+    numExact = 0;
+    if (bounds != NULL)
+      delta = triangle_assign(bounds, clusters, membership,
+          &prune->skipped[prune->loops]);
+    if (prune != NULL) prune->loops++;
+    if (gemm != NULL) {
+      /* the same size every iteration, so allocated in the first only */
+      gemm_centers_update(gemm, clusters);
+      gemmBufferSize = gemm_buffer_size(gemm);
+      gemm_buffers = (float*) workspace_get(ws, WS_GEMM_BUFFERS,
+          nthreads * gemmBufferSize * sizeof(float));
+    }
 
 #pragma omp parallel \
-    shared(objects,clusters,membership,local_newClusters,local_newClusterSize)
+    shared(objects,packed,object_rows,blocked,gemm,gemm_buffers,clusters,\
+           membership,local_newClusters,local_newClusterSize)
     {
       int tid = omp_get_thread_num();
+      int numSlots = is_perform_atomic ? 1 : omp_get_num_threads();
+
+      if (gemm != NULL) {
+        /* KMEANS_GEMM_TILE objects per iteration, one GEMM each */
+        float *buffer = gemm_buffers + tid * gemmBufferSize;
+        int    t;
 
 #pragma omp for \
-      private(i,j,index) \
-      firstprivate(numObjs,numClusters,numCoords) \
-      schedule(static) \
-      reduction(+:delta)
-      for (i=0; i<numObjs; i++) {
-        /* find the array index of nestest cluster center */
-        index = find_nearest_cluster(numClusters, numCoords,
-            objects[i], clusters);
-
-        /* if membership changes, increase delta by 1 */
-        if (membership[i] != index) delta += 1;
-
-        /* assign the membership to object i */
-        membership[i] = index;
-
-        /* update new cluster centers : sum of all objects located
-           within (average will be performed later) */
-        local_newClusterSize[tid][index]++;
-        for (j=0; j<numCoords; j++)
-          local_newClusters[tid][index][j] += objects[i][j];
-      }
-    } /* end of #pragma omp parallel */
+        private(i,j,index) \
+        schedule(static) \
+        reduction(+:delta,numExact)
+        for (t=0; t<numTiles; t++) {
+          int    nearest[KMEANS_GEMM_TILE], k, count;
+          float *first = objects + (size_t)t * KMEANS_GEMM_TILE * stride;
+
+          count = numObjs - t * KMEANS_GEMM_TILE;
+          if (count > KMEANS_GEMM_TILE) count = KMEANS_GEMM_TILE;
+          numExact += gemm_assign(gemm, first, stride, count, buffer,
+                                  nearest);
+
+          for (k=0; k<count; k++) {
+            float *object = first + (size_t)k * stride;
+
+            i     = t * KMEANS_GEMM_TILE + k;
+            index = nearest[k];
+            if (membership[i] != index) delta += 1;
+            membership[i] = index;
+
+            if (is_perform_atomic) {
+#pragma omp atomic
+              local_newClusterSize[0][index]++;
+              for (j=0; j<numCoords; j++) {
+#pragma omp atomic
+                local_newClusters[0][index * numCoords + j] += object[j];
+              }
+            } else {
+              local_newClusterSize[tid][index]++;
+              for (j=0; j<numCoords; j++)
+                local_newClusters[tid][index * numCoords + j] += object[j];
+            }
+          }
+        }
+      } else if (blocked != NULL) {
+        /* KMEANS_BLOCK objects per iteration, one per SIMD lane */
+        int b;
 
-    /* let the main thread perform the array reduction */
-    for (i=0; i<numClusters; i++) {
-      for (j=0; j<nthreads; j++) {
-        newClusterSize[i] += local_newClusterSize[j][i];
-        local_newClusterSize[j][i] = 0;
-        for (k=0; k<numCoords; k++) {
-          newClusters[i][k] += local_newClusters[j][i][k];
-          local_newClusters[j][i][k] = 0;
+#pragma omp for \
+        private(i,j,index) \
+        schedule(static) \
+        reduction(+:delta)
+        for (b=0; b<numBlocks; b++) {
+          float *block = blocked + (size_t)b * numCoords * KMEANS_BLOCK;
+          int    nearest[KMEANS_BLOCK], k, count;
+
+          kernels->find_nearest_block(numClusters, numCoords, block,
+              clusters, nearest);
+
+          count = numObjs - b * KMEANS_BLOCK;
+          if (count > KMEANS_BLOCK) count = KMEANS_BLOCK;
+          for (k=0; k<count; k++) {
+            i     = b * KMEANS_BLOCK + k;
+            index = nearest[k];
+            if (membership[i] != index) delta += 1;
+            membership[i] = index;
+
+            /* the sums: coordinate j of the object is in row j */
+            if (is_perform_atomic) {
+#pragma omp atomic
+              local_newClusterSize[0][index]++;
+              for (j=0; j<numCoords; j++) {
+#pragma omp atomic
+                local_newClusters[0][index * numCoords + j] +=
+                    block[j * KMEANS_BLOCK + k];
+              }
+            } else {
+              local_newClusterSize[tid][index]++;
+              for (j=0; j<numCoords; j++)
+                local_newClusters[tid][index * numCoords + j] +=
+                    block[j * KMEANS_BLOCK + k];
+            }
+          }
+        }
+      } else {
+#pragma omp for \
+        private(i,j,index) \
+        firstprivate(numObjs,numClusters,numCoords) \
+        schedule(static) \
+        reduction(+:delta)
+        for (i=0; i<numObjs; i++) {
+          float *object;
+
+          if (packed != NULL) {
+            object = object_rows + tid * rowSize;
+            kernels->unpack(precision, numCoords,
+                packed + (size_t)i * numCoords, object);
+          } else {
+            object = objects + (size_t)i * stride;
+          }
+
+          if (bounds != NULL) {
+            /* already assigned by triangle_assign() */
+            index = membership[i];
+          } else {
+            /* find the array index of nestest cluster center */
+            index = kernels->find_nearest_cluster(numClusters, numCoords,
+                object, clusters);
+
+            /* if membership changes, increase delta by 1 */
+            if (membership[i] != index) delta += 1;
+
+            /* assign the membership to object i */
+            membership[i] = index;
+          }
+
+          /* update new cluster centers : sum of all objects located
+             within (average will be performed later) */
+          if (is_perform_atomic) {
+#pragma omp atomic
+            local_newClusterSize[0][index]++;
+            for (j=0; j<numCoords; j++) {
+#pragma omp atomic
+              local_newClusters[0][index * numCoords + j] += object[j];
+            }
+          } else {
+            local_newClusterSize[tid][index]++;
+            for (j=0; j<numCoords; j++)
+              local_newClusters[tid][index * numCoords + j] += object[j];
+          }
         }
       }
-    }
+      /* implicit barrier: all slots are complete */
+#pragma omp master
+      if (kmeans_tracing) trace.assign = kmeans_trace_clock() - trace.start;
+
+      /* array reduction of the sizes, one cluster per iteration */
+#pragma omp for private(i,j) schedule(static)
+      for (i=0; i<numClusters; i++) {
+        int size = 0;
+        for (j=0; j<numSlots; j++) {
+          size += local_newClusterSize[j][i];
+          local_newClusterSize[j][i] = 0;
+        }
+        newClusterSize[i] = size;
+      }
 
-    /* average the sum and replace old cluster centers with newClusters */
-    for (i=0; i<numClusters; i++) {
-      for (j=0; j<numCoords; j++) {
-        if (newClusterSize[i] > 1)
-          clusters[i][j] = newClusters[i][j] / newClusterSize[i];
-        newClusters[i][j] = 0.0;   /* set back to 0 */
+      /* array reduction of the sums, one coordinate of one cluster per
+         iteration (slots added in thread order, as the merge on the main
+         thread did), averaged into the new cluster centers right away */
+#pragma omp for private(i,j) schedule(static)
+      for (i=0; i<numClusters*numCoords; i++) {
+        int   cluster = i / numCoords;
+        float sum     = 0.0;
+        for (j=0; j<numSlots; j++) {
+          sum += local_newClusters[j][i];
+          local_newClusters[j][i] = 0.0;   /* set back to 0 */
+        }
+        if (newClusterSize[cluster] > 1)
+          clusters[cluster][i % numCoords] = sum / newClusterSize[cluster];
       }
-      newClusterSize[i] = 0;   /* set back to 0 */
+    } /* end of #pragma omp parallel */
+
+    if (kmeans_tracing) {
+      /* the reduction averages into the new centers as it goes */
+      trace.iteration = loop;
+      trace.reduce    = kmeans_trace_clock() - trace.start - trace.assign;
+      trace.update    = 0.0;
+      trace.delta     = delta;
+      trace.distances = (long)numObjs * numClusters -
+                        (bounds != NULL ? prune->skipped[prune->loops-1] : 0) +
+                        numExact * numClusters;
+      trace.bytes     = (double)numObjs * numCoords *
+                        (packed != NULL ? sizeof(kmeans_half) : sizeof(float));
+      trace.h2d       = trace.d2h = 0.0;
+      kmeans_trace_iteration(&trace);
     }
+
     delta *= magnitude;
 
   } while (delta > numObjs && loop++ < 500);
@@ -248,21 +413,41 @@ float** omp_kmeans(int     is_perform_atomic, /* in: */
     printf("nloops = %2d (T = %7.4f)",loop,timing);
   }
 
-  if (!is_perform_atomic) {
-    free(local_newClusterSize[0]);
-    free(local_newClusterSize);
+  if (bounds != NULL) triangle_free(bounds);
+  if (gemm != NULL) gemm_centers_free(gemm);
 
-    for (i=0; i<nthreads; i++)
-      for (j=0; j<numClusters; j++)
-        free(local_newClusters[i][j]);
-    free(local_newClusters[0]);
-    free(local_newClusters);
-  }
-  free(newClusters[0]);
-  free(newClusters);
-  free(newClusterSize);
-  // We need to free the memory allocated
-  if (!isMultOf4) free(objects);
+  return clusters;
+}
+
+/*----< omp_kmeans() >-------------------------------------------------------*/
+/* omp_kmeans_ws() on a workspace of its own, returns a malloc'd array of
+   cluster centers of size [numClusters][numCoords]                          */
+float** omp_kmeans(int     is_perform_atomic, /* in: */
+    float  *objects,           /* in: [numObjs][stride] */
+    int     stride,            /* no. floats between objects */
+    int     numCoords,         /* no. coordinates */
+    int     numObjs,           /* no. objects */
+    int     numClusters,       /* no. clusters */
+    int     init,              /* KMEANS_SEED_* */
+    float  *centers,           /* in: [numClusters][numCoords], for
+                                  KMEANS_SEED_GIVEN, else unused */
+    int     precision,         /* KMEANS_FP*: objects as read by the
+                                  iterations, FP32 with pruning */
+    float   threshold,         /* % objects change membership */
+    int    *membership,        /* in/out: [numObjs], see KMEANS_SEED_GIVEN */
+    prune_stats *prune)        /* in/out: pruning, may be NULL */
+{
+  kmeans_workspace ws;
+  float **clusters, **result;
+
+  memset(&ws, 0, sizeof(ws));
+  result = omp_kmeans_ws(&ws, is_perform_atomic, objects, stride, numCoords,
+      numObjs, numClusters, init, centers, precision, threshold, membership,
+      prune);
+
+  malloc2D(clusters, numClusters, numCoords, float);
+  memcpy(clusters[0], result[0], numClusters * numCoords * sizeof(float));
+  workspace_free(&ws);
 
   return clusters;
 }
@@ -37,8 +37,29 @@ static void usage(char *argv0, float threshold) {
         "       -n num_clusters: number of clusters (K must > 1)\n"
         "       -t threshold   : threshold value (default %.4f)\n"
         "       -p nproc       : number of threads (default system allocated)\n"
+        "       -N placement   : NUMA placement of the objects: off (default),\n"
+        "                        local (first touch by the thread using them)\n"
+        "                        or interleave (round-robin over the nodes)\n"
+        "       -A binding     : pin the threads to cpus: none (default), close\n"
+        "                        (one socket after the other) or spread\n"
         "       -a             : perform atomic OpenMP pragma (default no)\n"
+        "       -s seeding     : initial centers: first (default), plusplus\n"
+        "                        (k-means++) or parallel (k-means||)\n"
+        "       -c centres_file: warm start from the centers of an earlier run\n"
+        "       -M member_file : and its memberships (objects past its end\n"
+        "                        are new); both in the format of -B\n"
+        "       -e             : Elkan triangle-inequality pruning\n"
+        "       -H             : Hamerly triangle-inequality pruning\n"
+        "       -P precision   : objects stored as fp32 (default), fp16 or\n"
+        "                        bf16 during the iterations; with -o also\n"
+        "                        compared to an fp32 run\n"
+        "       -m batch_size  : mini-batch k-means streaming the (binary)\n"
+        "                        input file batch_size objects at a time\n"
+        "       -B             : write binary output files (default no)\n"
         "       -o             : output timing results (default no)\n"
+        "       -T trace_file  : per-iteration trace as JSON lines, or as a\n"
+        "                        Chrome trace if the name ends in .json\n"
+        "       -C             : add the hardware counters to the trace\n"
         "       -d             : enable debug mode\n";
     fprintf(stderr, help, argv0, threshold);
     exit(-1);
@@ -49,42 +70,97 @@ int main(int argc, char **argv) {
            int     opt;
     extern char   *optarg;
     extern int     optind;
-           int     i, j, nthreads;
-           int     isBinaryFile, is_perform_atomic, is_output_timing;
+           int     i, j, nthreads, batchSize, loop_iterations;
+           size_t  batchMemory;
+           int     isBinaryFile, isBinaryOutput;
+           int     is_perform_atomic, is_output_timing;
+           int     init;          /* KMEANS_SEED_* */
+           int     precision;     /* KMEANS_FP* */
+           int     placement;     /* KMEANS_NUMA_* */
+           int     binding;       /* KMEANS_BIND_* */
 
            int     numClusters, numCoords, numObjs;
            int    *membership;    /* [numObjs] */
+           int    *refMembership; /* [numObjs], the fp32 run's (-P, -o) */
+           int     numDiffer;     /* objects not where the fp32 run puts them */
            char   *filename;
-           float **objects;       /* [numObjs][numCoords] data objects */
+           char   *centresFile, *membershipFile;  /* -c, -M */
+           char   *traceFile;     /* -T */
+           int     traceCounters; /* -C */
+           float  *centers;       /* [numClusters][numCoords], from -c */
+           kmeans_data data;      /* [numObjs][numCoords] data objects */
            float **clusters;      /* [numClusters][numCoords] cluster center */
            float   threshold;
-           double  timing, io_timing, clustering_timing;
+           double  timing, io_timing, read_timing, write_timing;
+           double  clustering_timing, ref_timing;
+           prune_stats prune;
 
     /* some default values */
     _debug            = 0;
     nthreads          = 0;
+    batchSize         = 0;
     numClusters       = 0;
     threshold         = 0.001;
     numClusters       = 0;
     isBinaryFile      = 0;
+    isBinaryOutput    = 0;
     is_output_timing  = 0;
     is_perform_atomic = 0;
     filename          = NULL;
+    centresFile       = NULL;
+    membershipFile    = NULL;
+    traceFile         = NULL;
+    traceCounters     = 0;
+    centers           = NULL;
+    refMembership     = NULL;
+    prune.method      = KMEANS_FULL;
+    init              = KMEANS_SEED_FIRST;
+    precision         = KMEANS_FP32;
+    placement         = KMEANS_NUMA_OFF;
+    binding           = KMEANS_BIND_NONE;
 
-    while ( (opt=getopt(argc,argv,"p:i:n:t:abdo"))!= EOF) {
+    while ( (opt=getopt(argc,argv,"p:i:m:n:s:t:c:M:P:N:A:T:abBCdeHo"))!= EOF) {
         switch (opt) {
             case 'i': filename=optarg;
                       break;
             case 'b': isBinaryFile = 1;
                       break;
+            case 'B': isBinaryOutput = 1;
+                      break;
             case 't': threshold=atof(optarg);
                       break;
             case 'n': numClusters = atoi(optarg);
                       break;
             case 'p': nthreads = atoi(optarg);
                       break;
+            case 'm': batchSize = atoi(optarg);
+                      break;
             case 'a': is_perform_atomic = 1;
                       break;
+            case 's': init = kmeans_seed_method(optarg);
+                      if (init < 0) usage(argv[0], threshold);
+                      break;
+            case 'c': centresFile = optarg;
+                      break;
+            case 'M': membershipFile = optarg;
+                      break;
+            case 'e': prune.method = KMEANS_ELKAN;
+                      break;
+            case 'H': prune.method = KMEANS_HAMERLY;
+                      break;
+            case 'P': precision = kmeans_precision_method(optarg);
+                      if (precision < 0) usage(argv[0], threshold);
+                      break;
+            case 'N': placement = kmeans_numa_method(optarg);
+                      if (placement < 0) usage(argv[0], threshold);
+                      break;
+            case 'A': binding = kmeans_bind_method(optarg);
+                      if (binding < 0) usage(argv[0], threshold);
+                      break;
+            case 'T': traceFile = optarg;
+                      break;
+            case 'C': traceCounters = 1;
+                      break;
             case 'o': is_output_timing = 1;
                       break;
             case 'd': _debug = 1;
@@ -97,42 +173,159 @@ int main(int argc, char **argv) {
     }
 
     if (filename == 0 || numClusters <= 1) usage(argv[0], threshold);
+    if (membershipFile != NULL && centresFile == NULL)
+        usage(argv[0], threshold);
+    if (centresFile != NULL) {
+        if (batchSize > 0) {
+            fprintf(stderr, "Error: -c does not apply to -m\n");
+            usage(argv[0], threshold);
+        }
+        init = KMEANS_SEED_GIVEN;
+    }
+    if (precision != KMEANS_FP32 &&
+        (batchSize > 0 || prune.method != KMEANS_FULL)) {
+        fprintf(stderr, "Error: -P does not apply to -m, -e or -H\n");
+        usage(argv[0], threshold);
+    }
+    if (batchSize > 0 && !isBinaryFile) {
+        fprintf(stderr, "Error: -m needs a binary input file (-b)\n");
+        usage(argv[0], threshold);
+    }
 
     /* set the no. threads if specified in command line, else use all
        threads allocated by run-time system */
     if (nthreads > 0)
         omp_set_num_threads(nthreads);
 
+    /* before the first parallel region, so that every later one (of this
+       size) runs on the pinned threads */
+    if (binding != KMEANS_BIND_NONE && kmeans_bind_threads(binding) == 0)
+        fprintf(stderr, "Warning: could not bind the threads (-A %s)\n",
+                kmeans_bind_name(binding));
+
+    /* after the binding, so that the counters follow the pinned threads */
+    if (traceFile != NULL &&
+        !kmeans_trace_open(traceFile, "omp", traceCounters))
+        exit(1);
+
+    if (batchSize > 0) {
+        /* the objects are never all in memory: the clustering streams the
+           file and a last pass writes the memberships batch by batch */
+        io_timing = 0.0;
+        clustering_timing = omp_get_wtime();
+        clusters = omp_minibatch_kmeans(filename, batchSize, numClusters,
+                                        init, threshold, &numObjs, &numCoords,
+                                        &loop_iterations, &batchMemory);
+        timing = omp_get_wtime();
+        kmeans_trace_close();
+        clustering_timing = timing - clustering_timing;
+
+        omp_minibatch_write(filename, batchSize, numClusters, clusters,
+                            isBinaryOutput);
+        free(clusters[0]);
+        free(clusters);
+
+        if (is_output_timing) {
+            io_timing = omp_get_wtime() - timing;
+
+            printf("\nPerforming **** Mini-batch Kmeans (OpenMP) ----");
+            printf(" streaming %d objects per batch ******\n", batchSize);
+            printf("Number of threads = %d\n", omp_get_max_threads());
+            printf("SIMD kernels      = %s\n", select_dist_kernels()->isa);
+            printf("Input file:     %s\n", filename);
+            printf("numObjs       = %d\n", numObjs);
+            printf("numCoords     = %d\n", numCoords);
+            printf("numClusters   = %d\n", numClusters);
+            printf("threshold     = %.4f\n", threshold);
+            printf("Batch memory  = %.2f MB\n", batchMemory / 1048576.0);
+
+            printf("Seeding            = %s\n", kmeans_seed_name(init));
+            printf("Passes             = %d\n", loop_iterations);
+            printf("Output time        = %10.4f sec\n", io_timing);
+            printf("Computation timing = %10.4f sec\n", clustering_timing);
+        }
+        return(0);
+    }
+
     if (is_output_timing) io_timing = omp_get_wtime();
 
     /* read data points from file ------------------------------------------*/
-    objects = file_read(isBinaryFile, filename, &numObjs, &numCoords);
-    if (objects == NULL) exit(1);
+    if (!file_load(isBinaryFile, filename, &data)) exit(1);
+    numObjs   = data.numObjs;
+    numCoords = data.numCoords;
+    if (!kmeans_numa_place(placement, &data))
+        fprintf(stderr, "Warning: no memory for -N %s, objects left as read\n",
+                kmeans_numa_name(placement));
+
+    /* membership: the cluster id for each data object */
+    membership = (int*) kmeans_numa_malloc(placement, numObjs, sizeof(int));
+    assert(membership != NULL);
+
+    /* the outputs of an earlier run to start from -------------------------*/
+    if (centresFile != NULL) {
+        centers = (float*) malloc(numClusters * numCoords * sizeof(float));
+        assert(centers != NULL);
+        if (!file_load_centres(isBinaryOutput, centresFile, numClusters,
+                               numCoords, centers))
+            exit(1);
+        if (membershipFile == NULL)
+            for (i=0; i<numObjs; i++) membership[i] = -1;
+        else if (!file_load_membership(isBinaryOutput, membershipFile,
+                                       numObjs, membership))
+            exit(1);
+    }
+
+    /* the fp32 run to compare with starts from the same memberships */
+    if (is_output_timing && precision != KMEANS_FP32) {
+        refMembership = (int*) malloc(numObjs * sizeof(int));
+        assert(refMembership != NULL);
+        memcpy(refMembership, membership, numObjs * sizeof(int));
+    }
 
     if (is_output_timing) {
         timing            = omp_get_wtime();
         io_timing         = timing - io_timing;
+        read_timing       = io_timing;
         clustering_timing = timing;
     }      
 
     /* start the core computation -------------------------------------------*/
-    /* membership: the cluster id for each data object */
-    membership = (int*) malloc(numObjs * sizeof(int));
-    assert(membership != NULL);
-
-    clusters = omp_kmeans(is_perform_atomic, objects, numCoords, numObjs,
-                          numClusters, threshold, membership);
-
-    free(objects[0]);
-    free(objects);
+    clusters = omp_kmeans(is_perform_atomic, data.objects, data.stride,
+                          numCoords, numObjs, numClusters, init, centers,
+                          precision, threshold, membership, &prune);
+    kmeans_trace_close();   /* the fp32 run below is not traced */
 
     if (is_output_timing) {
         timing            = omp_get_wtime();
         clustering_timing = timing - clustering_timing;
     }       
 
+    if (refMembership != NULL) {
+        float **refClusters;
+        prune_stats refPrune;
+
+        refPrune.method = KMEANS_FULL;
+        refClusters = omp_kmeans(is_perform_atomic, data.objects, data.stride,
+                                 numCoords, numObjs, numClusters, init,
+                                 centers, KMEANS_FP32, threshold,
+                                 refMembership, &refPrune);
+        numDiffer = 0;
+        for (i=0; i<numObjs; i++)
+            if (refMembership[i] != membership[i]) numDiffer++;
+        free(refClusters[0]);
+        free(refClusters);
+        free(refMembership);
+
+        ref_timing = omp_get_wtime() - timing;
+        timing    += ref_timing;    /* not part of the output write */
+    }
+
+    file_unload(&data);
+    free(centers);
+
     /* output: the coordinates of the cluster centres ----------------------*/
-    file_write(filename, numClusters, numObjs, numCoords, clusters, membership);
+    file_write(filename, numClusters, numObjs, numCoords, clusters,
+               membership, isBinaryOutput);
 
     free(membership);
     free(clusters[0]);
@@ -140,7 +333,8 @@ int main(int argc, char **argv) {
 
     /*---- output performance numbers ---------------------------------------*/
     if (is_output_timing) {
-        io_timing += omp_get_wtime() - timing;
+        write_timing = omp_get_wtime() - timing;
+        io_timing   += write_timing;
 
         printf("\nPerforming **** Regular Kmeans  (OpenMP) ----");
         if (is_perform_atomic)
@@ -149,14 +343,52 @@ int main(int argc, char **argv) {
             printf(" using array reduction ******\n");
 
         printf("Number of threads = %d\n", omp_get_max_threads());
+        printf("SIMD kernels      = %s\n", select_dist_kernels()->isa);
+        printf("NUMA placement    = %s\n", kmeans_numa_name(placement));
+        printf("Thread binding    = %s\n", kmeans_bind_name(binding));
         printf("Input file:     %s\n", filename);
         printf("numObjs       = %d\n", numObjs);
         printf("numCoords     = %d\n", numCoords);
         printf("numClusters   = %d\n", numClusters);
         printf("threshold     = %.4f\n", threshold);
 
+        printf("Seeding            = %s\n", kmeans_seed_name(init));
+        printf("Loop iterations    = %d\n", prune.loops);
+
         printf("I/O time           = %10.4f sec\n", io_timing);
+        if (isBinaryFile)
+            printf("Input read         = %10.4f sec (mapped)\n", read_timing);
+        else
+            printf("Input read         = %10.4f sec (%.1f MB/s parsed)\n",
+                   read_timing, data.fileSize / 1048576.0 / read_timing);
+        printf("Output write       = %10.4f sec%s\n", write_timing,
+               isBinaryOutput ? " (binary)" : "");
         printf("Computation timing = %10.4f sec\n", clustering_timing);
+
+        if (precision != KMEANS_FP32) {
+            printf("Object storage     = %s (%.1f MB, fp32 %.1f MB)\n",
+                   kmeans_precision_name(precision),
+                   (double)numObjs * numCoords * sizeof(kmeans_half) / 1048576.0,
+                   (double)numObjs * numCoords * sizeof(float) / 1048576.0);
+            printf("Membership vs fp32 = %d of %d objects differ (%.4f%%), fp32 run %.4f sec\n",
+                   numDiffer, numObjs, 100.0 * numDiffer / numObjs,
+                   ref_timing);
+        }
+
+        if (prune.method != KMEANS_FULL) {
+            long total = 0;
+            printf("Pruning            = %s\n",
+                   prune.method == KMEANS_ELKAN ? "Elkan" : "Hamerly");
+            for (i=0; i<prune.loops; i++) {
+                printf("  iteration %3d: skipped %12ld of %12ld distances (%5.1f%%)\n",
+                       i, prune.skipped[i], (long)numObjs * numClusters,
+                       100.0 * prune.skipped[i] / ((double)numObjs * numClusters));
+                total += prune.skipped[i];
+            }
+            printf("Skipped distances  = %ld of %ld (%5.1f%%)\n", total,
+                   (long)numObjs * numClusters * prune.loops,
+                   100.0 * total / ((double)numObjs * numClusters * prune.loops));
+        }
     }
 
     return(0);
@@ -0,0 +1,303 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+/*   File:         omp_minibatch.c  (OpenMP version)                         */
+/*   Description:  mini-batch k-means (D. Sculley, "Web-scale k-means        */
+/*                 clustering", WWW 2010) for binary inputs larger than      */
+/*                 memory. Objects are streamed from the file batchSize at   */
+/*                 a time, so memory is bounded by batchSize x numCoords     */
+/*                 instead of numObjs x numCoords.                           */
+/*                                                                           */
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>     /* memcpy() */
+#include <sys/types.h>  /* open() */
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>     /* pread(), close() */
+
+#include <omp.h>
+
+#include "kmeans.h"
+
+/* a raw binary input file, read a batch of objects at a time */
+typedef struct {
+  char *filename;
+  int   fd;
+  int   numObjs;
+  int   numCoords;
+} batch_file;
+
+/*----< batch_open() >-------------------------------------------------------*/
+static
+void batch_open(batch_file *f, char *filename)
+{
+  int     header[2];
+  ssize_t numBytesRead;
+
+  f->filename = filename;
+  if ((f->fd = open(filename, O_RDONLY)) == -1)
+    err("Error: no such file (%s)\n", filename);
+
+  numBytesRead = pread(f->fd, header, sizeof(header), 0);
+  if (numBytesRead != sizeof(header))
+    err("Error: cannot read the header of %s\n", filename);
+  f->numObjs   = header[0];
+  f->numCoords = header[1];
+
+  /* the batches are read front to back, once per pass */
+  posix_fadvise(f->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+}
+
+/*----< batch_read() >-------------------------------------------------------*/
+/* read objects [first, first+count) into buf[count][numCoords] */
+static
+void batch_read(batch_file *f, float *buf, long first, int count)
+{
+  size_t  len = (size_t)count * f->numCoords * sizeof(float);
+  off_t   off = 2 * sizeof(int) + (off_t)first * f->numCoords * sizeof(float);
+  char   *ptr = (char*)buf;
+  ssize_t numBytesRead;
+
+  while (len > 0) {
+    numBytesRead = pread(f->fd, ptr, len, off);
+    if (numBytesRead <= 0)
+      err("Error: short read in %s at object %ld\n", f->filename, first);
+    ptr += numBytesRead;
+    off += numBytesRead;
+    len -= numBytesRead;
+  }
+}
+
+/*----< omp_minibatch_kmeans() >---------------------------------------------*/
+/* return an array of cluster centers of size [numClusters][numCoords].
+   Each pass streams the whole file in batches; while the threads assign
+   one batch, one of them reads the next into the other buffer. After each
+   batch every center moves to the running mean of all the objects it has
+   been assigned so far, i.e. with a per-center learning rate of
+   1/(no. objects seen). The passes stop once the centers moved, in mean
+   square, less than threshold times the mean square distance of the
+   objects to their centers during the pass. */
+float** omp_minibatch_kmeans(char   *filename,     /* in: binary input file */
+    int     batchSize,         /* no. objects per batch */
+    int     numClusters,       /* no. clusters */
+    int     init,              /* KMEANS_SEED_*, from the first batch */
+    float   threshold,         /* relative center movement per pass */
+    int    *numObjs,           /* out: no. objects */
+    int    *numCoords,         /* out: no. coordinates */
+    int    *loop_iterations,   /* out: no. passes */
+    size_t *memory)            /* out: bytes allocated */
+{
+  batch_file f;
+  int      i, j, k, loop=0, K = numClusters, D;
+  int      nthreads = omp_get_max_threads();
+  long     first, N;
+  float   *batch[2];       /* [2][batchSize][numCoords] */
+  float  **clusters;       /* out: [numClusters][numCoords] */
+  float  **oldClusters;    /* [numClusters][numCoords] at start of a pass */
+  long    *numSeen;        /* [numClusters] objects assigned so far */
+  float   *local_sums;     /* [nthreads][numClusters][numCoords] */
+  int     *local_sizes;    /* [nthreads][numClusters] */
+  double   inertia, shift, delta;
+  const dist_kernels *kernels = select_dist_kernels();
+
+  batch_open(&f, filename);
+  *numObjs   = f.numObjs;
+  *numCoords = D = f.numCoords;
+  N = f.numObjs;
+  if (K > N) err("Error: %d clusters but only %ld objects\n", K, N);
+  if (batchSize > N) batchSize = N;
+
+  batch[0] = (float*) malloc(2 * (size_t)batchSize * D * sizeof(float));
+  assert(batch[0] != NULL);
+  batch[1] = batch[0] + (size_t)batchSize * D;
+
+  malloc2D(clusters, K, D, float);
+  malloc2D(oldClusters, K, D, float);
+  numSeen = (long*) calloc(K, sizeof(long));
+  assert(numSeen != NULL);
+  local_sums = (float*) calloc((size_t)nthreads * K * D, sizeof(float));
+  assert(local_sums != NULL);
+  local_sizes = (int*) calloc((size_t)nthreads * K, sizeof(int));
+  assert(local_sizes != NULL);
+
+  *memory = 2 * (size_t)batchSize * D * sizeof(float) +
+            2 * (size_t)K * D * sizeof(float) + K * sizeof(long) +
+            (size_t)nthreads * K * (D * sizeof(float) + sizeof(int));
+
+  if (init == KMEANS_SEED_FIRST) {
+    /* pick first numClusters elements of objects[] as initial cluster
+       centers */
+    batch_read(&f, clusters[0], 0, K);
+  } else {
+    /* seed from the objects of the first batch */
+    if (batchSize < K)
+      err("Error: seeding needs batches of at least %d objects\n", K);
+    batch_read(&f, batch[0], 0, batchSize);
+    kmeans_seed_host(init, kernels->euclid_dist_2, batch[0], D, batchSize, D,
+        K, clusters);
+  }
+
+  do {
+    int    cur = 0;
+    double t   = 0.0;
+    kmeans_trace_record trace;
+
+    if (kmeans_tracing) {
+      trace.start  = kmeans_trace_clock();
+      trace.assign = trace.update = 0.0;
+    }
+    memcpy(oldClusters[0], clusters[0], (size_t)K * D * sizeof(float));
+    inertia = 0.0;
+
+    batch_read(&f, batch[cur], 0, batchSize);
+    for (first=0; first<N; first+=batchSize, cur^=1) {
+      int  count     = (int)(N - first < batchSize ? N - first : batchSize);
+      long next      = first + batchSize;
+      int  nextCount = (int)(N - next < batchSize ? N - next : batchSize);
+
+#pragma omp parallel private(i,j)
+      {
+        int    tid   = omp_get_thread_num();
+        float *sums  = local_sums + (size_t)tid * K * D;
+        int   *sizes = local_sizes + (size_t)tid * K;
+
+        /* one thread reads ahead, the others start on this batch and
+           the dynamic schedule lets it catch up afterwards */
+#pragma omp single nowait
+        if (nextCount > 0) batch_read(&f, batch[cur^1], next, nextCount);
+
+#pragma omp for schedule(dynamic, 256) reduction(+:inertia)
+        for (i=0; i<count; i++) {
+          float *object = batch[cur] + (size_t)i * D;
+          int    index  = kernels->find_nearest_cluster(K, D, object,
+              clusters);
+
+          inertia += kernels->euclid_dist_2(D, object, clusters[index]);
+          sizes[index]++;
+          for (j=0; j<D; j++)
+            sums[(size_t)index * D + j] += object[j];
+        }
+      } /* end of #pragma omp parallel */
+      if (kmeans_tracing) {
+        t = kmeans_trace_clock();
+        trace.assign += t - (trace.start + trace.assign + trace.update);
+      }
+
+      /* c += (sum - n c) / seen is the closed form of the per-object
+         update c += (x - c) / seen over the n objects of this batch */
+      for (k=0; k<K; k++) {
+        long n = 0;
+        for (i=0; i<nthreads; i++) {
+          n += local_sizes[i * K + k];
+          local_sizes[i * K + k] = 0;
+        }
+        if (n == 0) continue;
+        numSeen[k] += n;
+        for (j=0; j<D; j++) {
+          float sum = 0.0;
+          for (i=0; i<nthreads; i++) {
+            sum += local_sums[((size_t)i * K + k) * D + j];
+            local_sums[((size_t)i * K + k) * D + j] = 0.0;
+          }
+          clusters[k][j] += (sum - n * clusters[k][j]) / numSeen[k];
+        }
+      }
+      if (kmeans_tracing) trace.update += kmeans_trace_clock() - t;
+    }
+
+    shift = 0.0;
+    for (k=0; k<K; k++)
+      shift += kernels->euclid_dist_2(D, clusters[k], oldClusters[k]);
+    delta = inertia > 0.0 ? (shift / K) / (inertia / N) : 0.0;
+
+    if (kmeans_tracing) {
+      /* a pass keeps no memberships, so there is no delta to report; the
+         thread sums are reduced as the centers are updated */
+      trace.iteration = loop;
+      trace.reduce    = 0.0;
+      trace.delta     = -1;
+      trace.distances = N * K;
+      trace.bytes     = (double)N * D * sizeof(float);
+      trace.h2d       = trace.d2h = 0.0;
+      kmeans_trace_iteration(&trace);
+    }
+
+    if (_debug)
+      printf("pass %3d: mean square shift %e, mean square distance %e\n",
+          loop, shift / K, inertia / N);
+  } while (delta > threshold && loop++ < 500);
+
+  *loop_iterations = loop + 1;
+
+  close(f.fd);
+  free(batch[0]);
+  free(oldClusters[0]);
+  free(oldClusters);
+  free(numSeen);
+  free(local_sums);
+  free(local_sizes);
+
+  return clusters;
+}
+
+/*----< omp_minibatch_write() >----------------------------------------------*/
+/* a last streaming pass: assign every object to the final centers and write
+   the .membership file one batch at a time, then the .cluster_centres */
+int omp_minibatch_write(char   *filename,     /* in: binary input file */
+    int     batchSize,         /* no. objects per batch */
+    int     numClusters,       /* no. clusters */
+    float **clusters,          /* [numClusters][numCoords] */
+    int     isBinaryOutput)
+{
+  batch_file f;
+  int     i, cur = 0, D, ok;
+  long    first, N;
+  float  *batch[2];
+  int    *membership;     /* [batchSize] */
+  membership_file out;
+  const dist_kernels *kernels = select_dist_kernels();
+
+  batch_open(&f, filename);
+  N = f.numObjs;
+  D = f.numCoords;
+  if (batchSize > N) batchSize = N;
+
+  batch[0] = (float*) malloc(2 * (size_t)batchSize * D * sizeof(float));
+  assert(batch[0] != NULL);
+  batch[1] = batch[0] + (size_t)batchSize * D;
+  membership = (int*) malloc(batchSize * sizeof(int));
+  assert(membership != NULL);
+
+  if (!membership_open(&out, filename, N, isBinaryOutput))
+    err("Error: cannot write %s.membership\n", filename);
+
+  batch_read(&f, batch[cur], 0, batchSize);
+  for (first=0; first<N; first+=batchSize, cur^=1) {
+    int  count     = (int)(N - first < batchSize ? N - first : batchSize);
+    long next      = first + batchSize;
+    int  nextCount = (int)(N - next < batchSize ? N - next : batchSize);
+
+#pragma omp parallel private(i)
+    {
+#pragma omp single nowait
+      if (nextCount > 0) batch_read(&f, batch[cur^1], next, nextCount);
+
+#pragma omp for schedule(dynamic, 256)
+      for (i=0; i<count; i++)
+        membership[i] = kernels->find_nearest_cluster(numClusters, D,
+            batch[cur] + (size_t)i * D, clusters);
+    }
+
+    if (!membership_append(&out, count, membership))
+      err("Error: cannot write %s.membership\n", filename);
+  }
+  ok = membership_close(&out);
+  close(f.fd);
+
+  free(batch[0]);
+  free(membership);
+
+  return file_write_centres(filename, numClusters, D, clusters,
+      isBinaryOutput) && ok;
+}
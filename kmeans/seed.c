@@ -0,0 +1,438 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+/*   File:         seed.c  (sequential, OpenMP and CUDA version)             */
+/*   Description:  initial cluster centers, -s on all drivers: the first     */
+/*                 numClusters objects, k-means++ (D. Arthur and S.          */
+/*                 Vassilvitskii, "k-means++: the advantages of careful      */
+/*                 seeding", SODA 2007) or k-means|| (B. Bahmani et al.,     */
+/*                 "Scalable k-means++", VLDB 2012). The distance of every   */
+/*                 object to its nearest center so far is kept by a seed_ops */
+/*                 backend: the host one below, or the device one of         */
+/*                 cuda_kmeans.cu.                                           */
+/*                                                                           */
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>     /* memcpy(), strcmp() */
+#include <stdint.h>
+#include <float.h>
+
+#include "kmeans.h"
+
+#define SEED_ROUNDS      5  /* k-means|| rounds, enough per the paper */
+#define SEED_OVERSAMPLE  2  /* k-means|| expects 2*numClusters candidates
+                               per round */
+
+#define SEED_CHUNKS(numObjs) \
+    (((numObjs) + KMEANS_SEED_CHUNK - 1) / KMEANS_SEED_CHUNK)
+
+/*----< seed_uniform() >-----------------------------------------------------*/
+/* a uniform number in [0, 1) made from (stream, i) alone by the splitmix64
+   finalizer: the draws, hence the centers, are the same for any no. threads
+   and on any backend (as far as the distances agree) */
+__inline static
+uint64_t seed_mix(uint64_t z)
+{
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+__inline static
+double seed_uniform(uint64_t stream, uint64_t i)
+{
+    uint64_t h = seed_mix(seed_mix(0x9e3779b97f4a7c15ULL * (stream + 1)) ^ i);
+    return (double)(h >> 11) * (1.0 / 9007199254740992.0);    /* 2^-53 */
+}
+
+/*----< kmeans_seed_method() >-----------------------------------------------*/
+/* -s argument to KMEANS_SEED_*, -1 if unknown */
+int kmeans_seed_method(const char *name)
+{
+    if (strcmp(name, "first") == 0)    return KMEANS_SEED_FIRST;
+    if (strcmp(name, "plusplus") == 0) return KMEANS_SEED_PLUSPLUS;
+    if (strcmp(name, "parallel") == 0) return KMEANS_SEED_PARALLEL;
+    return -1;
+}
+
+const char* kmeans_seed_name(int method)
+{
+    switch (method) {
+        case KMEANS_SEED_PLUSPLUS: return "k-means++";
+        case KMEANS_SEED_PARALLEL: return "k-means||";
+        case KMEANS_SEED_GIVEN:    return "given centers";
+        default:                   return "first objects";
+    }
+}
+
+/*----< seed_pick() >--------------------------------------------------------*/
+/* the object whose interval holds r, when the objects in order take
+   intervals as long as their distances (total = the sum of chunkSums[]).
+   Only the chunk that holds r is fetched from the backend. -1 if all
+   distances are 0 */
+static
+int seed_pick(const seed_ops *ops, const double *chunkSums, int numObjs,
+              float *buf, double r)
+{
+    int c, i, begin, end, last = -1, numChunks = SEED_CHUNKS(numObjs);
+
+    for (c=0; c<numChunks-1 && r >= chunkSums[c]; c++)
+        r -= chunkSums[c];
+    /* rounding can carry r past the last chunk, or into a trailing run of
+       chunks whose objects are all centers already */
+    while (c > 0 && chunkSums[c] <= 0.0) c--;
+
+    begin = c * KMEANS_SEED_CHUNK;
+    end   = begin + KMEANS_SEED_CHUNK < numObjs ? begin + KMEANS_SEED_CHUNK
+                                                : numObjs;
+    ops->fetch(ops->arg, begin, end, buf);
+    for (i=begin; i<end; i++) {
+        if (buf[i-begin] > 0.0f) {
+            last = i;
+            if (r < buf[i-begin]) break;
+            r -= buf[i-begin];
+        }
+    }
+    return last;
+}
+
+__inline static
+void seed_copy(float *objects, int stride, int numCoords, int i, float *center)
+{
+    memcpy(center, objects + (size_t)i * stride, numCoords * sizeof(float));
+}
+
+/*----< seed_plusplus() >----------------------------------------------------*/
+/* k-means++: choose clusters[first..numClusters), each object with
+   probability proportional to its squared distance to the nearest center
+   chosen before. The backend already holds the distances to
+   clusters[0..first) in chunkSums[] */
+static
+void seed_plusplus(const seed_ops *ops, float *objects, int stride,
+                   int numObjs, int numCoords, int numClusters, int first,
+                   float **clusters, double *chunkSums)
+{
+    int    c, k, i, numChunks = SEED_CHUNKS(numObjs);
+    float *buf = (float*) malloc(KMEANS_SEED_CHUNK * sizeof(float));
+    assert(buf != NULL);
+
+    for (c=first; c<numClusters; c++) {
+        double total = 0.0, u = seed_uniform(0, c);
+
+        i = -1;
+        if (c > 0) {
+            for (k=0; k<numChunks; k++) total += chunkSums[k];
+            if (total > 0.0)
+                i = seed_pick(ops, chunkSums, numObjs, buf, u * total);
+        }
+        /* the first center, or every object already is a center */
+        if (i < 0) i = (int)(u * numObjs);
+
+        seed_copy(objects, stride, numCoords, i, clusters[c]);
+        if (c + 1 < numClusters)
+            ops->update(ops->arg, &clusters[c], 1, c, chunkSums);
+    }
+    free(buf);
+}
+
+/*----< seed_weighted() >----------------------------------------------------*/
+/* k-means++ over the k-means|| candidates, each one standing for the
+   weight[m] objects nearest to it. Serial apart from the distance updates:
+   there are only about SEED_ROUNDS*SEED_OVERSAMPLE*numClusters of them */
+static
+void seed_weighted(float (*dist)(int, float*, float*), int numCoords,
+                   float **cand, int numCand, const int *weight,
+                   int numClusters, float **clusters)
+{
+    int     c, m;
+    double *d = (double*) malloc(numCand * sizeof(double));
+    assert(d != NULL);
+
+    for (c=0; c<numClusters; c++) {
+        double total = 0.0, u = seed_uniform(SEED_ROUNDS + 1, c), r;
+        int    pick = -1;
+
+        for (m=0; m<numCand; m++)
+            total += weight[m] * (c == 0 ? 1.0 : d[m]);
+        r = u * total;
+        for (m=0; m<numCand; m++) {
+            double w = weight[m] * (c == 0 ? 1.0 : d[m]);
+            if (w > 0.0) {
+                pick = m;
+                if (r < w) break;
+                r -= w;
+            }
+        }
+        if (pick < 0) pick = (int)(u * numCand);
+
+        memcpy(clusters[c], cand[pick], numCoords * sizeof(float));
+
+#pragma omp parallel for schedule(static)
+        for (m=0; m<numCand; m++) {
+            double dm = dist(numCoords, cand[m], clusters[c]);
+            if (c == 0 || dm < d[m]) d[m] = dm;
+        }
+    }
+    free(d);
+}
+
+/*----< seed_parallel() >----------------------------------------------------*/
+/* k-means||: starting from one random object, SEED_ROUNDS rounds each draw
+   every object independently with probability
+   SEED_OVERSAMPLE*numClusters*distance/(sum of distances), all objects of a
+   round at once. The candidates are then weighted by the no. objects
+   nearest to them and reduced to numClusters centers by k-means++ */
+static
+void seed_parallel(const seed_ops *ops, float (*dist)(int, float*, float*),
+                   float *objects, int stride, int numObjs, int numCoords,
+                   int numClusters, float **clusters, double *chunkSums)
+{
+    int     r, i, k, numCand, maxCand, numChunks = SEED_CHUNKS(numObjs);
+    float  *cand;       /* [maxCand][numCoords] */
+    float **candPtr;    /* [maxCand] rows of cand */
+    float  *minDist;    /* [numObjs] */
+    char   *selected;   /* [numObjs] */
+    int    *weight;
+
+    maxCand  = 1 + SEED_OVERSAMPLE * numClusters;
+    cand     = (float*) malloc((size_t)maxCand * numCoords * sizeof(float));
+    candPtr  = (float**) malloc(maxCand * sizeof(float*));
+    minDist  = (float*) malloc(numObjs * sizeof(float));
+    selected = (char*) malloc(numObjs);
+    assert(cand != NULL && candPtr != NULL);
+    assert(minDist != NULL && selected != NULL);
+
+    numCand    = 1;
+    candPtr[0] = cand;
+    seed_copy(objects, stride, numCoords,
+              (int)(seed_uniform(0, 0) * numObjs), cand);
+    ops->update(ops->arg, candPtr, 1, 0, chunkSums);
+
+    for (r=0; r<SEED_ROUNDS; r++) {
+        double phi = 0.0, l = (double)SEED_OVERSAMPLE * numClusters;
+        int    numNew = 0;
+
+        for (k=0; k<numChunks; k++) phi += chunkSums[k];
+        if (phi <= 0.0) break;      /* every object is a candidate */
+
+        ops->fetch(ops->arg, 0, numObjs, minDist);
+#pragma omp parallel for schedule(static) reduction(+:numNew)
+        for (i=0; i<numObjs; i++) {
+            selected[i] = seed_uniform(r + 1, i) * phi < l * minDist[i];
+            numNew += selected[i];
+        }
+        if (numNew == 0) continue;
+
+        if (numCand + numNew > maxCand) {
+            maxCand = 2 * maxCand > numCand + numNew ? 2 * maxCand
+                                                     : numCand + numNew;
+            cand    = (float*) realloc(cand, (size_t)maxCand * numCoords *
+                                             sizeof(float));
+            candPtr = (float**) realloc(candPtr, maxCand * sizeof(float*));
+            assert(cand != NULL && candPtr != NULL);
+        }
+        for (k=0; k<numCand+numNew; k++)
+            candPtr[k] = cand + (size_t)k * numCoords;
+        for (i=0, k=numCand; i<numObjs; i++)
+            if (selected[i]) seed_copy(objects, stride, numCoords, i,
+                                       candPtr[k++]);
+
+        ops->update(ops->arg, candPtr + numCand, numNew, numCand, chunkSums);
+        numCand += numNew;
+    }
+
+    if (numCand <= numClusters) {
+        /* too few distinct objects to choose from: keep them all, k-means++
+           picks the rest */
+        for (k=0; k<numCand; k++)
+            memcpy(clusters[k], candPtr[k], numCoords * sizeof(float));
+        seed_plusplus(ops, objects, stride, numObjs, numCoords, numClusters,
+                      numCand, clusters, chunkSums);
+    } else {
+        weight = (int*) calloc(numCand, sizeof(int));
+        assert(weight != NULL);
+        ops->count(ops->arg, numCand, weight);
+        seed_weighted(dist, numCoords, candPtr, numCand, weight, numClusters,
+                      clusters);
+        free(weight);
+    }
+
+    free(selected);
+    free(minDist);
+    free(candPtr);
+    free(cand);
+}
+
+/*----< kmeans_seed() >------------------------------------------------------*/
+/* fill clusters[numClusters][numCoords] with the initial centers. dist is
+   used for the k-means|| candidates only, ops for all distances to the
+   objects */
+void kmeans_seed(int              method,
+                 const seed_ops  *ops,
+                 float          (*dist)(int, float*, float*),
+                 float           *objects,     /* [numObjs][stride] */
+                 int              stride,
+                 int              numObjs,
+                 int              numCoords,
+                 int              numClusters,
+                 float          **clusters)    /* out: [numClusters][numCoords] */
+{
+    int     i;
+    double *chunkSums;
+
+    if (method == KMEANS_SEED_GIVEN) return;   /* see kmeans_start() */
+
+    if (method == KMEANS_SEED_FIRST) {
+        /* pick first numClusters elements of objects[] as initial cluster
+           centers */
+        for (i=0; i<numClusters; i++)
+            seed_copy(objects, stride, numCoords, i, clusters[i]);
+        return;
+    }
+
+    chunkSums = (double*) malloc(SEED_CHUNKS(numObjs) * sizeof(double));
+    assert(chunkSums != NULL);
+
+    if (method == KMEANS_SEED_PARALLEL)
+        seed_parallel(ops, dist, objects, stride, numObjs, numCoords,
+                      numClusters, clusters, chunkSums);
+    else
+        seed_plusplus(ops, objects, stride, numObjs, numCoords, numClusters,
+                      0, clusters, chunkSums);
+
+    free(chunkSums);
+}
+
+/*----< host backend >-------------------------------------------------------*/
+typedef struct {
+    float  (*dist)(int, float*, float*);
+    float   *objects;       /* [numObjs][stride] */
+    int      stride;
+    int      numObjs;
+    int      numCoords;
+    float   *minDist;       /* [numObjs] distance to the nearest center */
+    int     *nearest;       /* [numObjs] its id */
+} host_seed;
+
+static
+void host_seed_update(void *arg, float **centers, int count, int firstId,
+                      double *chunkSums)
+{
+    host_seed *h = (host_seed*) arg;
+    int        c, numChunks = SEED_CHUNKS(h->numObjs);
+
+    /* a chunk per iteration, so each sum is added in the same order */
+#pragma omp parallel for schedule(dynamic)
+    for (c=0; c<numChunks; c++) {
+        int    i, j;
+        int    begin = c * KMEANS_SEED_CHUNK;
+        int    end   = begin + KMEANS_SEED_CHUNK < h->numObjs ?
+                       begin + KMEANS_SEED_CHUNK : h->numObjs;
+        double sum   = 0.0;
+
+        for (i=begin; i<end; i++) {
+            float *object = h->objects + (size_t)i * h->stride;
+            float  best   = firstId == 0 ? FLT_MAX : h->minDist[i];
+            int    index  = firstId == 0 ? 0 : h->nearest[i];
+
+            for (j=0; j<count; j++) {
+                float d = h->dist(h->numCoords, object, centers[j]);
+                if (d < best) {
+                    best  = d;
+                    index = firstId + j;
+                }
+            }
+            h->minDist[i] = best;
+            h->nearest[i] = index;
+            sum += best;
+        }
+        chunkSums[c] = sum;
+    }
+}
+
+static
+void host_seed_fetch(void *arg, int begin, int end, float *out)
+{
+    host_seed *h = (host_seed*) arg;
+    memcpy(out, h->minDist + begin, (end - begin) * sizeof(float));
+}
+
+static
+void host_seed_count(void *arg, int numCenters, int *count)
+{
+    host_seed *h = (host_seed*) arg;
+    int        i;
+
+#pragma omp parallel for schedule(static)
+    for (i=0; i<h->numObjs; i++) {
+#pragma omp atomic
+        count[h->nearest[i]]++;
+    }
+}
+
+/*----< kmeans_seed_host() >-------------------------------------------------*/
+/* kmeans_seed() on objects in host memory, distances by dist (in parallel
+   when built with OpenMP) */
+void kmeans_seed_host(int      method,
+                      float  (*dist)(int, float*, float*),
+                      float   *objects,     /* [numObjs][stride] */
+                      int      stride,
+                      int      numObjs,
+                      int      numCoords,
+                      int      numClusters,
+                      float  **clusters)    /* out: [numClusters][numCoords] */
+{
+    host_seed h;
+    seed_ops  ops;
+
+    h.dist      = dist;
+    h.objects   = objects;
+    h.stride    = stride;
+    h.numObjs   = numObjs;
+    h.numCoords = numCoords;
+    h.minDist   = NULL;
+    h.nearest   = NULL;
+    if (method == KMEANS_SEED_PLUSPLUS || method == KMEANS_SEED_PARALLEL) {
+        h.minDist = (float*) malloc(numObjs * sizeof(float));
+        h.nearest = (int*) malloc(numObjs * sizeof(int));
+        assert(h.minDist != NULL && h.nearest != NULL);
+    }
+
+    ops.arg    = &h;
+    ops.update = host_seed_update;
+    ops.fetch  = host_seed_fetch;
+    ops.count  = host_seed_count;
+
+    kmeans_seed(method, &ops, dist, objects, stride, numObjs, numCoords,
+                numClusters, clusters);
+
+    free(h.minDist);
+    free(h.nearest);
+}
+
+/*----< kmeans_start() >-----------------------------------------------------*/
+/* with kmeans_seed(): the memberships the first iteration compares with.
+   For KMEANS_SEED_GIVEN, clusters[] are set to centers[] and membership[]
+   is kept, an id outside [0, numClusters) (an object added since) meaning
+   unassigned; otherwise no object is assigned yet */
+void kmeans_start(int          method,
+                  const float *centers,     /* [numClusters][numCoords] */
+                  int          numObjs,
+                  int          numCoords,
+                  int          numClusters,
+                  float      **clusters,    /* out: [numClusters][numCoords] */
+                  int         *membership)  /* in/out: [numObjs] */
+{
+    int i;
+
+    if (method != KMEANS_SEED_GIVEN) {
+        for (i=0; i<numObjs; i++) membership[i] = -1;
+        return;
+    }
+
+    memcpy(clusters[0], centers, (size_t)numClusters * numCoords *
+                                 sizeof(float));
+    for (i=0; i<numObjs; i++)
+        if (membership[i] < 0 || membership[i] >= numClusters)
+            membership[i] = -1;
+}
@@ -42,6 +42,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>     /* memset(), memcpy() */
 
 #include "kmeans.h"
 
@@ -87,15 +88,30 @@ int find_nearest_cluster(int     numClusters, /* no. clusters */
     return(index);
 }
 
-/*----< seq_kmeans() >-------------------------------------------------------*/
-/* return an array of cluster centers of size [numClusters][numCoords]       */
-float** seq_kmeans(float **objects,      /* in: [numObjs][numCoords] */
+/* workspace slots */
+#define WS_CLUSTERS          0  /* [numClusters][numCoords] */
+#define WS_CLUSTER_ROWS      1  /* [numClusters] */
+#define WS_SIZES             2  /* [numClusters] */
+#define WS_NEW_CLUSTERS      3  /* [numClusters][numCoords] */
+#define WS_NEW_CLUSTER_ROWS  4  /* [numClusters] */
+
+/*----< seq_kmeans_ws() >----------------------------------------------------*/
+/* return an array of cluster centers of size [numClusters][numCoords],
+   which belongs to ws                                                       */
+float** seq_kmeans_ws(kmeans_workspace *ws, /* in/out: buffers */
+                   float  *objects,      /* in: [numObjs][stride] */
+                   int     stride,       /* no. floats between objects */
                    int     numCoords,    /* no. features */
                    int     numObjs,      /* no. objects */
                    int     numClusters,  /* no. clusters */
+                   int     init,         /* KMEANS_SEED_* */
+                   float  *centers,      /* in: [numClusters][numCoords], for
+                                            KMEANS_SEED_GIVEN, else unused */
                    float   threshold,    /* % objects change membership */
-                   int    *membership,   /* out: [numObjs] */
-                   int    *loop_iterations)
+                   int    *membership,   /* in/out: [numObjs], see
+                                            KMEANS_SEED_GIVEN */
+                   int    *loop_iterations,
+                   prune_stats *prune)   /* in/out: pruning, may be NULL */
 {
     int      i, j, index, loop=0;
     int     *newClusterSize; /* [numClusters]: no. objects assigned in each
@@ -103,53 +119,79 @@ float** seq_kmeans(float **objects,      /* in: [numObjs][numCoords] */
     float    delta;          /* % of objects change their clusters */
     float  **clusters;       /* out: [numClusters][numCoords] */
     float  **newClusters;    /* [numClusters][numCoords] */
+    triangle_bounds *bounds = NULL;
 
-    /* allocate a 2D space for returning variable clusters[] (coordinates
-       of cluster centers) */
-    clusters    = (float**) malloc(numClusters *             sizeof(float*));
-    assert(clusters != NULL);
-    clusters[0] = (float*)  malloc(numClusters * numCoords * sizeof(float));
-    assert(clusters[0] != NULL);
+    /* a 2D space for returning variable clusters[] (coordinates of
+       cluster centers) */
+    clusters    = (float**) workspace_get(ws, WS_CLUSTER_ROWS,
+                                          numClusters * sizeof(float*));
+    clusters[0] = (float*)  workspace_get(ws, WS_CLUSTERS,
+                                          numClusters * numCoords * sizeof(float));
     for (i=1; i<numClusters; i++)
         clusters[i] = clusters[i-1] + numCoords;
 
-    /* pick first numClusters elements of objects[] as initial cluster centers*/
-    for (i=0; i<numClusters; i++)
-        for (j=0; j<numCoords; j++)
-            clusters[i][j] = objects[i][j];
+    kmeans_seed_host(init, euclid_dist_2, objects, stride, numObjs, numCoords,
+                     numClusters, clusters);
 
     /* initialize membership[] */
-    for (i=0; i<numObjs; i++) membership[i] = -1;
+    kmeans_start(init, centers, numObjs, numCoords, numClusters, clusters,
+                 membership);
 
     /* need to initialize newClusterSize and newClusters[0] to all 0 */
-    newClusterSize = (int*) calloc(numClusters, sizeof(int));
-    assert(newClusterSize != NULL);
+    newClusterSize = (int*) workspace_get(ws, WS_SIZES,
+                                          numClusters * sizeof(int));
+    memset(newClusterSize, 0, numClusters * sizeof(int));
 
-    newClusters    = (float**) malloc(numClusters *            sizeof(float*));
-    assert(newClusters != NULL);
-    newClusters[0] = (float*)  calloc(numClusters * numCoords, sizeof(float));
-    assert(newClusters[0] != NULL);
+    newClusters    = (float**) workspace_get(ws, WS_NEW_CLUSTER_ROWS,
+                                             numClusters * sizeof(float*));
+    newClusters[0] = (float*)  workspace_get(ws, WS_NEW_CLUSTERS,
+                                             numClusters * numCoords * sizeof(float));
+    memset(newClusters[0], 0, numClusters * numCoords * sizeof(float));
     for (i=1; i<numClusters; i++)
         newClusters[i] = newClusters[i-1] + numCoords;
 
+    if (prune != NULL) {
+        prune->loops = 0;
+        if (prune->method != KMEANS_FULL)
+            bounds = triangle_new(prune->method, euclid_dist_2, objects,
+                                  stride, numObjs, numCoords, numClusters);
+    }
+
     do {
+        kmeans_trace_record trace;
+
+        if (kmeans_tracing) trace.start = kmeans_trace_clock();
         delta = 0.0;
+        if (bounds != NULL)
+            delta = triangle_assign(bounds, clusters, membership,
+                                    &prune->skipped[prune->loops]);
+        if (prune != NULL) prune->loops++;
+
         for (i=0; i<numObjs; i++) {
-            /* find the array index of nestest cluster center */
-            index = find_nearest_cluster(numClusters, numCoords, objects[i],
-                                         clusters);
+            float *object = objects + (size_t)i * stride;
 
-            /* if membership changes, increase delta by 1 */
-            if (membership[i] != index) delta += 1.0;
+            if (bounds != NULL) {
+                /* already assigned by triangle_assign() */
+                index = membership[i];
+            }
+            else {
+                /* find the array index of nestest cluster center */
+                index = find_nearest_cluster(numClusters, numCoords,
+                                             object, clusters);
+
+                /* if membership changes, increase delta by 1 */
+                if (membership[i] != index) delta += 1.0;
 
-            /* assign the membership to object i */
-            membership[i] = index;
+                /* assign the membership to object i */
+                membership[i] = index;
+            }
 
             /* update new cluster centers : sum of objects located within */
             newClusterSize[index]++;
             for (j=0; j<numCoords; j++)
-                newClusters[index][j] += objects[i][j];
+                newClusters[index][j] += object[j];
         }
+        if (kmeans_tracing) trace.assign = kmeans_trace_clock() - trace.start;
 
         /* average the sum and replace old cluster centers with newClusters */
         for (i=0; i<numClusters; i++) {
@@ -160,15 +202,58 @@ float** seq_kmeans(float **objects,      /* in: [numObjs][numCoords] */
             }
             newClusterSize[i] = 0;   /* set back to 0 */
         }
-            
+
+        if (kmeans_tracing) {
+            /* the sums need no reduction */
+            trace.iteration = loop;
+            trace.reduce    = 0.0;
+            trace.update    = kmeans_trace_clock() - trace.start - trace.assign;
+            trace.delta     = (long)delta;
+            trace.distances = (long)numObjs * numClusters -
+                              (bounds != NULL ? prune->skipped[prune->loops-1] : 0);
+            trace.bytes     = (double)numObjs * numCoords * sizeof(float);
+            trace.h2d       = trace.d2h = 0.0;
+            kmeans_trace_iteration(&trace);
+        }
+
         delta /= numObjs;
     } while (delta > threshold && loop++ < 500);
 
     *loop_iterations = loop + 1;
 
-    free(newClusters[0]);
-    free(newClusters);
-    free(newClusterSize);
+    if (bounds != NULL) triangle_free(bounds);
+
+    return clusters;
+}
+
+/*----< seq_kmeans() >-------------------------------------------------------*/
+/* seq_kmeans_ws() on a workspace of its own, returns a malloc'd array of
+   cluster centers of size [numClusters][numCoords]                          */
+float** seq_kmeans(float  *objects,      /* in: [numObjs][stride] */
+                   int     stride,       /* no. floats between objects */
+                   int     numCoords,    /* no. features */
+                   int     numObjs,      /* no. objects */
+                   int     numClusters,  /* no. clusters */
+                   int     init,         /* KMEANS_SEED_* */
+                   float  *centers,      /* in: [numClusters][numCoords], for
+                                            KMEANS_SEED_GIVEN, else unused */
+                   float   threshold,    /* % objects change membership */
+                   int    *membership,   /* in/out: [numObjs], see
+                                            KMEANS_SEED_GIVEN */
+                   int    *loop_iterations,
+                   prune_stats *prune)   /* in/out: pruning, may be NULL */
+{
+    kmeans_workspace ws;
+    float **clusters, **result;
+
+    memset(&ws, 0, sizeof(ws));
+    result = seq_kmeans_ws(&ws, objects, stride, numCoords, numObjs,
+                           numClusters, init, centers, threshold, membership,
+                           loop_iterations, prune);
+
+    malloc2D(clusters, numClusters, numCoords, float);
+    memcpy(clusters[0], result[0], numClusters * numCoords * sizeof(float));
+    workspace_free(&ws);
 
     return clusters;
 }
@@ -58,7 +58,18 @@ static void usage(char *argv0, float threshold) {
         "       -b             : input file is in binary format (default no)\n"
         "       -n num_clusters: number of clusters (K must > 1)\n"
         "       -t threshold   : threshold value (default %.4f)\n"
+        "       -s seeding     : initial centers: first (default), plusplus\n"
+        "                        (k-means++) or parallel (k-means||)\n"
+        "       -c centres_file: warm start from the centers of an earlier run\n"
+        "       -M member_file : and its memberships (objects past its end\n"
+        "                        are new); both in the format of -B\n"
+        "       -e             : Elkan triangle-inequality pruning\n"
+        "       -H             : Hamerly triangle-inequality pruning\n"
+        "       -B             : write binary output files (default no)\n"
         "       -o             : output timing results (default no)\n"
+        "       -T trace_file  : per-iteration trace as JSON lines, or as a\n"
+        "                        Chrome trace if the name ends in .json\n"
+        "       -C             : add the hardware counters to the trace\n"
         "       -d             : enable debug mode\n";
     fprintf(stderr, help, argv0, threshold);
     exit(-1);
@@ -70,35 +81,67 @@ int main(int argc, char **argv) {
     extern char   *optarg;
     extern int     optind;
            int     i, j;
-           int     isBinaryFile, is_output_timing;
+           int     isBinaryFile, isBinaryOutput, is_output_timing;
 
            int     numClusters, numCoords, numObjs;
            int    *membership;    /* [numObjs] */
            char   *filename;
-           float **objects;       /* [numObjs][numCoords] data objects */
+           char   *centresFile, *membershipFile;  /* -c, -M */
+           char   *traceFile;     /* -T */
+           int     traceCounters; /* -C */
+           float  *centers;       /* [numClusters][numCoords], from -c */
+           kmeans_data data;      /* [numObjs][numCoords] data objects */
            float **clusters;      /* [numClusters][numCoords] cluster center */
            float   threshold;
-           double  timing, io_timing, clustering_timing;
+           double  timing, io_timing, read_timing, write_timing;
+           double  clustering_timing;
+           prune_stats prune;
            int     loop_iterations;
+           int     init;          /* KMEANS_SEED_* */
 
     /* some default values */
     _debug           = 0;
     threshold        = 0.001;
     numClusters      = 0;
     isBinaryFile     = 0;
+    isBinaryOutput   = 0;
     is_output_timing = 0;
     filename         = NULL;
+    centresFile      = NULL;
+    membershipFile   = NULL;
+    traceFile        = NULL;
+    traceCounters    = 0;
+    centers          = NULL;
+    prune.method     = KMEANS_FULL;
+    init             = KMEANS_SEED_FIRST;
 
-    while ( (opt=getopt(argc,argv,"p:i:n:t:abdo"))!= EOF) {
+    while ( (opt=getopt(argc,argv,"p:i:n:s:t:c:M:T:abBCdeHo"))!= EOF) {
         switch (opt) {
             case 'i': filename=optarg;
                       break;
             case 'b': isBinaryFile = 1;
                       break;
+            case 'B': isBinaryOutput = 1;
+                      break;
             case 't': threshold=atof(optarg);
                       break;
             case 'n': numClusters = atoi(optarg);
                       break;
+            case 's': init = kmeans_seed_method(optarg);
+                      if (init < 0) usage(argv[0], threshold);
+                      break;
+            case 'c': centresFile = optarg;
+                      break;
+            case 'M': membershipFile = optarg;
+                      break;
+            case 'e': prune.method = KMEANS_ELKAN;
+                      break;
+            case 'H': prune.method = KMEANS_HAMERLY;
+                      break;
+            case 'T': traceFile = optarg;
+                      break;
+            case 'C': traceCounters = 1;
+                      break;
             case 'o': is_output_timing = 1;
                       break;
             case 'd': _debug = 1;
@@ -111,29 +154,54 @@ int main(int argc, char **argv) {
     }
 
     if (filename == 0 || numClusters <= 1) usage(argv[0], threshold);
+    if (membershipFile != NULL && centresFile == NULL)
+        usage(argv[0], threshold);
+    if (centresFile != NULL) init = KMEANS_SEED_GIVEN;
+
+    if (traceFile != NULL &&
+        !kmeans_trace_open(traceFile, "seq", traceCounters))
+        exit(1);
 
     if (is_output_timing) io_timing = wtime();
 
     /* read data points from file ------------------------------------------*/
-    objects = file_read(isBinaryFile, filename, &numObjs, &numCoords);
-    if (objects == NULL) exit(1);
+    if (!file_load(isBinaryFile, filename, &data)) exit(1);
+    numObjs   = data.numObjs;
+    numCoords = data.numCoords;
+
+    /* membership: the cluster id for each data object */
+    membership = (int*) malloc(numObjs * sizeof(int));
+    assert(membership != NULL);
+
+    /* the outputs of an earlier run to start from -------------------------*/
+    if (centresFile != NULL) {
+        centers = (float*) malloc(numClusters * numCoords * sizeof(float));
+        assert(centers != NULL);
+        if (!file_load_centres(isBinaryOutput, centresFile, numClusters,
+                               numCoords, centers))
+            exit(1);
+        if (membershipFile == NULL)
+            for (i=0; i<numObjs; i++) membership[i] = -1;
+        else if (!file_load_membership(isBinaryOutput, membershipFile,
+                                       numObjs, membership))
+            exit(1);
+    }
 
     if (is_output_timing) {
         timing            = wtime();
         io_timing         = timing - io_timing;
+        read_timing       = io_timing;
         clustering_timing = timing;
     }
 
     /* start the timer for the core computation -----------------------------*/
-    /* membership: the cluster id for each data object */
-    membership = (int*) malloc(numObjs * sizeof(int));
-    assert(membership != NULL);
-
-    clusters = seq_kmeans(objects, numCoords, numObjs, numClusters, threshold,
-                          membership, &loop_iterations);
+    clusters = seq_kmeans(data.objects, data.stride, numCoords, numObjs,
+                          numClusters, init, centers, threshold, membership,
+                          &loop_iterations, &prune);
+    kmeans_trace_close();
 
-    free(objects[0]);
-    free(objects);
+    file_unload(&data);
+    free(centers);
 
     if (is_output_timing) {
         timing            = wtime();
@@ -142,7 +210,7 @@ int main(int argc, char **argv) {
 
     /* output: the coordinates of the cluster centres ----------------------*/
     file_write(filename, numClusters, numObjs, numCoords, clusters,
-               membership);
+               membership, isBinaryOutput);
 
     free(membership);
     free(clusters[0]);
@@ -150,7 +218,8 @@ int main(int argc, char **argv) {
 
     /*---- output performance numbers ---------------------------------------*/
     if (is_output_timing) {
-        io_timing += wtime() - timing;
+        write_timing = wtime() - timing;
+        io_timing   += write_timing;
         printf("\nPerforming **** Regular Kmeans (sequential version) ****\n");
 
         printf("Input file:     %s\n", filename);
@@ -159,10 +228,33 @@ int main(int argc, char **argv) {
         printf("numClusters   = %d\n", numClusters);
         printf("threshold     = %.4f\n", threshold);
 
+        printf("Seeding            = %s\n", kmeans_seed_name(init));
         printf("Loop iterations    = %d\n", loop_iterations);
 
         printf("I/O time           = %10.4f sec\n", io_timing);
+        if (isBinaryFile)
+            printf("Input read         = %10.4f sec (mapped)\n", read_timing);
+        else
+            printf("Input read         = %10.4f sec (%.1f MB/s parsed)\n",
+                   read_timing, data.fileSize / 1048576.0 / read_timing);
+        printf("Output write       = %10.4f sec%s\n", write_timing,
+               isBinaryOutput ? " (binary)" : "");
         printf("Computation timing = %10.4f sec\n", clustering_timing);
+
+        if (prune.method != KMEANS_FULL) {
+            long total = 0;
+            printf("Pruning            = %s\n",
+                   prune.method == KMEANS_ELKAN ? "Elkan" : "Hamerly");
+            for (i=0; i<prune.loops; i++) {
+                printf("  iteration %3d: skipped %12ld of %12ld distances (%5.1f%%)\n",
+                       i, prune.skipped[i], (long)numObjs * numClusters,
+                       100.0 * prune.skipped[i] / ((double)numObjs * numClusters));
+                total += prune.skipped[i];
+            }
+            printf("Skipped distances  = %ld of %ld (%5.1f%%)\n", total,
+                   (long)numObjs * numClusters * prune.loops,
+                   100.0 * total / ((double)numObjs * numClusters * prune.loops));
+        }
     }
 
     return(0);
@@ -0,0 +1,241 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+/*   File:         trace.c  (sequential, OpenMP, MPI and CUDA version)       */
+/*   Description:  per-iteration trace of the clustering (-T on all          */
+/*                 drivers): the time of each phase, the membership changes, */
+/*                 the distances evaluated and the bytes moved, with the     */
+/*                 hardware counters of perf_event_open() on request (-C).   */
+/*                 Written as JSON lines, or as a Chrome trace (chrome://    */
+/*                 tracing, Perfetto) when the file name ends in .json.      */
+/*                                                                           */
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>     /* strlen(), strcmp(), memset() */
+#include <time.h>       /* clock_gettime() */
+#include <unistd.h>     /* syscall(), read(), close() */
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "kmeans.h"
+
+#define TRACE_COUNTERS 3    /* cycles, instructions, cache misses */
+
+int kmeans_tracing = 0;
+
+static FILE       *traceFile;
+static const char *traceDriver;
+static int         traceChrome;     /* Chrome trace instead of JSON lines */
+static int         traceEvents;     /* events written, for the commas */
+static double      traceOrigin;     /* clock at kmeans_trace_open() */
+
+/* counters: TRACE_COUNTERS file descriptors per thread, -1 if unopened */
+static int         numCounterThreads;
+static int        *counterFds;
+static long long   counterLast[TRACE_COUNTERS];
+
+/*----< kmeans_trace_clock() >-----------------------------------------------*/
+/* monotonic seconds, also read by the kernels around their phases */
+double kmeans_trace_clock(void)
+{
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+/*----< open_counter() >-----------------------------------------------------*/
+/* a user-space hardware counter of the calling thread, -1 if there is none
+   (no PMU in a VM, perf_event_paranoid > 2, ...) */
+static int open_counter(unsigned long long config)
+{
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.type           = PERF_TYPE_HARDWARE;
+    attr.size           = sizeof(attr);
+    attr.config         = config;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv     = 1;
+    return (int) syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+/*----< read_counters() >----------------------------------------------------*/
+/* the counts of all threads since they were opened; each thread reads its
+   own, on the threads the OpenMP run-time keeps for every region of this
+   size */
+static void read_counters(long long *total)
+{
+    long long c0 = 0, c1 = 0, c2 = 0;
+
+#ifdef _OPENMP
+#pragma omp parallel num_threads(numCounterThreads) reduction(+:c0,c1,c2)
+#endif
+    {
+        int       tid = 0, k;
+        long long value[TRACE_COUNTERS];
+
+#ifdef _OPENMP
+        tid = omp_get_thread_num();
+#endif
+        for (k=0; k<TRACE_COUNTERS; k++) {
+            int fd = counterFds[tid * TRACE_COUNTERS + k];
+            value[k] = 0;
+            if (fd >= 0 && read(fd, &value[k], sizeof(value[k])) !=
+                           sizeof(value[k]))
+                value[k] = 0;
+        }
+        c0 += value[0];
+        c1 += value[1];
+        c2 += value[2];
+    }
+    total[0] = c0;
+    total[1] = c1;
+    total[2] = c2;
+}
+
+/*----< open_counters() >----------------------------------------------------*/
+/* returns 0 if not even the cycle counter opens on the first thread */
+static int open_counters(void)
+{
+    static const unsigned long long config[TRACE_COUNTERS] = {
+        PERF_COUNT_HW_CPU_CYCLES,
+        PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_MISSES,
+    };
+    int available = 0;
+
+    numCounterThreads = 1;
+#ifdef _OPENMP
+    numCounterThreads = omp_get_max_threads();
+#endif
+    counterFds = (int*) malloc(numCounterThreads * TRACE_COUNTERS *
+                               sizeof(int));
+    assert(counterFds != NULL);
+
+#ifdef _OPENMP
+#pragma omp parallel num_threads(numCounterThreads)
+#endif
+    {
+        int tid = 0, k;
+
+#ifdef _OPENMP
+        tid = omp_get_thread_num();
+#endif
+        for (k=0; k<TRACE_COUNTERS; k++)
+            counterFds[tid * TRACE_COUNTERS + k] = open_counter(config[k]);
+        if (tid == 0) available = counterFds[0] >= 0;
+    }
+
+    if (available) read_counters(counterLast);
+    return available;
+}
+
+/*----< kmeans_trace_open() >------------------------------------------------*/
+/* Start tracing into filename, the events tagged with driver ("seq", "omp",
+   "mpi", "cuda"). With counters, each iteration also reports the cycles,
+   instructions and cache misses of the threads that run it. Returns 0 if
+   the file cannot be created. */
+int kmeans_trace_open(const char *filename, const char *driver, int counters)
+{
+    size_t len = strlen(filename);
+
+    traceFile = fopen(filename, "w");
+    if (traceFile == NULL) {
+        perror(filename);
+        return 0;
+    }
+    traceDriver = driver;
+    traceChrome = len >= 5 && strcmp(filename + len - 5, ".json") == 0;
+    traceEvents = 0;
+    traceOrigin = kmeans_trace_clock();
+    if (traceChrome) fprintf(traceFile, "{\"traceEvents\": [");
+
+    counterFds = NULL;
+    if (counters && !open_counters()) {
+        fprintf(stderr, "Warning: no hardware counters (perf_event_open), "
+                "tracing without them\n");
+        free(counterFds);
+        counterFds = NULL;
+    }
+
+    kmeans_tracing = 1;
+    return 1;
+}
+
+/*----< chrome_phase() >-----------------------------------------------------*/
+static void chrome_phase(const char *name, double start, double seconds,
+                         int iteration)
+{
+    fprintf(traceFile, "%s\n{\"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"X\", "
+            "\"ts\": %.3f, \"dur\": %.3f, \"pid\": 0, \"tid\": 0, "
+            "\"args\": {\"iteration\": %d}}", traceEvents++ ? "," : "",
+            name, traceDriver, (start - traceOrigin) * 1e6, seconds * 1e6,
+            iteration);
+}
+
+/*----< kmeans_trace_iteration() >-------------------------------------------*/
+/* Write the record of one iteration; the counters are those since the
+   previous record (or kmeans_trace_open()). */
+void kmeans_trace_iteration(const kmeans_trace_record *r)
+{
+    long long now[TRACE_COUNTERS], delta[TRACE_COUNTERS];
+    int       k;
+
+    if (!kmeans_tracing) return;
+
+    if (counterFds != NULL) {
+        read_counters(now);
+        for (k=0; k<TRACE_COUNTERS; k++) {
+            delta[k]       = now[k] - counterLast[k];
+            counterLast[k] = now[k];
+        }
+    }
+
+    if (traceChrome) {
+        chrome_phase("assign", r->start, r->assign, r->iteration);
+        chrome_phase("reduce", r->start + r->assign, r->reduce, r->iteration);
+        chrome_phase("update", r->start + r->assign + r->reduce, r->update,
+                     r->iteration);
+        fprintf(traceFile, ",\n{\"name\": \"iteration\", \"ph\": \"C\", "
+                "\"ts\": %.3f, \"pid\": 0, \"args\": {\"delta\": %ld, "
+                "\"distances\": %ld, \"bytes\": %.0f, \"h2d_bytes\": %.0f, "
+                "\"d2h_bytes\": %.0f", (r->start - traceOrigin) * 1e6,
+                r->delta, r->distances, r->bytes, r->h2d, r->d2h);
+    } else {
+        fprintf(traceFile, "{\"driver\": \"%s\", \"iteration\": %d, "
+                "\"start_s\": %.9f, \"assign_s\": %.9f, \"reduce_s\": %.9f, "
+                "\"update_s\": %.9f, \"delta\": %ld, \"distances\": %ld, "
+                "\"bytes\": %.0f, \"h2d_bytes\": %.0f, \"d2h_bytes\": %.0f",
+                traceDriver, r->iteration, r->start - traceOrigin, r->assign,
+                r->reduce, r->update, r->delta, r->distances, r->bytes,
+                r->h2d, r->d2h);
+    }
+    if (counterFds != NULL)
+        fprintf(traceFile, ", \"cycles\": %lld, \"instructions\": %lld, "
+                "\"ipc\": %.3f, \"cache_misses\": %lld", delta[0], delta[1],
+                delta[0] > 0 ? (double)delta[1] / delta[0] : 0.0, delta[2]);
+    fprintf(traceFile, traceChrome ? "}}" : "}\n");
+}
+
+/*----< kmeans_trace_close() >-----------------------------------------------*/
+void kmeans_trace_close(void)
+{
+    int i;
+
+    if (!kmeans_tracing) return;
+    kmeans_tracing = 0;
+
+    if (traceChrome) fprintf(traceFile, "\n]}\n");
+    fclose(traceFile);
+
+    if (counterFds != NULL) {
+        for (i=0; i<numCounterThreads * TRACE_COUNTERS; i++)
+            if (counterFds[i] >= 0) close(counterFds[i]);
+        free(counterFds);
+        counterFds = NULL;
+    }
+}
@@ -0,0 +1,348 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+/*   File:         triangle.c  (sequential and OpenMP version)               */
+/*   Description:  triangle-inequality pruning of the assignment step, after */
+/*                 C. Elkan, "Using the triangle inequality to accelerate    */
+/*                 k-means" (ICML 2003) and G. Hamerly, "Making k-means      */
+/*                 even faster" (SDM 2010). The distances that are still     */
+/*                 computed use the caller's euclid_dist_2(), so the         */
+/*                 memberships are exactly those of the full search.         */
+/*                                                                           */
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>     /* memcpy() */
+#include <math.h>
+#include <float.h>
+
+#include "kmeans.h"
+
+struct triangle_bounds {
+    int      method;        /* KMEANS_ELKAN or KMEANS_HAMERLY */
+    float  (*euclid_dist_2)(int, float*, float*);
+    float   *objects;       /* [numObjs][stride] */
+    int      stride;
+    int      numObjs;
+    int      numCoords;
+    int      numClusters;
+    int      initialized;   /* bounds are valid for oldClusters */
+
+    float  **oldClusters;   /* [numClusters][numCoords] centers of last call */
+    double  *drift;         /* [numClusters] distance each center moved */
+    double   maxDrift;      /* largest drift[], of center maxIndex */
+    double   secondDrift;   /* largest drift[] of the other centers */
+    int      maxIndex;
+    double  *half;          /* [numClusters][numClusters] half the center-
+                               center distances (Elkan only) */
+    double  *s;             /* [numClusters] half the distance to the nearest
+                               other center */
+    double  *upper;         /* [numObjs] >= distance to own center */
+    float   *lower;         /* Elkan:   [numObjs][numClusters] <= distance to
+                                        each center
+                               Hamerly: [numObjs] <= distance to any other
+                                        center */
+
+    /* the float distances carry a relative error of about numCoords ulps
+       (all terms are positive), and upper/lower pick up an absolute error
+       from the drifts added since they were computed. A center is only
+       skipped when it is farther by more than both. */
+    double   eps;
+    double   driftSum;
+    double   slack;
+};
+
+/* c (lower bound l) is strictly farther than the own center (upper bound
+   u), even if every distance involved was rounded the wrong way */
+#define FARTHER(b, l, u) \
+    ((l) * (1.0 - (b)->eps) > (u) * (1.0 + (b)->eps) + (b)->slack)
+
+/* store a lower bound as float, rounding down so it stays a lower bound */
+__inline static
+float lower_bound(double v)
+{
+    float f;
+
+    if (v <= 0.0) return 0.0f;
+    f = (float)v;
+    if (f > v) f = nextafterf(f, 0.0f);
+    return f;
+}
+
+/*----< triangle_new() >-----------------------------------------------------*/
+triangle_bounds* triangle_new(int     method,        /* KMEANS_ELKAN/HAMERLY */
+                              float (*euclid_dist_2)(int, float*, float*),
+                              float  *objects,       /* [numObjs][stride] */
+                              int     stride,
+                              int     numObjs,
+                              int     numCoords,
+                              int     numClusters)
+{
+    triangle_bounds *b;
+    size_t           numLower;
+
+    assert(method == KMEANS_ELKAN || method == KMEANS_HAMERLY);
+
+    b = (triangle_bounds*) calloc(1, sizeof(triangle_bounds));
+    assert(b != NULL);
+
+    b->method        = method;
+    b->euclid_dist_2 = euclid_dist_2;
+    b->objects       = objects;
+    b->stride        = stride;
+    b->numObjs       = numObjs;
+    b->numCoords     = numCoords;
+    b->numClusters   = numClusters;
+    b->eps           = 2.0 * (numCoords + 4) * FLT_EPSILON;
+
+    malloc2D(b->oldClusters, numClusters, numCoords, float);
+
+    b->drift = (double*) malloc(numClusters * sizeof(double));
+    assert(b->drift != NULL);
+    b->s     = (double*) malloc(numClusters * sizeof(double));
+    assert(b->s != NULL);
+    b->upper = (double*) malloc(numObjs * sizeof(double));
+    assert(b->upper != NULL);
+
+    if (method == KMEANS_ELKAN) {
+        b->half = (double*) malloc((size_t)numClusters * numClusters *
+                                   sizeof(double));
+        assert(b->half != NULL);
+        numLower = (size_t)numObjs * numClusters;
+    }
+    else
+        numLower = numObjs;
+
+    b->lower = (float*) malloc(numLower * sizeof(float));
+    assert(b->lower != NULL);
+
+    return b;
+}
+
+/*----< triangle_free() >----------------------------------------------------*/
+void triangle_free(triangle_bounds *b)
+{
+    free(b->oldClusters[0]);
+    free(b->oldClusters);
+    free(b->drift);
+    free(b->s);
+    free(b->half);
+    free(b->upper);
+    free(b->lower);
+    free(b);
+}
+
+/*----< full_search() >------------------------------------------------------*/
+/* all numClusters distances of object i: the nearest one wins exactly as in
+   find_nearest_cluster(), and every bound is set from scratch */
+static
+int full_search(triangle_bounds *b, float **clusters, int i)
+{
+    int    numClusters = b->numClusters;
+    float *object      = b->objects + (size_t)i * b->stride;
+    int    index, c;
+    float  dist, min_dist, second_dist;
+
+    index       = 0;
+    min_dist    = FLT_MAX;
+    second_dist = FLT_MAX;
+
+    for (c=0; c<numClusters; c++) {
+        dist = b->euclid_dist_2(b->numCoords, object, clusters[c]);
+        if (b->method == KMEANS_ELKAN)
+            b->lower[(size_t)i * numClusters + c] = lower_bound(sqrt(dist));
+
+        if (c == 0 || dist < min_dist) {
+            second_dist = min_dist;
+            min_dist    = dist;
+            index       = c;
+        }
+        else if (dist < second_dist)
+            second_dist = dist;
+    }
+
+    b->upper[i] = sqrt(min_dist);
+    if (b->method == KMEANS_HAMERLY)
+        b->lower[i] = lower_bound(sqrt(second_dist));
+
+    return index;
+}
+
+/*----< elkan_search() >-----------------------------------------------------*/
+static
+int elkan_search(triangle_bounds *b, float **clusters, int i, int index,
+                 long *numDists)
+{
+    int    numClusters = b->numClusters;
+    float *object      = b->objects + (size_t)i * b->stride;
+    float *lower       = b->lower + (size_t)i * numClusters;
+    double u           = b->upper[i];
+    int    tight       = 0;          /* u is the distance of this call */
+    int    c;
+    float  dist, min_dist = 0.0;
+
+    /* no other center is within twice the own center's distance */
+    if (FARTHER(b, b->s[index], u)) return index;
+
+    for (c=0; c<numClusters; c++) {
+        if (c == index ||
+            FARTHER(b, lower[c], u) ||
+            FARTHER(b, b->half[index * numClusters + c], u))
+            continue;
+
+        if (!tight) {
+            min_dist = b->euclid_dist_2(b->numCoords, object, clusters[index]);
+            (*numDists)++;
+            u = sqrt(min_dist);
+            lower[index] = lower_bound(u);
+            tight = 1;
+            if (FARTHER(b, lower[c], u) ||
+                FARTHER(b, b->half[index * numClusters + c], u))
+                continue;
+        }
+
+        dist = b->euclid_dist_2(b->numCoords, object, clusters[c]);
+        (*numDists)++;
+        lower[c] = lower_bound(sqrt(dist));
+
+        /* ties go to the lower cluster id, as in the full search */
+        if (dist < min_dist || (dist == min_dist && c < index)) {
+            min_dist = dist;
+            index    = c;
+            u        = sqrt(dist);
+        }
+    }
+
+    b->upper[i] = u;
+    return index;
+}
+
+/*----< hamerly_search() >---------------------------------------------------*/
+static
+int hamerly_search(triangle_bounds *b, float **clusters, int i, int index,
+                   long *numDists)
+{
+    double bound = b->lower[i];
+
+    if (b->s[index] > bound) bound = b->s[index];
+    if (FARTHER(b, bound, b->upper[i])) return index;
+
+    /* tighten the upper bound and test again */
+    b->upper[i] = sqrt(b->euclid_dist_2(b->numCoords,
+                                        b->objects + (size_t)i * b->stride,
+                                        clusters[index]));
+    (*numDists)++;
+    if (FARTHER(b, bound, b->upper[i])) return index;
+
+    /* full_search() evaluates all numClusters again, the own one too */
+    (*numDists) += b->numClusters;
+    return full_search(b, clusters, i);
+}
+
+/*----< move_centers() >-----------------------------------------------------*/
+/* loosen the bounds by how far each center moved since the last call and
+   recompute the center-center distances */
+static
+void move_centers(triangle_bounds *b, float **clusters)
+{
+    int    numClusters = b->numClusters;
+    int    numCoords   = b->numCoords;
+    int    i, j, c;
+
+    b->maxIndex    = 0;
+    b->maxDrift    = 0.0;
+    b->secondDrift = 0.0;
+    for (c=0; c<numClusters; c++) {
+        b->drift[c] = sqrt(b->euclid_dist_2(numCoords, b->oldClusters[c],
+                                            clusters[c]));
+        if (b->drift[c] > b->maxDrift) {
+            b->secondDrift = b->maxDrift;
+            b->maxDrift    = b->drift[c];
+            b->maxIndex    = c;
+        }
+        else if (b->drift[c] > b->secondDrift)
+            b->secondDrift = b->drift[c];
+    }
+    memcpy(b->oldClusters[0], clusters[0],
+           numClusters * numCoords * sizeof(float));
+
+    b->driftSum += b->maxDrift;
+    b->slack     = 2.0 * b->eps * b->driftSum;
+
+    #pragma omp parallel for private(i,j) schedule(static)
+    for (i=0; i<numClusters; i++) {
+        double nearest = DBL_MAX;
+        for (j=0; j<numClusters; j++) {
+            double h;
+            if (j == i) continue;
+            h = 0.5 * sqrt(b->euclid_dist_2(numCoords, clusters[i],
+                                            clusters[j]));
+            if (b->method == KMEANS_ELKAN)
+                b->half[i * numClusters + j] = h;
+            if (h < nearest) nearest = h;
+        }
+        b->s[i] = nearest;
+    }
+
+    /* upper[] is updated with the object's membership in triangle_assign() */
+    if (b->method == KMEANS_ELKAN) {
+        #pragma omp parallel for private(i,c) schedule(static)
+        for (i=0; i<b->numObjs; i++) {
+            float *lower = b->lower + (size_t)i * numClusters;
+            for (c=0; c<numClusters; c++)
+                lower[c] = lower_bound(lower[c] - b->drift[c]);
+        }
+    }
+}
+
+/*----< triangle_assign() >--------------------------------------------------*/
+/* assign every object to its nearest center, skipping the centers the bounds
+   rule out. Returns the no. objects whose membership changed; *skipped gets
+   the no. distance evaluations saved over the full search. */
+int triangle_assign(triangle_bounds *b,
+                    float          **clusters,   /* [numClusters][numCoords] */
+                    int             *membership, /* in/out: [numObjs] */
+                    long            *skipped)
+{
+    int    numClusters = b->numClusters;
+    int    i, index, delta = 0;
+    long   numDists = 0;
+
+    if (b->initialized) move_centers(b, clusters);
+
+    #pragma omp parallel for private(i,index) schedule(dynamic, 64) \
+                             reduction(+:delta,numDists)
+    for (i=0; i<b->numObjs; i++) {
+        if (!b->initialized) {
+            index = full_search(b, clusters, i);
+            numDists += numClusters;
+        }
+        else {
+            index = membership[i];
+            b->upper[i] += b->drift[index];
+            if (b->method == KMEANS_ELKAN)
+                index = elkan_search(b, clusters, i, index, &numDists);
+            else {
+                /* the other centers moved by at most the largest drift,
+                   or the second largest if that was the own center */
+                b->lower[i] = lower_bound(b->lower[i] - (index == b->maxIndex ?
+                                          b->secondDrift : b->maxDrift));
+                index = hamerly_search(b, clusters, i, index, &numDists);
+            }
+        }
+
+        /* if membership changes, increase delta by 1 */
+        if (membership[i] != index) delta++;
+        membership[i] = index;
+    }
+
+    if (!b->initialized) {
+        memcpy(b->oldClusters[0], clusters[0],
+               numClusters * b->numCoords * sizeof(float));
+        b->initialized = 1;
+
+        /* move_centers() of the next call fills s[] and half[] */
+    }
+
+    *skipped = (long)b->numObjs * numClusters - numDists;
+    return delta;
+}
@@ -0,0 +1,741 @@
+/*
+    bench.cpp: benchmark harness for all versions of matrix multiplication
+
+    Copyright (C) 2011  Abhinav Jauhri (abhinav.jauhri@gmail.com), Carnegie Mellon University - Silicon Valley
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+  Runs every variant over a sweep of sizes and thread counts and reports
+  the median of repeated runs (after warmups) as GFLOP/s, percent of the
+  machine peak, effective bandwidth (the 3 n^2 floats that must move)
+  and strong or weak scaling against the smallest thread count. Each
+  result is checked against the packed omp product of the same inputs,
+  which is far cheaper than the tests' tripleloop() at large sizes.
+
+    ./bench -s 256,512,1024 -t 1,2,4 -c run.csv -j run.json
+    ./bench -v omp -S weak -s 512
+    ./bench -b old.csv          # flags variants slower than old.csv
+    ./bench -v opt1,opt4 -B     # each block size the tuner would try
+    ./bench -N local -A spread  # on a multi-socket host
+
+  Exit status: 0, 1 if a result was wrong, 2 if -b found a regression.
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <map>
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <omp.h>
+
+#include "../omp/micro_kernel.h"
+#include "../omp/variants.h"
+#include "numa.h"
+#ifdef BENCH_CUDA
+#include "../cuda/matrix_mul.h"
+#endif
+
+// The sequential and omp headers share the MATRIX_MUL_H guard, so their
+// entry points are declared here
+namespace sequential
+{
+  void matrix_multiplication(float *sq_matrix_1, float *sq_matrix_2, float *sq_matrix_result, unsigned int sq_dimension);
+}
+
+namespace omp
+{
+  void matrix_multiplication(float *sq_matrix_1, float *sq_matrix_2, float *sq_matrix_result, unsigned int sq_dimension);
+}
+
+namespace bench
+{
+  typedef void (*matrix_mul_fn)(float *sq_matrix_1, float *sq_matrix_2, float *sq_matrix_result, unsigned int sq_dimension);
+
+  struct Variant
+  {
+    std::string name;
+    std::string description;
+    bool threaded;              // honours omp_set_num_threads()
+    bool gpu;
+    matrix_mul_fn run;
+    omp::variants::variant_fn blocked;  // used instead of run when set
+    unsigned int block_size;
+  };
+
+  struct Result
+  {
+    std::string variant;
+    const char *scaling;        // "strong", "weak" or "-" (single thread, gpu)
+    unsigned int n;
+    int threads;
+    int reps;
+    double median, min, max;    // seconds
+    double gflops;
+    double peak_pct;            // NAN when the peak is unknown
+    double gbytes;
+    double speedup;             // over the smallest thread count
+    double efficiency;
+    float max_err;
+    bool ok;
+  };
+
+  // The same inputs and reference product for every variant of a size
+  struct Problem
+  {
+    Matrix a, b, reference;
+  };
+
+  static Variant variant(const char *name, const char *description, bool threaded, bool gpu,
+                         matrix_mul_fn run)
+  {
+    Variant v = { name, description, threaded, gpu, run, NULL, 0 };
+    return v;
+  }
+
+  // A variant of the omp registry, with its default or the given block size
+  static Variant registered(const omp::variants::Variant &r, unsigned int block_size)
+  {
+    Variant v = { r.name, r.description, r.threaded, false, NULL, r.run, r.block_size };
+    if (block_size > 0 && r.block_size > 0) {
+      char suffix[16];
+      snprintf(suffix, sizeof(suffix), ":%u", block_size);
+      v.name += suffix;
+      v.block_size = block_size;
+    }
+    return v;
+  }
+
+// The sequential and cuda versions and the omp registry
+  static std::vector<Variant> variants()
+  {
+    std::vector<Variant> all;
+
+    all.push_back(variant("sequential", "sequential/ naive i-j-k loop", false, false,
+                          sequential::matrix_multiplication));
+    all.push_back(variant("omp", "omp/ matrix_multiplication(): packed, or MATMUL_VARIANT", true, false,
+                          omp::matrix_multiplication));
+    unsigned int count;
+    const omp::variants::Variant *r = omp::variants::all(&count);
+    for (unsigned int i = 0; i < count; i++)
+      all.push_back(registered(r[i], 0));
+#ifdef BENCH_CUDA
+    // Its process wide Context keeps the device buffers between runs
+    all.push_back(variant("cuda", "cuda/ tiled kernel, host/device copies included", false, true,
+                          cuda::matrix_multiplication));
+#endif
+    return all;
+  }
+
+  static void run(const Variant &v, float *a, float *b, float *c, unsigned int n)
+  {
+    if (v.blocked != NULL)
+      v.blocked(a, b, c, n, v.block_size);
+    else
+      v.run(a, b, c, n);
+  }
+
+  static double seconds()
+  {
+    // steady_clock rather than rdtsc: it is monotonic, in ns, and does not
+    // drift with frequency scaling or between cores
+    return std::chrono::duration<double>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  static double flops(unsigned int sq_dimension)
+  {
+    double n = sq_dimension;
+    return (2*n - 1) * n * n;
+  }
+
+  static double median(std::vector<double> times)
+  {
+    std::sort(times.begin(), times.end());
+    size_t half = times.size() / 2;
+    return (times.size() % 2) ? times[half] : 0.5 * (times[half - 1] + times[half]);
+  }
+
+/**
+ * @brief Estimated FP32 GFLOP/s of one core: the SIMD width of the widest
+ *        micro-kernel the host runs, two FMA (or one add plus one mul for
+ *        SSE3) issues per cycle, and the maximum clock from sysfs or cpuinfo
+ */
+  static double core_peak_gflops()
+  {
+    const omp::kernel::MicroKernel &uk = omp::kernel::select();
+    double flops_per_cycle = (&uk == &omp::kernel::avx512) ? 64.0 :
+                             (&uk == &omp::kernel::avx2) ? 32.0 : 8.0;
+    double ghz = 0.0;
+    FILE *f = fopen("/sys/devices/system/cpu/cpu0/cpufreq/cpuinfo_max_freq", "r");
+    if (f != NULL) {
+      double khz;
+      if (fscanf(f, "%lf", &khz) == 1)
+        ghz = khz * 1e-6;
+      fclose(f);
+    }
+    if (ghz <= 0.0 && (f = fopen("/proc/cpuinfo", "r")) != NULL) {
+      char line[256];
+      double mhz;
+      while (fgets(line, sizeof(line), f) != NULL)
+        if (sscanf(line, "cpu MHz : %lf", &mhz) == 1) {
+          ghz = mhz * 1e-3;
+          break;
+        }
+      fclose(f);
+    }
+    return flops_per_cycle * ghz;
+  }
+
+  static std::vector<unsigned int> parse_list(const char *arg)
+  {
+    std::vector<unsigned int> values;
+    std::string s(arg);
+    size_t start = 0;
+    while (start <= s.size()) {
+      size_t end = s.find(',', start);
+      if (end == std::string::npos)
+        end = s.size();
+      int v = atoi(s.substr(start, end - start).c_str());
+      if (v > 0)
+        values.push_back(v);
+      start = end + 1;
+    }
+    return values;
+  }
+
+  // The format of matrix_mul_01.dat: a count, then one size per line
+  static std::vector<unsigned int> read_sizes(const char *filename)
+  {
+    std::vector<unsigned int> sizes;
+    FILE *f = fopen(filename, "r");
+    int count, n;
+    if (f == NULL) {
+      perror(filename);
+      exit(1);
+    }
+    if (fscanf(f, "%d", &count) == 1)
+      while (count-- > 0 && fscanf(f, "%d", &n) == 1)
+        if (n > 0)
+          sizes.push_back(n);
+    fclose(f);
+    return sizes;
+  }
+
+  struct Options
+  {
+    std::vector<unsigned int> sizes;
+    std::vector<unsigned int> threads;
+    std::vector<std::string> names;
+    int reps, warmups;
+    bool strong, weak;
+    bool every_block;
+    double time_limit;          // seconds per run before larger sizes are skipped
+    double core_peak, gpu_peak; // GFLOP/s
+    const char *csv, *json, *baseline;
+    double tolerance;           // percent slower than the baseline
+    Placement placement;        // of the matrices
+    Binding binding;            // of the threads
+  };
+
+  // The pages of the inputs are placed for the largest thread count
+  static Problem &problem(std::map<unsigned int, Problem> &cache, const Options &opt,
+                          unsigned int n)
+  {
+    std::map<unsigned int, Problem>::iterator it = cache.find(n);
+    if (it != cache.end())
+      return it->second;
+
+    Problem &p = cache[n];
+    size_t elements = (size_t)n * n;
+    omp_set_num_threads(opt.threads.back());
+    bind_threads(opt.binding);
+    p.a.allocate(n, opt.placement);
+    p.b.allocate(n, opt.placement);
+    p.reference.allocate(n, opt.placement);
+    srand(n);
+    for (size_t i = 0; i < elements; i++) {
+      p.a[i] = (float)rand() / (float)RAND_MAX;
+      p.b[i] = (float)rand() / (float)RAND_MAX;
+    }
+    omp::variants::packed(p.a.data(), p.b.data(), p.reference.data(), n, 0);
+    return p;
+  }
+
+/**
+ * @brief Largest difference from the reference, relative to its largest
+ *        entry (about n/4 for the uniform [0, 1] inputs)
+ */
+  static float max_error(const Matrix &result, const Matrix &reference)
+  {
+    float err = 0.0f, scale = 0.0f;
+    for (size_t i = 0; i < result.size(); i++) {
+      float d = fabsf(result[i] - reference[i]);
+      if (!(d <= err))          // also catches NaN
+        err = d;
+      scale = std::max(scale, fabsf(reference[i]));
+    }
+    return (scale > 0.0f) ? err / scale : err;
+  }
+
+  static void measure(const Variant &v, const Options &opt, Problem &p, unsigned int n, int threads,
+                      Result &r)
+  {
+    Matrix result;
+    std::vector<double> times;
+    double elapsed = 0.0;
+
+    if (v.threaded)
+      omp_set_num_threads(threads);
+    bind_threads(opt.binding);
+    result.allocate(n, opt.placement);
+
+    for (int i = 0; i < opt.warmups; i++) {
+      double start = seconds();
+      run(v, p.a.data(), p.b.data(), result.data(), n);
+      elapsed = seconds() - start;
+    }
+    // One run is all there is time for: keep the warmup as the measurement
+    if (opt.warmups > 0 && elapsed > opt.time_limit)
+      times.push_back(elapsed);
+    else
+      for (int i = 0; i < opt.reps; i++) {
+        double start = seconds();
+        run(v, p.a.data(), p.b.data(), result.data(), n);
+        times.push_back(seconds() - start);
+      }
+
+    r.variant = v.name;
+    r.n = n;
+    r.threads = threads;
+    r.reps = times.size();
+    r.median = median(times);
+    r.min = *std::min_element(times.begin(), times.end());
+    r.max = *std::max_element(times.begin(), times.end());
+    r.gflops = flops(n) * 1e-9 / r.median;
+    double peak = v.gpu ? opt.gpu_peak : opt.core_peak * threads;
+    r.peak_pct = (peak > 0.0) ? 100.0 * r.gflops / peak : NAN;
+    r.gbytes = 3.0 * n * n * sizeof(float) * 1e-9 / r.median;
+    r.speedup = r.efficiency = NAN;
+    r.max_err = max_error(result, p.reference);
+    r.ok = r.max_err < 1e-5f;
+  }
+
+  static void print_header()
+  {
+    printf("%-12s %-6s %6s %7s %4s %11s %11s %9s %7s %8s %7s %6s %9s\n",
+           "variant", "scale", "n", "threads", "reps", "median(ms)", "min(ms)",
+           "GFLOP/s", "%peak", "GB/s", "speedup", "eff", "rel.err");
+  }
+
+  static void print_result(const Result &r)
+  {
+    char pct[16] = "-", speedup[16] = "-", eff[16] = "-";
+    if (!std::isnan(r.peak_pct))
+      snprintf(pct, sizeof(pct), "%.1f", r.peak_pct);
+    if (!std::isnan(r.speedup))
+      snprintf(speedup, sizeof(speedup), "%.2f", r.speedup);
+    if (!std::isnan(r.efficiency))
+      snprintf(eff, sizeof(eff), "%.2f", r.efficiency);
+    printf("%-12s %-6s %6u %7d %4d %11.3f %11.3f %9.2f %7s %8.2f %7s %6s %9.1e%s\n",
+           r.variant.c_str(), r.scaling, r.n, r.threads, r.reps, r.median * 1e3,
+           r.min * 1e3, r.gflops, pct, r.gbytes, speedup, eff, r.max_err,
+           r.ok ? "" : "  WRONG");
+    fflush(stdout);
+  }
+
+  // NAN as an empty CSV field
+  static void csv_number(FILE *f, double v, const char *format)
+  {
+    fputc(',', f);
+    if (!std::isnan(v))
+      fprintf(f, format, v);
+  }
+
+  static void write_csv(const char *filename, const std::vector<Result> &results)
+  {
+    FILE *f = fopen(filename, "w");
+    if (f == NULL) {
+      perror(filename);
+      return;
+    }
+    fprintf(f, "variant,scaling,n,threads,reps,median_s,min_s,max_s,gflops,peak_pct,"
+               "gbytes_s,speedup,efficiency,max_rel_err,ok\n");
+    for (size_t i = 0; i < results.size(); i++) {
+      const Result &r = results[i];
+      fprintf(f, "%s,%s,%u,%d,%d,%.9g,%.9g,%.9g,%.6g", r.variant.c_str(), r.scaling,
+              r.n, r.threads, r.reps, r.median, r.min, r.max, r.gflops);
+      csv_number(f, r.peak_pct, "%.4g");
+      csv_number(f, r.gbytes, "%.6g");
+      csv_number(f, r.speedup, "%.4g");
+      csv_number(f, r.efficiency, "%.4g");
+      fprintf(f, ",%.3g,%d\n", r.max_err, r.ok ? 1 : 0);
+    }
+    fclose(f);
+  }
+
+  // NAN as null
+  static void json_number(FILE *f, const char *key, double v, const char *format)
+  {
+    fprintf(f, ", \"%s\": ", key);
+    if (std::isnan(v))
+      fputs("null", f);
+    else
+      fprintf(f, format, v);
+  }
+
+  static void write_json(const char *filename, const Options &opt, const std::vector<Result> &results)
+  {
+    FILE *f = fopen(filename, "w");
+    if (f == NULL) {
+      perror(filename);
+      return;
+    }
+    fprintf(f, "{\n  \"machine\": {\"procs\": %d, \"isa\": \"%s\"", omp_get_num_procs(),
+            omp::kernel::select().isa);
+    json_number(f, "core_peak_gflops", opt.core_peak > 0.0 ? opt.core_peak : NAN, "%.6g");
+    json_number(f, "gpu_peak_gflops", opt.gpu_peak > 0.0 ? opt.gpu_peak : NAN, "%.6g");
+    fprintf(f, ", \"placement\": \"%s\", \"binding\": \"%s\"", placement_name(opt.placement),
+            binding_name(opt.binding));
+    fprintf(f, "},\n  \"warmups\": %d,\n  \"results\": [", opt.warmups);
+    for (size_t i = 0; i < results.size(); i++) {
+      const Result &r = results[i];
+      fprintf(f, "%s\n    {\"variant\": \"%s\", \"scaling\": \"%s\", \"n\": %u, \"threads\": %d, "
+                 "\"reps\": %d, \"median_s\": %.9g, \"min_s\": %.9g, \"max_s\": %.9g, \"gflops\": %.6g",
+              i ? "," : "", r.variant.c_str(), r.scaling, r.n, r.threads, r.reps,
+              r.median, r.min, r.max, r.gflops);
+      json_number(f, "peak_pct", r.peak_pct, "%.4g");
+      json_number(f, "gbytes_s", r.gbytes, "%.6g");
+      json_number(f, "speedup", r.speedup, "%.4g");
+      json_number(f, "efficiency", r.efficiency, "%.4g");
+      fprintf(f, ", \"max_rel_err\": %.3g, \"ok\": %s}", r.max_err, r.ok ? "true" : "false");
+    }
+    fprintf(f, "\n  ]\n}\n");
+    fclose(f);
+  }
+
+  static std::string key(const std::string &variant, const std::string &scaling, unsigned int n, int threads)
+  {
+    char buf[64];
+    snprintf(buf, sizeof(buf), "/%s/%u/%d", scaling.c_str(), n, threads);
+    return variant + buf;
+  }
+
+/**
+ * @brief Compares the GFLOP/s with those of an earlier -c file
+ * @return number of results slower than the baseline by more than tolerance
+ */
+  static int compare_baseline(const char *filename, double tolerance, const std::vector<Result> &results)
+  {
+    FILE *f = fopen(filename, "r");
+    if (f == NULL) {
+      perror(filename);
+      return 0;
+    }
+    // Columns are found by name, so files of older builds with fewer
+    // columns still compare
+    std::map<std::string, double> baseline;
+    std::vector<std::string> columns;
+    char line[1024];
+    int variant = -1, scaling = -1, n = -1, threads = -1, gflops = -1;
+    while (fgets(line, sizeof(line), f) != NULL) {
+      std::vector<std::string> fields;
+      line[strcspn(line, "\r\n")] = '\0';
+      // strtok_r() skips empty fields: split by hand
+      for (char *p = line, *comma; ; p = comma + 1) {
+        comma = strchr(p, ',');
+        fields.push_back(comma ? std::string(p, comma - p) : std::string(p));
+        if (comma == NULL)
+          break;
+      }
+      if (columns.empty()) {
+        columns = fields;
+        for (size_t i = 0; i < columns.size(); i++) {
+          if (columns[i] == "variant") variant = i;
+          if (columns[i] == "scaling") scaling = i;
+          if (columns[i] == "n") n = i;
+          if (columns[i] == "threads") threads = i;
+          if (columns[i] == "gflops") gflops = i;
+        }
+        if (variant < 0 || scaling < 0 || n < 0 || threads < 0 || gflops < 0) {
+          fprintf(stderr, "%s: not a bench CSV file\n", filename);
+          fclose(f);
+          return 0;
+        }
+        continue;
+      }
+      if (fields.size() < columns.size())
+        continue;
+      baseline[key(fields[variant], fields[scaling], atoi(fields[n].c_str()),
+                   atoi(fields[threads].c_str()))] = atof(fields[gflops].c_str());
+    }
+    fclose(f);
+
+    int regressions = 0, compared = 0;
+    printf("\nAgainst %s (slower by more than %.0f%%):\n", filename, tolerance);
+    for (size_t i = 0; i < results.size(); i++) {
+      const Result &r = results[i];
+      std::map<std::string, double>::iterator it =
+          baseline.find(key(r.variant, r.scaling, r.n, r.threads));
+      if (it == baseline.end() || it->second <= 0.0)
+        continue;
+      compared++;
+      double ratio = r.gflops / it->second;
+      if (ratio < 1.0 - tolerance / 100.0) {
+        printf("  %-12s %-6s n = %5u threads = %3d: %9.2f GFLOP/s, was %9.2f (%+.1f%%)\n",
+               r.variant.c_str(), r.scaling, r.n, r.threads, r.gflops, it->second,
+               100.0 * (ratio - 1.0));
+        regressions++;
+      }
+    }
+    printf("  %d of %d compared results regressed\n", regressions, compared);
+    return regressions;
+  }
+
+  static void usage(const char *argv0)
+  {
+    std::vector<Variant> all = variants();
+    fprintf(stderr,
+        "Usage: %s [switches]\n"
+        "       -s sizes     : comma separated matrix sizes (default 64,128,256,512,1024)\n"
+        "       -f file      : sizes from a test case file (e.g. ../matrix_mul_02.dat)\n"
+        "       -v variants  : comma separated variants (default all, see below),\n"
+        "                      omp ones as name:block_size for another block size\n"
+        "       -B           : every omp variant with each block size of the tuner\n"
+        "       -t threads   : comma separated thread counts (default 1, 2, 4, ...\n"
+        "                      up to the number of processors)\n"
+        "       -r reps      : timed runs per point, the median is reported (default 5)\n"
+        "       -w warmups   : untimed runs before them (default 1)\n"
+        "       -S scaling   : strong (fixed n, default), weak (n grows with the\n"
+        "                      cube root of threads, the same work per thread) or both\n"
+        "       -T seconds   : a variant that needs longer for one run is measured\n"
+        "                      once and skips the larger sizes (default 10)\n"
+        "       -P gflops    : peak GFLOP/s of one core (default estimated from\n"
+        "                      the SIMD width and clock)\n"
+        "       -G gflops    : peak GFLOP/s of the GPU, for %%peak of cuda variants\n"
+        "       -c file.csv  : write the results as CSV\n"
+        "       -j file.json : write the results as JSON\n"
+        "       -b file.csv  : compare GFLOP/s with an earlier -c file\n"
+        "       -R percent   : slowdown that -b reports as a regression (default 10)\n"
+        "       -N placement : NUMA placement of the matrices: off (default, the main\n"
+        "                      thread touches every page), local (rows first touched by\n"
+        "                      the threads, as schedule(static) splits them) or interleave\n"
+        "       -A binding   : pin the threads to cpus: none (default), close (one\n"
+        "                      socket after the other) or spread (alternating sockets)\n"
+        "variants:\n", argv0);
+    for (size_t i = 0; i < all.size(); i++)
+      fprintf(stderr, "       %-16s %s\n", all[i].name.c_str(), all[i].description.c_str());
+    exit(-1);
+  }
+} // namespace bench
+
+int
+main(int argc, char **argv)
+{
+  using namespace bench;
+
+  std::vector<Variant> all;
+  std::vector<Result> results;
+  std::map<unsigned int, Problem> cache;
+  Options opt;
+  int c;
+
+  opt.reps = 5;
+  opt.warmups = 1;
+  opt.strong = true;
+  opt.weak = false;
+  opt.every_block = false;
+  opt.time_limit = 10.0;
+  opt.core_peak = 0.0;
+  opt.gpu_peak = 0.0;
+  opt.csv = opt.json = opt.baseline = NULL;
+  opt.tolerance = 10.0;
+  opt.placement = PLACE_OFF;
+  opt.binding = BIND_NONE;
+
+  while ((c = getopt(argc, argv, "s:f:v:t:r:w:S:T:P:G:c:j:b:R:N:A:Bh")) != -1) {
+    switch (c) {
+      case 's': opt.sizes = parse_list(optarg); break;
+      case 'f': opt.sizes = read_sizes(optarg); break;
+      case 'v': {
+        std::string s(optarg);
+        size_t start = 0, end;
+        while ((end = s.find(',', start)) != std::string::npos) {
+          opt.names.push_back(s.substr(start, end - start));
+          start = end + 1;
+        }
+        opt.names.push_back(s.substr(start));
+        break;
+      }
+      case 't': opt.threads = parse_list(optarg); break;
+      case 'r': opt.reps = atoi(optarg); break;
+      case 'w': opt.warmups = atoi(optarg); break;
+      case 'S':
+        opt.strong = strcmp(optarg, "weak") != 0;
+        opt.weak = strcmp(optarg, "strong") != 0;
+        if (strcmp(optarg, "strong") && strcmp(optarg, "weak") && strcmp(optarg, "both"))
+          usage(argv[0]);
+        break;
+      case 'T': opt.time_limit = atof(optarg); break;
+      case 'P': opt.core_peak = atof(optarg); break;
+      case 'G': opt.gpu_peak = atof(optarg); break;
+      case 'c': opt.csv = optarg; break;
+      case 'j': opt.json = optarg; break;
+      case 'b': opt.baseline = optarg; break;
+      case 'R': opt.tolerance = atof(optarg); break;
+      case 'B': opt.every_block = true; break;
+      case 'N':
+        if (!parse_placement(optarg, opt.placement))
+          usage(argv[0]);
+        break;
+      case 'A':
+        if (!parse_binding(optarg, opt.binding))
+          usage(argv[0]);
+        break;
+      default: usage(argv[0]);
+    }
+  }
+  if (optind < argc || opt.reps < 1 || opt.warmups < 0)
+    usage(argv[0]);
+
+  if (opt.sizes.empty()) {
+    unsigned int sizes[] = { 64, 128, 256, 512, 1024 };
+    opt.sizes.assign(sizes, sizes + 5);
+  }
+  if (opt.threads.empty()) {
+    int procs = omp_get_num_procs();
+    for (int t = 1; t < procs; t *= 2)
+      opt.threads.push_back(t);
+    opt.threads.push_back(procs);
+  }
+  std::sort(opt.threads.begin(), opt.threads.end());
+  if (opt.core_peak <= 0.0)
+    opt.core_peak = core_peak_gflops();
+
+  all = variants();
+  std::vector<Variant> selected;
+  if (opt.names.empty())
+    selected = all;
+  for (size_t i = 0; i < opt.names.size(); i++) {
+    const std::string &name = opt.names[i];
+    size_t j = 0, colon = name.find(':');
+    while (j < all.size() && name != all[j].name)
+      j++;
+    if (j < all.size())
+      selected.push_back(all[j]);
+    else if (colon != std::string::npos &&
+             omp::variants::find(name.substr(0, colon).c_str()) != NULL)
+      selected.push_back(registered(*omp::variants::find(name.substr(0, colon).c_str()),
+                                    atoi(name.c_str() + colon + 1)));
+    else {
+      fprintf(stderr, "Error: unknown variant %s\n", name.c_str());
+      usage(argv[0]);
+    }
+  }
+  if (opt.every_block) {
+    std::vector<Variant> expanded;
+    for (size_t i = 0; i < selected.size(); i++) {
+      const omp::variants::Variant *r = omp::variants::find(selected[i].name.c_str());
+      if (r == NULL || r->block_sizes == NULL) {
+        expanded.push_back(selected[i]);
+        continue;
+      }
+      for (const unsigned int *bs = r->block_sizes; *bs != 0; bs++)
+        expanded.push_back(registered(*r, *bs));
+    }
+    selected = expanded;
+  }
+
+  printf("Processors         = %d\n", omp_get_num_procs());
+  printf("SIMD kernel        = %s\n", omp::kernel::select().isa);
+  printf("Core peak          = %.1f GFLOP/s (%.1f with %d threads)\n", opt.core_peak,
+         opt.core_peak * opt.threads.back(), opt.threads.back());
+  printf("NUMA placement     = %s, thread binding %s\n", placement_name(opt.placement),
+         binding_name(opt.binding));
+  printf("Runs per point     = %d warmup + median of %d\n\n", opt.warmups, opt.reps);
+  print_header();
+
+  bool wrong = false;
+  for (size_t i = 0; i < selected.size(); i++) {
+    const Variant &v = selected[i];
+    unsigned int size_limit = 0;   // 0: none yet
+
+    for (int mode = 0; mode < 2; mode++) {
+      bool weak = (mode == 1);
+      if ((weak && !opt.weak) || (!weak && !opt.strong))
+        continue;
+      // Without threads there is nothing to scale: one pass at 1 thread
+      if (!v.threaded && mode == 1 && opt.strong)
+        continue;
+
+      for (size_t s = 0; s < opt.sizes.size(); s++) {
+        std::vector<unsigned int> threads = opt.threads;
+        if (!v.threaded)
+          threads = std::vector<unsigned int>(1, 1);
+        double base_time = 0.0, base_gflops = 0.0;
+        int base_threads = 0;
+
+        for (size_t t = 0; t < threads.size(); t++) {
+          unsigned int n = opt.sizes[s];
+          if (weak && v.threaded)
+            n = (unsigned int)lround(n * cbrt((double)threads[t] / threads[0]));
+          if (size_limit && n > size_limit) {
+            fprintf(stderr, "%s: skipping n = %u, n = %u took longer than %.0f s\n",
+                    v.name.c_str(), n, size_limit, opt.time_limit);
+            continue;
+          }
+
+          Result r;
+          measure(v, opt, problem(cache, opt, n), n, threads[t], r);
+          r.scaling = !v.threaded ? "-" : (weak ? "weak" : "strong");
+          if (base_threads == 0) {
+            base_threads = threads[t];
+            base_time = r.median;
+            base_gflops = r.gflops;
+          }
+          if (v.threaded) {
+            double scale = (double)threads[t] / base_threads;
+            r.speedup = weak ? r.gflops / base_gflops : base_time / r.median;
+            r.efficiency = r.speedup / scale;
+          }
+          if (r.median > opt.time_limit && (size_limit == 0 || n < size_limit))
+            size_limit = n;
+
+          wrong |= !r.ok;
+          print_result(r);
+          results.push_back(r);
+        }
+      }
+    }
+  }
+
+  if (opt.csv)
+    write_csv(opt.csv, results);
+  if (opt.json)
+    write_json(opt.json, opt, results);
+
+  int regressions = 0;
+  if (opt.baseline)
+    regressions = compare_baseline(opt.baseline, opt.tolerance, results);
+
+  if (wrong)
+    return 1;
+  return regressions ? 2 : 0;
+}
@@ -0,0 +1,180 @@
+/*
+    numa.cpp: page placement of the benchmark matrices and binding of the
+    OpenMP threads to cpus (Linux: mbind() and sched_setaffinity() are
+    called directly, so no libnuma is needed)
+
+    Copyright (C) 2011  Abhinav Jauhri (abhinav.jauhri@gmail.com), Carnegie Mellon University - Silicon Valley
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <vector>
+#include <assert.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <omp.h>
+
+#include "numa.h"
+
+namespace bench
+{
+  static const int MPOL_INTERLEAVE_ = 3;        // <numaif.h> MPOL_INTERLEAVE
+  static const unsigned long MAX_NODES = 1024;  // bits of the node mask
+
+  bool parse_placement(const char *name, Placement &placement)
+  {
+    if (strcmp(name, "off") == 0)
+      placement = PLACE_OFF;
+    else if (strcmp(name, "local") == 0)
+      placement = PLACE_LOCAL;
+    else if (strcmp(name, "interleave") == 0)
+      placement = PLACE_INTERLEAVE;
+    else
+      return false;
+    return true;
+  }
+
+  bool parse_binding(const char *name, Binding &binding)
+  {
+    if (strcmp(name, "none") == 0)
+      binding = BIND_NONE;
+    else if (strcmp(name, "close") == 0)
+      binding = BIND_CLOSE;
+    else if (strcmp(name, "spread") == 0)
+      binding = BIND_SPREAD;
+    else
+      return false;
+    return true;
+  }
+
+  const char *placement_name(Placement placement)
+  {
+    static const char *names[] = { "off", "local", "interleave" };
+    return names[placement];
+  }
+
+  const char *binding_name(Binding binding)
+  {
+    static const char *names[] = { "none", "close", "spread" };
+    return names[binding];
+  }
+
+  Matrix::~Matrix()
+  {
+    free(data_);
+  }
+
+  void Matrix::allocate(unsigned int n, Placement placement)
+  {
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t row = (size_t)n * sizeof(float);
+    size_t bytes = std::max(page, (n * row + page - 1) / page * page);
+
+    free(data_);
+    void *p = NULL;
+    int failed = posix_memalign(&p, page, bytes);
+    assert(failed == 0);
+    (void)failed;
+    data_ = (float *)p;
+    size_ = (size_t)n * n;
+
+    if (placement == PLACE_INTERLEAVE) {
+      // Every node: the kernel keeps those the process may use
+      std::vector<unsigned long> mask(MAX_NODES / (8 * sizeof(unsigned long)), ~0UL);
+      if (syscall(SYS_mbind, data_, bytes, MPOL_INTERLEAVE_, &mask[0], MAX_NODES, 0) != 0) {
+        static bool warned = false;
+        if (!warned)
+          perror("Warning: mbind(MPOL_INTERLEAVE), pages placed by first touch");
+        warned = true;
+      }
+    }
+
+    if (placement == PLACE_OFF) {
+      memset(data_, 0, n * row);
+      return;
+    }
+    char *rows = (char *)data_;
+#pragma omp parallel for schedule(static)
+    for (int i = 0; i < (int)n; i++)
+      memset(rows + i * row, 0, row);
+  }
+
+  // The cpus this process may run on, socket by socket (close) or taking
+  // the next one of every socket in turn (spread)
+  static std::vector<int> cpu_order(Binding binding)
+  {
+    std::vector<int> order;
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+      return order;
+
+    std::vector<std::pair<int, int> > cpus;   // (socket, cpu)
+    for (int i = 0; i < CPU_SETSIZE; i++) {
+      if (!CPU_ISSET(i, &allowed))
+        continue;
+      char path[128];
+      int socket = 0;
+      snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/physical_package_id", i);
+      FILE *f = fopen(path, "r");
+      if (f != NULL) {
+        if (fscanf(f, "%d", &socket) != 1 || socket < 0)
+          socket = 0;
+        fclose(f);
+      }
+      cpus.push_back(std::make_pair(socket, i));
+    }
+    std::sort(cpus.begin(), cpus.end());
+
+    if (binding == BIND_CLOSE) {
+      for (size_t i = 0; i < cpus.size(); i++)
+        order.push_back(cpus[i].second);
+      return order;
+    }
+    // The rank of each cpu within its socket; sorting by it interleaves them
+    std::vector<std::pair<std::pair<int, int>, int> > ranked;
+    for (size_t i = 0, rank = 0; i < cpus.size(); i++) {
+      rank = (i > 0 && cpus[i].first == cpus[i - 1].first) ? rank + 1 : 0;
+      ranked.push_back(std::make_pair(std::make_pair((int)rank, cpus[i].first), cpus[i].second));
+    }
+    std::sort(ranked.begin(), ranked.end());
+    for (size_t i = 0; i < ranked.size(); i++)
+      order.push_back(ranked[i].second);
+    return order;
+  }
+
+  int bind_threads(Binding binding)
+  {
+    if (binding == BIND_NONE)
+      return 0;
+    std::vector<int> order = cpu_order(binding);
+    if (order.empty())
+      return 0;
+
+    int bound = 0;
+#pragma omp parallel reduction(+:bound)
+    {
+      cpu_set_t cpu;
+      CPU_ZERO(&cpu);
+      CPU_SET(order[omp_get_thread_num() % order.size()], &cpu);
+      if (sched_setaffinity(0, sizeof(cpu), &cpu) == 0)
+        bound++;
+    }
+    return bound;
+  }
+}
@@ -0,0 +1,86 @@
+/*
+    numa.h: page placement of the benchmark matrices and binding of the
+    OpenMP threads to cpus, for multi-socket hosts
+
+    Copyright (C) 2011  Abhinav Jauhri (abhinav.jauhri@gmail.com), Carnegie Mellon University - Silicon Valley
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef BENCH_NUMA_H
+#define BENCH_NUMA_H
+
+#include <stddef.h>
+
+namespace bench
+{
+  enum Placement
+  {
+    PLACE_OFF,          // the main thread touches every page (as std::vector)
+    PLACE_LOCAL,        // rows first touched in parallel, schedule(static)
+    PLACE_INTERLEAVE    // pages round-robin over the nodes
+  };
+
+  enum Binding
+  {
+    BIND_NONE,
+    BIND_CLOSE,         // one socket after the other
+    BIND_SPREAD         // round-robin over the sockets
+  };
+
+/**
+ * @brief -N and -A arguments
+ * @return false if the name is none of them
+ */
+  bool parse_placement(const char *name, Placement &placement);
+  bool parse_binding(const char *name, Binding &binding);
+  const char *placement_name(Placement placement);
+  const char *binding_name(Binding binding);
+
+/**
+ * @brief A zeroed, page aligned n x n matrix placed as asked. PLACE_LOCAL
+ *        splits the rows over the threads as the row-parallel variants
+ *        do, so call it with the thread count (and binding) of the runs.
+ */
+  class Matrix
+  {
+  public:
+    Matrix() : data_(NULL), size_(0) {}
+    ~Matrix();
+
+    void allocate(unsigned int n, Placement placement);
+    float *data() const { return data_; }
+    size_t size() const { return size_; }
+    float &operator[](size_t i) { return data_[i]; }
+    float operator[](size_t i) const { return data_[i]; }
+
+  private:
+    float *data_;
+    size_t size_;
+
+    Matrix(const Matrix &);
+    Matrix &operator=(const Matrix &);
+  };
+
+/**
+ * @brief Pins thread t of a team of omp_get_max_threads() threads to the
+ *        t-th cpu in the order of binding. The OpenMP run-time keeps the
+ *        threads for later regions of the same size, so call it again
+ *        after omp_set_num_threads().
+ * @return Number of threads pinned, 0 for BIND_NONE or on failure
+ */
+  int bind_threads(Binding binding);
+}
+
+#endif
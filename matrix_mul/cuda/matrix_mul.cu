@@ -16,63 +16,381 @@
 */
 
 
+#include <iostream>
+#include <algorithm>
+#include <string.h>
+#include <sys/time.h>
 #include <cuda.h>
 #include <cuda_runtime.h>
 #include "matrix_mul.h"
-#define TILE_WIDTH 2
+
+// Each block computes a BLOCK_TILE x BLOCK_TILE tile of the result,
+// walking the k dimension TILE_WIDTH at a time through shared memory.
+// The THREADS x THREADS threads of a block each keep a
+// THREAD_TILE x THREAD_TILE sub-tile of C in registers.
+#define TILE_WIDTH 16
+#define BLOCK_TILE 64
+#define THREAD_TILE 4
+#define THREADS (BLOCK_TILE / THREAD_TILE)
+#define LOADS_PER_THREAD (BLOCK_TILE * TILE_WIDTH / (THREADS * THREADS))
 
 namespace cuda
 {
-  __global__ 
-  void 
-  matrix_mul_kernel(float *sq_matrix_1, float *sq_matrix_2, float *sq_matrix_result, int sq_dimension)
+  static double kernel_gflops = 0.0;
+
+  static void
+  check(cudaError_t e, const char *what)
   {
-    
+    if (e != cudaSuccess)
+      std::cerr << "CUDA error (" << what << "): " << cudaGetErrorString(e) << std::endl;
+  }
+
+  __global__
+  void
+  gemm_kernel(bool trans_a, bool trans_b, int m, int n, int k, float alpha,
+              const float *a, int lda, const float *b, int ldb, float beta, float *c, int ldc)
+  {
+    // A is stored transposed (k major) so that the inner loop reads both
+    // tiles along a row of shared memory.
+    __shared__ float tile_1[TILE_WIDTH][BLOCK_TILE];
+    __shared__ float tile_2[TILE_WIDTH][BLOCK_TILE];
+
     int tx = threadIdx.x;
     int ty = threadIdx.y;
-    
-    float sum = 0.0f;
-    
-    for(int k = 0; k < sq_dimension; k++)
+    int tid = ty * THREADS + tx;
+    int row_0 = blockIdx.y * BLOCK_TILE;
+    int col_0 = blockIdx.x * BLOCK_TILE;
+
+    float sum[THREAD_TILE][THREAD_TILE];
+    for (int i = 0; i < THREAD_TILE; i++)
+      for (int j = 0; j < THREAD_TILE; j++)
+        sum[i][j] = 0.0f;
+
+    for (int k_0 = 0; k_0 < k; k_0 += TILE_WIDTH)
+      {
+        // Both tiles hold BLOCK_TILE * TILE_WIDTH values, i.e.
+        // LOADS_PER_THREAD per thread. Consecutive threads read consecutive
+        // addresses of global memory (along the stored rows, so the walk
+        // is swapped for a transposed operand); anything outside the
+        // matrix is loaded as 0 so partial tiles need no special casing
+        // below.
+        for (int l = 0; l < LOADS_PER_THREAD; l++)
+          {
+            int e = tid + l * THREADS * THREADS;
+            int r, col;
+
+            if (trans_a)
+              {
+                r = row_0 + e % BLOCK_TILE;
+                col = k_0 + e / BLOCK_TILE;
+              }
+            else
+              {
+                r = row_0 + e / TILE_WIDTH;
+                col = k_0 + e % TILE_WIDTH;
+              }
+            tile_1[col - k_0][r - row_0] =
+              (r < m && col < k) ? a[trans_a ? col*lda + r : r*lda + col] : 0.0f;
+
+            if (trans_b)
+              {
+                r = k_0 + e % TILE_WIDTH;
+                col = col_0 + e / TILE_WIDTH;
+              }
+            else
+              {
+                r = k_0 + e / BLOCK_TILE;
+                col = col_0 + e % BLOCK_TILE;
+              }
+            tile_2[r - k_0][col - col_0] =
+              (r < k && col < n) ? b[trans_b ? col*ldb + r : r*ldb + col] : 0.0f;
+          }
+        __syncthreads();
+
+        for (int kk = 0; kk < TILE_WIDTH; kk++)
+          {
+            float a_reg[THREAD_TILE], b_reg[THREAD_TILE];
+            // Thread (tx, ty) owns rows ty + i*THREADS and columns
+            // tx + j*THREADS, which keeps the stores to C coalesced.
+            for (int i = 0; i < THREAD_TILE; i++)
+              a_reg[i] = tile_1[kk][ty + i * THREADS];
+            for (int j = 0; j < THREAD_TILE; j++)
+              b_reg[j] = tile_2[kk][tx + j * THREADS];
+            for (int i = 0; i < THREAD_TILE; i++)
+              for (int j = 0; j < THREAD_TILE; j++)
+                sum[i][j] += a_reg[i] * b_reg[j];
+          }
+        __syncthreads();
+      }
+
+    for (int i = 0; i < THREAD_TILE; i++)
+      {
+        int r = row_0 + ty + i * THREADS;
+        for (int j = 0; j < THREAD_TILE; j++)
+          {
+            int col = col_0 + tx + j * THREADS;
+            // C is not read when beta is 0, as in BLAS
+            if (r < m && col < n)
+              c[r*ldc + col] = (beta == 0.0f) ? alpha * sum[i][j]
+                                              : alpha * sum[i][j] + beta * c[r*ldc + col];
+          }
+      }
+  }
+
+  double
+  last_kernel_gflops()
+  {
+    return kernel_gflops;
+  }
+
+  static void
+  launch_gemm(bool trans_a, bool trans_b, unsigned int m, unsigned int n, unsigned int k, float alpha,
+              const float *a_d, unsigned int lda, const float *b_d, unsigned int ldb, float beta,
+              float *c_d, unsigned int ldc, cudaStream_t stream)
+  {
+    dim3 dimBlock(THREADS, THREADS);
+    dim3 dimGrid((n + BLOCK_TILE - 1) / BLOCK_TILE,
+                 (m + BLOCK_TILE - 1) / BLOCK_TILE);
+    gemm_kernel<<<dimGrid, dimBlock, 0, stream>>>(trans_a, trans_b, m, n, k, alpha, a_d, lda, b_d, ldb,
+                                                  beta, c_d, ldc);
+    check(cudaGetLastError(), "gemm_kernel");
+  }
+
+  /* rows x cols of src (row stride ld) into dense dst, and back */
+  static void
+  pack(float *dst, const float *src, unsigned int rows, unsigned int cols, unsigned int ld)
+  {
+    if (ld == cols)
+      memcpy(dst, src, (size_t) rows * cols * sizeof(float));
+    else
+      for (unsigned int r = 0; r < rows; r++)
+        memcpy(dst + (size_t) r * cols, src + (size_t) r * ld, cols * sizeof(float));
+  }
+
+  static void
+  unpack(float *dst, unsigned int ld, const float *src, unsigned int rows, unsigned int cols)
+  {
+    if (ld == cols)
+      memcpy(dst, src, (size_t) rows * cols * sizeof(float));
+    else
+      for (unsigned int r = 0; r < rows; r++)
+        memcpy(dst + (size_t) r * ld, src + (size_t) r * cols, cols * sizeof(float));
+  }
+
+  static double
+  flops(unsigned int sq_dimension)
+  {
+    double n = sq_dimension;
+    return (2*n - 1) * n * n;
+  }
+
+  static double
+  host_seconds()
+  {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec * 1e-6;
+  }
+
+  /* One stream with its own device buffers and pinned staging area. A
+     result copied back into h_result is handed to the caller's buffer
+     (pending_result) the next time the slot is used, or when the batch is
+     drained. */
+  struct Context::Slot
+  {
+    cudaStream_t stream;
+    cudaEvent_t start, stop;
+    size_t capacity;            // floats per buffer
+    float *d_1, *d_2, *d_result;
+    float *h_1, *h_2, *h_result;
+    float *pending_result;
+    unsigned int pending_rows, pending_cols, pending_ld;
+
+    void
+    reserve(size_t size)
+    {
+      if (size <= capacity)
+        return;
+      release();
+      check(cudaMalloc((void**) &d_1, size * sizeof(float)), "cudaMalloc");
+      check(cudaMalloc((void**) &d_2, size * sizeof(float)), "cudaMalloc");
+      check(cudaMalloc((void**) &d_result, size * sizeof(float)), "cudaMalloc");
+      check(cudaMallocHost((void**) &h_1, size * sizeof(float)), "cudaMallocHost");
+      check(cudaMallocHost((void**) &h_2, size * sizeof(float)), "cudaMallocHost");
+      check(cudaMallocHost((void**) &h_result, size * sizeof(float)), "cudaMallocHost");
+      capacity = size;
+    }
+
+    void
+    release()
+    {
+      if (capacity == 0)
+        return;
+      cudaFree(d_1);
+      cudaFree(d_2);
+      cudaFree(d_result);
+      cudaFreeHost(h_1);
+      cudaFreeHost(h_2);
+      cudaFreeHost(h_result);
+      capacity = 0;
+    }
+
+    /* stage the inputs densely and queue copy in, kernel and copy out;
+       C is copied in too unless beta is 0 */
+    void
+    submit(bool trans_a, bool trans_b, unsigned int m, unsigned int n, unsigned int k, float alpha,
+           const float *a, unsigned int lda, const float *b, unsigned int ldb, float beta,
+           float *c, unsigned int ldc, bool timed)
+    {
+      unsigned int a_rows = trans_a ? k : m, a_cols = trans_a ? m : k;
+      unsigned int b_rows = trans_b ? n : k, b_cols = trans_b ? k : n;
+      size_t a_size = (size_t) a_rows * a_cols;
+      size_t b_size = (size_t) b_rows * b_cols;
+      size_t c_size = (size_t) m * n;
+      reserve(std::max(std::max(a_size, b_size), c_size));
+      pack(h_1, a, a_rows, a_cols, lda);
+      pack(h_2, b, b_rows, b_cols, ldb);
+      cudaMemcpyAsync(d_1, h_1, a_size * sizeof(float), cudaMemcpyHostToDevice, stream);
+      cudaMemcpyAsync(d_2, h_2, b_size * sizeof(float), cudaMemcpyHostToDevice, stream);
+      if (beta != 0.0f)
+        {
+          pack(h_result, c, m, n, ldc);
+          cudaMemcpyAsync(d_result, h_result, c_size * sizeof(float), cudaMemcpyHostToDevice, stream);
+        }
+      if (timed)
+        cudaEventRecord(start, stream);
+      launch_gemm(trans_a, trans_b, m, n, k, alpha, d_1, a_cols, d_2, b_cols, beta, d_result, n, stream);
+      if (timed)
+        cudaEventRecord(stop, stream);
+      cudaMemcpyAsync(h_result, d_result, c_size * sizeof(float), cudaMemcpyDeviceToHost, stream);
+      pending_result = c;
+      pending_rows = m;
+      pending_cols = n;
+      pending_ld = ldc;
+    }
+
+    void
+    submit(float *sq_matrix_1, float *sq_matrix_2, float *sq_matrix_result, unsigned int sq_dimension, bool timed)
+    {
+      unsigned int n = sq_dimension;
+      submit(false, false, n, n, n, 1.0f, sq_matrix_1, n, sq_matrix_2, n, 0.0f, sq_matrix_result, n, timed);
+    }
+
+    /* wait for the queued work and hand the result over */
+    void
+    finish()
+    {
+      if (pending_result == NULL)
+        return;
+      check(cudaStreamSynchronize(stream), "cudaStreamSynchronize");
+      unpack(pending_result, pending_ld, h_result, pending_rows, pending_cols);
+      pending_result = NULL;
+    }
+  };
+
+  Context::Context(unsigned int num_streams)
+    : num_slots(num_streams > 0 ? num_streams : 1)
+  {
+    slots = new Slot[num_slots];
+    for (unsigned int i = 0; i < num_slots; i++)
+      {
+        Slot &slot = slots[i];
+        cudaStreamCreate(&slot.stream);
+        cudaEventCreate(&slot.start);
+        cudaEventCreate(&slot.stop);
+        slot.capacity = 0;
+        slot.pending_result = NULL;
+      }
+  }
+
+  Context::~Context()
+  {
+    for (unsigned int i = 0; i < num_slots; i++)
+      {
+        Slot &slot = slots[i];
+        slot.finish();
+        slot.release();
+        cudaEventDestroy(slot.start);
+        cudaEventDestroy(slot.stop);
+        cudaStreamDestroy(slot.stream);
+      }
+    delete [] slots;
+  }
+
+  void
+  Context::matrix_multiplication(float *sq_matrix_1, float *sq_matrix_2, float *sq_matrix_result, unsigned int sq_dimension)
+  {
+    if (sq_dimension == 0)
+      return;
+    Slot &slot = slots[0];
+    slot.submit(sq_matrix_1, sq_matrix_2, sq_matrix_result, sq_dimension, true);
+    slot.finish();
+
+    float ms = 0.0f;
+    cudaEventElapsedTime(&ms, slot.start, slot.stop);
+    kernel_gflops = (ms > 0.0f) ? flops(sq_dimension) * 1e-6 / ms : 0.0;
+  }
+
+  void
+  Context::gemm(bool trans_a, bool trans_b, unsigned int m, unsigned int n, unsigned int k, float alpha,
+                const float *a, unsigned int lda, const float *b, unsigned int ldb, float beta,
+                float *c, unsigned int ldc)
+  {
+    if (m == 0 || n == 0)
+      return;
+    Slot &slot = slots[0];
+    slot.finish();
+    slot.submit(trans_a, trans_b, m, n, k, alpha, a, lda, b, ldb, beta, c, ldc, true);
+    slot.finish();
+
+    float ms = 0.0f;
+    cudaEventElapsedTime(&ms, slot.start, slot.stop);
+    kernel_gflops = (ms > 0.0f) ? 2.0 * m * n * k * 1e-6 / ms : 0.0;
+  }
+
+  void
+  Context::batched_matrix_multiplication(float **sq_matrices_1, float **sq_matrices_2, float **sq_matrices_result,
+                                         const unsigned int *sq_dimensions, unsigned int count)
+  {
+    double total_flops = 0.0;
+    double start_time = host_seconds();
+
+    for (unsigned int i = 0; i < count; i++)
       {
-	sum += sq_matrix_1[ty*sq_dimension + k] * sq_matrix_2[k*sq_dimension + tx];
+        if (sq_dimensions[i] == 0)
+          continue;
+        // The slot's staging buffers are reused, so its previous pair must
+        // have been copied out first; the other streams keep running.
+        Slot &slot = slots[i % num_slots];
+        slot.finish();
+        slot.submit(sq_matrices_1[i], sq_matrices_2[i], sq_matrices_result[i], sq_dimensions[i], false);
+        total_flops += flops(sq_dimensions[i]);
       }
-    sq_matrix_result[ty*sq_dimension + tx] = sum;
-    
+    for (unsigned int i = 0; i < num_slots; i++)
+      slots[i].finish();
+
+    double elapsed = host_seconds() - start_time;
+    kernel_gflops = (elapsed > 0.0) ? total_flops * 1e-9 / elapsed : 0.0;
+  }
+
+  // Process wide context, so that repeated calls keep their device buffers.
+  static Context &
+  default_context()
+  {
+    static Context context(1);
+    return context;
   }
-  
+
   void 
   matrix_multiplication(float *sq_matrix_1, float *sq_matrix_2, float *sq_matrix_result, unsigned int sq_dimension)
   {
-    int size = sq_dimension * sq_dimension * sizeof(float);
-    float *sq_matrix_1_d, *sq_matrix_2_d, *sq_matrix_result_d;
-    
-    /***************************************************
-  1st Part: Allocation of memory on device memory  
-    ****************************************************/
-    
-    /* copy sq_matrix_1 and sq_matrix_2 to device memory */
-    cudaMalloc((void**) &sq_matrix_1_d, size);
-    cudaMemcpy(sq_matrix_1_d, sq_matrix_1, size, cudaMemcpyHostToDevice);
-    cudaMalloc((void**) &sq_matrix_2_d, size);
-    cudaMemcpy(sq_matrix_2_d, sq_matrix_2, size, cudaMemcpyHostToDevice);
-    
-    /*allocate sq_matrix_result on host */
-    cudaMalloc((void**) &sq_matrix_result_d, size);
-    
-    /***************************************************
-   2nd Part: Inovke kernel 
-    ****************************************************/
-    dim3 dimBlock(sq_dimension, sq_dimension);
-    dim3 dimGrid(1,1);
-    matrix_mul_kernel<<<dimGrid, dimBlock, dimBlock.x * dimBlock.x * sizeof(float)>>>(sq_matrix_1_d, sq_matrix_2_d, sq_matrix_result_d, sq_dimension);
-    
-    /***************************************************
-   3rd Part: Transfer result from device to host 
-    ****************************************************/
-    cudaMemcpy(sq_matrix_result, sq_matrix_result_d, size, cudaMemcpyDeviceToHost);
-    cudaFree(sq_matrix_1_d);
-    cudaFree(sq_matrix_2_d);
-    cudaFree(sq_matrix_result_d);
+    default_context().matrix_multiplication(sq_matrix_1, sq_matrix_2, sq_matrix_result, sq_dimension);
   }  
+
+  void
+  gemm(bool trans_a, bool trans_b, unsigned int m, unsigned int n, unsigned int k, float alpha,
+       const float *a, unsigned int lda, const float *b, unsigned int ldb, float beta, float *c, unsigned int ldc)
+  {
+    default_context().gemm(trans_a, trans_b, m, n, k, alpha, a, lda, b, ldb, beta, c, ldc);
+  }
 } // namespace cuda
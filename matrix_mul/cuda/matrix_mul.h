@@ -30,5 +30,68 @@ namespace cuda
  * @param sq_dimension Dimension of the square matrix 
  */
   void matrix_multiplication(float *sq_matrix_1, float *sq_matrix_2, float *sq_matrix_result, unsigned int sq_dimension);  
+
+/**
+ * @brief General product C = alpha op(A) op(B) + beta C of row-major
+ *        matrices in host memory, as omp::gemm(). The operands are staged
+ *        densely, so strided views and transposes need no copies by the
+ *        caller; C is only copied to the device when beta is not 0.
+ */
+  void gemm(bool trans_a, bool trans_b, unsigned int m, unsigned int n, unsigned int k,
+            float alpha, const float *a, unsigned int lda, const float *b, unsigned int ldb,
+            float beta, float *c, unsigned int ldc);
+
+/**
+ * @brief Kernel-only throughput of the last matrix_multiplication() call
+ * @return GFLOP/s measured with CUDA events, excluding host/device copies.
+ *         After a batched call it is the rate of the whole batch, copies
+ *         included, since kernels and copies overlap.
+ */
+  double last_kernel_gflops();
+
+/**
+ * @brief Keeps device buffers, pinned host staging buffers and streams
+ *        alive across calls so repeated products skip cudaMalloc/cudaFree
+ *        and pageable copies. Buffers only grow; one Context per host thread.
+ */
+  class Context
+  {
+  public:
+    explicit Context(unsigned int num_streams = 4);
+    ~Context();
+
+/**
+ * @brief Same as cuda::matrix_multiplication() but reuses this context's buffers
+ */
+    void matrix_multiplication(float *sq_matrix_1, float *sq_matrix_2, float *sq_matrix_result, unsigned int sq_dimension);
+
+/**
+ * @brief Same as cuda::gemm() but reuses this context's buffers
+ */
+    void gemm(bool trans_a, bool trans_b, unsigned int m, unsigned int n, unsigned int k,
+              float alpha, const float *a, unsigned int lda, const float *b, unsigned int ldb,
+              float beta, float *c, unsigned int ldc);
+
+/**
+ * @brief Multiplies count pairs of square matrices, spreading them round
+ *        robin over the context's streams so that the copies of one pair
+ *        overlap with the kernels of the others
+ * @param sq_matrices_1 count first matrices
+ * @param sq_matrices_2 count second matrices
+ * @param sq_matrices_result count pointers to store the results
+ * @param sq_dimensions Dimension of each pair
+ * @param count Number of pairs
+ */
+    void batched_matrix_multiplication(float **sq_matrices_1, float **sq_matrices_2, float **sq_matrices_result,
+                                       const unsigned int *sq_dimensions, unsigned int count);
+
+  private:
+    struct Slot;
+    Slot *slots;
+    unsigned int num_slots;
+
+    Context(const Context &);
+    Context &operator=(const Context &);
+  };
 }
 #endif
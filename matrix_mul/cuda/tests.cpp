@@ -36,6 +36,8 @@ namespace cuda
   {
     CPPUNIT_TEST_SUITE(Tests);
     CPPUNIT_TEST(test_cases);
+    CPPUNIT_TEST(test_gemm);
+    CPPUNIT_TEST(test_batched);
     CPPUNIT_TEST_SUITE_END();
         
   public:
@@ -74,7 +76,7 @@ namespace cuda
 
 	  double gflops = (double)((2*TestFrameWork::matrix_dim[i]-1)*TestFrameWork::matrix_dim[i]*TestFrameWork::matrix_dim[i]*1e-9/t);
 
-          std::cout<<"\t"<< gflops <<" Gflop/s\n";
+          std::cout<<"\t"<< gflops <<" Gflop/s ("<< last_kernel_gflops() <<" Gflop/s kernel only)\n";
 
           delete sq_matrix_1;
           delete sq_matrix_2;
@@ -83,6 +85,52 @@ namespace cuda
         }
     }
 
+    void
+    test_batched()
+    {
+      // every test case of the file in one batch, over several streams
+      int count = TestFrameWork::size;
+      float **matrices_1 = new float*[count];
+      float **matrices_2 = new float*[count];
+      float **results = new float*[count];
+      unsigned int *dims = new unsigned int[count];
+      for (int i = 0; i < count; i++)
+        {
+          dims[i] = TestFrameWork::matrix_dim[i];
+          matrices_1[i] = new float[dims[i] * dims[i]];
+          matrices_2[i] = new float[dims[i] * dims[i]];
+          results[i] = new float[dims[i] * dims[i]];
+          randomize(matrices_1[i], dims[i], dims[i]);
+          randomize(matrices_2[i], dims[i], dims[i]);
+        }
+
+      Context context;
+      context.batched_matrix_multiplication(matrices_1, matrices_2, results, dims, count);
+      std::cout<<"\n"<<"Batch of "<<count<<"\t"<< last_kernel_gflops() <<" Gflop/s\n";
+
+      for (int i = 0; i < count; i++)
+        {
+          answers = new float[dims[i] * dims[i]];
+          tripleloop(answers, matrices_1[i], matrices_2[i], dims[i], dims[i], dims[i]);
+          CPPUNIT_ASSERT(TestFrameWork::diff(answers, results[i], dims[i], dims[i]) < EPS);
+          delete [] answers;
+          delete [] matrices_1[i];
+          delete [] matrices_2[i];
+          delete [] results[i];
+        }
+      delete [] matrices_1;
+      delete [] matrices_2;
+      delete [] results;
+      delete [] dims;
+    }
+
+    void
+    test_gemm()
+    {
+      CPPUNIT_ASSERT(gemm_sweep_error(gemm) < EPS);
+      std::cout<<"\n"<<"gemm\t"<<TestFrameWork::size<<" sizes\n";
+    }
+
     void
     setUp()
     {
@@ -0,0 +1,40 @@
+/*
+    cpu_dispatch.cpp: run-time selection of the GEMM micro-kernel
+
+    Copyright (C) 2011  Abhinav Jauhri (abhinav.jauhri@gmail.com), Carnegie Mellon University - Silicon Valley 
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "micro_kernel.h"
+
+namespace omp {
+namespace kernel {
+  static const MicroKernel &detect() {
+    // __builtin_cpu_supports() runs cpuid and also checks (xgetbv) that
+    // the OS saves the wider register state.
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+      return avx512;
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+      return avx2;
+    return sse3;
+  }
+
+  const MicroKernel &select() {
+    static const MicroKernel &best = detect();
+    return best;
+  }
+} // namespace kernel
+} // namespace omp
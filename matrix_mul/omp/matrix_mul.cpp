@@ -24,6 +24,8 @@
 #include <omp.h>
 #include <inttypes.h>
 #include "matrix_mul.h"
+#include "micro_kernel.h"
+#include "variants.h"
 
 extern "C"
 {
@@ -36,86 +38,361 @@ using std::endl;
 typedef unsigned int uint;
 
 namespace omp {
-  void matrix_multiplication(
-      float *sq_matrix_1,
-      float *sq_matrix_2,
-      float *sq_matrix_result,
-      unsigned int sq_dimension ) {
-    // seems we can't modify sq_matrix_1 and sq_matrix_2....
-
-    uint mask4 = 0x3;
-    // check whether sq_dimension is multiple of 4.
-    // This is mainly used to make sure that the data is aligned
-    // in 16 bytes.
-    // Note we don't need to adjust the starting address since
-    // GCC makes sure all allocated memory is aligned by 16 bytes on x86_64
-    if ((sq_dimension & mask4) > 0) {
-      // If not aligned, we need to allocate a new block of memory
-      uint dim4 = sq_dimension + 4 - (sq_dimension & mask4);
-      // aligned sq_matrix_1
-      float *sq1 = (float *)malloc(dim4*dim4*sizeof(float));
-      // aligned sq_matrix_2 (sq2_t is also a transpose of sq_matrix_2)
-      float *sq2_t = (float *)malloc(dim4*dim4*sizeof(float));
-      for (uint i = 0; i < sq_dimension; i++) {
-        uint base_i4 = i*dim4;
-        uint base_i = i*sq_dimension;
-        for (uint j = 0; j < sq_dimension; j++) {
-          sq1[base_i4 + j] = sq_matrix_1[base_i+j];
-          sq2_t[j*dim4 + i] = sq_matrix_2[base_i+j];
+  // Blocking parameters of the GEMM path (Goto/BLIS style loop nest).
+  // The register tile MR x NR comes from the micro-kernel picked at run
+  // time (see micro_kernel.h), the cache blocks are shared by all of them.
+  // KC x NR  : one packed B micro-panel, stays in L1 across the MR loop.
+  // MC x KC  : one packed A block (private to a thread), sized for L2.
+  // KC x NC  : the packed B panel shared by all threads, sized for L3.
+  static const uint KC = 256;
+  static const uint MC = 128;
+  static const uint NC = 3072;
+  // Micro-panels per macro-tile handed to a thread. Splitting the NC range
+  // gives enough independent tiles even when there are few MC blocks.
+  static const uint NT_PANELS = 16;
+
+  // Pack the mc x kc block of A starting at a into mr-row micro-panels,
+  // scaled by alpha. Element (i, p) of the block is a[i*rs + p*cs], so a
+  // transposed A is packed by swapping the strides. Rows past mc are zero
+  // filled so the micro-kernel never needs a remainder path.
+  static void pack_a(uint mr_max, uint mc, uint kc, const float *a, uint rs, uint cs,
+      float alpha, float *a_packed) {
+    for (uint ir = 0; ir < mc; ir += mr_max) {
+      uint mr = std::min(mr_max, mc - ir);
+      for (uint p = 0; p < kc; p++) {
+        for (uint i = 0; i < mr; i++) {
+          a_packed[i] = alpha * a[(size_t)(ir+i)*rs + (size_t)p*cs];
+        }
+        for (uint i = mr; i < mr_max; i++) {
+          a_packed[i] = 0.0f;
         }
-        for (uint j = sq_dimension; j < dim4; j++) {
-          sq1[base_i4 + j] = 0;
-          sq2_t[j*dim4 + i] = 0;
+        a_packed += mr_max;
+      }
+    }
+  }
+
+  // Pack one kc x nr_max micro-panel of B starting at b, element (p, j)
+  // at b[p*rs + j*cs]. Columns past nr are zero filled.
+  static void pack_b_panel(uint nr_max, uint nr, uint kc, const float *b, uint rs, uint cs,
+      float *b_packed) {
+    for (uint p = 0; p < kc; p++) {
+      const float *b_row = &b[(size_t)p*rs];
+      if (cs == 1) {
+        for (uint j = 0; j < nr; j++) {
+          b_packed[j] = b_row[j];
+        }
+      } else {
+        for (uint j = 0; j < nr; j++) {
+          b_packed[j] = b_row[(size_t)j*cs];
+        }
+      }
+      for (uint j = nr; j < nr_max; j++) {
+        b_packed[j] = 0.0f;
+      }
+      b_packed += nr_max;
+    }
+  }
+
+  // Run the micro-kernel over an mc x nc macro-tile of C. b_packed points
+  // at the first micro-panel of the tile.
+  static void macro_kernel(
+      const kernel::MicroKernel &uk,
+      uint mc,
+      uint nc,
+      uint kc,
+      const float *a_packed,
+      const float *b_packed,
+      float *c,
+      uint ldc,
+      bool accumulate) {
+    const uint MR = uk.mr;
+    const uint NR = uk.nr;
+
+    for (uint jr = 0; jr < nc; jr += NR) {
+      uint nr = std::min(NR, nc - jr);
+      const float *b_panel = &b_packed[jr*kc];
+      for (uint ir = 0; ir < mc; ir += MR) {
+        // Border tiles (mr < MR or nr < NR) are clipped by the kernel
+        // itself with masked or scalar stores.
+        uk.run(kc, &a_packed[ir*kc], b_panel, &c[ir*ldc + jr], ldc,
+            std::min(MR, mc - ir), nr, accumulate);
+      }
+    }
+  }
+
+  // Offset of the packed (jc, pc) block of B in a PackedB: the NC column
+  // blocks one after the other, each k rows deep in kc_step slices whose
+  // micro-panels are NR wide.
+  static size_t packed_b_offset(uint NR, uint k, uint jc, uint nc, uint pc) {
+    return (size_t)(jc / NC) * ((NC + NR - 1) / NR * NR) * k + (size_t)pc * ((nc + NR - 1) / NR * NR);
+  }
+
+  // The loop nest of kernel::gemm(). B comes either as strided elements
+  // (b, b_rs, b_cs), packed into a shared panel per (jc, pc) block, or
+  // already packed (prepacked, laid out by packed_b_offset()).
+  static void gemm_driver(
+      const kernel::MicroKernel &uk,
+      uint m, uint n, uint k,
+      float alpha,
+      const float *a, uint a_rs, uint a_cs,
+      const float *b, uint b_rs, uint b_cs,
+      const float *prepacked,
+      float beta,
+      float *c, uint ldc,
+      uint kc_step ) {
+    if (m == 0 || n == 0) return;
+
+    // C = beta C first when the product adds nothing or beta is neither 0
+    // (the first k block overwrites C) nor 1 (every block accumulates).
+    // As in BLAS, C is not read when beta is 0.
+    bool scale_c = (k == 0 || alpha == 0.0f) ? beta != 1.0f : (beta != 0.0f && beta != 1.0f);
+    if (scale_c) {
+#pragma omp parallel for schedule(static)
+      for (uint i = 0; i < m; i++) {
+        float *c_row = &c[(size_t)i*ldc];
+        for (uint j = 0; j < n; j++) {
+          c_row[j] = (beta == 0.0f) ? 0.0f : beta * c_row[j];
         }
       }
-#pragma omp parallel for
-      for (uint i = 0; i < sq_dimension; i++) {
-        for (uint j = 0; j < sq_dimension; j++) {
-          __m128 sum128 = _mm_setzero_ps();
-          __m128 X, Y;
-          uint base_i4 = i * dim4;
-          uint base_j4 = j * dim4;
-          for (uint k = 0; k < sq_dimension; k+=4) {
-            X = _mm_load_ps(&sq1[base_i4+k]);
-            Y = _mm_load_ps(&sq2_t[base_j4+k]);
-            sum128 = _mm_add_ps(sum128, _mm_mul_ps(X, Y));
+    }
+    if (k == 0 || alpha == 0.0f) return;
+
+    const uint MR = uk.mr;
+    const uint NR = uk.nr;
+    const uint mc_blk = MC / MR * MR;
+    const uint nt = NT_PANELS * NR;
+    uint nc_max = std::min(NC, (n + NR - 1) / NR * NR);
+    uint kc_max = std::min(kc_step, k);
+    float *b_packed = NULL;
+    if (prepacked == NULL) {
+      b_packed = (float *)_mm_malloc(nc_max*kc_max*sizeof(float), 64);
+      assert(b_packed != NULL);
+    }
+
+#pragma omp parallel
+    {
+      float *a_packed = (float *)_mm_malloc(mc_blk*kc_max*sizeof(float), 64);
+      assert(a_packed != NULL);
+
+      for (uint jc = 0; jc < n; jc += NC) {
+        uint nc = std::min(NC, n - jc);
+        uint num_nr = (nc + NR - 1) / NR;
+        for (uint pc = 0; pc < k; pc += kc_step) {
+          uint kc = std::min(kc_step, k - pc);
+          // Without beta, the first k block overwrites C and later ones
+          // accumulate into it.
+          bool accumulate = pc > 0 || beta != 0.0f;
+          const float *b_panel;
+
+          if (prepacked != NULL) {
+            b_panel = &prepacked[packed_b_offset(NR, k, jc, nc, pc)];
+          } else {
+            // All threads pack the shared B panel together.
+#pragma omp for schedule(static)
+            for (uint jp = 0; jp < num_nr; jp++) {
+              uint jr = jp * NR;
+              pack_b_panel(NR, std::min(NR, nc - jr), kc,
+                  &b[(size_t)pc*b_rs + (size_t)(jc + jr)*b_cs], b_rs, b_cs, &b_packed[jr*kc]);
+            }
+            b_panel = b_packed;
+          }
+
+          // Each (ic, jt) macro-tile of C is owned by exactly one thread,
+          // so no synchronisation is needed on C. A thread repacks its
+          // private A block only when it moves on to a new ic.
+          uint num_mc = (m + mc_blk - 1) / mc_blk;
+          uint num_nt = (nc + nt - 1) / nt;
+          uint last_ic = m;
+#pragma omp for collapse(2) schedule(dynamic)
+          for (uint it = 0; it < num_mc; it++) {
+            for (uint jt = 0; jt < num_nt; jt++) {
+              uint ic = it * mc_blk;
+              uint mc = std::min(mc_blk, m - ic);
+              uint jr = jt * nt;
+              if (ic != last_ic) {
+                pack_a(MR, mc, kc, &a[(size_t)ic*a_rs + (size_t)pc*a_cs], a_rs, a_cs,
+                    alpha, a_packed);
+                last_ic = ic;
+              }
+              macro_kernel(uk, mc, std::min(nt, nc - jr), kc, a_packed,
+                  &b_panel[jr*kc], &c[(size_t)ic*ldc + jc + jr], ldc,
+                  accumulate);
+            }
           }
-          float sum_temp[4];
-          _mm_store_ps(sum_temp, sum128);
-          float sum_32 = sum_temp[0] + sum_temp[1] + sum_temp[2] + sum_temp[3];
-          sq_matrix_result[i*sq_dimension+j] = sum_32;
+          // implicit barrier: b_packed is reused by the next k block
         }
       }
-      free(sq1);
-      free(sq2_t);
-    } else {
-      // Data is aligned, we only need to transpose sq_matrix_2
-      float *sq2_t = (float *)malloc(sq_dimension*sq_dimension*sizeof(float));
-      for (uint i = 0; i < sq_dimension; i++) {
-        uint base_i = i * sq_dimension;
-        for (uint j = 0; j < sq_dimension; j++) {
-          sq2_t[j*sq_dimension+i ] = sq_matrix_2[base_i+j];
+      _mm_free(a_packed);
+    }
+    if (b_packed != NULL)
+      _mm_free(b_packed);
+  }
+
+  void kernel::gemm(
+      const kernel::MicroKernel &uk,
+      bool trans_a, bool trans_b,
+      unsigned int m, unsigned int n, unsigned int k,
+      float alpha,
+      const float *a, unsigned int lda,
+      const float *b, unsigned int ldb,
+      float beta,
+      float *c, unsigned int ldc,
+      unsigned int kc_block ) {
+    // Row and column strides of op(A) and op(B)
+    gemm_driver(uk, m, n, k, alpha,
+        a, trans_a ? 1 : lda, trans_a ? lda : 1,
+        b, trans_b ? 1 : ldb, trans_b ? ldb : 1, NULL,
+        beta, c, ldc, kc_block ? kc_block : KC);
+  }
+
+  PackedB::PackedB(bool trans_b, unsigned int k, unsigned int n, const float *b, unsigned int ldb)
+    : uk(&kernel::select()), k(k), n(n), data(NULL) {
+    const uint NR = uk->nr;
+    const uint b_rs = trans_b ? 1 : ldb, b_cs = trans_b ? ldb : 1;
+    size_t size = (size_t)((n + NR - 1) / NR * NR) * k;
+    if (size == 0)
+      return;
+    data = (float *)_mm_malloc(size*sizeof(float), 64);
+    assert(data != NULL);
+
+    // Every micro-panel of every (jc, pc) block, in parallel
+    uint num_jc = (n + NC - 1) / NC;
+    uint num_pc = (k + KC - 1) / KC;
+    uint panels_per_nc = (NC + NR - 1) / NR;
+#pragma omp parallel for collapse(3) schedule(static)
+    for (uint jb = 0; jb < num_jc; jb++) {
+      for (uint pb = 0; pb < num_pc; pb++) {
+        for (uint jp = 0; jp < panels_per_nc; jp++) {
+          uint jc = jb * NC, pc = pb * KC, jr = jp * NR;
+          uint nc = std::min(NC, n - jc);
+          if (jr >= nc)
+            continue;
+          uint kc = std::min(KC, k - pc);
+          pack_b_panel(NR, std::min(NR, nc - jr), kc,
+              &b[(size_t)pc*b_rs + (size_t)(jc + jr)*b_cs], b_rs, b_cs,
+              &data[packed_b_offset(NR, k, jc, nc, pc) + (size_t)jr*kc]);
         }
       }
-#pragma omp parallel for
-      for (uint i = 0; i < sq_dimension; i++) {
-        for (uint j = 0; j < sq_dimension; j++) {
-          __m128 sum128 = _mm_setzero_ps();
-          __m128 X, Y;
-          uint base_i = i * sq_dimension;
-          uint base_j = j * sq_dimension;
-          for (uint k = 0; k < sq_dimension; k+=4) {
-            X = _mm_load_ps(&sq_matrix_1[base_i+k]);
-            Y = _mm_load_ps(&sq2_t[base_j+k]);
-            sum128 = _mm_add_ps(sum128, _mm_mul_ps(X,Y));
+    }
+  }
+
+  PackedB::~PackedB() {
+    if (data != NULL)
+      _mm_free(data);
+  }
+
+  void kernel::gemm_blocked(
+      const kernel::MicroKernel &uk,
+      float *sq_matrix_1,
+      float *sq_matrix_2,
+      float *sq_matrix_result,
+      unsigned int sq_dimension,
+      unsigned int kc_block ) {
+    uint n = sq_dimension;
+    kernel::gemm(uk, false, false, n, n, n, 1.0f, sq_matrix_1, n, sq_matrix_2, n,
+        0.0f, sq_matrix_result, n, kc_block);
+  }
+
+  void gemm(bool trans_a, bool trans_b, unsigned int m, unsigned int n, unsigned int k,
+      float alpha, const float *a, unsigned int lda, const float *b, unsigned int ldb,
+      float beta, float *c, unsigned int ldc) {
+    kernel::gemm(kernel::select(), trans_a, trans_b, m, n, k, alpha, a, lda, b, ldb,
+        beta, c, ldc);
+  }
+
+  void gemm(bool trans_a, unsigned int m, float alpha, const float *a, unsigned int lda,
+      const PackedB &b, float beta, float *c, unsigned int ldc) {
+    gemm_driver(*b.uk, m, b.n, b.k, alpha,
+        a, trans_a ? 1 : lda, trans_a ? lda : 1,
+        NULL, 0, 0, b.data,
+        beta, c, ldc, KC);
+  }
+
+  size_t kernel::fused_buffer_size(const PackedB &b) {
+    const uint mc_blk = MC / b.uk->mr * b.uk->mr;
+    return (size_t)mc_blk * b.k + (size_t)mc_blk * b.uk->nr;
+  }
+
+  // The loop nest of gemm_driver() for one thread, reordered so that a
+  // strip of C is finished before the next one starts: per MC block of A
+  // (packed at its whole depth, one KC slice after the other), every NR
+  // column micro-panel of B runs through all k into the strip.
+  void kernel::gemm_fused(bool trans_a, unsigned int m, float alpha, const float *a,
+      unsigned int lda, const PackedB &b, float *buffer, epilogue_fn epilogue, void *arg) {
+    const kernel::MicroKernel &uk = *b.uk;
+    const uint MR = uk.mr;
+    const uint NR = uk.nr;
+    const uint mc_blk = MC / MR * MR;
+    const uint a_rs = trans_a ? 1 : lda, a_cs = trans_a ? lda : 1;
+    const uint k = b.k, n = b.n;
+    float *a_packed = buffer;                      // [k / KC][mc_blk][KC]
+    float *c = &buffer[(size_t)mc_blk * k];        // mc x NR, row stride NR
+
+    for (uint ic = 0; ic < m; ic += mc_blk) {
+      uint mc = std::min(mc_blk, m - ic);
+      for (uint pc = 0; pc < k; pc += KC) {
+        pack_a(MR, mc, std::min(KC, k - pc), &a[(size_t)ic*a_rs + (size_t)pc*a_cs],
+            a_rs, a_cs, alpha, &a_packed[(size_t)mc_blk * pc]);
+      }
+
+      for (uint jc = 0; jc < n; jc += NC) {
+        uint nc = std::min(NC, n - jc);
+        for (uint jr = 0; jr < nc; jr += NR) {
+          uint nr = std::min(NR, nc - jr);
+          if (k == 0)
+            std::fill(c, c + (size_t)mc_blk * NR, 0.0f);
+          for (uint pc = 0; pc < k; pc += KC) {
+            uint kc = std::min(KC, k - pc);
+            const float *a_slice = &a_packed[(size_t)mc_blk * pc];
+            const float *b_panel = &b.data[packed_b_offset(NR, k, jc, nc, pc) + (size_t)jr*kc];
+            for (uint ir = 0; ir < mc; ir += MR) {
+              uk.run(kc, &a_slice[ir*kc], b_panel, &c[ir*NR], NR,
+                  std::min(MR, mc - ir), nr, pc > 0);
+            }
           }
-          float sum_temp[4];
-          _mm_store_ps(sum_temp, sum128);
-          float sum32 = sum_temp[0] + sum_temp[1] + sum_temp[2] + sum_temp[3];
-          sq_matrix_result[i*sq_dimension + j] = sum32;
+          epilogue(arg, ic, mc, jc + jr, nr, c, NR);
         }
       }
-      free(sq2_t);
     }
   }
+
+  void matrix_multiplication(float *sq_matrix_1, const PackedB &sq_matrix_2, float *sq_matrix_result) {
+    uint n = sq_matrix_2.cols();
+    gemm(false, n, 1.0f, sq_matrix_1, n, sq_matrix_2, 0.0f, sq_matrix_result, n);
+  }
+
+  void variants::packed(float *sq_matrix_1, float *sq_matrix_2, float *sq_matrix_result,
+      unsigned int sq_dimension, unsigned int block_size) {
+    kernel::gemm_blocked(kernel::select(), sq_matrix_1, sq_matrix_2,
+        sq_matrix_result, sq_dimension, block_size);
+  }
+
+  void variants::packed_sse3(float *sq_matrix_1, float *sq_matrix_2, float *sq_matrix_result,
+      unsigned int sq_dimension, unsigned int block_size) {
+    kernel::gemm_blocked(kernel::sse3, sq_matrix_1, sq_matrix_2,
+        sq_matrix_result, sq_dimension, block_size);
+  }
+
+  void variants::packed_avx2(float *sq_matrix_1, float *sq_matrix_2, float *sq_matrix_result,
+      unsigned int sq_dimension, unsigned int block_size) {
+    kernel::gemm_blocked(kernel::avx2, sq_matrix_1, sq_matrix_2,
+        sq_matrix_result, sq_dimension, block_size);
+  }
+
+  void variants::packed_avx512(float *sq_matrix_1, float *sq_matrix_2, float *sq_matrix_result,
+      unsigned int sq_dimension, unsigned int block_size) {
+    kernel::gemm_blocked(kernel::avx512, sq_matrix_1, sq_matrix_2,
+        sq_matrix_result, sq_dimension, block_size);
+  }
+
+  void matrix_multiplication(
+      float *sq_matrix_1,
+      float *sq_matrix_2,
+      float *sq_matrix_result,
+      unsigned int sq_dimension ) {
+    // "packed" unless MATMUL_VARIANT or variants::select() say otherwise
+    variants::Choice choice = variants::choose(sq_dimension);
+    choice.variant->run(sq_matrix_1, sq_matrix_2, sq_matrix_result,
+        sq_dimension, choice.block_size);
+  }
 } //namespace omp
@@ -20,8 +20,45 @@
 #ifndef MATRIX_MUL_H
 #define MATRIX_MUL_H
 
+#include <stddef.h>
+
 namespace omp
 {
+  class PackedB;
+
+  namespace kernel
+  {
+    struct MicroKernel;
+
+/**
+ * @brief Receives the finished blocks of the product of gemm_fused():
+ *        rows [i0, i0 + rows) and columns [j0, j0 + cols) of C, element
+ *        (i, j) at c[(i - i0)*ldc + j - j0]. Each element comes exactly
+ *        once, and the blocks of a row come in increasing columns.
+ */
+    typedef void (*epilogue_fn)(void *arg, unsigned int i0, unsigned int rows,
+                                unsigned int j0, unsigned int cols,
+                                const float *c, unsigned int ldc);
+
+/**
+ * @brief Floats of the buffer gemm_fused() needs with this B
+ */
+    size_t fused_buffer_size(const PackedB &b);
+
+/**
+ * @brief alpha op(A) B (m x n, B prepacked) on the calling thread alone,
+ *        without a parallel region or an allocation: the product is
+ *        handed to epilogue, one MC-row by NR-column strip at a time,
+ *        instead of being stored, so C never exists in memory as a
+ *        whole. For callers that run it on their own threads.
+ * @param buffer fused_buffer_size(b) floats, 64 byte aligned, owned by
+ *        the caller (one per thread, reused from call to call)
+ */
+    void gemm_fused(bool trans_a, unsigned int m, float alpha, const float *a,
+                    unsigned int lda, const PackedB &b, float *buffer,
+                    epilogue_fn epilogue, void *arg);
+  }
+
 /**
  * @brief Gives the product of two square matrices (of equal dimensions)
  * @param sq_matrix_1 First square matrix 
@@ -30,6 +67,81 @@ namespace omp
  * @param sq_dimension Dimension of the square matrix 
  */
   void matrix_multiplication(float *sq_matrix_1, float *sq_matrix_2, float *sq_matrix_result, unsigned int sq_dimension);
+
+/**
+ * @brief matrix_multiplication() through the Strassen-Winograd recursion
+ *        (7 half-size products instead of 8) while the dimension is above
+ *        cutoff, the packed GEMM below it. Less accurate than the GEMM:
+ *        the error grows with every level of recursion.
+ * @param cutoff Largest dimension multiplied directly, 0 for the default (1024)
+ */
+  void strassen_multiplication(float *sq_matrix_1, float *sq_matrix_2, float *sq_matrix_result,
+                               unsigned int sq_dimension, unsigned int cutoff);
+
+/**
+ * @brief General product C = alpha op(A) op(B) + beta C of row-major
+ *        matrices, op(X) being X or its transpose (as BLAS sgemm)
+ * @param trans_a Use the transpose of A: A is stored k x m instead of m x k
+ * @param trans_b Use the transpose of B: B is stored n x k instead of k x n
+ * @param m Rows of op(A) and C
+ * @param n Columns of op(B) and C
+ * @param k Columns of op(A), rows of op(B)
+ * @param alpha Scale of the product
+ * @param a First matrix, row stride lda (>= its stored columns)
+ * @param b Second matrix, row stride ldb
+ * @param beta Scale of C before the product is added; C is not read when 0
+ * @param c m x n result, row stride ldc, updated in place
+ */
+  void gemm(bool trans_a, bool trans_b, unsigned int m, unsigned int n, unsigned int k,
+            float alpha, const float *a, unsigned int lda, const float *b, unsigned int ldb,
+            float beta, float *c, unsigned int ldc);
+
+/**
+ * @brief op(B) packed once into the micro-panels of the GEMM, for many
+ *        products with the same B: gemm() with a PackedB skips the
+ *        packing of B that every other call repeats. Holds k x n floats
+ *        (n rounded up to the micro-panel width); b is not needed after
+ *        the constructor returns.
+ */
+  class PackedB
+  {
+  public:
+/**
+ * @param trans_b Pack the transpose of b (stored n x k)
+ * @param k Rows of op(B)
+ * @param n Columns of op(B)
+ * @param b The matrix, row stride ldb
+ */
+    PackedB(bool trans_b, unsigned int k, unsigned int n, const float *b, unsigned int ldb);
+    ~PackedB();
+
+    unsigned int rows() const { return k; }
+    unsigned int cols() const { return n; }
+
+  private:
+    friend void gemm(bool, unsigned int, float, const float *, unsigned int, const PackedB &, float,
+                     float *, unsigned int);
+    friend size_t kernel::fused_buffer_size(const PackedB &);
+    friend void kernel::gemm_fused(bool, unsigned int, float, const float *, unsigned int,
+                                   const PackedB &, float *, kernel::epilogue_fn, void *);
+    const kernel::MicroKernel *uk;   // the packing depends on its NR
+    unsigned int k, n;
+    float *data;
+
+    PackedB(const PackedB &);
+    PackedB &operator=(const PackedB &);
+  };
+
+/**
+ * @brief C = alpha op(A) B + beta C with a prepacked B (k x n), see gemm()
+ */
+  void gemm(bool trans_a, unsigned int m, float alpha, const float *a, unsigned int lda,
+            const PackedB &b, float beta, float *c, unsigned int ldc);
+
+/**
+ * @brief Square product with a prepacked sq_matrix_2 of dimension rows()
+ */
+  void matrix_multiplication(float *sq_matrix_1, const PackedB &sq_matrix_2, float *sq_matrix_result);
 }
 
 #endif
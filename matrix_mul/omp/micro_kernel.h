@@ -0,0 +1,82 @@
+/*
+    micro_kernel.h: register-tile kernels used by the OpenMP GEMM path
+
+    Copyright (C) 2011  Abhinav Jauhri (abhinav.jauhri@gmail.com), Carnegie Mellon University - Silicon Valley 
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef MICRO_KERNEL_H
+#define MICRO_KERNEL_H
+
+namespace omp
+{
+namespace kernel
+{
+/**
+ * @brief Computes one MR x NR register tile of C from packed panels
+ * @param kc Depth of the panels
+ * @param a Packed A micro-panel, kc groups of MR values
+ * @param b Packed B micro-panel, kc groups of NR values (64 byte aligned)
+ * @param c Top left element of the C tile
+ * @param ldc Row stride of C
+ * @param mr Rows of the tile that exist in C (<= MR), for the bottom border
+ * @param nr Columns of the tile that exist in C (<= NR), for the right border
+ * @param accumulate Adds to C when true, overwrites it otherwise
+ */
+  typedef void (*micro_kernel_fn)(unsigned int kc, const float *a, const float *b,
+                                  float *c, unsigned int ldc, unsigned int mr,
+                                  unsigned int nr, bool accumulate);
+
+  struct MicroKernel
+  {
+    const char *isa;
+    unsigned int mr;
+    unsigned int nr;
+    micro_kernel_fn run;
+  };
+
+  // Each one lives in its own translation unit built with the matching
+  // -m flags (see Makefile), so only call those the host supports.
+  extern const MicroKernel sse3;
+  extern const MicroKernel avx2;
+  extern const MicroKernel avx512;
+
+/**
+ * @brief Picks the widest micro-kernel supported by the host cpu
+ * @return kernel chosen on first call (cpuid), cached afterwards
+ */
+  const MicroKernel &select();
+
+/**
+ * @brief Packed GEMM C = alpha op(A) op(B) + beta C with an explicit kernel,
+ *        see omp::gemm()
+ * @param kc_block Depth of the packed panels, 0 for the default (KC)
+ */
+  void gemm(const MicroKernel &uk, bool trans_a, bool trans_b,
+            unsigned int m, unsigned int n, unsigned int k, float alpha,
+            const float *a, unsigned int lda, const float *b, unsigned int ldb,
+            float beta, float *c, unsigned int ldc, unsigned int kc_block = 0);
+
+/**
+ * @brief Blocked GEMM driver of matrix_multiplication() with an explicit kernel
+ * @param kc_block Depth of the packed panels, 0 for the default (KC)
+ */
+  void gemm_blocked(const MicroKernel &uk, float *sq_matrix_1, float *sq_matrix_2,
+                    float *sq_matrix_result, unsigned int sq_dimension,
+                    unsigned int kc_block = 0);
+}
+}
+
+#endif
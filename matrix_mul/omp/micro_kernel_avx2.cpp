@@ -0,0 +1,100 @@
+/*
+    micro_kernel_avx2.cpp: 6x16 AVX2/FMA micro-kernel of the OpenMP GEMM
+
+    Copyright (C) 2011  Abhinav Jauhri (abhinav.jauhri@gmail.com), Carnegie Mellon University - Silicon Valley 
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "micro_kernel.h"
+
+extern "C"
+{
+#include <immintrin.h>
+}
+
+typedef unsigned int uint;
+
+namespace omp {
+namespace kernel {
+  static const uint MR = 6;
+  static const uint NR = 16;
+
+  // 6 rows of two __m256 each: 12 accumulators, 2 B vectors and the
+  // broadcast A value use 15 of the 16 ymm registers.
+  static void micro_kernel_avx2(
+      uint kc,
+      const float *a,
+      const float *b,
+      float *c,
+      uint ldc,
+      uint mr,
+      uint nr,
+      bool accumulate) {
+    __m256 acc[MR][2];
+#pragma GCC unroll 6
+    for (uint i = 0; i < MR; i++) {
+      acc[i][0] = _mm256_setzero_ps();
+      acc[i][1] = _mm256_setzero_ps();
+    }
+
+    for (uint p = 0; p < kc; p++) {
+      __m256 b0 = _mm256_load_ps(b);
+      __m256 b1 = _mm256_load_ps(b + 8);
+#pragma GCC unroll 6
+      for (uint i = 0; i < MR; i++) {
+        __m256 ai = _mm256_broadcast_ss(a + i);
+        acc[i][0] = _mm256_fmadd_ps(ai, b0, acc[i][0]);
+        acc[i][1] = _mm256_fmadd_ps(ai, b1, acc[i][1]);
+      }
+      a += MR;
+      b += NR;
+    }
+
+    if (mr == MR && nr == NR) {
+#pragma GCC unroll 6
+      for (uint i = 0; i < MR; i++) {
+        float *c_row = c + i*ldc;
+        if (accumulate) {
+          acc[i][0] = _mm256_add_ps(acc[i][0], _mm256_loadu_ps(c_row));
+          acc[i][1] = _mm256_add_ps(acc[i][1], _mm256_loadu_ps(c_row + 8));
+        }
+        _mm256_storeu_ps(c_row, acc[i][0]);
+        _mm256_storeu_ps(c_row + 8, acc[i][1]);
+      }
+      return;
+    }
+
+    // Border tile: clip columns with maskload/maskstore (lanes with the
+    // sign bit set are accessed) and rows with mr.
+    const __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256i m0 = _mm256_cmpgt_epi32(_mm256_set1_epi32(nr), lane);
+    const __m256i m1 = _mm256_cmpgt_epi32(_mm256_set1_epi32((int)nr - 8), lane);
+#pragma GCC unroll 6
+    for (uint i = 0; i < MR; i++) {
+      // constant trip count keeps acc[][] in registers once unrolled
+      if (i >= mr) break;
+      float *c_row = c + i*ldc;
+      if (accumulate) {
+        acc[i][0] = _mm256_add_ps(acc[i][0], _mm256_maskload_ps(c_row, m0));
+        acc[i][1] = _mm256_add_ps(acc[i][1], _mm256_maskload_ps(c_row + 8, m1));
+      }
+      _mm256_maskstore_ps(c_row, m0, acc[i][0]);
+      _mm256_maskstore_ps(c_row + 8, m1, acc[i][1]);
+    }
+  }
+
+  const MicroKernel avx2 = { "avx2", MR, NR, micro_kernel_avx2 };
+} // namespace kernel
+} // namespace omp
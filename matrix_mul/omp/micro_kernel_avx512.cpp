@@ -0,0 +1,89 @@
+/*
+    micro_kernel_avx512.cpp: 12x32 AVX-512 micro-kernel of the OpenMP GEMM
+
+    Copyright (C) 2011  Abhinav Jauhri (abhinav.jauhri@gmail.com), Carnegie Mellon University - Silicon Valley 
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "micro_kernel.h"
+
+extern "C"
+{
+#include <immintrin.h>
+}
+
+typedef unsigned int uint;
+
+namespace omp {
+namespace kernel {
+  static const uint MR = 12;
+  static const uint NR = 32;
+
+  // Mask with the low n (<= 16) lanes set.
+  static inline __mmask16 lane_mask(uint n) {
+    return n >= 16 ? (__mmask16)0xFFFF : (__mmask16)((1u << n) - 1);
+  }
+
+  // 12 rows of two __m512 each: 24 accumulators, 2 B vectors and the
+  // broadcast A value out of the 32 zmm registers.
+  static void micro_kernel_avx512(
+      uint kc,
+      const float *a,
+      const float *b,
+      float *c,
+      uint ldc,
+      uint mr,
+      uint nr,
+      bool accumulate) {
+    __m512 acc[MR][2];
+#pragma GCC unroll 12
+    for (uint i = 0; i < MR; i++) {
+      acc[i][0] = _mm512_setzero_ps();
+      acc[i][1] = _mm512_setzero_ps();
+    }
+
+    for (uint p = 0; p < kc; p++) {
+      __m512 b0 = _mm512_load_ps(b);
+      __m512 b1 = _mm512_load_ps(b + 16);
+#pragma GCC unroll 12
+      for (uint i = 0; i < MR; i++) {
+        __m512 ai = _mm512_set1_ps(a[i]);
+        acc[i][0] = _mm512_fmadd_ps(ai, b0, acc[i][0]);
+        acc[i][1] = _mm512_fmadd_ps(ai, b1, acc[i][1]);
+      }
+      a += MR;
+      b += NR;
+    }
+
+    // Masked stores cost the same as plain ones, so border tiles (nr < NR
+    // columns, mr < MR rows) share the path of full tiles.
+    const __mmask16 k0 = lane_mask(nr);
+    const __mmask16 k1 = lane_mask(nr > 16 ? nr - 16 : 0);
+#pragma GCC unroll 12
+    for (uint i = 0; i < MR; i++) {
+      if (i >= mr) break;
+      float *c_row = c + i*ldc;
+      if (accumulate) {
+        acc[i][0] = _mm512_add_ps(acc[i][0], _mm512_maskz_loadu_ps(k0, c_row));
+        acc[i][1] = _mm512_add_ps(acc[i][1], _mm512_maskz_loadu_ps(k1, c_row + 16));
+      }
+      _mm512_mask_storeu_ps(c_row, k0, acc[i][0]);
+      _mm512_mask_storeu_ps(c_row + 16, k1, acc[i][1]);
+    }
+  }
+
+  const MicroKernel avx512 = { "avx512", MR, NR, micro_kernel_avx512 };
+} // namespace kernel
+} // namespace omp
@@ -0,0 +1,114 @@
+/*
+    micro_kernel_sse3.cpp: 4x8 SSE3 micro-kernel of the OpenMP GEMM
+
+    Copyright (C) 2011  Abhinav Jauhri (abhinav.jauhri@gmail.com), Carnegie Mellon University - Silicon Valley 
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "micro_kernel.h"
+
+extern "C"
+{
+#include <pmmintrin.h>
+}
+
+typedef unsigned int uint;
+
+namespace omp {
+namespace kernel {
+  static const uint MR = 4;
+  static const uint NR = 8;
+
+  // 4 rows of two __m128 each keep 8 accumulators plus the B row and the
+  // broadcast A value in the 16 xmm registers.
+  static void micro_kernel_sse3(
+      uint kc,
+      const float *a,
+      const float *b,
+      float *c,
+      uint ldc,
+      uint mr,
+      uint nr,
+      bool accumulate) {
+    __m128 c00 = _mm_setzero_ps(), c01 = _mm_setzero_ps();
+    __m128 c10 = _mm_setzero_ps(), c11 = _mm_setzero_ps();
+    __m128 c20 = _mm_setzero_ps(), c21 = _mm_setzero_ps();
+    __m128 c30 = _mm_setzero_ps(), c31 = _mm_setzero_ps();
+
+    for (uint p = 0; p < kc; p++) {
+      __m128 b0 = _mm_load_ps(b);
+      __m128 b1 = _mm_load_ps(b + 4);
+      __m128 a0 = _mm_load1_ps(a);
+      c00 = _mm_add_ps(c00, _mm_mul_ps(a0, b0));
+      c01 = _mm_add_ps(c01, _mm_mul_ps(a0, b1));
+      a0 = _mm_load1_ps(a + 1);
+      c10 = _mm_add_ps(c10, _mm_mul_ps(a0, b0));
+      c11 = _mm_add_ps(c11, _mm_mul_ps(a0, b1));
+      a0 = _mm_load1_ps(a + 2);
+      c20 = _mm_add_ps(c20, _mm_mul_ps(a0, b0));
+      c21 = _mm_add_ps(c21, _mm_mul_ps(a0, b1));
+      a0 = _mm_load1_ps(a + 3);
+      c30 = _mm_add_ps(c30, _mm_mul_ps(a0, b0));
+      c31 = _mm_add_ps(c31, _mm_mul_ps(a0, b1));
+      a += MR;
+      b += NR;
+    }
+
+    if (mr == MR && nr == NR) {
+      if (accumulate) {
+        c00 = _mm_add_ps(c00, _mm_loadu_ps(c));
+        c01 = _mm_add_ps(c01, _mm_loadu_ps(c + 4));
+        c10 = _mm_add_ps(c10, _mm_loadu_ps(c + ldc));
+        c11 = _mm_add_ps(c11, _mm_loadu_ps(c + ldc + 4));
+        c20 = _mm_add_ps(c20, _mm_loadu_ps(c + 2*ldc));
+        c21 = _mm_add_ps(c21, _mm_loadu_ps(c + 2*ldc + 4));
+        c30 = _mm_add_ps(c30, _mm_loadu_ps(c + 3*ldc));
+        c31 = _mm_add_ps(c31, _mm_loadu_ps(c + 3*ldc + 4));
+      }
+      _mm_storeu_ps(c, c00);
+      _mm_storeu_ps(c + 4, c01);
+      _mm_storeu_ps(c + ldc, c10);
+      _mm_storeu_ps(c + ldc + 4, c11);
+      _mm_storeu_ps(c + 2*ldc, c20);
+      _mm_storeu_ps(c + 2*ldc + 4, c21);
+      _mm_storeu_ps(c + 3*ldc, c30);
+      _mm_storeu_ps(c + 3*ldc + 4, c31);
+      return;
+    }
+
+    // Border tile: SSE has no masked store, so spill the registers and
+    // write back the valid part with a scalar remainder loop.
+    float tile[MR*NR] __attribute__((aligned(16)));
+    _mm_store_ps(tile, c00);
+    _mm_store_ps(tile + 4, c01);
+    _mm_store_ps(tile + 8, c10);
+    _mm_store_ps(tile + 12, c11);
+    _mm_store_ps(tile + 16, c20);
+    _mm_store_ps(tile + 20, c21);
+    _mm_store_ps(tile + 24, c30);
+    _mm_store_ps(tile + 28, c31);
+    for (uint i = 0; i < mr; i++) {
+      for (uint j = 0; j < nr; j++) {
+        if (accumulate)
+          c[i*ldc + j] += tile[i*NR + j];
+        else
+          c[i*ldc + j] = tile[i*NR + j];
+      }
+    }
+  }
+
+  const MicroKernel sse3 = { "sse3", MR, NR, micro_kernel_sse3 };
+} // namespace kernel
+} // namespace omp
@@ -20,17 +20,18 @@
 #include <omp.h>
 #include <stdlib.h>
 #include <memory.h>
-#include "matrix_mul.h"
+#include "../variants.h"
 
 typedef unsigned int uint;
 
 namespace omp
 {
+namespace variants
+{
 void
-    matrix_multiplication(float *sq_matrix_1, float *sq_matrix_2, float *sq_matrix_result, unsigned int sq_dimension )
+    opt1(float *sq_matrix_1, float *sq_matrix_2, float *sq_matrix_result, unsigned int sq_dimension, unsigned int block_size )
     {
       memset(sq_matrix_result, 0, sq_dimension*sq_dimension*sizeof(float));
-      unsigned block_size = 8;
       for (unsigned int jj = 0; jj < sq_dimension; jj+= block_size) {
         for (unsigned int i = 0; i < sq_dimension; i++) 
         {
@@ -49,4 +50,5 @@ void
     }
 
 
+} //namespace variants
 } //namespace omp
@@ -20,14 +20,16 @@
 #include <omp.h>
 #include <stdlib.h>
 #include <memory.h>
-#include "matrix_mul.h"
+#include "../variants.h"
 
 typedef unsigned int uint;
 
 namespace omp
 {
+namespace variants
+{
 void
-    matrix_multiplication(float *sq_matrix_1, float *sq_matrix_2, float *sq_matrix_result, unsigned int sq_dimension )
+    opt2(float *sq_matrix_1, float *sq_matrix_2, float *sq_matrix_result, unsigned int sq_dimension, unsigned int /* block_size */ )
     {
       memset(sq_matrix_result, 0, sq_dimension*sq_dimension*sizeof(float));
       for (unsigned int i = 0; i < sq_dimension; i++) 
@@ -44,4 +46,5 @@ void
       }// End of parallel region
     }
 
+} //namespace variants
 } //namespace omp
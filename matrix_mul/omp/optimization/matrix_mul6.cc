@@ -22,7 +22,7 @@
 #include <stdlib.h>
 #include <memory.h>
 #include <cassert>
-#include "matrix_mul.h"
+#include "../variants.h"
 
 using std::cout;
 using std::endl;
@@ -30,13 +30,16 @@ using std::endl;
 typedef unsigned int uint;
 
 namespace omp
+{
+namespace variants
 {
   void
-  matrix_multiplication(
+  opt6(
       float *sq_matrix_1,
       float *sq_matrix_2,
       float *sq_matrix_result,
-      unsigned int sq_dimension ) {
+      unsigned int sq_dimension,
+      unsigned int /* block_size */ ) {
     // seems we can't modify sq_matrix_1 and sq_matrix_2....
 
     uint mm_size = sq_dimension*sq_dimension*sizeof(float);
@@ -59,4 +62,5 @@ namespace omp
     }
     free(tmp);
   }
+} //namespace variants
 } //namespace omp
@@ -20,20 +20,22 @@
 #include <omp.h>
 #include <stdlib.h>
 #include <memory.h>
-#include "matrix_mul.h"
+#include "../variants.h"
 
 typedef unsigned int uint;
 
 namespace omp
+{
+namespace variants
 {
   void
-  matrix_multiplication(
+  opt_bak(
       float *sq_matrix_1,
       float *sq_matrix_2,
       float *sq_matrix_result,
-      unsigned int sq_dimension ) {
+      unsigned int sq_dimension,
+      unsigned int block_size ) {
     memset(sq_matrix_result, 0, sq_dimension*sq_dimension*sizeof(float));
-    uint block_size = 64;
     for (uint kk = 0; kk < sq_dimension; kk+=block_size) {
       for (uint jj = 0; jj < sq_dimension; jj+=block_size) {
         for (uint i = 0; i < sq_dimension; i++) {
@@ -50,4 +52,5 @@ namespace omp
     }
   }
   
+} //namespace variants
 } //namespace omp
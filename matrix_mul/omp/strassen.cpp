@@ -0,0 +1,208 @@
+/*
+    strassen.cpp: Strassen-Winograd recursion on top of the packed GEMM
+
+    Copyright (C) 2011  Abhinav Jauhri (abhinav.jauhri@gmail.com), Carnegie Mellon University - Silicon Valley
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <assert.h>
+#include <stddef.h>
+#include <xmmintrin.h>
+#include "matrix_mul.h"
+#include "micro_kernel.h"
+#include "variants.h"
+
+typedef unsigned int uint;
+
+namespace omp
+{
+  static const uint STRASSEN_CUTOFF = 1024;
+
+  // The seven sub-products of the first TASK_LEVELS levels are OpenMP
+  // tasks (7 and 49 of them); below that a task recurses on its own, the
+  // GEMMs of its leaves running single-threaded inside it.
+  static const uint TASK_LEVELS = 2;
+
+  // Temporaries of one node: S1..S4, T1..T4 and the products P1, P6, P7
+  // (P2..P5 are built in the quadrants of C)
+  static const uint NODE_TEMPS = 11;
+
+  // Bump allocator over one buffer for the whole recursion. Nodes below
+  // the task levels run one child at a time, so the children reuse the
+  // same space.
+  struct Arena
+  {
+    float *base;
+    size_t top, size;
+
+    float *take(size_t count) {
+      float *p = base + top;
+      top += (count + 15) & ~(size_t)15;  // keeps every block 64 byte aligned
+      assert(top <= size);
+      return p;
+    }
+  };
+
+  static size_t quadrant_size(uint h) {
+    return ((size_t)h * h + 15) & ~(size_t)15;
+  }
+
+  // Floats of the arena the recursion on an n x n product needs
+  static size_t arena_size(uint n, uint cutoff, uint level) {
+    if (n <= cutoff || n < 2)
+      return 0;
+    uint h = n / 2;
+    size_t child = arena_size(h, cutoff, level + 1);
+    return NODE_TEMPS * quadrant_size(h) + (level < TASK_LEVELS ? 7 * child : child);
+  }
+
+  // z = x + y, or x - y if subtract, over h x h quadrants
+  static void add(uint h, const float *x, uint ldx, const float *y, uint ldy,
+                  float *z, uint ldz, bool subtract) {
+    for (uint i = 0; i < h; i++) {
+      const float *x_row = &x[(size_t)i*ldx], *y_row = &y[(size_t)i*ldy];
+      float *z_row = &z[(size_t)i*ldz];
+      if (subtract)
+        for (uint j = 0; j < h; j++) z_row[j] = x_row[j] - y_row[j];
+      else
+        for (uint j = 0; j < h; j++) z_row[j] = x_row[j] + y_row[j];
+    }
+  }
+
+  static void multiply(const kernel::MicroKernel &uk, uint n,
+                       const float *a, uint lda, const float *b, uint ldb,
+                       float *c, uint ldc, uint cutoff, uint level, Arena &arena);
+
+  // One sub-product P = X Y into p (row stride ldp), with its own arena
+  // at the task levels
+  static void product(const kernel::MicroKernel &uk, uint h,
+                      const float *x, uint ldx, const float *y, uint ldy,
+                      float *p, uint ldp, uint cutoff, uint level, Arena &arena,
+                      size_t child_size) {
+    if (level < TASK_LEVELS) {
+      Arena sub = { arena.take(child_size), 0, child_size };
+#pragma omp task firstprivate(sub)
+      multiply(uk, h, x, ldx, y, ldy, p, ldp, cutoff, level + 1, sub);
+    } else {
+      size_t mark = arena.top;
+      multiply(uk, h, x, ldx, y, ldy, p, ldp, cutoff, level + 1, arena);
+      arena.top = mark;
+    }
+  }
+
+  // C = A B, n x n, with the Winograd form of Strassen's algorithm
+  // (7 products, 15 additions). An odd n is peeled: the recursion covers
+  // the leading n-1 rows and columns, the GEMM the last ones.
+  static void multiply(const kernel::MicroKernel &uk, uint n,
+                       const float *a, uint lda, const float *b, uint ldb,
+                       float *c, uint ldc, uint cutoff, uint level, Arena &arena) {
+    if (n <= cutoff || n < 2) {
+      kernel::gemm(uk, false, false, n, n, n, 1.0f, a, lda, b, ldb, 0.0f, c, ldc);
+      return;
+    }
+
+    uint h = n / 2, m = 2 * h;
+    const float *a11 = a, *a12 = a + h, *a21 = a + (size_t)h*lda, *a22 = a21 + h;
+    const float *b11 = b, *b12 = b + h, *b21 = b + (size_t)h*ldb, *b22 = b21 + h;
+    float *c11 = c, *c12 = c + h, *c21 = c + (size_t)h*ldc, *c22 = c21 + h;
+
+    size_t q = quadrant_size(h);
+    float *s1 = arena.take(q), *s2 = arena.take(q), *s3 = arena.take(q), *s4 = arena.take(q);
+    float *t1 = arena.take(q), *t2 = arena.take(q), *t3 = arena.take(q), *t4 = arena.take(q);
+    float *p1 = arena.take(q), *p6 = arena.take(q), *p7 = arena.take(q);
+
+    add(h, a21, lda, a22, lda, s1, h, false);  // S1 = A21 + A22
+    add(h, s1, h, a11, lda, s2, h, true);      // S2 = S1 - A11
+    add(h, a11, lda, a21, lda, s3, h, true);   // S3 = A11 - A21
+    add(h, a12, lda, s2, h, s4, h, true);      // S4 = A12 - S2
+    add(h, b12, ldb, b11, ldb, t1, h, true);   // T1 = B12 - B11
+    add(h, b22, ldb, t1, h, t2, h, true);      // T2 = B22 - T1
+    add(h, b22, ldb, b12, ldb, t3, h, true);   // T3 = B22 - B12
+    add(h, t2, h, b21, ldb, t4, h, true);      // T4 = T2 - B21
+
+    size_t child = arena_size(h, cutoff, level + 1);
+    product(uk, h, a11, lda, b11, ldb, p1, h, cutoff, level, arena, child);    // P1
+    product(uk, h, a12, lda, b21, ldb, c11, ldc, cutoff, level, arena, child); // P2
+    product(uk, h, s4, h, b22, ldb, c12, ldc, cutoff, level, arena, child);    // P3
+    product(uk, h, a22, lda, t4, h, c21, ldc, cutoff, level, arena, child);    // P4
+    product(uk, h, s1, h, t1, h, c22, ldc, cutoff, level, arena, child);       // P5
+    product(uk, h, s2, h, t2, h, p6, h, cutoff, level, arena, child);          // P6
+    product(uk, h, s3, h, t3, h, p7, h, cutoff, level, arena, child);          // P7
+#pragma omp taskwait
+
+    add(h, c11, ldc, p1, h, c11, ldc, false);  // C11 = P1 + P2
+    add(h, p1, h, p6, h, p1, h, false);        // U2 = P1 + P6
+    add(h, p7, h, p1, h, p7, h, false);        // U3 = U2 + P7
+    add(h, c12, ldc, p1, h, c12, ldc, false);  // C12 = U2 + P5 + P3
+    add(h, c12, ldc, c22, ldc, c12, ldc, false);
+    add(h, p7, h, c21, ldc, c21, ldc, true);   // C21 = U3 - P4
+    add(h, c22, ldc, p7, h, c22, ldc, false);  // C22 = U3 + P5
+
+    if (m < n) {
+      // C[0:m, 0:m] += A[0:m, m] B[m, 0:m], then the last column and row
+      kernel::gemm(uk, false, false, m, m, 1, 1.0f, a + m, lda, b + (size_t)m*ldb, ldb,
+          1.0f, c, ldc);
+      kernel::gemm(uk, false, false, m, 1, n, 1.0f, a, lda, b + m, ldb, 0.0f, c + m, ldc);
+      kernel::gemm(uk, false, false, 1, n, n, 1.0f, a + (size_t)m*lda, lda, b, ldb,
+          0.0f, c + (size_t)m*ldc, ldc);
+    }
+  }
+
+  void strassen_multiplication(float *sq_matrix_1, float *sq_matrix_2, float *sq_matrix_result,
+      unsigned int sq_dimension, unsigned int cutoff) {
+    const kernel::MicroKernel &uk = kernel::select();
+    uint n = sq_dimension;
+    if (cutoff == 0)
+      cutoff = STRASSEN_CUTOFF;
+    if (n <= cutoff) {
+      kernel::gemm(uk, false, false, n, n, n, 1.0f, sq_matrix_1, n, sq_matrix_2, n,
+          0.0f, sq_matrix_result, n);
+      return;
+    }
+
+    // The buffer is kept for the next call, which then neither allocates
+    // nor page-faults; a concurrent caller takes one of its own.
+    static float *cached = NULL;
+    static size_t cached_size = 0;
+    static volatile int in_use = 0;
+    bool own = __sync_lock_test_and_set(&in_use, 1) != 0;
+
+    size_t size = arena_size(n, cutoff, 0);
+    Arena arena = { own ? NULL : cached, 0, size };
+    if (arena.base == NULL || (!own && cached_size < size)) {
+      if (!own && cached != NULL)
+        _mm_free(cached);
+      arena.base = (float *)_mm_malloc(size*sizeof(float), 64);
+      assert(arena.base != NULL);
+      if (!own) {
+        cached = arena.base;
+        cached_size = size;
+      }
+    }
+#pragma omp parallel
+#pragma omp single
+    multiply(uk, n, sq_matrix_1, n, sq_matrix_2, n, sq_matrix_result, n, cutoff, 0, arena);
+
+    if (own)
+      _mm_free(arena.base);
+    else
+      __sync_lock_release(&in_use);
+  }
+
+  void variants::strassen(float *sq_matrix_1, float *sq_matrix_2, float *sq_matrix_result,
+      unsigned int sq_dimension, unsigned int block_size) {
+    strassen_multiplication(sq_matrix_1, sq_matrix_2, sq_matrix_result, sq_dimension, block_size);
+  }
+}
@@ -20,12 +20,14 @@
 
 #include <iostream>
 #include <string.h>
+#include <mm_malloc.h>
 #include <cppunit/extensions/HelperMacros.h>
 #include <cppunit/ui/text/TestRunner.h>
 #include <cppunit/TestResult.h>
 #include <cppunit/TestResultCollector.h>
 #include <cppunit/XmlOutputter.h>
 #include "matrix_mul.h"
+#include "variants.h"
 #include "../tests/testutil.h"
 
 namespace omp 
@@ -34,6 +36,10 @@ namespace omp
   {
     CPPUNIT_TEST_SUITE(Tests);
     CPPUNIT_TEST(test_cases);
+    CPPUNIT_TEST(test_gemm);
+    CPPUNIT_TEST(test_packed_b);
+    CPPUNIT_TEST(test_fused);
+    CPPUNIT_TEST(test_strassen);
     CPPUNIT_TEST_SUITE_END();
 
   public:
@@ -72,6 +78,104 @@ namespace omp
         }
     }
 
+    void
+    test_gemm()
+    {
+      CPPUNIT_ASSERT(gemm_sweep_error(gemm) < EPS);
+      std::cout<<"\n"<<"gemm\t"<<TestFrameWork::size<<" sizes\n";
+    }
+
+    // gemm() through a PackedB built from b, as a testutil::gemm_fn
+    static void
+    packed_gemm(bool trans_a, bool trans_b, unsigned int m, unsigned int n, unsigned int k,
+                float alpha, const float *a, unsigned int lda, const float *b, unsigned int ldb,
+                float beta, float *c, unsigned int ldc)
+    {
+      PackedB packed(trans_b, k, n, b, ldb);
+      gemm(trans_a, m, alpha, a, lda, packed, beta, c, ldc);
+    }
+
+    void
+    test_packed_b()
+    {
+      CPPUNIT_ASSERT(gemm_sweep_error(packed_gemm) < EPS);
+      // more than one column block and k block of the packed layout
+      CPPUNIT_ASSERT(gemm_error(packed_gemm, false, true, 7, 3109, 517, 1.0f, 0.5f) < EPS);
+      std::cout<<"\n"<<"packed B\t"<<TestFrameWork::size<<" sizes\n";
+    }
+
+    // kernel::gemm_fused() storing its strips into C, as a testutil::gemm_fn;
+    // an element handed over twice would be scaled by beta twice
+    struct FusedC
+    {
+      float *c;
+      unsigned int ldc;
+      float beta;
+    };
+
+    static void
+    store_strip(void *arg, unsigned int i0, unsigned int rows, unsigned int j0, unsigned int cols,
+                const float *c, unsigned int ldc)
+    {
+      FusedC *out = (FusedC *)arg;
+      for (unsigned int i = 0; i < rows; i++)
+        for (unsigned int j = 0; j < cols; j++)
+          {
+            float *x = &out->c[(i0 + i) * out->ldc + j0 + j];
+            *x = c[i * ldc + j] + (out->beta == 0.0f ? 0.0f : out->beta * *x);
+          }
+    }
+
+    static void
+    fused_gemm(bool trans_a, bool trans_b, unsigned int m, unsigned int n, unsigned int k,
+               float alpha, const float *a, unsigned int lda, const float *b, unsigned int ldb,
+               float beta, float *c, unsigned int ldc)
+    {
+      PackedB packed(trans_b, k, n, b, ldb);
+      float *buffer = (float *)_mm_malloc(kernel::fused_buffer_size(packed) * sizeof(float), 64);
+      FusedC out = { c, ldc, beta };
+      kernel::gemm_fused(trans_a, m, alpha, a, lda, packed, buffer, store_strip, &out);
+      _mm_free(buffer);
+    }
+
+    void
+    test_fused()
+    {
+      CPPUNIT_ASSERT(gemm_sweep_error(fused_gemm) < EPS);
+      // several MC blocks, column blocks and k blocks
+      CPPUNIT_ASSERT(gemm_error(fused_gemm, false, true, 301, 3109, 517, -2.0f, 0.0f) < EPS);
+      std::cout<<"\n"<<"fused\t"<<TestFrameWork::size<<" sizes\n";
+    }
+
+    void
+    test_strassen()
+    {
+      // a small cutoff, so that the test sizes recurse (and peel odd ones)
+      for (int i = 0; i < TestFrameWork::size; i++)
+        {
+          unsigned int n = TestFrameWork::matrix_dim[i];
+          result = new float[n * n];
+          sq_matrix_1 = new float[n * n];
+          sq_matrix_2 = new float[n * n];
+          answers = new float[n * n];
+
+          randomize(sq_matrix_1, n, n);
+          randomize(sq_matrix_2, n, n);
+          strassen_multiplication(sq_matrix_1, sq_matrix_2, result, n, 16);
+          tripleloop(answers, sq_matrix_1, sq_matrix_2, n, n, n);
+
+          float err = rel_diff(answers, result, n, n);
+          std::cout<<"\n"<<"strassen n = "<<n<<"\trelative error "<<err;
+          CPPUNIT_ASSERT(err < EPS);
+
+          delete[] sq_matrix_1;
+          delete[] sq_matrix_2;
+          delete[] answers;
+          delete[] result;
+        }
+      std::cout<<"\n";
+    }
+
     void
     setUp()
     {
@@ -90,6 +194,20 @@ main(int argc, char **argv)
   CppUnit::TestResultCollector result;
   CppUnit::TextUi::TestRunner runner;
   
+  // -v name[:block_size] (or -v auto) first picks the variant under test,
+  // like MATMUL_VARIANT
+  if (argc >= 3 && strcmp(argv[1], "-v") == 0)
+    {
+      if (!omp::variants::select(argv[2]))
+        {
+          std::cout<<"Unknown variant "<<argv[2]<<"\n";
+          return 1;
+        }
+      for (int i = 3; i <= argc; i++)
+        argv[i - 2] = argv[i];
+      argc -= 2;
+    }
+
   runner.addTest(omp::Tests::suite());
   strcpy(omp::Tests::filename, argv[2]);
   if (argc == 3 && strcmp(argv[1], "-i") == 0) 
@@ -103,6 +221,6 @@ main(int argc, char **argv)
   else if (argc == 4 && strcmp(argv[3], "-o") == 0) 
     runner.run();
   else
-    std::cout<<"Usage "<<argv[0]<<" -i <test filename>\n -o";
+    std::cout<<"Usage "<<argv[0]<<" [-v variant[:block_size]|auto] -i <test filename>\n -o";
   return 0;
 }
@@ -0,0 +1,314 @@
+/*
+    variants.cpp: registry, run-time selection and auto-tuner of the
+    OpenMP matrix multiplication variants
+
+    Copyright (C) 2011  Abhinav Jauhri (abhinav.jauhri@gmail.com), Carnegie Mellon University - Silicon Valley
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <omp.h>
+#include "micro_kernel.h"
+#include "variants.h"
+
+typedef unsigned int uint;
+
+namespace omp {
+namespace variants {
+  // Tuner candidates per variant, ascending and 0 terminated. KC of the
+  // packed GEMM is the depth of its L1-resident panels, Strassen's are
+  // its cutoffs; the others block the j (and k) loops of C.
+  static const uint PACKED_BLOCKS[] = { 128, 256, 384, 512, 0 };
+  static const uint COLUMN_BLOCKS[] = { 8, 16, 32, 64, 128, 0 };
+  static const uint TILE_BLOCKS[] = { 32, 64, 128, 256, 0 };
+  static const uint STRASSEN_BLOCKS[] = { 512, 1024, 2048, 0 };
+
+  static const Variant VARIANTS[] = {
+    { "packed", "packed GEMM, cpuid-selected micro-kernel", packed, true, 256, PACKED_BLOCKS },
+    { "packed-sse3", "packed GEMM, SSE3 micro-kernel", packed_sse3, true, 256, PACKED_BLOCKS },
+    { "packed-avx2", "packed GEMM, AVX2 micro-kernel", packed_avx2, true, 256, PACKED_BLOCKS },
+    { "packed-avx512", "packed GEMM, AVX-512 micro-kernel", packed_avx512, true, 256, PACKED_BLOCKS },
+    { "strassen", "Strassen-Winograd over the packed GEMM", strassen, true, 1024, STRASSEN_BLOCKS },
+    { "opt1", "optimization/matrix_mul1.cc, column blocks", opt1, false, 8, COLUMN_BLOCKS },
+    { "opt2", "optimization/matrix_mul2.cc, i-k-j loop", opt2, false, 0, NULL },
+    { "opt3", "optimization/matrix_mul3.cc, parallel tiles, atomics", opt3, true, 64, TILE_BLOCKS },
+    { "opt4", "optimization/matrix_mul4.cc, tiles, parallel rows, atomics", opt4, true, 64, TILE_BLOCKS },
+    { "opt5", "optimization/matrix_mul5.cc, parallel i-k-j", opt5, true, 0, NULL },
+    { "opt6", "optimization/matrix_mul6.cc, transposed B", opt6, true, 0, NULL },
+    { "opt_bak", "optimization/matrix_mul_bak.cc, tiles", opt_bak, false, 64, TILE_BLOCKS },
+  };
+  static const uint NUM_VARIANTS = sizeof(VARIANTS) / sizeof(VARIANTS[0]);
+
+  // The tuner times every variant on min(n, SCREEN_N) first and drops
+  // those more than SCREEN_RATIO times slower than the best, so that the
+  // naive loops cost milliseconds; the rest are timed with each block
+  // size on min(n, TUNE_N). Buckets above TUNE_N share its timings,
+  // which is large enough for Strassen's 512 and 1024 cutoffs to recurse.
+  static const uint SCREEN_N = 64;
+  static const double SCREEN_RATIO = 4.0;
+  static const uint TUNE_N = 2048;
+  static const int TUNE_REPS = 3;
+
+  static bool supported(const Variant &v) {
+    __builtin_cpu_init();
+    if (v.run == packed_avx2)
+      return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    if (v.run == packed_avx512)
+      return __builtin_cpu_supports("avx512f");
+    return true;
+  }
+
+  struct Usable
+  {
+    Variant variants[NUM_VARIANTS];
+    uint count;
+  };
+
+  static Usable usable_variants() {
+    Usable usable;
+    usable.count = 0;
+    for (uint i = 0; i < NUM_VARIANTS; i++)
+      if (supported(VARIANTS[i]))
+        usable.variants[usable.count++] = VARIANTS[i];
+    return usable;
+  }
+
+  const Variant *all(unsigned int *count) {
+    // initialised once, also when several threads get here first
+    static const Usable usable = usable_variants();
+    *count = usable.count;
+    return usable.variants;
+  }
+
+  const Variant *find(const char *name) {
+    uint count;
+    const Variant *v = all(&count);
+    for (uint i = 0; i < count; i++)
+      if (strcmp(v[i].name, name) == 0)
+        return &v[i];
+    return NULL;
+  }
+
+  // The selection: a fixed choice, or the tuner when auto is set
+  static Choice selected;
+  static bool tuned_choice = false;
+  static bool initialised = false;
+
+  // omp::matrix_multiplication() may run on several threads at once:
+  // the selection and the tuner's cache are only used under this lock
+  static pthread_mutex_t state_lock = PTHREAD_MUTEX_INITIALIZER;
+
+  struct Lock
+  {
+    Lock() { pthread_mutex_lock(&state_lock); }
+    ~Lock() { pthread_mutex_unlock(&state_lock); }
+  };
+
+  static Choice tune_locked(uint sq_dimension);
+
+  static bool parse(const char *spec, Choice &choice, bool &automatic) {
+    std::string name(spec);
+    uint block_size = 0;
+    size_t colon = name.find(':');
+    if (colon != std::string::npos) {
+      block_size = atoi(name.c_str() + colon + 1);
+      name.erase(colon);
+    }
+    if (name == "auto") {
+      automatic = true;
+      return true;
+    }
+    const Variant *v = find(name.c_str());
+    if (v == NULL)
+      return false;
+    choice.variant = v;
+    choice.block_size = (block_size > 0 && v->block_size > 0) ? block_size : v->block_size;
+    automatic = false;
+    return true;
+  }
+
+  static void initialise() {
+    if (initialised)
+      return;
+    initialised = true;
+    selected.variant = find("packed");
+    selected.block_size = selected.variant->block_size;
+    const char *spec = getenv("MATMUL_VARIANT");
+    if (spec != NULL && *spec != '\0' && !parse(spec, selected, tuned_choice))
+      fprintf(stderr, "Warning: MATMUL_VARIANT=%s names no variant, using packed\n", spec);
+  }
+
+  bool select(const char *spec) {
+    Lock lock;
+    initialise();
+    Choice choice = selected;
+    bool automatic;
+    if (!parse(spec, choice, automatic))
+      return false;
+    selected = choice;
+    tuned_choice = automatic;
+    return true;
+  }
+
+  Choice choose(unsigned int sq_dimension) {
+    Lock lock;
+    initialise();
+    return tuned_choice ? tune_locked(sq_dimension) : selected;
+  }
+
+  // Cache keys: the micro-kernel ISA, the thread count and the size
+  // bucket (the next power of two), one line "isa threads bucket name
+  // block_size" per tuned bucket
+  static std::string cache_key(const char *isa, int threads, uint bucket) {
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%s %d %u", isa, threads, bucket);
+    return buf;
+  }
+
+  static std::string cache_path() {
+    const char *path = getenv("MATMUL_TUNE_CACHE");
+    if (path != NULL && *path != '\0')
+      return path;
+    const char *home = getenv("HOME");
+    return std::string(home ? home : ".") + "/.matrix_mul_tune";
+  }
+
+  static void load_cache(std::map<std::string, Choice> &cache) {
+    FILE *f = fopen(cache_path().c_str(), "r");
+    if (f == NULL)
+      return;
+    char line[256], isa[32], name[64];
+    int threads;
+    uint bucket, block_size;
+    while (fgets(line, sizeof(line), f) != NULL) {
+      if (sscanf(line, "%31s %d %u %63s %u", isa, &threads, &bucket, name, &block_size) != 5)
+        continue;
+      // Entries of variants this build no longer has are ignored
+      const Variant *v = find(name);
+      if (v != NULL) {
+        Choice choice = { v, block_size };
+        cache[cache_key(isa, threads, bucket)] = choice;
+      }
+    }
+    fclose(f);
+  }
+
+  static void save_cache(const std::string &key, const Choice &choice) {
+    FILE *f = fopen(cache_path().c_str(), "a");
+    if (f == NULL)
+      return;
+    fprintf(f, "%s %s %u\n", key.c_str(), choice.variant->name, choice.block_size);
+    fclose(f);
+  }
+
+  // Smallest time of reps runs after one warmup, or of the warmup alone
+  // when it is already slower than limit
+  static double time_run(const Variant &v, uint block_size, float *a, float *b, float *c,
+                         uint n, int reps, double limit) {
+    double start = omp_get_wtime();
+    v.run(a, b, c, n, block_size);
+    double best = omp_get_wtime() - start;
+    if (best > limit)
+      return best;
+    for (int i = 0; i < reps; i++) {
+      start = omp_get_wtime();
+      v.run(a, b, c, n, block_size);
+      best = std::min(best, omp_get_wtime() - start);
+    }
+    return best;
+  }
+
+  Choice tune(unsigned int sq_dimension) {
+    Lock lock;
+    return tune_locked(sq_dimension);
+  }
+
+  static Choice tune_locked(uint sq_dimension) {
+    static std::map<std::string, Choice> cache;
+    static bool loaded = false;
+    if (!loaded) {
+      load_cache(cache);
+      loaded = true;
+    }
+
+    uint bucket = 1;
+    while (bucket < sq_dimension)
+      bucket *= 2;
+    std::string key = cache_key(kernel::select().isa, omp_get_max_threads(), bucket);
+    std::map<std::string, Choice>::iterator it = cache.find(key);
+    if (it != cache.end())
+      return it->second;
+
+    uint count;
+    const Variant *v = all(&count);
+    uint tune_n = std::max(1u, std::min(sq_dimension, TUNE_N));
+    uint screen_n = std::min(tune_n, SCREEN_N);
+
+    // Fixed inputs (a small LCG, so rand() of the caller is left alone)
+    std::vector<float> a((size_t)tune_n * tune_n), b(a.size()), c(a.size());
+    uint state = 12345u;
+    for (size_t i = 0; i < a.size(); i++) {
+      state = state * 1103515245u + 12345u;
+      a[i] = (state >> 8) * (1.0f / 16777216.0f);
+      state = state * 1103515245u + 12345u;
+      b[i] = (state >> 8) * (1.0f / 16777216.0f);
+    }
+
+    std::vector<double> screen(count);
+    double screen_best = 1e30;
+    for (uint i = 0; i < count; i++) {
+      screen[i] = time_run(v[i], v[i].block_size, &a[0], &b[0], &c[0], screen_n, 1, 1e30);
+      screen_best = std::min(screen_best, screen[i]);
+    }
+
+    Choice best = { &v[0], v[0].block_size };
+    double best_time = 1e30;
+    for (uint i = 0; i < count; i++) {
+      if (screen[i] > SCREEN_RATIO * screen_best)
+        continue;
+      // A block of tune_n or more covers the whole matrix (and Strassen
+      // does not recurse), so of those only the smallest is timed
+      std::vector<uint> blocks(1, v[i].block_size);
+      if (v[i].block_sizes != NULL) {
+        blocks.clear();
+        for (const uint *bs = v[i].block_sizes; *bs != 0; bs++) {
+          blocks.push_back(*bs);
+          if (*bs >= tune_n)
+            break;
+        }
+      }
+      for (size_t j = 0; j < blocks.size(); j++) {
+        double t = time_run(v[i], blocks[j], &a[0], &b[0], &c[0], tune_n, TUNE_REPS, 2.0 * best_time);
+        if (t < best_time) {
+          best_time = t;
+          best.variant = &v[i];
+          best.block_size = blocks[j];
+        }
+      }
+    }
+
+    cache[key] = best;
+    save_cache(key, best);
+    return best;
+  }
+} // namespace variants
+} // namespace omp
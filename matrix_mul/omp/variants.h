@@ -0,0 +1,108 @@
+/*
+    variants.h: named matrix multiplication variants of the OpenMP version,
+    selectable at run time and auto-tuned per size
+
+    Copyright (C) 2011  Abhinav Jauhri (abhinav.jauhri@gmail.com), Carnegie Mellon University - Silicon Valley
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef VARIANTS_H
+#define VARIANTS_H
+
+namespace omp
+{
+namespace variants
+{
+/**
+ * @brief One implementation of the square product
+ * @param block_size Cache block of the variant (the k depth for the
+ *        packed GEMM), ignored by variants without one
+ */
+  typedef void (*variant_fn)(float *sq_matrix_1, float *sq_matrix_2, float *sq_matrix_result,
+                             unsigned int sq_dimension, unsigned int block_size);
+
+  struct Variant
+  {
+    const char *name;
+    const char *description;
+    variant_fn run;
+    bool threaded;                    // honours omp_set_num_threads()
+    unsigned int block_size;          // default, 0 if it has none
+    const unsigned int *block_sizes;  // candidates of the tuner, 0 terminated
+  };
+
+  struct Choice
+  {
+    const Variant *variant;
+    unsigned int block_size;
+  };
+
+  // matrix_mul.cpp: the packed GEMM, with the cpuid-selected or a given
+  // micro-kernel
+  void packed(float *sq_matrix_1, float *sq_matrix_2, float *sq_matrix_result, unsigned int sq_dimension, unsigned int block_size);
+  void packed_sse3(float *sq_matrix_1, float *sq_matrix_2, float *sq_matrix_result, unsigned int sq_dimension, unsigned int block_size);
+  void packed_avx2(float *sq_matrix_1, float *sq_matrix_2, float *sq_matrix_result, unsigned int sq_dimension, unsigned int block_size);
+  void packed_avx512(float *sq_matrix_1, float *sq_matrix_2, float *sq_matrix_result, unsigned int sq_dimension, unsigned int block_size);
+
+  // strassen.cpp: Strassen-Winograd, block_size being its cutoff
+  void strassen(float *sq_matrix_1, float *sq_matrix_2, float *sq_matrix_result, unsigned int sq_dimension, unsigned int block_size);
+
+  // optimization/matrix_mul{1..6,_bak}.cc
+  void opt1(float *sq_matrix_1, float *sq_matrix_2, float *sq_matrix_result, unsigned int sq_dimension, unsigned int block_size);
+  void opt2(float *sq_matrix_1, float *sq_matrix_2, float *sq_matrix_result, unsigned int sq_dimension, unsigned int block_size);
+  void opt3(float *sq_matrix_1, float *sq_matrix_2, float *sq_matrix_result, unsigned int sq_dimension, unsigned int block_size);
+  void opt4(float *sq_matrix_1, float *sq_matrix_2, float *sq_matrix_result, unsigned int sq_dimension, unsigned int block_size);
+  void opt5(float *sq_matrix_1, float *sq_matrix_2, float *sq_matrix_result, unsigned int sq_dimension, unsigned int block_size);
+  void opt6(float *sq_matrix_1, float *sq_matrix_2, float *sq_matrix_result, unsigned int sq_dimension, unsigned int block_size);
+  void opt_bak(float *sq_matrix_1, float *sq_matrix_2, float *sq_matrix_result, unsigned int sq_dimension, unsigned int block_size);
+
+/**
+ * @brief The variants this host can run, the default ("packed") first
+ * @param count Set to the number of variants
+ */
+  const Variant *all(unsigned int *count);
+
+/**
+ * @brief Looks a variant up by name
+ * @return NULL if there is none (or the host lacks its SIMD extension)
+ */
+  const Variant *find(const char *name);
+
+/**
+ * @brief Sets what omp::matrix_multiplication() runs, overriding the
+ *        MATMUL_VARIANT environment variable that is read otherwise
+ * @param spec "name", "name:block_size" or "auto" for the tuner
+ * @return false, leaving the selection as it was, if spec names no variant
+ */
+  bool select(const char *spec);
+
+/**
+ * @brief The variant and block size omp::matrix_multiplication() runs
+ *        for this size: the selected one, or the tuned one under "auto"
+ */
+  Choice choose(unsigned int sq_dimension);
+
+/**
+ * @brief Times the variants and their block sizes on this machine, for
+ *        sizes up to the next power of two with the current number of
+ *        threads, and keeps the fastest in MATMUL_TUNE_CACHE (default
+ *        $HOME/.matrix_mul_tune) so later processes skip the timing.
+ *        Calls from several threads tune one at a time.
+ */
+  Choice tune(unsigned int sq_dimension);
+}
+}
+
+#endif
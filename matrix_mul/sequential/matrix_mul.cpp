@@ -17,6 +17,7 @@
 
 #include "matrix_mul.h"
 #include<iostream>
+#include<stddef.h>
 
 namespace sequential
 {
@@ -35,6 +36,28 @@ namespace sequential
 			}
 		}
 	}
+
+	void gemm(	bool trans_a, bool trans_b, unsigned int m, unsigned int n, unsigned int k,
+			float alpha, const float *a, unsigned int lda, const float *b, unsigned int ldb,
+			float beta, float *c, unsigned int ldc	)
+	{
+		// Strides of op(A) and op(B) along their rows and columns
+		size_t a_rs = trans_a ? 1 : lda, a_cs = trans_a ? lda : 1;
+		size_t b_rs = trans_b ? 1 : ldb, b_cs = trans_b ? ldb : 1;
+
+		for( unsigned int i = 0; i < m; i++ )
+		{
+			for( unsigned int j = 0; j < n; j++ )
+			{
+				float sum = 0.0f;
+				for( unsigned int l = 0; l < k; l++ )
+					sum += a[i*a_rs + l*a_cs] * b[l*b_rs + j*b_cs];
+				float *result = &c[(size_t)i*ldc + j];
+				// C is not read when beta is 0, as in BLAS
+				*result = (beta == 0.0f) ? alpha * sum : alpha * sum + beta * *result;
+			}
+		}
+	}
   
 } //namespace sequential
 
@@ -31,6 +31,24 @@ namespace sequential
  * @param sq_dimension Dimension of the square matrix 
  */
   void matrix_multiplication(float *sq_matrix_1, float *sq_matrix_2, float *sq_matrix_result, unsigned int sq_dimension);
+
+/**
+ * @brief General product C = alpha op(A) op(B) + beta C of row-major
+ *        matrices, op(X) being X or its transpose (as BLAS sgemm)
+ * @param trans_a Use the transpose of A: A is stored k x m instead of m x k
+ * @param trans_b Use the transpose of B: B is stored n x k instead of k x n
+ * @param m Rows of op(A) and C
+ * @param n Columns of op(B) and C
+ * @param k Columns of op(A), rows of op(B)
+ * @param alpha Scale of the product
+ * @param a First matrix, row stride lda (>= its stored columns)
+ * @param b Second matrix, row stride ldb
+ * @param beta Scale of C before the product is added; C is not read when 0
+ * @param c m x n result, row stride ldc, updated in place
+ */
+  void gemm(bool trans_a, bool trans_b, unsigned int m, unsigned int n, unsigned int k,
+            float alpha, const float *a, unsigned int lda, const float *b, unsigned int ldb,
+            float beta, float *c, unsigned int ldc);
 }
 
 #endif
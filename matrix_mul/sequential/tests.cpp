@@ -35,6 +35,7 @@ namespace sequential
   {
     CPPUNIT_TEST_SUITE(Tests);
     CPPUNIT_TEST(test_cases);
+    CPPUNIT_TEST(test_gemm);
     CPPUNIT_TEST_SUITE_END();
     
   public:
@@ -74,6 +75,13 @@ namespace sequential
 	}
     }
 
+    void
+    test_gemm()
+    {
+      CPPUNIT_ASSERT(gemm_sweep_error(gemm) < EPS);
+      std::cout<<"\n"<<"gemm\t"<<TestFrameWork::size<<" sizes\n";
+    }
+
     void 
     setUp()
     {
@@ -27,6 +27,7 @@
 #include<string.h>
 
 #include <math.h>
+#include <algorithm>
 
 #define EPS 1E-3
 
@@ -90,7 +91,89 @@ namespace testutil
   	    return max_err;
 	}
 
-	
+
+    // Largest difference relative to the largest element of answers
+    float rel_diff(float* answers, float* in, int lines, int cols)
+	{
+	    float err = 0.0f, scale = 0.0f;
+
+	    for (int i = 0; i < lines * cols; i++) {
+		err = std::max(err, (float)fabs(answers[i] - in[i]));
+		scale = std::max(scale, (float)fabs(answers[i]));
+	    }
+	    return (scale > 0.0f) ? err / scale : err;
+	}
+
+    typedef void (*gemm_fn)(bool trans_a, bool trans_b, unsigned int m, unsigned int n, unsigned int k,
+			    float alpha, const float *a, unsigned int lda, const float *b, unsigned int ldb,
+			    float beta, float *c, unsigned int ldc);
+
+/**
+ * @brief Runs gemm on views of larger buffers (row strides 3 past the
+ *        stored width) and compares with the product in doubles
+ * @return largest error divided by k + 1, or 1 if gemm wrote outside C
+ */
+    float gemm_error(gemm_fn gemm, bool trans_a, bool trans_b, unsigned int m, unsigned int n,
+		     unsigned int k, float alpha, float beta)
+	{
+	    unsigned int a_rows = trans_a ? k : m, a_cols = trans_a ? m : k;
+	    unsigned int b_rows = trans_b ? n : k, b_cols = trans_b ? k : n;
+	    unsigned int lda = a_cols + 3, ldb = b_cols + 3, ldc = n + 3;
+	    float *a = new float[a_rows * lda + 1];
+	    float *b = new float[b_rows * ldb + 1];
+	    float *c = new float[m * ldc];
+	    float *c_0 = new float[m * ldc];
+	    float err = 0.0f;
+
+	    randomize(a, a_rows * lda + 1, 1);
+	    randomize(b, b_rows * ldb + 1, 1);
+	    randomize(c_0, m, ldc);
+	    memcpy(c, c_0, m * ldc * sizeof(float));
+	    gemm(trans_a, trans_b, m, n, k, alpha, a, lda, b, ldb, beta, c, ldc);
+
+	    for (unsigned int i = 0; i < m; i++) {
+		for (unsigned int j = 0; j < ldc; j++) {
+		    if (j >= n) {
+			if (c[i * ldc + j] != c_0[i * ldc + j])
+			    err = k + 1;
+			continue;
+		    }
+		    double sum = 0.0;
+		    for (unsigned int l = 0; l < k; l++)
+			sum += (double)(trans_a ? a[l * lda + i] : a[i * lda + l]) *
+			       (trans_b ? b[j * ldb + l] : b[l * ldb + j]);
+		    double expected = alpha * sum + beta * c_0[i * ldc + j];
+		    err = std::max(err, (float)fabs(c[i * ldc + j] - expected));
+		}
+	    }
+
+	    delete [] a;
+	    delete [] b;
+	    delete [] c;
+	    delete [] c_0;
+	    return err / (k + 1);
+	}
+
+/**
+ * @brief gemm_error() with each test case size as m of a rectangular
+ *        product, with both transposes, with and without accumulation
+ *        into C
+ * @return the largest of these errors
+ */
+    float gemm_sweep_error(gemm_fn gemm)
+	{
+	    float err = 0.0f;
+
+	    for (int i = 0; i < size; i++) {
+		unsigned int m = matrix_dim[i];
+		for (int t = 0; t < 4; t++) {
+		    err = std::max(err, gemm_error(gemm, t & 1, t & 2, m, m / 2 + 1, m + 3, 1.0f, 0.0f));
+		    err = std::max(err, gemm_error(gemm, t & 1, t & 2, m, m + 5, m / 3, -0.5f, 0.75f));
+		}
+	    }
+	    return err;
+	}
+
 /**
  * @brief Initializes all arrays based on the size of the testcase
  */